@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <unistd.h>
+#include <errno.h>
+
+#include "aio.h"
+#include "../cpp_util/lib/error.hpp"
+
+#ifdef SDB_IO_URING
+#include <liburing.h>
+#endif
+
+using namespace cpp_util;
+
+namespace sdb {
+
+// ========== AioBatch ==========
+void AioBatch::read(BlockNum block_num, Byte *data) {
+    AioRequest req{AioRequest::READ, block_num, data};
+    req_lst.push_back(req);
+}
+
+void AioBatch::write(BlockNum block_num, const Byte *data) {
+    // buffer only read by engine
+    AioRequest req{AioRequest::WRITE, block_num, const_cast<Byte*>(data)};
+    req_lst.push_back(req);
+}
+
+void AioBatch::wait() {
+    std::unique_lock<std::mutex> ul(mutex);
+    cv.wait(ul, [this]{return pending == 0;});
+    file_ptr = nullptr;
+}
+
+bool AioBatch::has_error()const {
+    auto f = [](const AioRequest &req){return req.result != BLOCK_SIZE;};
+    return std::any_of(req_lst.begin(), req_lst.end(), f);
+}
+
+void AioBatch::finish(AioRequest &req, ssize_t result) {
+    req.result = result;
+    // decrease under mutex, waiter may destroy batch once it sees 0
+    std::lock_guard<std::mutex> lg(mutex);
+    if (--pending == 0) {
+        cv.notify_all();
+    }
+}
+
+// ========== engine ==========
+void AsyncIO::Engine::complete(AioRequest *req, ssize_t result) {
+    AsyncIO::finish(req, result);
+}
+
+namespace {
+
+// fallback: workers run blocking pread/pwrite,
+// many workers => many requests in flight
+class ThreadPoolEngine : public AsyncIO::Engine {
+public:
+    explicit ThreadPoolEngine(size_t thread_count) {
+        for (size_t i = 0; i < thread_count; i++) {
+            worker_lst.emplace_back([this]{run();});
+        }
+    }
+
+    ~ThreadPoolEngine() {
+        {
+            std::lock_guard<std::mutex> lg(mutex);
+            is_stop = true;
+        }
+        cv.notify_all();
+        for (auto &&worker : worker_lst) {
+            worker.join();
+        }
+    }
+
+    void submit(int fd, const std::vector<AioRequest*> &req_lst) override {
+        {
+            std::lock_guard<std::mutex> lg(mutex);
+            for (AioRequest *req : req_lst) {
+                queue.push_back({fd, req});
+            }
+        }
+        cv.notify_all();
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::unique_lock<std::mutex> ul(mutex);
+            cv.wait(ul, [this]{return is_stop || !queue.empty();});
+            if (queue.empty()) return;
+            auto [fd, req] = queue.front();
+            queue.pop_front();
+            ul.unlock();
+
+            off_t offset = off_t(req->block_num) * BLOCK_SIZE;
+            ssize_t res = req->op == AioRequest::READ
+                        ? pread(fd, req->data, BLOCK_SIZE, offset)
+                        : pwrite(fd, req->data, BLOCK_SIZE, offset);
+            complete(req, res < 0 ? -errno : res);
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool is_stop = false;
+    std::deque<std::pair<int, AioRequest*>> queue;
+    std::vector<std::thread> worker_lst;
+};
+
+#ifdef SDB_IO_URING
+// io_uring: submitters fill sq under mutex,
+// one reaper thread drains cq
+class UringEngine : public AsyncIO::Engine {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 256;
+
+    UringEngine() {
+        is_ok = io_uring_queue_init(QUEUE_DEPTH, &ring, 0) == 0;
+        if (is_ok) {
+            reaper = std::thread([this]{reap();});
+        }
+    }
+
+    ~UringEngine() {
+        if (!is_ok) return;
+        {
+            // nop without user data stops reaper
+            std::unique_lock<std::mutex> ul(mutex);
+            cv.wait(ul, [this]{return ring_in_flight < QUEUE_DEPTH;});
+            io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            if (sqe == nullptr) {
+                io_uring_submit(&ring);
+                sqe = io_uring_get_sqe(&ring);
+            }
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data(sqe, nullptr);
+            io_uring_submit(&ring);
+        }
+        reaper.join();
+        io_uring_queue_exit(&ring);
+    }
+
+    bool ok()const {return is_ok;}
+
+    void submit(int fd, const std::vector<AioRequest*> &req_lst) override {
+        std::unique_lock<std::mutex> ul(mutex);
+        // sqes prepared, not yet submitted
+        unsigned prepared = 0;
+        auto has_room = [this, &prepared]{return ring_in_flight + prepared < QUEUE_DEPTH;};
+        for (AioRequest *req : req_lst) {
+            // never pass more than cq can hold,
+            // prepared sqes go first, else no completion comes to wake us
+            if (!has_room() && prepared > 0) {
+                flush(prepared);
+            }
+            cv.wait(ul, has_room);
+            io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            if (sqe == nullptr) {
+                flush(prepared);
+                sqe = io_uring_get_sqe(&ring);
+                assert(sqe != nullptr);
+            }
+            off_t offset = off_t(req->block_num) * BLOCK_SIZE;
+            if (req->op == AioRequest::READ) {
+                io_uring_prep_read(sqe, fd, req->data, BLOCK_SIZE, offset);
+            } else {
+                io_uring_prep_write(sqe, fd, req->data, BLOCK_SIZE, offset);
+            }
+            io_uring_sqe_set_data(sqe, req);
+            prepared++;
+        }
+        flush(prepared);
+    }
+
+private:
+    // submit prepared sqes under mutex, they are in flight once kernel took them
+    void flush(unsigned &prepared) {
+        int ret = io_uring_submit(&ring);
+        assert_msg(ret >= 0, format("io_uring_submit: %s", -ret));
+        ring_in_flight += unsigned(ret);
+        prepared -= std::min(prepared, unsigned(ret));
+    }
+
+    void reap() {
+        while (true) {
+            io_uring_cqe *cqe = nullptr;
+            int ret = io_uring_wait_cqe(&ring, &cqe);
+            if (ret == -EINTR) continue;
+            assert_msg(ret == 0, format("io_uring_wait_cqe: %s", -ret));
+            auto req = static_cast<AioRequest*>(io_uring_cqe_get_data(cqe));
+            ssize_t res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            if (req == nullptr) return;
+            complete(req, res);
+            {
+                std::lock_guard<std::mutex> lg(mutex);
+                ring_in_flight--;
+            }
+            cv.notify_all();
+        }
+    }
+
+private:
+    io_uring ring;
+    bool is_ok = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned ring_in_flight = 0;
+    std::thread reaper;
+};
+#endif
+
+} // namespace
+
+// ========== AsyncIO ==========
+AsyncIO::AsyncIO() {
+#ifdef SDB_IO_URING
+    auto uring_ptr = std::make_unique<UringEngine>();
+    if (uring_ptr->ok()) {
+        engine = std::move(uring_ptr);
+    }
+#endif
+    // io_uring not built or not permitted by kernel
+    if (engine == nullptr) {
+        size_t thread_count = std::max(4u, std::thread::hardware_concurrency());
+        engine = std::make_unique<ThreadPoolEngine>(thread_count);
+    }
+}
+
+AsyncIO::~AsyncIO() {}
+
+void AsyncIO::submit(std::shared_ptr<MmapFile> file_ptr, AioBatch &batch) {
+    assert(batch.pending == 0);
+    if (batch.req_lst.empty()) return;
+
+    // grow file first, pwrite beyond mapped file size
+    size_t file_end = 0;
+    std::vector<AioRequest*> req_ptr_lst;
+    for (auto &&req : batch.req_lst) {
+        req.batch = &batch;
+        req.result = 0;
+        if (req.op == AioRequest::WRITE) {
+            file_end = std::max(file_end, size_t(req.block_num + 1) * BLOCK_SIZE);
+        }
+        req_ptr_lst.push_back(&req);
+    }
+    if (file_end != 0) {
+        file_ptr->ensure_size(file_end);
+    }
+
+    batch.file_ptr = file_ptr;
+    batch.pending = batch.req_lst.size();
+    in_flight += batch.req_lst.size();
+    engine->submit(file_ptr->get_fd(), req_ptr_lst);
+}
+
+void AsyncIO::execute(std::shared_ptr<MmapFile> file_ptr, AioBatch &batch) {
+    submit(file_ptr, batch);
+    batch.wait();
+}
+
+void AsyncIO::finish(AioRequest *req, ssize_t result) {
+    AsyncIO::get().in_flight--;
+    req->batch->finish(*req, result);
+}
+
+} // namespace sdb
@@ -0,0 +1,105 @@
+#ifndef DB_AIO_H
+#define DB_AIO_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "util.h"
+#include "mmap_file.h"
+
+namespace sdb {
+
+// one block read or write
+struct AioRequest {
+    enum Op : char { READ, WRITE };
+    Op op;
+    BlockNum block_num;
+    // BLOCK_SIZE buffer, owned by caller until batch finished
+    Byte *data;
+    // bytes done, or -errno
+    ssize_t result = 0;
+    class AioBatch *batch = nullptr;
+};
+
+// requests submitted and waited together
+class AioBatch {
+public:
+    AioBatch()=default;
+    AioBatch(const AioBatch &)=delete;
+    AioBatch &operator=(const AioBatch &)=delete;
+
+    void read(BlockNum block_num, Byte *data);
+    void write(BlockNum block_num, const Byte *data);
+
+    // block until all requests finished
+    void wait();
+    bool is_done()const {return pending == 0;}
+    // true if any request failed or was short
+    bool has_error()const;
+
+    std::vector<AioRequest> req_lst;
+
+private:
+    friend class AsyncIO;
+    void finish(AioRequest &req, ssize_t result);
+
+    // keep file open until batch finished
+    std::shared_ptr<MmapFile> file_ptr;
+    std::atomic<size_t> pending{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+// async block io engine:
+//     io_uring when built with SDB_IO_URING,
+//     else a thread pool doing pread/pwrite
+class AsyncIO {
+public:
+    static AsyncIO &get() {
+        static AsyncIO aio;
+        return aio;
+    }
+
+    // submit all requests of batch, return without waiting
+    void submit(std::shared_ptr<MmapFile> file_ptr, AioBatch &batch);
+    // submit and wait
+    void execute(std::shared_ptr<MmapFile> file_ptr, AioBatch &batch);
+
+    size_t get_in_flight()const {return in_flight;}
+
+    class Engine;
+
+private:
+    AsyncIO();
+    ~AsyncIO();
+    AsyncIO(const AsyncIO &)=delete;
+    AsyncIO(AsyncIO &&)=delete;
+    AsyncIO &operator=(const AsyncIO &)=delete;
+    AsyncIO &operator=(AsyncIO &&)=delete;
+
+    static void finish(AioRequest *req, ssize_t result);
+
+private:
+    std::unique_ptr<Engine> engine;
+    std::atomic<size_t> in_flight{0};
+};
+
+// backend interface
+class AsyncIO::Engine {
+public:
+    virtual ~Engine(){}
+    virtual void submit(int fd, const std::vector<AioRequest*> &req_lst) =0;
+
+protected:
+    // called by backend when a request done
+    void complete(AioRequest *req, ssize_t result);
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_AIO_H */
@@ -1,104 +1,176 @@
+#include <algorithm>
+
 #include "block_alloc.h"
 #include "io.h"
-#include "tlog.h"
 #include "../cpp_util/lib/error.hpp"
 
 namespace sdb {
 
-enum BlockLogType : char { 
-    LAST_NUM_UPDATE, 
-    FREE_SET_INSERT, 
-    FREE_SET_REMOVE, 
-    TEMP_SET_INSERT, 
-    TEMP_SET_REMOVE, 
-};
-
 // ========== public ==========
-BlockNum BlockAlloc::new_block() {
-    // get num and log
+BlockNum BlockAlloc::new_block(const std::string &owner) {
+    ThreadCache &cache = get_thread_cache();
+    std::lock_guard<std::mutex> lg(cache.mutex);
     BlockNum num;
-    auto num_opt = free_set.pop_min();
-    if (num_opt.has_value()) {
-        num = num_opt.value();
-        log.log(sdb::en_bytes(FREE_SET_REMOVE, num));
+    if (owner.empty()) {
+        if (cache.block_lst.empty()) {
+            // lowest blocks last, popped first
+            cache.block_lst = fsm.alloc_batch(MAGAZINE_BLOCK_COUNT);
+            std::reverse(cache.block_lst.begin(), cache.block_lst.end());
+            BlockNum max_num = *std::max_element(cache.block_lst.begin(), cache.block_lst.end());
+            io.reserve_blocks(io.block_path(), max_num + 1);
+        }
+        num = cache.block_lst.back();
+        cache.block_lst.pop_back();
     } else {
-        num = atomic_increment_integer(last_num);
-        log.log(sdb::en_bytes(LAST_NUM_UPDATE, num));
+        auto &&[next, end] = cache.extent_map[owner];
+        if (next == end) {
+            next = fsm.alloc_run(EXTENT_BLOCK_COUNT);
+            end = next + EXTENT_BLOCK_COUNT;
+            // block.sdb grows by extent,
+            // so this only touches file metadata once per extent
+            io.reserve_blocks(io.block_path(), end);
+        }
+        num = next++;
     }
-    assert(temp_set.insert(num));
-    log.log(sdb::en_bytes(TEMP_SET_INSERT, num));
     return num;
 }
 
+void BlockAlloc::close_extent(const std::string &owner) {
+    std::lock_guard<std::mutex> lg(cache_mutex);
+    std::vector<BlockNum> free_lst;
+    for (auto &&cache_ptr : cache_lst) {
+        std::lock_guard<std::mutex> cache_lg(cache_ptr->mutex);
+        auto it = cache_ptr->extent_map.find(owner);
+        if (it == cache_ptr->extent_map.end()) continue;
+        for (BlockNum num = it->second.first; num < it->second.second; num++) {
+            free_lst.push_back(num);
+        }
+        cache_ptr->extent_map.erase(it);
+    }
+    fsm.free_batch(free_lst);
+}
+
 void BlockAlloc::free_block(BlockNum block_num) {
-    assert(free_set.insert(block_num));
-    log.log(sdb::en_bytes(FREE_SET_INSERT, block_num));
+    std::lock_guard<std::mutex> lg(pending_mutex);
+    pending_lst.push_back(block_num);
 }
 
 void BlockAlloc::free_temp_block(BlockNum block_num) {
-    assert(temp_set.remove(block_num));
-    log.log(sdb::en_bytes(TEMP_SET_REMOVE, block_num));
+    ThreadCache &cache = get_thread_cache();
+    std::lock_guard<std::mutex> lg(cache.mutex);
+    cache.block_lst.push_back(block_num);
+    if (cache.block_lst.size() >= 2 * MAGAZINE_BLOCK_COUNT) {
+        // keep half, return the oldest half
+        auto mid = cache.block_lst.begin() + MAGAZINE_BLOCK_COUNT;
+        fsm.free_batch(std::vector<BlockNum>(cache.block_lst.begin(), mid));
+        cache.block_lst.erase(cache.block_lst.begin(), mid);
+    }
+}
+
+BlockNum BlockAlloc::new_block_before(BlockNum limit) {
+    BlockNum num = fsm.alloc();
+    if (num < limit) return num;
+    fsm.free(num);
+    return -1;
+}
+
+void BlockAlloc::free_blocks(const std::vector<BlockNum> &block_lst) {
+    std::lock_guard<std::mutex> lg(pending_mutex);
+    pending_lst.insert(pending_lst.end(), block_lst.begin(), block_lst.end());
+}
+
+void BlockAlloc::sync(const std::function<void()> &flush) {
+    // blocks freed later may still be referred to by what flush writes
+    std::vector<BlockNum> free_lst;
+    {
+        std::lock_guard<std::mutex> lg(pending_mutex);
+        free_lst.swap(pending_lst);
+    }
+    flush();
+    fsm.free_batch(free_lst);
+    fsm.sync();
 }
 
-void BlockAlloc::sync_block(BlockNum block_num) {
-    assert(temp_set.remove(block_num));
-    log.log(sdb::en_bytes(FREE_SET_REMOVE, block_num));
+size_t BlockAlloc::truncate(const std::function<bool(BlockNum)> &discard) {
+    size_t block_count = io.get_mmap_file(io.block_path())->get_file_size() / BLOCK_SIZE;
+    fsm.with_end([&](BlockNum end) {
+        // free blocks may still be cached, dirty ones would grow file again
+        size_t new_count = size_t(end);
+        for (size_t num = new_count; num < block_count; num++) {
+            if (!discard(BlockNum(num))) {
+                new_count = num + 1;
+            }
+        }
+        if (new_count < block_count) {
+            io.truncate_blocks(io.block_path(), new_count);
+            block_count = new_count;
+        }
+    });
+    return block_count;
 }
 
 // ========== private ==========
-BlockAlloc::BlockAlloc():log(io.balloc_log_path()) {
+BlockAlloc::BlockAlloc():fsm(open_fsm_file()) {
+    // new fsm.sdb has no page yet, first fit gives out catalog blocks first
+    if (fsm.get_page_count() == 0) {
+        for (BlockNum num : fsm.alloc_batch(CATALOG_BLOCK_COUNT)) {
+            assert_msg(num < CATALOG_BLOCK_COUNT, "free space map: catalog block isn't free");
+        }
+        fsm.sync();
+    }
 }
 
-void BlockAlloc::load_backup() {
-    // bytes: |free_set, temp_set|
-    Bytes bytes = io.read_file(io.balloc_backup_path());
-    Size offset = 0;
-    Size len = 0;
-    // free set
-    sdb::de_bytes(len, bytes, offset);
-    for (int i = 0; i < len; ++i) {
-        BlockNum num;
-        sdb::de_bytes(num, bytes, offset);
-        free_set.insert(num);
+BlockAlloc::~BlockAlloc() {
+    std::lock_guard<std::mutex> lg(cache_mutex);
+    for (auto &&cache_ptr : cache_lst) {
+        std::lock_guard<std::mutex> cache_lg(cache_ptr->mutex);
+        release_cache(*cache_ptr);
     }
-    // temp set
-    sdb::de_bytes(len, bytes, offset);
-    for (int i = 0; i < len; ++i) {
-        BlockNum num;
-        sdb::de_bytes(num, bytes, offset);
-        temp_set.insert(num);
+    cache_lst.clear();
+}
+
+BlockAlloc::ThreadCacheHolder::ThreadCacheHolder():cache_ptr(std::make_shared<ThreadCache>()) {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    std::lock_guard<std::mutex> lg(block_alloc.cache_mutex);
+    block_alloc.cache_lst.push_back(cache_ptr);
+}
+
+BlockAlloc::ThreadCacheHolder::~ThreadCacheHolder() {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    std::lock_guard<std::mutex> lg(block_alloc.cache_mutex);
+    auto &&lst = block_alloc.cache_lst;
+    auto it = std::find(lst.begin(), lst.end(), cache_ptr);
+    if (it == lst.end()) return;
+    {
+        std::lock_guard<std::mutex> cache_lg(cache_ptr->mutex);
+        block_alloc.release_cache(*cache_ptr);
+    }
+    lst.erase(it);
+}
+
+std::shared_ptr<MmapFile> BlockAlloc::open_fsm_file() {
+    IO &io = IO::get();
+    if (!io.has_file(io.fsm_path())) {
+        io.create_file(io.fsm_path());
     }
+    return io.get_mmap_file(io.fsm_path());
 }
 
-void BlockAlloc::write_backup() {
-    auto f = [this](Bytes &&bytes){
-        Size offset = 0;
-        char type;
-        sdb::de_bytes(type, bytes, offset);
-        BlockNum num;
-        sdb::de_bytes(num, bytes, offset);
-        switch (type) {
-            case LAST_NUM_UPDATE:
-                atomic_increment_integer(last_num);
-                break;
-            case FREE_SET_INSERT:
-                free_set.insert(num);
-                break;
-            case FREE_SET_REMOVE:
-                free_set.remove(num);
-                break;
-            case TEMP_SET_INSERT:
-                temp_set.remove(num);
-                break;
-            case TEMP_SET_REMOVE:
-                temp_set.remove(num);
-                break;
-            default:
-                assert(false);
+BlockAlloc::ThreadCache &BlockAlloc::get_thread_cache() {
+    static thread_local ThreadCacheHolder holder;
+    return *holder.cache_ptr;
+}
+
+void BlockAlloc::release_cache(ThreadCache &cache) {
+    std::vector<BlockNum> free_lst = std::move(cache.block_lst);
+    for (auto &&[owner, extent] : cache.extent_map) {
+        for (BlockNum num = extent.first; num < extent.second; num++) {
+            free_lst.push_back(num);
         }
-    };
-    // range op
-    log.range(f);
+    }
+    cache.block_lst.clear();
+    cache.extent_map.clear();
+    fsm.free_batch(free_lst);
 }
 
 } // namespace sdb
@@ -1,43 +1,118 @@
 #ifndef DB_BLOCK_ALLOC_H
 #define DB_BLOCK_ALLOC_H
 
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <unordered_map>
+
 #include "util.h"
 #include "io.h"
-#include "tlog.h"
-#include "../cpp_util/lib/skip_list_set.hpp"
+#include "free_space_map.h"
 
 namespace sdb {
 
+// used blocks of block.sdb are kept by a bitmap free space map in fsm.sdb.
+// blocks of one owner, e.g. record chain of a table, are taken from its own extent:
+// EXTENT_BLOCK_COUNT adjacent free blocks aligned to a run of BlockCache,
+// so scans of an owner read whole runs by one preadv and read ahead.
+// unused blocks of open extents are freed at exit,
+// a crash leaks them and blocks of uncommitted transactions.
+//
+// a freed block may still be referred to by blocks on disk until the cache is written,
+// so frees wait in a pending list and reach free space map only at checkpoint (sync),
+// frees after last checkpoint are leaked by exit or crash.
+// free space map is mapped shared, so a free applied earlier could be on disk
+// before the blocks that stop using it, and a crash would hand out a used block.
+//
+// every thread keeps its own extents and a magazine of single blocks,
+// both taken from free space map in batches and freed back in batches,
+// so threads splitting nodes at the same time rarely share a lock.
+// threads using BlockAlloc must end before exit.
 class BlockAlloc {
 public:
+    static constexpr BlockNum EXTENT_BLOCK_COUNT = 16;
+    // blocks [0, CATALOG_BLOCK_COUNT) are roots of catalog tables at fixed places,
+    // <record root, keys index root> of .table_list, .col_list and .index.
+    // they are marked used when fsm.sdb is created, never handed out
+    static constexpr BlockNum CATALOG_BLOCK_COUNT = 6;
+    // blocks moved between magazine and free space map at once
+    static constexpr size_t MAGAZINE_BLOCK_COUNT = 32;
+
     static BlockAlloc &get() {
         static BlockAlloc block_alloc;
         return block_alloc;
     }
 
-    BlockNum new_block();
-    void sync_block(BlockNum block_num);
+    // owner: "" => block of thread's magazine, else next block of owner's extent
+    BlockNum new_block(const std::string &owner = "");
+    // unused blocks of owner's extents in all threads are freed, e.g. table dropped
+    void close_extent(const std::string &owner);
+    // block is reused after next checkpoint
     void free_block(BlockNum block_num);
+    // temp block: never referred to by other blocks on disk,
+    // e.g. private copy of a snapshot or new node given up before it is linked.
+    // freed temp block goes to thread's magazine and is reused at once
+    BlockNum new_temp_block() {
+        return new_block();
+    }
     void free_temp_block(BlockNum block_num);
 
+    // === shrink block.sdb ===
+    // lowest free block if it is before limit, else -1
+    BlockNum new_block_before(BlockNum limit);
+    // blocks go to free space map at next checkpoint, not to magazine
+    void free_blocks(const std::vector<BlockNum> &block_lst);
+    // cut block.sdb after last used block,
+    // discard(num) drops free block num from cache, false if it can't.
+    // return block count of file
+    size_t truncate(const std::function<bool(BlockNum)> &discard);
+    size_t get_used_count() {
+        return fsm.get_used_count();
+    }
+    // checkpoint: flush() writes all cached blocks,
+    // then blocks freed before it are freed in free space map and map is written.
+    // blocks cached by threads stay used in it
+    void sync(const std::function<void()> &flush);
+
 private:
     BlockAlloc();
+    ~BlockAlloc();
     BlockAlloc(const BlockAlloc &)=delete;
     BlockAlloc(BlockAlloc &&)=delete;
     BlockAlloc &operator=(const BlockAlloc &)=delete;
     BlockAlloc &operator=(BlockAlloc &&)=delete;
 
-    void load_backup();
-    void write_backup();
-    void load_log();
-    
-private:
-    std::atomic_int64_t last_num;
-    cpp_util::SkipListSet<BlockNum, 12> free_set;
-    cpp_util::SkipListSet<BlockNum, 12> temp_set;
+    // blocks owned by one thread, mutex only taken by other threads
+    // in close_extent or at exit
+    struct ThreadCache {
+        std::mutex mutex;
+        // <owner, [next block, end of extent)>
+        std::unordered_map<std::string, std::pair<BlockNum, BlockNum>> extent_map;
+        std::vector<BlockNum> block_lst;
+    };
+    // registers cache of thread, returns it to free space map when thread ends
+    struct ThreadCacheHolder {
+        std::shared_ptr<ThreadCache> cache_ptr;
+        ThreadCacheHolder();
+        ~ThreadCacheHolder();
+    };
 
+    // open file of free space map, create it if first use
+    static std::shared_ptr<MmapFile> open_fsm_file();
+    static ThreadCache &get_thread_cache();
+    // free all blocks of cache, caller holds mutex of cache
+    void release_cache(ThreadCache &cache);
+
+private:
     IO &io = IO::get();
-    BaseLog log;
+    FreeSpaceMap fsm;
+    std::mutex cache_mutex;
+    std::vector<std::shared_ptr<ThreadCache>> cache_lst;
+    // blocks freed since last checkpoint
+    std::mutex pending_mutex;
+    std::vector<BlockNum> pending_lst;
 };
 
 } // namespace sdb
@@ -3,6 +3,8 @@
 #include <stdexcept>
 #include <iostream>
 #include <string>
+#include <tuple>
+#include <algorithm>
 
 #include "util.h"
 #include "record.h"
@@ -10,6 +12,10 @@
 #include "cache.h"
 #include "io.h"
 #include "block_alloc.h"
+#include "snapshot.h"
+#include "../cpp_util/lib/error.hpp"
+
+using namespace cpp_util;
 
 namespace sdb {
 
@@ -19,282 +25,766 @@ using db_type::ObjCntPtr;
 // --------------- Function ---------------
 // ========== BpTree Function =========
 void BpTree::insert(TransInfo t_info, const Tuple &key, const Tuple &data) {
-    auto lst = search_path(key);
+    auto lst = lock_path(t_info, en_key(key));
     BlockNum record_pos = lst.back();
+    lst.pop_back();
     Record record(t_info, tp, record_pos);
-    auto res = record.insert(key, data);
-    if (!res.has_value()) return;
-
-    bubble_split(std::move(lst), key, res.value());
+    for (BlockNum right_pos : record.insert(key, data)) {
+        split_record(t_info, std::vector<BlockNum>(lst), right_pos);
+    }
 }
 
-// remove record only, 
-// we don't delete record block though block is empty,
-// so B+Tree node don't need merge
-void BpTree::remove(TransInfo t_info, const Tuple &key) {
-    auto lst = search_path(key);
+// remove record only, the tuple is gone once transaction commits.
+// record block is kept though it becomes empty,
+// under-full records and nodes are merged or refilled by vacuum later,
+// on committed records
+Tuples BpTree::remove(TransInfo t_info, const Tuple &key) {
+    auto lst = lock_path(t_info, en_key(key));
     auto record_pos = lst.back();
     Record record(t_info, tp, record_pos);
+    Tuples old_ts = record.find_key(key);
     record.remove(key);
+    return old_ts;
 }
 
-void BpTree::update(TransInfo t_info, const Tuple &key, const Tuple &data) {
-    auto lst = search_path(key);
+Tuples BpTree::update(TransInfo t_info, const Tuple &key, const Tuple &data) {
+    auto lst = lock_path(t_info, en_key(key));
     auto record_pos = lst.back();
     lst.pop_back();
     Record record(t_info, tp, record_pos);
-    std::optional<BlockNum> res = record.update(key, data);
-    if (!res.has_value()) return;
-
-    bubble_split(std::move(lst), key, res.value());
+    Tuples old_ts = record.find_key(key);
+    for (BlockNum right_pos : record.update(key, data)) {
+        split_record(t_info, std::vector<BlockNum>(lst), right_pos);
+    }
+    return old_ts;
 }
 
 Tuples BpTree::find_key(TransInfo t_info, const Tuple &key)const {
-    auto lst = search_path(key);
+    auto lst = search_path(en_key(key));
     Record record(t_info, tp, lst.back());
     return record.find_key(key);
 }
 
-// Tuples BpTree::find_pre_key(const Tuple &key)const {
-// }
+// encoded columns are prefix free,
+// so tuples with leading key columns equal to key have en_key(key) as byte prefix
+Tuples BpTree::find_pre_key(TransInfo t_info, const Tuple &key)const {
+    Tuples ts(tp.col_property_lst.size());
+    Bytes prefix = en_key(key);
+    auto keys_pos = tp.get_keys_pos();
+    BlockNum pos = search_path(prefix).back();
+    while (pos != -1) {
+        Record record(t_info, tp, pos);
+        for (auto &&tuple : record.get_all_tuple().data) {
+            Bytes bytes = en_key(tuple.select(keys_pos));
+            if (bytes.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), bytes.begin())) {
+                ts.push_back(tuple);
+            } else if (NodeView::compare(bytes, prefix) > 0) {
+                return ts;
+            }
+        }
+        pos = record.get_next_record_num();
+    }
+    return ts;
+}
 
+// chain is walked from record root and stopped by key, not by the record search_path gives:
+// vacuum relinks the chain before the leaf routing to an unlinked record is synced
 Tuples BpTree::find_less(TransInfo t_info, const Tuple &key, bool is_close)const {
     Tuples ts(tp.col_property_lst.size());
-    auto mid_pos = search_path(key).back();
-    Record record(t_info, tp, tp.record_root);
-    while (record.get_block_num() != mid_pos) {
-        ts.append(record.get_all_tuple());
-        record = Record(t_info, tp, record.get_block_num());
+    BlockNum pos = tp.record_root;
+    while (pos != -1) {
+        Record record(t_info, tp, pos);
+        Tuples less_ts = record.find_less(key, is_close);
+        bool is_past = less_ts.data.size() < record.record_lst.size();
+        ts.append(less_ts);
+        // keys of later records are past key too
+        if (is_past) break;
+        pos = record.get_next_record_num();
     }
-    ts.append(record.find_less(key, is_close));
     return ts;
 }
 
 Tuples BpTree::find_greater(TransInfo t_info, const Tuple &key, bool is_close)const {
     Tuples ts(tp.col_property_lst.size());
-    auto pos = search_path(key).back();
+    auto pos = search_path(en_key(key)).back();
     Record record(t_info, tp, pos);
     ts.append(record.find_greater(key, is_close));
     while (record.get_next_record_num() != -1) {
-        assert(record.get_next_record_num() != -1);
-        record = Record(t_info, tp, record.get_block_num());
+        record = Record(t_info, tp, record.get_next_record_num());
         ts.append(record.get_all_tuple());
     }
     return ts;
 }
 
+// record of beg may be unlinked by vacuum meanwhile, it and its next record are still whole,
+// so chain is followed from it till a key past end, see find_less
 Tuples BpTree::find_range(TransInfo t_info, const Tuple &beg, const Tuple &end, bool is_beg_close, bool is_end_close)const {
-    assert(beg <= end);
+    assert(!end.less(beg));
 
     Tuples ts(tp.col_property_lst.size());
-    auto beg_pos = search_path(beg).back();
-    auto end_pos = search_path(end).back();
-    Record record(t_info, tp, beg_pos);
-    if (beg_pos == end_pos) {
-        return record.find_range(beg, end, is_beg_close, is_end_close);
+    BlockNum pos = search_path(en_key(beg)).back();
+    while (pos != -1) {
+        Record record(t_info, tp, pos);
+        ts.append(record.find_range(beg, end, is_beg_close, is_end_close));
+        if (record.find_less(end, is_end_close).data.size() < record.record_lst.size()) break;
+        pos = record.get_next_record_num();
     }
+    return ts;
+}
 
-    // being block
-    ts.append(record.find_greater(beg, is_beg_close));
-    record = Record(t_info, tp, record.get_block_num());
-    // inter block
-    while (record.get_block_num() != end_pos) {
-        assert(record.get_next_record_num() != -1);
-        ts.append(record.get_all_tuple());
-        record = Record(t_info, tp, record.get_block_num());
+std::vector<BlockNum> BpTree::record_pos_lst()const {
+    std::vector<BlockNum> lst;
+    for (BlockNum pos = first_leaf_pos(); pos != -1; ) {
+        pos = leaf_record_pos(pos, lst);
+    }
+    return lst;
+}
+
+BlockNum BpTree::leaf_record_pos(BlockNum pos, std::vector<BlockNum> &lst)const {
+    // separator goes up on split, neighbour leaves share no pos
+    auto [pos_lst, right_pos] = read_node(pos, [](NodeView node) {
+        std::vector<BlockNum> pos_lst;
+        for (Size i = 0; i <= node.get_key_count(); i++) {
+            pos_lst.push_back(node.get_pos(i));
+        }
+        return std::make_pair(pos_lst, node.get_right_pos());
+    });
+    lst.insert(lst.end(), pos_lst.begin(), pos_lst.end());
+    return right_pos;
+}
+
+std::vector<BlockNum> BpTree::vacuum(size_t max_merge_count) {
+    std::vector<BlockNum> free_lst;
+    // records are only merged inside a leaf
+    // writers are excluded by caller, no latch
+    for (BlockNum pos = first_leaf_pos(); pos != -1 && free_lst.size() < max_merge_count; ) {
+        BptNode node = BptNode::get(tp, pos);
+        bool is_changed = false;
+        Size i = 0;
+        while (i < node.page.view().get_key_count() && free_lst.size() < max_merge_count) {
+            BlockNum left_pos = node.page.view().get_pos(i);
+            BlockNum right_pos = node.page.view().get_pos(i + 1);
+            if (right_pos != left_pos && !merge_record(left_pos, right_pos)) {
+                BlockNum old_pos = borrow_record(node.page, i);
+                if (old_pos != -1) {
+                    free_lst.push_back(old_pos);
+                    is_changed = true;
+                }
+                i++;
+                continue;
+            }
+            // keys of right record route to left one,
+            // try to merge next record into left one too
+            if (right_pos != left_pos) {
+                free_lst.push_back(right_pos);
+            }
+            node.page.erase(i);
+            is_changed = true;
+        }
+        if (is_changed) {
+            node.sync();
+        }
+        pos = node.page.view().get_right_pos();
+    }
+
+    // first node of every level, root first
+    std::vector<BlockNum> level_lst{root_pos.load()};
+    while (true) {
+        auto [is_leaf, first_pos] = read_node(level_lst.back(), [](NodeView node) {
+            return std::make_pair(node.is_leaf(), node.get_pos(0));
+        });
+        if (is_leaf) break;
+        level_lst.push_back(first_pos);
+    }
+    // children are merged before their parents, from lowest inner level up
+    for (size_t i = level_lst.size() - 1; i > 0 && free_lst.size() < max_merge_count; i--) {
+        rebalance_level(level_lst[i - 1], max_merge_count, free_lst);
     }
-    // end block
-    ts.append(record.find_less(end, is_end_close));
+    collapse_root(free_lst);
+    return free_lst;
+}
+
+std::vector<BlockNum> BpTree::relocate(BlockNum limit) {
+    // every block is copied before anything points to the copy,
+    // readers following an old pointer still find the old block
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    std::vector<BlockNum> old_lst;
+    std::unordered_map<BlockNum, BlockNum> move_map;
+    auto get_pos = [&move_map](BlockNum pos) {
+        auto it = move_map.find(pos);
+        return it == move_map.end() ? pos : it->second;
+    };
+    // roots given to catalog stay, as in collapse_root:
+    // after a root split one is a child, but catalog may still point to it
+    auto move_pos = [&](BlockNum pos) {
+        if (pos < limit || is_catalog_root(pos) || move_map.count(pos) != 0) return BlockNum(-1);
+        BlockNum new_pos = block_alloc.new_block_before(limit);
+        if (new_pos != -1) {
+            move_map[pos] = new_pos;
+            old_lst.push_back(pos);
+        }
+        return new_pos;
+    };
+    // point node to moved blocks, sync if changed
+    auto fix_node = [&get_pos](BptNode &node) {
+        NodeView view = node.page.view();
+        bool is_changed = false;
+        for (Size i = 0; i <= view.get_key_count(); i++) {
+            BlockNum pos = view.get_pos(i);
+            if (get_pos(pos) != pos) {
+                node.page.set_pos(i, get_pos(pos));
+                is_changed = true;
+            }
+        }
+        if (get_pos(view.get_right_pos()) != view.get_right_pos()) {
+            node.page.set_right_pos(get_pos(view.get_right_pos()));
+            is_changed = true;
+        }
+        if (is_changed) {
+            node.sync();
+        }
+    };
+
+    // index, level by level from root:
+    // copy children of level, then fix parents, then fix right links of children
+    BlockNum level_pos = root_pos.load();
+    while (true) {
+        BptNode first = BptNode::get(tp, level_pos);
+        if (first.page.view().is_leaf()) break;
+        for (BlockNum pos = level_pos; pos != -1; ) {
+            BptNode node = BptNode::get(tp, pos);
+            NodeView view = node.page.view();
+            for (Size i = 0; i <= view.get_key_count(); i++) {
+                BlockNum child_pos = view.get_pos(i);
+                BlockNum new_pos = move_pos(child_pos);
+                if (new_pos == -1) continue;
+                BptNode child = BptNode::get(tp, child_pos);
+                child.file_pos = new_pos;
+                child.sync();
+            }
+            pos = view.get_right_pos();
+        }
+        for (BlockNum pos = level_pos; pos != -1; ) {
+            BptNode node = BptNode::get(tp, pos);
+            fix_node(node);
+            pos = node.page.view().get_right_pos();
+        }
+        level_pos = get_pos(first.page.view().get_pos(0));
+        for (BlockNum pos = level_pos; pos != -1; ) {
+            BptNode node = BptNode::get(tp, pos);
+            fix_node(node);
+            pos = node.page.view().get_right_pos();
+        }
+    }
+
+    // record chain: copy record, then point previous record to it
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    BlockNum prev_pos = tp.record_root;
+    while (true) {
+        TransInfo t_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+        Record prev(t_info, tp, prev_pos);
+        BlockNum pos = prev.get_next_record_num();
+        if (pos == -1) break;
+        BlockNum new_pos = move_pos(pos);
+        if (new_pos != -1) {
+            cache.put(new_pos, cache.get(pos));
+            prev.set_next_record_num(new_pos);
+            prev.sync();
+            t_info.s_ptr->commit();
+        }
+        prev_pos = get_pos(pos);
+    }
+
+    // leaves point to moved records
+    for (BlockNum pos = level_pos; pos != -1; ) {
+        BptNode node = BptNode::get(tp, pos);
+        fix_node(node);
+        pos = node.page.view().get_right_pos();
+    }
+    return old_lst;
+}
+
+std::shared_ptr<BpTree> BpTree::build(const TableProperty &property) {
+    // empty record, then a leaf pointing to it, to cache directly as bulk_load
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    TransInfo t_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    Record record = Record::new_record(t_info, property, property.record_root);
+    cache.put(property.record_root, record.en_bytes());
+    NodePage leaf(true);
+    leaf.set_pos(0, property.record_root);
+    cache.put(property.keys_idx_root, leaf.bytes(), INDEX_LEAF_PAGE);
+    return std::make_shared<BpTree>(property);
+}
+
+TableProperty BpTree::bulk_load(TransInfo t_info, TableProperty tp, TupleSource next, Size fill_percent) {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    // blocks of a partial tree are freed if input is bad, nothing reaches them
+    std::vector<BlockNum> alloc_lst;
+    try {
+        return bulk_build(t_info, std::move(tp), std::move(next), fill_percent, alloc_lst);
+    } catch (...) {
+        block_alloc.free_blocks(alloc_lst);
+        throw;
+    }
+}
+
+TableProperty BpTree::bulk_build(TransInfo t_info, TableProperty tp, TupleSource next, Size fill_percent,
+                                 std::vector<BlockNum> &alloc_lst) {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    Size fill_size = BLOCK_SIZE * std::clamp(fill_percent, Size(50), Size(100)) / 100;
+
+    // records go to cache directly, not through snapshot,
+    // they are only reachable once roots are published
+    alloc_lst.push_back(block_alloc.new_block(tp.record_owner()));
+    Record record = Record::new_record(t_info, tp, alloc_lst.back());
+    Size record_size = Record::HEADER_SIZE;
+    tp.record_root = record.get_block_num();
+    // open node of every level, leaf => 0
+    std::vector<BptNode> level_lst;
+    level_lst.push_back(BptNode::new_node(tp, true));
+    alloc_lst.push_back(level_lst[0].file_pos);
+    level_lst[0].page.set_pos(0, tp.record_root);
+
+    std::optional<Bytes> last_key;
+    while (std::optional<Tuple> tuple = next()) {
+        Bytes key = en_key(tuple->select(tp.get_keys_pos()));
+        if (last_key && NodeView::compare(*last_key, key) >= 0) {
+            throw std::runtime_error("bulk load keys aren't strictly increasing");
+        }
+        Size size = Record::tuple_bytes_size(*tuple);
+        if (Record::HEADER_SIZE + size > BLOCK_SIZE) {
+            throw std::runtime_error(format("tuple of %s bytes doesn't fit in a block", size));
+        }
+        if (!record.record_lst.empty() && record_size + size > fill_size) {
+            alloc_lst.push_back(block_alloc.new_block(tp.record_owner()));
+            Record right = Record::new_record(t_info, tp, alloc_lst.back());
+            record.set_next_record_num(right.get_block_num());
+            cache.put(record.get_block_num(), record.en_bytes());
+            record = std::move(right);
+            record_size = Record::HEADER_SIZE;
+            bulk_push(tp, level_lst, 0, key, record.get_block_num(), fill_size, alloc_lst);
+        }
+        record.record_lst.push_back({t_info.id, std::move(*tuple)});
+        record_size += size;
+        last_key = std::move(key);
+    }
+    cache.put(record.get_block_num(), record.en_bytes());
+    // rightmost node of every level
+    for (auto &&node : level_lst) {
+        node.sync();
+    }
+    tp.keys_idx_root = level_lst.back().file_pos;
+    return tp;
+}
+
+void BpTree::drop() {
+    if (root_pos.load() == -1) return;
+    std::vector<BlockNum> free_lst = record_pos_lst();
+    // records merged by vacuum may be routed by neighbour keys
+    std::sort(free_lst.begin(), free_lst.end());
+    free_lst.erase(std::unique(free_lst.begin(), free_lst.end()), free_lst.end());
+    // index, level by level from root
+    for (BlockNum level_pos = root_pos.load(); level_pos != -1; ) {
+        auto [is_leaf, first_pos] = read_node(level_pos, [](NodeView node) {
+            return std::make_pair(node.is_leaf(), node.get_pos(0));
+        });
+        for (BlockNum pos = level_pos; pos != -1; ) {
+            free_lst.push_back(pos);
+            pos = read_node(pos, [](NodeView node) {return node.get_right_pos();});
+        }
+        level_pos = is_leaf ? -1 : first_pos;
+    }
+    BlockAlloc::get().free_blocks(free_lst);
+    root_pos.store(-1);
 }
 
 //  === BpTree private function ===
-std::string BpTree::index_path()const {
-    return tp.db_name + "/block.sdb";
+// memcmp order of bytes is key order:
+//     int/bigint => big endian with sign bit flipped, uint => big endian,
+//     char => sign bit flipped,
+//     varchar => chars with sign bit flipped, 0x00 escaped as 0x00 0x01, end with 0x00 0x00
+Bytes BpTree::en_key(const Tuple &key) {
+    Bytes bytes;
+    auto append_int = [&bytes](uint64_t v, size_t size) {
+        for (size_t i = size; i > 0; i--) {
+            bytes.push_back(Byte((v >> ((i - 1) * 8)) & 0xff));
+        }
+    };
+    auto append_char = [&bytes](char ch) {
+        Byte b = Byte(uint8_t(ch) ^ 0x80);
+        bytes.push_back(b);
+        if (b == 0) {
+            bytes.push_back(1);
+        }
+    };
+    key.range([&](ObjCntPtr ptr){
+        switch (ptr->get_type_tag()) {
+        case db_type::INT:
+            append_int(uint32_t(db_type::dfc<const db_type::Int>(ptr)->data) ^ 0x80000000u, 4);
+            break;
+        case db_type::UINT:
+            append_int(db_type::dfc<const db_type::UInt>(ptr)->data, 4);
+            break;
+        case db_type::BIGINT:
+            append_int(uint64_t(db_type::dfc<const db_type::BigInt>(ptr)->data) ^ (uint64_t(1) << 63), 8);
+            break;
+        case db_type::CHAR:
+            bytes.push_back(Byte(uint8_t(ptr->to_string()[0]) ^ 0x80));
+            break;
+        case db_type::VARCHAR:
+            for (char ch : ptr->to_string()) {
+                append_char(ch);
+            }
+            bytes.push_back(0);
+            bytes.push_back(0);
+            break;
+        default:
+            throw std::runtime_error(format("index key of type %s isn't supported", ptr->get_type_name()));
+        }
+    });
+    if (Size(bytes.size()) > NodeView::MAX_KEY_SIZE) {
+        throw std::runtime_error(format("index key of %s bytes is too long", bytes.size()));
+    }
+    return bytes;
+}
+
+// node level is only known after reading, so inner nodes are upgraded then
+PageRef BpTree::pin_node(BlockNum pos) {
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    PageRef page = cache.pin(pos, false, INDEX_LEAF_PAGE);
+    if (!NodeView(page.view()).is_leaf()) {
+        cache.upgrade(pos, INDEX_INNER_PAGE);
+    }
+    return page;
 }
 
-std::vector<BlockNum> BpTree::search_path(const Tuple &key)const {
+BlockNum BpTree::first_leaf_pos()const {
+    BlockNum pos = root_pos.load();
+    while (true) {
+        auto [is_leaf, first_pos] = read_node(pos, [](NodeView node) {
+            return std::make_pair(node.is_leaf(), node.get_pos(0));
+        });
+        if (is_leaf) return pos;
+        pos = first_pos;
+    }
+}
+
+std::vector<BlockNum> BpTree::search_path(BytesView key)const {
     std::vector<BlockNum> lst;
-    BptNode node = BptNode::get(tp, tp.keys_idx_root);
+    BlockNum pos = root_pos.load();
     while (true) {
-        lst.push_back(node.file_pos);
-        auto [key_it, pos_it] = node.search_less_or_eq_key(key);
-        if (pos_it == std::prev(node.pos_lst.end()) || node.right_node_pos != -1) {
-            node = BptNode::get(tp, node.right_node_pos);
+        // next => right node if key went right, else child covering key
+        auto [next, is_right, is_leaf] = read_node(pos, [&key](NodeView node) {
+            bool is_right = node.is_beyond(key);
+            BlockNum next = is_right ? node.get_right_pos() : node.get_pos(node.search(key));
+            return std::make_tuple(next, is_right, node.is_leaf());
+        });
+        if (is_right) {
+            pos = next;
             continue;
-        } else if (node.is_leaf) {
-            lst.push_back(*pos_it);
+        }
+        lst.push_back(pos);
+        if (is_leaf) {
+            lst.push_back(next);
             return lst;
         }
-        node = BptNode::get(tp, *pos_it);
+        pos = next;
+    }
+}
+
+std::vector<BlockNum> BpTree::lock_path(TransInfo t_info, BytesView key)const {
+    auto lst = search_path(key);
+    while (true) {
+        t_info.s_ptr->lock_block(lst.back());
+        // record may be split before lock was taken, key moved right
+        auto new_lst = search_path(key);
+        if (new_lst.back() == lst.back()) return new_lst;
+        lst = std::move(new_lst);
     }
 }
 
-void BpTree::bubble_split(std::vector<BlockNum> &&lst, const Tuple &key, BlockNum record_pos) {
+void BpTree::split_record(TransInfo t_info, std::vector<BlockNum> &&lst, BlockNum right_pos) {
+    Record right(t_info, tp, right_pos);
+    assert(!right.record_lst.empty());
+    Bytes sep = en_key(right.record_lst.front().second.select(tp.get_keys_pos()));
+    bubble_split(t_info, std::move(lst), sep, right_pos);
+}
+
+void BpTree::bubble_split(TransInfo t_info, std::vector<BlockNum> &&lst, BytesView key, BlockNum record_pos) {
+    Bytes key_bytes(key.begin(), key.end());
     BlockNum insert_pos = record_pos;
-    mutex_map[insert_pos].lock();
-    BptNode node = BptNode::get(tp, lst.back());
+    // level of node to insert into, leaf => 0
+    size_t level = 0;
     while (true) {
-        auto &&[key_it, pos_it] = node.search_less_or_eq_key(key);
-        node.key_lst.insert(std::next(key_it), key);
-        node.pos_lst.insert(std::next(pos_it), insert_pos);
-        if (node.is_full()) {
-            // split and sync 
-            auto [right_node_pos, min_key] = node.split();
-            if (node.file_pos == tp.keys_idx_root) {
-                BptNode root_node = BptNode::new_node(tp);
-                root_node.is_leaf = false;
-                root_node.key_lst.push_back(min_key);
-                root_node.pos_lst.push_back(node.file_pos);
-                root_node.pos_lst.push_back(right_node_pos);
-                root_node.sync();
-                tp.keys_idx_root = root_node.file_pos;
-                mutex_map[node.file_pos].unlock();
-                return;
-            }
-            lst.pop_back();
-            mutex_map[insert_pos].unlock();
-            insert_pos = right_node_pos;
-            mutex_map[lst.back()].lock();
-            node = BptNode::get(tp, lst.back());
-        } else {
+        BlockNum node_pos = lst.back();
+        lst.pop_back();
+        std::unique_lock<std::mutex> ul(get_latch(node_pos));
+        BptNode node = BptNode::get(tp, node_pos);
+        // node was split since path was read
+        while (node.page.view().is_beyond(key_bytes)) {
+            node_pos = node.page.view().get_right_pos();
+            ul.unlock();
+            ul = std::unique_lock<std::mutex>(get_latch(node_pos));
+            node = BptNode::get(tp, node_pos);
+        }
+        if (node.page.insert(node.page.view().search(key_bytes), key_bytes, insert_pos)) {
             node.sync();
-            mutex_map[insert_pos].unlock();
             return;
         }
-    }
-}
 
-// ========== BptNode Function =========
-// node block bytes:
-//     |is_leaf right_node_pos key_lst pos_lst|
-BpTree::BptNode BpTree::BptNode::get(const TableProperty &tp, BlockNum pos) {
-    std::string path = IO::get_block_path(tp.db_name);
-    Bytes bytes = CacheMaster::get_block_cache().get(path, pos);
-
-    BptNode node(tp);
-    Size offset = 0;
-    sdb::de_bytes(node.is_leaf, bytes, offset);
-    sdb::de_bytes(node.right_node_pos, bytes, offset);
-    node.file_pos = pos;
-    Size size = 0;
-    sdb::de_bytes(size, bytes, offset);
-    assert(size >= 0 && size <= BLOCK_SIZE);
-    auto cps = tp.get_keys_property();
-    for (int i = 0; i < size; i++) {
-        Tuple keys;
-        for (auto &&cp : cps) {
-            ObjPtr key = db_type::get_default(cp.type_info);
-            key->de_bytes(bytes, offset);
-            keys.push_back(key);
+        // full: split, then insert into the half covering key.
+        // right node is synced first, left node links to it after
+        auto [sep, right] = node.split();
+        BptNode &half = NodeView::compare(key_bytes, sep) < 0 ? node : right;
+        bool is_inserted = half.page.insert(half.page.view().search(key_bytes), key_bytes, insert_pos);
+        assert(is_inserted);
+        right.sync();
+        node.sync();
+        ul.unlock();
+        key_bytes = std::move(sep);
+        insert_pos = right.file_pos;
+        level++;
+        if (!lst.empty()) continue;
+
+        std::unique_lock<std::mutex> root_ul(root_mutex);
+        if (root_pos.load() == node.file_pos) {
+            BptNode root = BptNode::new_node(tp, false);
+            root.page.set_pos(0, node.file_pos);
+            root.page.insert(0, key_bytes, insert_pos);
+            root.sync();
+            root_pos.store(root.file_pos);
+            if (root_hook) {
+                // a later root may reach catalog first,
+                // an old root still finds every key by going right
+                catalog_root_lst.push_back(root.file_pos);
+                root_ul.unlock();
+                root_hook(t_info, root.file_pos);
+            }
+            return;
         }
-        node.key_lst.push_back(keys);
+        root_ul.unlock();
+        // root was split by others since path was read,
+        // parent is found from new root
+        lst = search_path(key_bytes);
+        assert(lst.size() > level + 1);
+        lst.resize(lst.size() - 1 - level);
     }
-    sdb::de_bytes(node.pos_lst, bytes, offset);
-    return node;
 }
 
-BpTree::BptNode BpTree::BptNode::new_node(const TableProperty &tp) {
-    BptNode node(tp);
-    node.file_pos = BlockAlloc::get().new_block(tp.db_name);
-    return node;
+// left record is committed before index moves,
+// so readers following old index or chain find tuples in either record
+bool BpTree::merge_record(BlockNum left_pos, BlockNum right_pos) {
+    TransInfo t_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    Record left(t_info, tp, left_pos);
+    if (left.get_next_record_num() != right_pos) return false;
+    Record right(t_info, tp, right_pos);
+    // one of them under half full, both fit in one block
+    if (!left.is_less() && !right.is_less()) return false;
+    if (left.get_bytes_size() + right.get_bytes_size() - Record::HEADER_SIZE > BLOCK_SIZE) return false;
+    left.merge(std::move(right));
+    left.sync();
+    t_info.s_ptr->commit();
+    return true;
+}
+
+void BpTree::bulk_push(const TableProperty &tp, std::vector<BptNode> &level_lst, size_t level,
+                       const Bytes &key, BlockNum pos, Size fill_size, std::vector<BlockNum> &alloc_lst) {
+    BptNode &node = level_lst[level];
+    Size key_count = node.page.view().get_key_count();
+    Size used_size = BLOCK_SIZE - node.page.get_free_size();
+    Size need_size = NodeView::SLOT_SIZE + NodeView::CELL_HEADER_SIZE + Size(key.size());
+    if (key_count == 0 || used_size + need_size <= fill_size) {
+        if (node.page.insert(key_count, key, pos)) return;
+    }
+
+    // close node: key starts right node and becomes high key of node.
+    // no room for high key => last keys of node move right too,
+    // the first moved key goes up instead
+    Bytes sep = key;
+    std::vector<std::pair<Bytes, BlockNum>> move_lst{{key, pos}};
+    while (!node.page.set_high_key(sep)) {
+        NodeView view = node.page.view();
+        Size last = view.get_key_count() - 1;
+        assert(last >= 0);
+        BytesView last_key = view.get_key(last);
+        sep = Bytes(last_key.begin(), last_key.end());
+        move_lst.insert(move_lst.begin(), {sep, view.get_pos(last + 1)});
+        node.page.erase(last);
+    }
+    BptNode right = BptNode::new_node(tp, node.page.view().is_leaf());
+    alloc_lst.push_back(right.file_pos);
+    right.page.set_pos(0, move_lst[0].second);
+    for (size_t i = 1; i < move_lst.size(); i++) {
+        bool is_inserted = right.page.insert(Size(i - 1), move_lst[i].first, move_lst[i].second);
+        assert(is_inserted);
+    }
+    node.page.set_right_pos(right.file_pos);
+    node.sync();
+
+    // node is replaced by right one, no reference into level_lst is kept
+    BlockNum left_pos = node.file_pos;
+    BlockNum right_pos = right.file_pos;
+    level_lst[level] = std::move(right);
+    if (level + 1 == level_lst.size()) {
+        BptNode parent = BptNode::new_node(tp, false);
+        alloc_lst.push_back(parent.file_pos);
+        parent.page.set_pos(0, left_pos);
+        level_lst.push_back(std::move(parent));
+    }
+    bulk_push(tp, level_lst, level + 1, sep, right_pos, fill_size, alloc_lst);
 }
 
-bool BpTree::BptNode::is_full()const {
-    return get_bytes_size() > BLOCK_SIZE;
+// right record is copied to a new block,
+// readers on old one still find all tuples it had.
+// records are committed before leaf moves, as merge_record
+BlockNum BpTree::borrow_record(NodePage &leaf, Size i) {
+    BlockNum left_pos = leaf.view().get_pos(i);
+    BlockNum right_pos = leaf.view().get_pos(i + 1);
+    TransInfo t_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    Record left(t_info, tp, left_pos);
+    if (!left.is_less() || left.get_next_record_num() != right_pos) return -1;
+    Record right(t_info, tp, right_pos);
+    if (right.is_less()) return -1;
+
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    Record new_right = Record::new_record(t_info, tp, block_alloc.new_block(tp.record_owner()));
+    new_right.record_lst = right.record_lst;
+    new_right.set_next_record_num(right.get_next_record_num());
+    size_t left_count = left.record_lst.size();
+    left.borrow(new_right);
+    NodePage page = leaf;
+    if (left.record_lst.size() != left_count) {
+        // first key of right record routes to it
+        Bytes key = en_key(new_right.record_lst.front().second.select(tp.get_keys_pos()));
+        page.erase(i);
+        if (page.insert(i, key, new_right.get_block_num())) {
+            left.set_next_record_num(new_right.get_block_num());
+            new_right.sync();
+            left.sync();
+            t_info.s_ptr->commit();
+            leaf = std::move(page);
+            return right_pos;
+        }
+    }
+    block_alloc.free_temp_block(new_right.get_block_num());
+    return -1;
 }
 
-Size BpTree::BptNode::get_bytes_size()const {
-    Size bytes_size = 0;
-    bytes_size += sizeof(is_leaf);
-    bytes_size += sizeof(right_node_pos);
+// merge: right node goes into left, parent drops it.
+// refill: keys move between left and a copy of right in a new block,
+// parent points to the copy with new separator.
+// either way, changed left has all keys it routes and links to what follows,
+// old right node stays as it was for readers on it
+void BpTree::rebalance_level(BlockNum parent_pos, size_t max_merge_count, std::vector<BlockNum> &free_lst) {
+    while (parent_pos != -1 && free_lst.size() < max_merge_count) {
+        BptNode parent = BptNode::get(tp, parent_pos);
+        bool is_changed = false;
+        Size i = 0;
+        while (i < parent.page.view().get_key_count() && free_lst.size() < max_merge_count) {
+            NodeView parent_view = parent.page.view();
+            BptNode left = BptNode::get(tp, parent_view.get_pos(i));
+            BptNode right = BptNode::get(tp, parent_view.get_pos(i + 1));
+            Bytes sep(parent_view.get_key(i).begin(), parent_view.get_key(i).end());
+            Size left_size = left.page.view().get_used_size();
+            Size right_size = right.page.view().get_used_size();
+            if (left_size >= NODE_LESS_SIZE && right_size >= NODE_LESS_SIZE) {
+                i++;
+                continue;
+            }
+
+            // sep takes a slot, left high key (sep) and a header are dropped
+            if (left_size + right_size - NodeView::HEADER_SIZE + NodeView::SLOT_SIZE <= NODE_MERGE_SIZE) {
+                bool is_merged = left.page.merge(sep, right.page.view());
+                assert(is_merged);
+                left.sync();
+                parent.page.erase(i);
+                free_lst.push_back(right.file_pos);
+                is_changed = true;
+                // try to merge next node into left one too
+                continue;
+            }
 
-    // key list
-    for (auto &&key : key_lst) {
-        key.range([&bytes_size](auto ptr){bytes_size+= ptr->get_size();});
+            BptNode new_right = BptNode::new_node(tp, left.page.view().is_leaf());
+            new_right.page = right.page;
+            Bytes new_sep = left.page.balance(sep, new_right.page);
+            NodePage parent_page = parent.page;
+            parent_page.erase(i);
+            if (!parent_page.insert(i, new_sep, new_right.file_pos)) {
+                // no room in parent for a longer separator
+                BlockAlloc::get().free_temp_block(new_right.file_pos);
+                i++;
+                continue;
+            }
+            left.page.set_right_pos(new_right.file_pos);
+            new_right.sync();
+            left.sync();
+            parent.page = std::move(parent_page);
+            free_lst.push_back(right.file_pos);
+            is_changed = true;
+            i++;
+        }
+        if (is_changed) {
+            parent.sync();
+        }
+        parent_pos = parent.page.view().get_right_pos();
     }
+}
 
-    // pos list
-    bytes_size += sizeof(BlockNum) * pos_lst.size();
-    return bytes_size;
-}
-
-using KeyListIt = std::list<Tuple>::const_iterator;
-using PosListIt = std::list<BlockNum>::const_iterator;
-std::pair<KeyListIt, PosListIt>
-BpTree::BptNode::search_less_or_eq_key(Tuple key) {
-    // e.g.: key_list: | 1 3 5 7 9 |
-    //       pos_list |p1, p2, p3, p4, p5, p6|
-    // key: 5 => return <5, p4>
-    // key: 4 => return <3, p3>
-    //
-    auto key_it = key_lst.cbegin();
-    auto pos_it = pos_lst.cbegin();
-    for (; key_it != key_lst.cend(); key_it++) {
-        if (key.less(*key_it)) {
-            return {std::prev(key_it), pos_it};
-        } else if (key.eq(*key_it)) {
-            return {key_it, std::next(pos_it)};
+// readers on old root or child find what they had till block is freed.
+// roots given to catalog are never freed
+void BpTree::collapse_root(std::vector<BlockNum> &free_lst) {
+    while (true) {
+        BlockNum pos = root_pos.load();
+        BptNode root = BptNode::get(tp, pos);
+        NodeView view = root.page.view();
+        if (view.is_leaf() || view.get_key_count() > 0 || view.get_right_pos() != -1) return;
+        BlockNum child_pos = view.get_pos(0);
+        if (is_catalog_root(child_pos)) {
+            // root moves down
+            root_pos.store(child_pos);
+            if (!is_catalog_root(pos)) {
+                free_lst.push_back(pos);
+            }
+        } else {
+            // child moves up into root block
+            BptNode child = BptNode::get(tp, child_pos);
+            child.file_pos = pos;
+            child.sync();
+            free_lst.push_back(child_pos);
         }
-        pos_it++;
     }
-    return {key_it, pos_it};
+}
+
+bool BpTree::is_catalog_root(BlockNum pos) {
+    std::lock_guard<std::mutex> lg(root_mutex);
+    return std::find(catalog_root_lst.begin(), catalog_root_lst.end(), pos) != catalog_root_lst.end();
+}
+
+// ========== BptNode Function =========
+BpTree::BptNode BpTree::BptNode::get(const TableProperty &tp, BlockNum pos) {
+    PageRef page = pin_node(pos);
+    return BptNode(tp, pos, NodePage(page.view()));
+}
+
+BpTree::BptNode BpTree::BptNode::new_node(const TableProperty &tp, bool is_leaf) {
+    BlockNum pos = BlockAlloc::get().new_block(tp.keys_index_owner());
+    return BptNode(tp, pos, NodePage(is_leaf));
 }
 
 void BpTree::BptNode::sync() {
-    assert(!is_full());
     assert(file_pos != -1);
+    PageClass page_class = page.view().is_leaf() ? INDEX_LEAF_PAGE : INDEX_INNER_PAGE;
+    CacheMaster::get_block_cache().put(file_pos, page.bytes(), page_class);
+}
 
-    // node block bytes:
-    //     |is_leaf right_node_pos key_lst pos_lst|
-    Bytes bytes = sdb::en_bytes(is_leaf, right_node_pos);
-    bytes_append(bytes, key_lst);
-    for (auto &&key: key_lst) {
-        key.range([&bytes](auto &&ptr){bytes_append(bytes, ptr);});
-    }
-    bytes_append(bytes, pos_lst);
-    bytes.resize(BLOCK_SIZE);
-    auto path = IO::get_block_path(tp.db_name);
-    CacheMaster::get_block_cache().put(path, file_pos, bytes);
-}
-
-// split, return right node pos and min key
-std::pair<BlockNum, Tuple> BpTree::BptNode::split() {
-    // alloc block
-    BlockNum new_pos = BlockAlloc::get().new_block(tp.db_name);
-    BptNode new_node(tp);
-    new_node.is_leaf = is_leaf;
-
-    // reset right node pos
-    new_node.right_node_pos = right_node_pos;
-    right_node_pos = new_pos;
-    // pass new pos
-    new_node.file_pos = new_pos;
-
-    // split key list
-    // e.g.: key_list: | 1 2 3 4 5 |
-    //              => | 1 2 3| and | 4 5 |
-    //
-    // e.g.: pos_list |p1, p2, p3, p4, p5, p6|
-    //             => |p1, p2, p3, p4| and |p4, p5, p6|
-    //
-    Size mid = key_lst.size() / 2;
-    assert(key_lst.size() >= 2);
-
-    // key list
-    new_node.key_lst.splice(new_node.key_lst.begin(), key_lst, std::next(key_lst.begin(), mid), key_lst.end());
-    key_lst.pop_back();
-
-    // pos list
-    new_node.pos_lst.splice(new_node.pos_lst.begin(), pos_lst, std::next(pos_lst.begin(), mid), pos_lst.end());
-    pos_lst.push_back(*new_node.pos_lst.begin());
-
-    // sync new node
-    new_node.sync();
-
-    // sync current node
-    sync();
-
-    return {new_pos, new_node.key_lst.front()};
+std::pair<Bytes, BpTree::BptNode> BpTree::BptNode::split() {
+    BptNode right = new_node(tp, page.view().is_leaf());
+    Bytes sep = page.split(right.page);
+    // right node takes over right link
+    right.page.set_right_pos(page.view().get_right_pos());
+    page.set_right_pos(right.file_pos);
+    return {std::move(sep), std::move(right)};
 }
 
 } // namespace sdb
@@ -12,15 +12,24 @@
 #include <string>
 #include <functional>
 #include <mutex>
+#include <array>
+#include <atomic>
 
 #include "util.h"
 #include "db_type.h"
 #include "record.h"
 #include "property.h"
+#include "node_page.h"
+#include "cache.h"
 
 namespace sdb {
 
-// b-link tree
+// b-link tree (Lehman & Yao):
+//     every node links to its right node and keeps the first key of it as high key,
+//     a split makes right node first, then links left to it, then tells parent.
+// readers take no latch: node is read in place on its pinned page and checked by page version,
+// key at or past high key => node was split meanwhile, go right.
+// writers latch one node at a time, only the node they change.
 class BpTree {
 public:
     // === type ===
@@ -28,36 +37,118 @@ public:
     using nodePtr = std::shared_ptr<BptNode>;
 
     BpTree()= delete;
-    BpTree(const TableProperty &tp):tp(tp){}
+    BpTree(const TableProperty &tp):tp(tp), root_pos(tp.keys_idx_root), catalog_root_lst{tp.keys_idx_root}{}
     BpTree(const BpTree &bpt)= delete;
     BpTree(BpTree &&bpt)= delete;
     const BpTree &operator=(const BpTree &bpt)= delete;
     BpTree &operator=(BpTree &&bpt)= delete;
     // ~BpTree();
 
+    // empty tree at roots of property, blocks of them are given by caller,
+    // e.g. reserved catalog blocks of a new db
     static std::shared_ptr<BpTree> build(const TableProperty &property);
+    // build a new tree bottom up from tuples in strictly increasing key order.
+    // record blocks and nodes are filled to fill_percent and written once, left to right,
+    // nothing reaches them until caller publishes returned roots.
+    // throw if keys aren't strictly increasing or a tuple doesn't fit in a block,
+    // blocks taken so far are freed then.
+    // return tp with new record root and keys index root
+    static TableProperty bulk_load(TransInfo t_info, TableProperty tp, TupleSource next, Size fill_percent);
+    // free all record blocks and nodes, nobody may use tree meanwhile
     void drop();
 
+    // f(t_info, new root) once root moves up by a split in a write of t_info,
+    // e.g. to put it in catalog in the same transaction. set before writers use tree
+    using RootHook = std::function<void(TransInfo, BlockNum)>;
+    void set_root_hook(RootHook hook) {root_hook = std::move(hook);}
+
     // op
     void insert(TransInfo t_info, const Tuple &key, const Tuple &data);
-    void remove(TransInfo t_info, const Tuple &key);
-    void update(TransInfo t_info, const Tuple &key, const Tuple &data);
+    // return tuple of key before the write, read under record lock of t_info
+    Tuples remove(TransInfo t_info, const Tuple &key);
+    Tuples update(TransInfo t_info, const Tuple &key, const Tuple &data);
     Tuples find_key(TransInfo t_info, const Tuple &key)const;
-    // TODO
+    // tuples whose leading key columns equal key
     Tuples find_pre_key(TransInfo t_info, const Tuple &key)const;
     Tuples find_less(TransInfo t_info, const Tuple &key, bool is_close)const;
     Tuples find_greater(TransInfo t_info, const Tuple &key, bool is_close)const;
     Tuples find_range(TransInfo t_info, const Tuple &beg, const Tuple &end, bool is_beg_close, bool is_end_close)const;
 
+    // record block nums in key order, read from leaf level
+    std::vector<BlockNum> record_pos_lst()const;
+    // leftmost leaf
+    BlockNum first_leaf_pos()const;
+    // record block nums of leaf at pos appended to lst, return pos of right leaf, -1 if none
+    BlockNum leaf_record_pos(BlockNum pos, std::vector<BlockNum> &lst)const;
+
+    // shrink tree after removes, at most max_merge_count blocks per round:
+    //     records less than half full are merged with or refilled from next record of leaf,
+    //     nodes less than a quarter full are merged with or refilled from a sibling,
+    //     level by level up, then a root of one child gives way to it.
+    // blocks left of a pair change in place, the right one is copied to a new block,
+    // old blocks stay as they were for readers still on them.
+    // return blocks unlinked from record chain and index,
+    // caller frees them once readers are gone.
+    // writers of table must be excluded by caller, that is the only protection:
+    // vacuum takes no node latch, readers take none either
+    std::vector<BlockNum> vacuum(size_t max_merge_count);
+    // move record blocks and nodes at or past limit to free blocks before it,
+    // roots and roots given to catalog stay. return old blocks, freed by caller once readers are gone.
+    // writers of table must be excluded by caller
+    std::vector<BlockNum> relocate(BlockNum limit);
+
     // debug log
     void print()const;
 
+    // order preserving key bytes, compared by memcmp in node pages
+    static Bytes en_key(const Tuple &key);
+
 private:
-    std::vector<BlockNum> search_path(const Tuple &key)const;
-    // get
-    std::string index_path()const;
-    // bubble split
-    void bubble_split(std::vector<BlockNum> &&lst, const Tuple &key, BlockNum record_pos);
+    // pinned node page for read, no copy
+    static PageRef pin_node(BlockNum pos);
+    // f(NodeView) on page in place, again until page didn't change meanwhile
+    template <typename F>
+    static auto read_node(BlockNum pos, F f) {
+        PageRef page = pin_node(pos);
+        while (true) {
+            uint64_t version = page.get_version();
+            auto res = f(NodeView(page.view()));
+            if (!page.is_changed(version)) return res;
+        }
+    }
+    // node of every level covering key from root, then record pos covering key
+    std::vector<BlockNum> search_path(BytesView key)const;
+    // search_path, with record pos locked by snapshot of t_info,
+    // again till record pos is the same after lock
+    std::vector<BlockNum> lock_path(TransInfo t_info, BytesView key)const;
+    std::mutex &get_latch(BlockNum pos) {
+        return latch_lst[size_t(pos) % LATCH_COUNT];
+    }
+    // first key of new right record of a split goes into last node of path
+    void split_record(TransInfo t_info, std::vector<BlockNum> &&lst, BlockNum right_pos);
+    // insert key and new record pos into last node of path,
+    // split full nodes up the path, a new root goes to root_hook under t_info
+    void bubble_split(TransInfo t_info, std::vector<BlockNum> &&lst, BytesView key, BlockNum record_pos);
+    // pos is in catalog_root_lst
+    bool is_catalog_root(BlockNum pos);
+    // move tuples of right record into left one, return false if not merged
+    bool merge_record(BlockNum left_pos, BlockNum right_pos);
+    // refill under-full record i of leaf from record i + 1,
+    // which moves to a new block. return old pos of it, -1 if nothing moved
+    BlockNum borrow_record(NodePage &leaf, Size i);
+    // merge or refill under-full children of every node of level from parent_pos.
+    // no latch, writers are excluded by caller of vacuum
+    void rebalance_level(BlockNum parent_pos, size_t max_merge_count, std::vector<BlockNum> &free_lst);
+    // root of one child gives way to it
+    void collapse_root(std::vector<BlockNum> &free_lst);
+    // bulk load, blocks of new records and nodes are appended to alloc_lst
+    static TableProperty bulk_build(TransInfo t_info, TableProperty tp, TupleSource next, Size fill_percent,
+                                    std::vector<BlockNum> &alloc_lst);
+    // bulk load: append key and pos to open node of level,
+    // node past fill_size is closed and a new right node is opened,
+    // its first key goes up to level + 1
+    static void bulk_push(const TableProperty &tp, std::vector<BptNode> &level_lst, size_t level,
+                          const Bytes &key, BlockNum pos, Size fill_size, std::vector<BlockNum> &alloc_lst);
 
     // === 异常处理 ===
     void throw_error(const std::string &str)const{
@@ -65,47 +156,50 @@ private:
     }
 
 private:
+    // node latches by block num, writers hold one at a time
+    static constexpr size_t LATCH_COUNT = 64;
+    // node under this is refilled by vacuum, merged if both fit in NODE_MERGE_SIZE
+    static constexpr Size NODE_LESS_SIZE = BLOCK_SIZE / 4;
+    static constexpr Size NODE_MERGE_SIZE = BLOCK_SIZE * 3 / 4;
+
     TableProperty tp;
-    // TODO concurrent map
-    std::unordered_map<BlockNum, std::mutex> mutex_map;
-    // std::mutex global_mutex;
+    // root moves up by root split, an old root is leftmost node of its level,
+    // readers starting from it go right.
+    // root moves down by collapse_root in vacuum, old root stays till readers are gone
+    std::atomic<BlockNum> root_pos;
+    std::mutex root_mutex;
+    std::array<std::mutex, LATCH_COUNT> latch_lst;
+    // roots given to catalog under root_mutex, tp.keys_idx_root then new roots of root_hook.
+    // transaction of a root may roll back, so any of them may be the one in catalog,
+    // none of them is freed or moved
+    std::vector<BlockNum> catalog_root_lst;
+    RootHook root_hook;
 };
 
-// Node
+// Node: slotted page, see NodePage.
+// readers search pinned pages by NodeView,
+// writers change a copy of page in place and sync it
 struct BpTree::BptNode {
-    // copy constructor
-    BptNode(const BptNode &node)=default;
-    BptNode &operator=(const BptNode &node)=default;
-
-    // read by cache
+    // copy of node page
     static BptNode get(const TableProperty &tp, BlockNum pos);
-    // new_node
-    static BptNode new_node(const TableProperty &tp);
-    
-    bool is_full()const;
-    Size get_bytes_size()const;
-    // return => <key_list_iterator, pos_list_iterator>
-    using KeyListIt = std::list<Tuple>::const_iterator;
-    using PosListIt = std::list<BlockNum>::const_iterator;
-    std::pair<KeyListIt, PosListIt> search_less_or_eq_key(Tuple key);
+    // empty node in a new block
+    static BptNode new_node(const TableProperty &tp, bool is_leaf);
 
     // sync to cache
     void sync();
 
-    // return right pos
-    std::pair<BlockNum, Tuple> split();
+    // move upper half to new right node and link it, nothing synced.
+    // return separator key and right node
+    std::pair<Bytes, BptNode> split();
 
     // ===== member =====
-    bool is_leaf = true;
-    BlockNum right_node_pos = -1;
     BlockNum file_pos = -1;
-
-    std::list<Tuple> key_lst;
-    std::list<BlockNum> pos_lst;
+    NodePage page;
 
 private:
     TableProperty tp;
-    BptNode(const TableProperty &tp):tp(tp){}
+    BptNode(const TableProperty &tp, BlockNum file_pos, NodePage page)
+        :file_pos(file_pos), page(std::move(page)), tp(tp){}
 };
 
 } // namespace sdb
@@ -1,67 +1,929 @@
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "cache.h"
 #include "util.h"
+#include "aio.h"
 #include "../cpp_util/log.hpp"
 
 using namespace cpp_util;
 
 namespace sdb {
 
+// ========== FrameArena ==========
+// zero filled memory, backed once touched
+static void *reserve_memory(size_t size) {
+    void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert_msg(ptr != MAP_FAILED, format("reserve %s bytes for cache failed", size));
+    return ptr;
+}
+
+FrameArena::FrameArena(size_t frame_count):frame_count(std::max(frame_count, size_t(1))) {
+    // hint table at least twice frame count
+    hint_bits = 1;
+    while ((size_t(1) << hint_bits) < 2 * this->frame_count) {
+        hint_bits++;
+    }
+    base = static_cast<Byte*>(reserve_memory(this->frame_count * BLOCK_SIZE));
+    tag_lst = static_cast<FrameTag*>(reserve_memory(this->frame_count * sizeof(FrameTag)));
+    hint_lst = static_cast<std::atomic<uint64_t>*>(reserve_memory((size_t(1) << hint_bits) * sizeof(uint64_t)));
+}
+
+FrameArena::~FrameArena() {
+    munmap(base, frame_count * BLOCK_SIZE);
+    munmap(tag_lst, frame_count * sizeof(FrameTag));
+    munmap(hint_lst, (size_t(1) << hint_bits) * sizeof(uint64_t));
+}
+
+void FrameArena::release(Byte *frame) {
+    madvise(frame, BLOCK_SIZE, MADV_DONTNEED);
+}
+
 // ========== public function ==========
-Bytes BlockCache::get(BlockNum key) {
+BlockCache::BlockCache(size_t max_block_count, const std::string &policy)
+    :BlockCache(std::make_shared<FrameArena>(2 * max_block_count), 0, 2 * max_block_count, max_block_count, policy){}
+
+BlockCache::BlockCache(std::shared_ptr<FrameArena> arena, size_t first_frame, size_t frame_count,
+                       size_t max_block_count, const std::string &policy)
+        :max_block_count(std::min(max_block_count, frame_count)), arena(std::move(arena)),
+         first_frame(first_frame), frame_count(frame_count) {
+    assert(first_frame + frame_count <= this->arena->get_frame_count());
+    for (auto &&class_policy : policy_lst) {
+        class_policy = ReplacePolicy::make(policy, this->max_block_count);
+    }
+}
+
+Bytes BlockCache::get(BlockNum key, PageClass page_class) {
+    Bytes data(BLOCK_SIZE);
+    if (try_get(key, page_class, data.data())) {
+        return data;
+    }
+    std::lock_guard<std::mutex> lg(mutex);
+    std::memcpy(data.data(), load(key, page_class).data, BLOCK_SIZE);
+    return data;
+}
+
+void BlockCache::put(BlockNum key, BytesView data, PageClass page_class) {
+    assert(data.size() == BLOCK_SIZE);
     std::lock_guard<std::mutex> lg(mutex);
-    auto it = key_map.find(key);
-    if (it == key_map.end()) {
-        Bytes block = io.read_block(io.block_path(), key);
-        if (value_list.size() >= max_block_count) {
-            pop();
+    auto it = frame_map.find(key);
+    if (it == frame_map.end()) {
+        Byte *frame = take_frame();
+        assert_msg(frame != nullptr, "block cache: all frames are pinned");
+        std::memcpy(frame, data.data(), BLOCK_SIZE);
+        insert(key, frame, true, page_class);
+    } else {
+        set_class(key, it->second, page_class);
+        begin_change(it->second);
+        std::memcpy(it->second.data, data.data(), BLOCK_SIZE);
+        end_change(it->second);
+        mark_dirty(it->second);
+    }
+    if (flusher != nullptr && dirty_count > high_dirty_count()) {
+        flusher->notify();
+    }
+}
+
+PageRef BlockCache::pin(BlockNum key, bool is_write, PageClass page_class) {
+    if (!is_write) {
+        Byte *data = try_pin(key, page_class);
+        if (data != nullptr) {
+            return PageRef(this, key, data, false);
         }
-        value_list.push_front(CacheValue(key, block));
-        key_map[key] = value_list.begin();
-        mutex.unlock();
-        return block;
     }
-    Bytes block = it->second->data;
-    value_list.erase(it->second);
-    value_list.push_front(CacheValue(key, block));
-    it->second = value_list.begin();
-    return block;
+    std::lock_guard<std::mutex> lg(mutex);
+    Frame &frame = load(key, page_class);
+    get_tag(frame).pin_count++;
+    if (is_write && frame.write_pin_count++ == 0) {
+        // written in place without lock until unpin
+        begin_change(frame);
+    }
+    return PageRef(this, key, frame.data, is_write);
 }
 
-void BlockCache::put(BlockNum key, const Bytes &data) {
+void BlockCache::upgrade(BlockNum key, PageClass page_class) {
+    uint64_t version = 0;
+    if (find_frame(key, page_class, version) >= 0) return;
     std::lock_guard<std::mutex> lg(mutex);
-    auto it = key_map.find(key);
-    if (it == key_map.end()) {
-        value_list.push_front(CacheValue(key, data));
-        key_map[key] = value_list.begin();
-        mutex.unlock();
-        return;
+    auto it = frame_map.find(key);
+    if (it != frame_map.end() && it->second.page_class < page_class) {
+        if (it->second.is_new) {
+            // class of a node is only known once it is read
+            get_stat_stripe().miss_count[it->second.page_class]--;
+            get_stat_stripe().miss_count[page_class]++;
+            it->second.is_new = false;
+        }
+        set_class(key, it->second, page_class);
+    }
+}
+
+void BlockCache::prefetch(const std::vector<BlockNum> &key_lst, PageClass page_class) {
+    std::vector<BlockNum> sorted_lst = key_lst;
+    std::sort(sorted_lst.begin(), sorted_lst.end());
+    sorted_lst.erase(std::unique(sorted_lst.begin(), sorted_lst.end()), sorted_lst.end());
+    std::vector<BlockNum> miss_lst;
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        for (BlockNum key : sorted_lst) {
+            // don't evict prefetched blocks by each other
+            if (miss_lst.size() == max_block_count) break;
+            // block read by another prefetch is left to it
+            if (frame_map.find(key) == frame_map.end() && prefetch_map.emplace(key, false).second) {
+                miss_lst.push_back(key);
+            }
+        }
+    }
+    if (miss_lst.empty()) return;
+
+    // blocks out of file are read short, keep them zero
+    std::vector<AlignedBytes> block_lst(miss_lst.size(), AlignedBytes(BLOCK_SIZE));
+    AioBatch batch;
+    for (size_t i = 0; i < miss_lst.size(); i++) {
+        batch.read(miss_lst[i], block_lst[i].data());
+    }
+    AsyncIO::get().execute(io.get_mmap_file(io.block_path()), batch);
+
+    std::lock_guard<std::mutex> lg(mutex);
+    bool is_full = false;
+    for (size_t i = 0; i < miss_lst.size(); i++) {
+        BlockNum key = miss_lst[i];
+        auto it = prefetch_map.find(key);
+        bool is_stale = it->second;
+        prefetch_map.erase(it);
+        // failed, or cached while reading: bytes read may be older than
+        // a put since written back and evicted
+        if (is_full || is_stale || batch.req_lst[i].result < 0 || frame_map.find(key) != frame_map.end()) {
+            continue;
+        }
+        Byte *frame = take_frame();
+        if (frame == nullptr) {
+            is_full = true;
+            continue;
+        }
+        std::memcpy(frame, block_lst[i].data(), BLOCK_SIZE);
+        insert(key, frame, false, page_class);
     }
-    value_list.erase(it->second);
-    value_list.push_front(CacheValue(key, data));
-    it->second = value_list.begin();
+}
+
+bool BlockCache::peek(BlockNum key, Byte *data) {
+    PageRef page;
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        auto it = frame_map.find(key);
+        if (it == frame_map.end()) return false;
+        // pinned so frame isn't reused while copying, recency untouched
+        get_tag(it->second).pin_count++;
+        page = PageRef(this, key, it->second.data, false);
+    }
+    // write pins change frame in place without lock, copy by version check
+    page.copy_to(data);
+    return true;
+}
+
+bool BlockCache::discard(BlockNum key) {
+    std::lock_guard<std::mutex> lg(mutex);
+    auto it = frame_map.find(key);
+    if (it == frame_map.end()) return true;
+    if (!try_lock_frame(it->second)) return false;
+    mark_stale(key);
+    policy_lst[it->second.page_class]->erase(key);
+    if (it->second.is_dirty) {
+        dirty_count--;
+    }
+    remove_frame(it);
+    return true;
 }
 
 // ========== private function ==========
 void BlockCache::sync() {
     std::lock_guard<std::mutex> lg(mutex);
-    for (auto &&[key, vl_it] : key_map) {
-        IO::get().write_block(io.block_path(), key, vl_it->data);
+    // adjacent blocks are flushed by one pwritev
+    std::vector<size_t> num_lst;
+    std::vector<const Byte*> ptr_lst;
+    for (auto &&[key, frame] : frame_map) {
+        // pinned for write => written after unpin
+        if (frame.is_dirty && frame.write_pin_count == 0) {
+            num_lst.push_back(key);
+            ptr_lst.push_back(frame.data);
+            frame.is_dirty = false;
+        }
     }
+    io.write_blocks(io.block_path(), num_lst, ptr_lst);
+    dirty_count -= num_lst.size();
 }
 
 void BlockCache::sync(BlockNum block_num) {
     std::lock_guard<std::mutex> lg(mutex);
-    auto it = key_map.find(block_num);
-    IO::get().write_block(io.block_path(), block_num, it->second->data);
+    auto it = frame_map.find(block_num);
+    if (it == frame_map.end() || !it->second.is_dirty || it->second.write_pin_count > 0) return;
+    io.write_blocks(io.block_path(), {size_t(block_num)}, {it->second.data});
+    it->second.is_dirty = false;
+    dirty_count--;
+}
+
+size_t BlockCache::flush_cold() {
+    std::lock_guard<std::mutex> lg(mutex);
+    if (dirty_count == 0) return 0;
+    size_t zone_count = std::max(max_block_count / 8, size_t(1));
+    size_t over_count = dirty_count > high_dirty_count() ? dirty_count - low_dirty_count() : 0;
+    std::vector<BlockNum> cold_lst = cold_keys(over_count > 0 ? frame_map.size() : zone_count);
+
+    std::vector<size_t> num_lst;
+    std::vector<const Byte*> ptr_lst;
+    for (size_t i = 0; i < cold_lst.size() && num_lst.size() < FLUSH_BATCH_COUNT; i++) {
+        if (i >= zone_count && num_lst.size() >= over_count) break;
+        auto &&frame = frame_map.at(cold_lst[i]);
+        if (frame.is_dirty && frame.write_pin_count == 0) {
+            num_lst.push_back(cold_lst[i]);
+            ptr_lst.push_back(frame.data);
+            frame.is_dirty = false;
+        }
+    }
+    // written under lock, so no newer version of block can reach disk first
+    io.write_blocks(io.block_path(), num_lst, ptr_lst);
+    dirty_count -= num_lst.size();
+    return num_lst.size();
+}
+
+CacheStats BlockCache::get_stats(PageClass page_class)const {
+    CacheStats stats;
+    for (auto &&stripe : stat_lst) {
+        stats.hit_count += stripe.hit_count[page_class];
+        stats.miss_count += stripe.miss_count[page_class];
+    }
+    return stats;
+}
+
+std::vector<std::pair<BlockNum, PageClass>> BlockCache::resident_list() {
+    std::lock_guard<std::mutex> lg(mutex);
+    // recency of lock free hits is only known by reference bits
+    for (auto &&[key, frame] : frame_map) {
+        if (get_tag(frame).is_referenced.exchange(false)) {
+            policy_lst[frame.page_class]->access(key);
+        }
+    }
+    std::vector<std::pair<BlockNum, PageClass>> resident_lst;
+    for (size_t i = PAGE_CLASS_COUNT; i-- > 0;) {
+        for (BlockNum key : policy_lst[i]->key_list()) {
+            resident_lst.push_back({key, PageClass(i)});
+        }
+    }
+    return resident_lst;
 }
 
-void BlockCache::pop() {
-    auto &&[key, data] = value_list.back();
-    IO::get().write_block(io.block_path(), key, data);
-    key_map.erase(key);
-    value_list.pop_back();
+std::vector<BlockNum> BlockCache::_key_list() {
+    std::vector<BlockNum> key_lst;
+    for (auto &&[key, page_class] : resident_list()) {
+        key_lst.push_back(key);
+    }
+    return key_lst;
+}
+
+int64_t BlockCache::find_frame(BlockNum key, PageClass page_class, uint64_t &version)const {
+    int64_t idx = arena->find_hint(key);
+    if (idx < 0) return -1;
+    FrameTag &tag = arena->get_tag(idx);
+    version = tag.version.load(std::memory_order_acquire);
+    // acquire pairs with release of owner in insert(), a reused frame keeps its
+    // version, bytes written before owner are only seen by acquiring owner
+    if (version % 2 == 1 || tag.owner.load(std::memory_order_acquire) != uint64_t(key) + 1) return -1;
+    // class raised by lock
+    if (tag.page_class.load(std::memory_order_relaxed) < page_class) return -1;
+    return idx;
+}
+
+bool BlockCache::try_get(BlockNum key, PageClass page_class, Byte *data) {
+    uint64_t version = 0;
+    int64_t idx = find_frame(key, page_class, version);
+    if (idx < 0) return false;
+    FrameTag &tag = arena->get_tag(idx);
+    // copy may be torn, then version has moved
+    std::memcpy(data, arena->get_frame(idx), BLOCK_SIZE);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (tag.version.load(std::memory_order_relaxed) != version) return false;
+    // no write if set, hot frames are only read by hits
+    if (!tag.is_referenced.load(std::memory_order_relaxed)) {
+        tag.is_referenced.store(true, std::memory_order_relaxed);
+    }
+    // counted by class of frame, it may be above the asked one
+    get_stat_stripe().hit_count[size_t(tag.page_class.load(std::memory_order_relaxed))]++;
+    return true;
+}
+
+Byte *BlockCache::try_pin(BlockNum key, PageClass page_class) {
+    uint64_t version = 0;
+    int64_t idx = find_frame(key, page_class, version);
+    if (idx < 0) return nullptr;
+    FrameTag &tag = arena->get_tag(idx);
+    // pin first, then check version:
+    // evictor bumps version first, then checks pins, so one of us sees the other
+    tag.pin_count.fetch_add(1);
+    if (tag.version.load() != version) {
+        tag.pin_count.fetch_sub(1);
+        return nullptr;
+    }
+    if (!tag.is_referenced.load(std::memory_order_relaxed)) {
+        tag.is_referenced.store(true, std::memory_order_relaxed);
+    }
+    get_stat_stripe().hit_count[size_t(tag.page_class.load(std::memory_order_relaxed))]++;
+    return arena->get_frame(idx);
+}
+
+void BlockCache::apply_reference(PageClass page_class) {
+    auto &&policy = policy_lst[page_class];
+    for (size_t i = 0; i < class_count[page_class]; i++) {
+        std::vector<BlockNum> cold_lst = policy->cold_keys(1);
+        if (cold_lst.empty()) return;
+        FrameTag &tag = get_tag(frame_map.at(cold_lst[0]));
+        if (!tag.is_referenced.exchange(false)) return;
+        policy->access(cold_lst[0]);
+    }
+}
+
+BlockCache::StatStripe &BlockCache::get_stat_stripe() {
+    static std::atomic<size_t> thread_count{0};
+    thread_local size_t stripe = thread_count++ % STAT_STRIPE_COUNT;
+    return stat_lst[stripe];
+}
+
+BlockCache::Frame &BlockCache::load(BlockNum key, PageClass page_class) {
+    auto it = frame_map.find(key);
+    if (it != frame_map.end()) {
+        // never lower class, e.g. snapshot reads index pages as data
+        set_class(key, it->second, std::max(page_class, it->second.page_class));
+        get_stat_stripe().hit_count[it->second.page_class]++;
+        it->second.is_new = false;
+        // hint slot may have been taken by another block
+        arena->set_hint(key, arena->get_index(it->second.data));
+        return it->second;
+    }
+    // read ahead following uncached blocks by the same preadv,
+    // only for data, neighbours of an index node are seldom index nodes of same level
+    std::vector<size_t> num_lst = {size_t(key)};
+    size_t file_block_count = io.get_mmap_file(io.block_path())->get_file_size() / BLOCK_SIZE;
+    size_t ahead_count = page_class == DATA_PAGE ? std::min(READ_AHEAD_COUNT, max_block_count / 4) : 0;
+    size_t run_end = (key / RUN_BLOCK_COUNT + 1) * RUN_BLOCK_COUNT;
+    size_t ahead_end = std::min({key + ahead_count + 1, file_block_count, run_end});
+    for (size_t num = key + 1; num < ahead_end; num++) {
+        if (frame_map.find(num) != frame_map.end()) break;
+        num_lst.push_back(num);
+    }
+    // read straight into frames
+    std::vector<Byte*> ptr_lst;
+    for (size_t i = 0; i < num_lst.size(); i++) {
+        Byte *frame = take_frame();
+        if (frame == nullptr) break;
+        ptr_lst.push_back(frame);
+    }
+    assert_msg(!ptr_lst.empty(), "block cache: all frames are pinned");
+    num_lst.resize(ptr_lst.size());
+    io.read_blocks(io.block_path(), num_lst, ptr_lst);
+
+    // missed block is inserted last, so it is the hottest
+    for (size_t i = num_lst.size(); i-- > 0;) {
+        insert(num_lst[i], ptr_lst[i], false, i == 0 ? page_class : DATA_PAGE);
+    }
+    get_stat_stripe().miss_count[page_class]++;
+    Frame &frame = frame_map.at(key);
+    frame.is_new = true;
+    return frame;
+}
+
+Byte *BlockCache::take_frame() {
+    for (size_t i = 0; i < 2 && frame_map.size() >= max_block_count; i++) {
+        // all pinned => cache grows over max until unpinned
+        if (!pop()) break;
+    }
+    if (!free_frame_lst.empty()) {
+        Byte *frame = free_frame_lst.back();
+        free_frame_lst.pop_back();
+        return frame;
+    }
+    if (next_frame < frame_count) {
+        return arena->get_frame(first_frame + next_frame++);
+    }
+    return nullptr;
+}
+
+void BlockCache::insert(BlockNum key, Byte *data, bool is_dirty, PageClass page_class) {
+    mark_stale(key);
+    // data is written before frame is owned, readers don't see it early
+    size_t idx = arena->get_index(data);
+    FrameTag &tag = arena->get_tag(idx);
+    tag.page_class.store(page_class, std::memory_order_relaxed);
+    tag.is_referenced.store(false, std::memory_order_relaxed);
+    tag.owner.store(uint64_t(key) + 1, std::memory_order_release);
+    arena->set_hint(key, idx);
+    frame_map.emplace(key, Frame{data, is_dirty, page_class});
+    policy_lst[page_class]->insert(key);
+    class_count[page_class]++;
+    if (is_dirty) {
+        dirty_count++;
+    }
+}
+
+void BlockCache::set_class(BlockNum key, Frame &frame, PageClass page_class) {
+    if (frame.page_class == page_class) {
+        policy_lst[page_class]->access(key);
+        return;
+    }
+    policy_lst[frame.page_class]->erase(key);
+    class_count[frame.page_class]--;
+    frame.page_class = page_class;
+    get_tag(frame).page_class.store(page_class, std::memory_order_relaxed);
+    policy_lst[page_class]->insert(key);
+    class_count[page_class]++;
+}
+
+std::vector<PageClass> BlockCache::evict_order()const {
+    // index classes over quota are evicted like data
+    size_t quota_lst[PAGE_CLASS_COUNT] = {
+        0,
+        max_block_count * INDEX_LEAF_QUOTA_PERCENT / 100,
+        max_block_count * INDEX_INNER_QUOTA_PERCENT / 100,
+    };
+    std::vector<PageClass> order;
+    for (size_t i = 0; i < PAGE_CLASS_COUNT; i++) {
+        if (class_count[i] > quota_lst[i]) {
+            order.push_back(PageClass(i));
+        }
+    }
+    for (size_t i = 0; i < PAGE_CLASS_COUNT; i++) {
+        if (class_count[i] <= quota_lst[i]) {
+            order.push_back(PageClass(i));
+        }
+    }
+    return order;
+}
+
+std::vector<BlockNum> BlockCache::cold_keys(size_t count)const {
+    std::vector<BlockNum> key_lst;
+    for (PageClass page_class : evict_order()) {
+        if (key_lst.size() >= count) break;
+        auto class_key_lst = policy_lst[page_class]->cold_keys(count - key_lst.size());
+        key_lst.insert(key_lst.end(), class_key_lst.begin(), class_key_lst.end());
+    }
+    return key_lst;
+}
+
+void BlockCache::mark_dirty(Frame &frame) {
+    if (!frame.is_dirty) {
+        frame.is_dirty = true;
+        dirty_count++;
+    }
+}
+
+bool BlockCache::try_lock_frame(Frame &frame) {
+    if (frame.write_pin_count != 0) return false;
+    begin_change(frame);
+    if (get_tag(frame).pin_count.load() == 0) return true;
+    end_change(frame);
+    return false;
+}
+
+void BlockCache::remove_frame(std::unordered_map<BlockNum, Frame>::iterator it) {
+    Byte *frame = it->second.data;
+    size_t idx = arena->get_index(frame);
+    FrameTag &tag = arena->get_tag(idx);
+    tag.owner.store(0, std::memory_order_relaxed);
+    arena->clear_hint(it->first, idx);
+    class_count[it->second.page_class]--;
+    frame_map.erase(it);
+    if (frame_map.size() >= max_block_count) {
+        arena->release(frame);
+    }
+    // version moved, readers of the old block retry
+    tag.version.fetch_add(1);
+    free_frame_lst.push_back(frame);
+}
+
+bool BlockCache::pop() {
+    auto it = frame_map.end();
+    for (PageClass page_class : evict_order()) {
+        apply_reference(page_class);
+        // pinned pages get a second chance
+        auto &&policy = policy_lst[page_class];
+        std::vector<BlockNum> pinned_lst;
+        while (pinned_lst.size() < class_count[page_class]) {
+            BlockNum key = policy->victim();
+            it = frame_map.find(key);
+            if (try_lock_frame(it->second)) break;
+            pinned_lst.push_back(key);
+            it = frame_map.end();
+        }
+        for (BlockNum key : pinned_lst) {
+            policy->requeue(key);
+        }
+        if (it != frame_map.end()) break;
+    }
+    if (it == frame_map.end()) return false;
+
+    if (it->second.is_dirty) {
+        io.write_blocks(io.block_path(), {size_t(it->first)}, {it->second.data});
+        dirty_count--;
+    }
+    remove_frame(it);
+    return true;
+}
+
+void BlockCache::resize(size_t max_block_count) {
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        this->max_block_count = std::min(max_block_count, frame_count);
+        for (auto &&policy : policy_lst) {
+            policy->resize(this->max_block_count);
+        }
+    }
+    if (flusher != nullptr) {
+        flusher->notify();
+    }
+}
+
+size_t BlockCache::trim() {
+    std::lock_guard<std::mutex> lg(mutex);
+    size_t count = 0;
+    while (count < FLUSH_BATCH_COUNT && frame_map.size() > max_block_count && pop()) {
+        count++;
+    }
+    return count;
+}
+
+void BlockCache::unpin(BlockNum key, const Byte *data, bool is_write) {
+    FrameTag &tag = arena->get_tag(arena->get_index(data));
+    if (!is_write) {
+        assert(tag.pin_count > 0);
+        tag.pin_count.fetch_sub(1);
+        return;
+    }
+    std::lock_guard<std::mutex> lg(mutex);
+    Frame &frame = frame_map.at(key);
+    assert(tag.pin_count > 0 && frame.write_pin_count > 0);
+    tag.pin_count.fetch_sub(1);
+    if (--frame.write_pin_count == 0) {
+        end_change(frame);
+    }
+    mark_dirty(frame);
+    if (flusher != nullptr && dirty_count > high_dirty_count()) {
+        flusher->notify();
+    }
+}
+
+// ========== PageRef ==========
+PageRef &PageRef::operator=(PageRef &&ref) noexcept {
+    if (this != &ref) {
+        release();
+        cache = ref.cache;
+        block_num = ref.block_num;
+        ptr = ref.ptr;
+        is_write = ref.is_write;
+        ref.cache = nullptr;
+        ref.ptr = nullptr;
+    }
+    return *this;
+}
+
+void PageRef::release() {
+    if (cache == nullptr) return;
+    cache->unpin(block_num, ptr, is_write);
+    cache = nullptr;
+    ptr = nullptr;
+}
+
+uint64_t PageRef::get_version()const {
+    FrameTag &tag = cache->get_tag(ptr);
+    while (true) {
+        uint64_t version = tag.version.load(std::memory_order_acquire);
+        if (version % 2 == 0) return version;
+        std::this_thread::yield();
+    }
+}
+
+bool PageRef::is_changed(uint64_t version)const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return cache->get_tag(ptr).version.load(std::memory_order_relaxed) != version;
+}
+
+void PageRef::copy_to(Byte *data)const {
+    while (true) {
+        uint64_t version = get_version();
+        std::memcpy(data, ptr, BLOCK_SIZE);
+        if (!is_changed(version)) return;
+    }
+}
+
+// ========== CacheFlusher ==========
+CacheFlusher::CacheFlusher(std::vector<BlockCache*> cache_lst):cache_lst(std::move(cache_lst)) {
+    for (BlockCache *cache : this->cache_lst) {
+        cache->set_flusher(this);
+    }
+    worker = std::thread([this]{run();});
+}
+
+CacheFlusher::~CacheFlusher() {
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        is_stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+    for (BlockCache *cache : cache_lst) {
+        cache->set_flusher(nullptr);
+    }
+}
+
+void CacheFlusher::notify() {
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        is_notified = true;
+    }
+    cv.notify_all();
+}
+
+void CacheFlusher::set_periodic_task(std::chrono::milliseconds interval, std::function<void()> task) {
+    std::lock_guard<std::mutex> lg(mutex);
+    task_interval = interval;
+    periodic_task = std::move(task);
+    task_time = std::chrono::steady_clock::now();
+}
+
+void CacheFlusher::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> ul(mutex);
+            cv.wait_for(ul, FLUSH_INTERVAL, [this]{return is_stop || is_notified;});
+            if (is_stop) return;
+            is_notified = false;
+            auto now = std::chrono::steady_clock::now();
+            if (periodic_task && now - task_time >= task_interval) {
+                task = periodic_task;
+                task_time = now;
+            }
+        }
+        for (BlockCache *cache : cache_lst) {
+            while (cache->trim() == BlockCache::FLUSH_BATCH_COUNT);
+            while (cache->flush_cold() == BlockCache::FLUSH_BATCH_COUNT);
+        }
+        if (task) {
+            task();
+        }
+    }
+}
+
+// ========== ShardedBlockCache ==========
+ShardedBlockCache::ShardedBlockCache(size_t max_block_count, size_t shard_count,
+                                     const std::string &policy, size_t reserve_block_count) {
+    size_t max_shard_count = std::max(max_block_count / MIN_SHARD_BLOCK_COUNT, size_t(1));
+    shard_count = std::min(std::max(shard_count, size_t(1)), max_shard_count);
+    // round down to power of 2
+    while ((size_t(1) << (shard_bits + 1)) <= shard_count) {
+        shard_bits++;
+    }
+    shard_count = size_t(1) << shard_bits;
+
+    // shards split frames of one arena, with room for pinned pages
+    reserve_block_count = std::max(reserve_block_count, max_block_count);
+    size_t shard_frame_count = reserve_block_count / shard_count + MIN_SHARD_BLOCK_COUNT;
+    auto arena = std::make_shared<FrameArena>(shard_frame_count * shard_count);
+    for (size_t i = 0; i < shard_count; i++) {
+        size_t count = max_block_count / shard_count + (i < max_block_count % shard_count ? 1 : 0);
+        shard_lst.push_back(std::make_unique<BlockCache>(arena, i * shard_frame_count, shard_frame_count, count, policy));
+    }
+    std::vector<BlockCache*> cache_lst;
+    for (auto &&shard : shard_lst) {
+        cache_lst.push_back(shard.get());
+    }
+    flusher = std::make_unique<CacheFlusher>(cache_lst);
+}
+
+void ShardedBlockCache::prefetch(const std::vector<BlockNum> &block_num_lst, PageClass page_class) {
+    std::vector<std::vector<BlockNum>> shard_num_lst(shard_lst.size());
+    for (BlockNum num : block_num_lst) {
+        shard_num_lst[shard_index(num)].push_back(num);
+    }
+    for (size_t i = 0; i < shard_lst.size(); i++) {
+        if (!shard_num_lst[i].empty()) {
+            shard_lst[i]->prefetch(shard_num_lst[i], page_class);
+        }
+    }
+}
+
+std::vector<std::pair<BlockNum, PageClass>> ShardedBlockCache::resident_list()const {
+    // no recency order across shards, interleave them
+    std::vector<std::vector<std::pair<BlockNum, PageClass>>> shard_resident_lst;
+    size_t max_len = 0;
+    for (auto &&shard : shard_lst) {
+        shard_resident_lst.push_back(shard->resident_list());
+        max_len = std::max(max_len, shard_resident_lst.back().size());
+    }
+    std::vector<std::pair<BlockNum, PageClass>> resident_lst;
+    for (size_t i = 0; i < max_len; i++) {
+        for (auto &&lst : shard_resident_lst) {
+            if (i < lst.size()) {
+                resident_lst.push_back(lst[i]);
+            }
+        }
+    }
+    return resident_lst;
+}
+
+void ShardedBlockCache::dump_resident(const std::string &file_path)const {
+    std::vector<std::pair<BlockNum, char>> resident_lst;
+    for (auto &&[key, page_class] : resident_list()) {
+        resident_lst.push_back({key, char(page_class)});
+    }
+    IO &io = IO::get();
+    if (!io.has_file(file_path)) {
+        io.create_file(file_path);
+    }
+    io.full_write_file(file_path, sdb::en_bytes(resident_lst));
+}
+
+size_t ShardedBlockCache::warm_up(const std::string &file_path, std::chrono::milliseconds time_limit) {
+    auto deadline = std::chrono::steady_clock::now() + time_limit;
+    IO &io = IO::get();
+    std::vector<std::pair<BlockNum, char>> resident_lst;
+    if (io.has_file(file_path)) {
+        Bytes bytes = io.read_file(file_path);
+        // half written dump is ignored
+        Size len = 0;
+        size_t item_size = sizeof(BlockNum) + sizeof(char);
+        if (bytes.size() >= sizeof(Size)) {
+            std::memcpy(&len, bytes.data(), sizeof(Size));
+        }
+        if (len > 0 && bytes.size() == sizeof(Size) + size_t(len) * item_size) {
+            Size offset = 0;
+            sdb::de_bytes(resident_lst, bytes, offset);
+        }
+    }
+    // more than cache would evict each other
+    resident_lst.resize(std::min(resident_lst.size(), get_max_block_count()));
+    warm_done_count = 0;
+    warm_total_count = resident_lst.size();
+    is_warm_done = false;
+
+    size_t read_count = 0;
+    for (size_t beg = 0; beg < resident_lst.size(); beg += WARM_BATCH_COUNT) {
+        if (std::chrono::steady_clock::now() >= deadline) break;
+        size_t end = std::min(resident_lst.size(), beg + WARM_BATCH_COUNT);
+        std::vector<BlockNum> class_num_lst[PAGE_CLASS_COUNT];
+        for (size_t i = beg; i < end; i++) {
+            auto &&[num, page_class] = resident_lst[i];
+            if (page_class >= 0 && page_class < PAGE_CLASS_COUNT) {
+                class_num_lst[size_t(page_class)].push_back(num);
+            }
+        }
+        for (size_t i = 0; i < PAGE_CLASS_COUNT; i++) {
+            std::sort(class_num_lst[i].begin(), class_num_lst[i].end());
+            prefetch(class_num_lst[i], PageClass(i));
+        }
+        read_count += end - beg;
+        warm_done_count = read_count;
+    }
+    is_warm_done = true;
+    return read_count;
+}
+
+void ShardedBlockCache::set_dump_task(const std::string &file_path, std::chrono::milliseconds interval) {
+    flusher->set_periodic_task(interval, [this, file_path]{dump_resident(file_path);});
+}
+
+void ShardedBlockCache::sync() {
+    for (auto &&shard : shard_lst) {
+        shard->sync();
+    }
+}
+
+void ShardedBlockCache::resize(size_t max_block_count) {
+    size_t shard_count = shard_lst.size();
+    for (size_t i = 0; i < shard_count; i++) {
+        size_t count = max_block_count / shard_count + (i < max_block_count % shard_count ? 1 : 0);
+        shard_lst[i]->resize(count);
+    }
+}
+
+size_t ShardedBlockCache::get_max_block_count()const {
+    size_t count = 0;
+    for (auto &&shard : shard_lst) {
+        count += shard->get_max_block_count();
+    }
+    return count;
+}
+
+CacheStats ShardedBlockCache::get_stats(PageClass page_class)const {
+    CacheStats stats;
+    for (auto &&shard : shard_lst) {
+        CacheStats shard_stats = shard->get_stats(page_class);
+        stats.hit_count += shard_stats.hit_count;
+        stats.miss_count += shard_stats.miss_count;
+    }
+    return stats;
+}
+
+size_t ShardedBlockCache::get_block_count()const {
+    size_t count = 0;
+    for (auto &&shard : shard_lst) {
+        count += shard->get_block_count();
+    }
+    return count;
+}
+
+size_t ShardedBlockCache::shard_index(BlockNum block_num)const {
+    if (shard_bits == 0) return 0;
+    // fibonacci hashing, spread adjacent runs over shards
+    uint64_t run = uint64_t(block_num) / BlockCache::RUN_BLOCK_COUNT;
+    return size_t((run * 0x9E3779B97F4A7C15ull) >> (64 - shard_bits));
+}
+
+// ========== ScanRing ==========
+ScanRing::ScanRing(ShardedBlockCache &cache, size_t block_count)
+        :cache(cache), frames(std::max(block_count, size_t(2)) * BLOCK_SIZE),
+         key_lst(std::max(block_count, size_t(2)), -1) {}
+
+void ScanRing::prefetch(const std::vector<BlockNum> &block_num_lst) {
+    std::vector<BlockNum> miss_lst;
+    for (BlockNum num : block_num_lst) {
+        if (slot_map.find(num) == slot_map.end()) {
+            miss_lst.push_back(num);
+        }
+    }
+    std::sort(miss_lst.begin(), miss_lst.end());
+    miss_lst.erase(std::unique(miss_lst.begin(), miss_lst.end()), miss_lst.end());
+    if (miss_lst.size() > key_lst.size() / 2) {
+        miss_lst.resize(key_lst.size() / 2);
+    }
+
+    // cached blocks may be newer than file
+    AioBatch batch;
+    for (BlockNum num : miss_lst) {
+        Byte *frame = frames.data() + take_slot(num) * BLOCK_SIZE;
+        if (!cache.peek(num, frame)) {
+            // blocks out of file are read short, keep them zero
+            std::memset(frame, 0, BLOCK_SIZE);
+            batch.read(num, frame);
+        }
+    }
+    if (batch.req_lst.empty()) return;
+    AsyncIO::get().execute(io.get_mmap_file(io.block_path()), batch);
+    read_count += batch.req_lst.size();
+}
+
+BytesView ScanRing::read(BlockNum block_num) {
+    auto it = slot_map.find(block_num);
+    if (it == slot_map.end()) {
+        prefetch({block_num});
+        it = slot_map.find(block_num);
+    }
+    return BytesView(frames.data() + it->second * BLOCK_SIZE, BLOCK_SIZE);
+}
+
+BytesView ScanRing::put(BlockNum block_num, BytesView data) {
+    assert(data.size() == BLOCK_SIZE);
+    auto it = slot_map.find(block_num);
+    size_t slot = it == slot_map.end() ? take_slot(block_num) : it->second;
+    Byte *frame = frames.data() + slot * BLOCK_SIZE;
+    std::memcpy(frame, data.data(), BLOCK_SIZE);
+    return BytesView(frame, BLOCK_SIZE);
+}
+
+size_t ScanRing::take_slot(BlockNum block_num) {
+    size_t slot = next_slot;
+    next_slot = (next_slot + 1) % key_lst.size();
+    if (key_lst[slot] != -1) {
+        slot_map.erase(key_lst[slot]);
+    }
+    key_lst[slot] = block_num;
+    slot_map[block_num] = slot;
+    return slot;
+}
+
+// ========== CacheMaster ==========
+ShardedBlockCache &CacheMaster::get_block_cache() {
+    static ShardedBlockCache cache = []()->ShardedBlockCache {
+        Config &config = Config::get();
+        size_t reserve_size = config.cache_max_size;
+        if (reserve_size == 0) {
+            // up to physical memory
+            reserve_size = size_t(sysconf(_SC_PHYS_PAGES)) * size_t(sysconf(_SC_PAGESIZE));
+        }
+        return ShardedBlockCache(config.cache_size / BLOCK_SIZE, std::thread::hardware_concurrency(),
+                                 config.cache_policy, reserve_size / BLOCK_SIZE);
+    }();
+    return cache;
+}
+
+void CacheMaster::warm_up() {
+    Config &config = Config::get();
+    IO &io = IO::get();
+    ShardedBlockCache &cache = get_block_cache();
+    auto time_limit = std::chrono::seconds(config.cache_warm_time);
+    cache.warm_up(io.warm_path(), time_limit);
+    if (config.cache_warm_interval > 0) {
+        cache.set_dump_task(io.warm_path(), std::chrono::seconds(config.cache_warm_interval));
+    }
 }
 
 } // namespace sdb
@@ -6,12 +6,19 @@
 #define DB_CACHE_H
 
 #include <memory>
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <unordered_map>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
 
 #include "util.h"
 #include "io.h"
+#include "config.h"
+#include "replace_policy.h"
 
 namespace sdb {
 
@@ -25,61 +32,537 @@ namespace sdb {
 // };
 // 
 
+class CacheFlusher;
+class BlockCache;
+
+// cache priority class, lower class is evicted first.
+// index classes are only protected up to their quota of the cache
+enum PageClass : char { DATA_PAGE, INDEX_LEAF_PAGE, INDEX_INNER_PAGE, PAGE_CLASS_COUNT };
+
+struct CacheStats {
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+
+    double hit_rate()const {
+        size_t count = hit_count + miss_count;
+        return count == 0 ? 0 : double(hit_count) / count;
+    }
+};
+
+// state of a frame shared with lock free readers
+struct alignas(64) FrameTag {
+    // odd while frame is being changed under cache lock,
+    // readers retry by lock if it moved while they copied
+    std::atomic<uint64_t> version;
+    // block num + 1 of frame, 0 => no block
+    std::atomic<uint64_t> owner;
+    // read pins, frame with pins is never evicted
+    std::atomic<uint32_t> pin_count;
+    std::atomic<char> page_class;
+    // CLOCK reference bit, set by lock free hits
+    std::atomic<bool> is_referenced;
+};
+
+// cache frames carved from one anonymous mapping reserved up front,
+// pages are only backed by memory once touched.
+// arena also keeps a tag per frame and a block => frame hint table,
+// so hits find their frame without cache lock.
+// zero filled memory is an empty tag and an empty hint.
+class FrameArena {
+public:
+    explicit FrameArena(size_t frame_count);
+    FrameArena(const FrameArena &)=delete;
+    FrameArena(FrameArena &&)=delete;
+    FrameArena &operator=(const FrameArena &)=delete;
+    FrameArena &operator=(FrameArena &&)=delete;
+    ~FrameArena();
+
+    // give memory of frame back to os, frame reads as zero after
+    void release(Byte *frame);
+
+    // hint: one frame per slot, may be stale or overwritten by another block,
+    // readers check owner of frame tag.
+    // return frame index, or -1 if none
+    int64_t find_hint(BlockNum block_num)const {
+        return int64_t(hint_lst[hint_index(block_num)].load(std::memory_order_acquire)) - 1;
+    }
+    void set_hint(BlockNum block_num, size_t idx) {
+        hint_lst[hint_index(block_num)].store(idx + 1, std::memory_order_release);
+    }
+    // only if slot still points to idx
+    void clear_hint(BlockNum block_num, size_t idx) {
+        uint64_t expect = idx + 1;
+        hint_lst[hint_index(block_num)].compare_exchange_strong(expect, 0);
+    }
+
+    // get
+    size_t get_frame_count()const {return frame_count;}
+    Byte *get_frame(size_t idx)const {
+        assert(idx < frame_count);
+        return base + idx * BLOCK_SIZE;
+    }
+    size_t get_index(const Byte *frame)const {
+        return size_t(frame - base) / BLOCK_SIZE;
+    }
+    FrameTag &get_tag(size_t idx)const {
+        assert(idx < frame_count);
+        return tag_lst[idx];
+    }
+
+private:
+    size_t hint_index(BlockNum block_num)const {
+        // fibonacci hashing
+        return size_t((uint64_t(block_num) * 0x9E3779B97F4A7C15ull) >> (64 - hint_bits));
+    }
+
+private:
+    Byte *base;
+    size_t frame_count;
+    FrameTag *tag_lst;
+    // 2^hint_bits slots, frame index + 1, 0 => empty
+    std::atomic<uint64_t> *hint_lst;
+    size_t hint_bits;
+};
+
+// pinned cache page, the page is never evicted while pinned.
+// read or write bytes in place, no copy out of cache.
+// callers latch the block themselves, as with get/put.
+class PageRef {
+public:
+    PageRef()=default;
+    PageRef(const PageRef &)=delete;
+    PageRef &operator=(const PageRef &)=delete;
+    PageRef(PageRef &&ref) noexcept {
+        *this = std::move(ref);
+    }
+    PageRef &operator=(PageRef &&ref) noexcept;
+    ~PageRef() {
+        release();
+    }
+
+    // unpin, mark page dirty if pinned for write
+    void release();
+    // optimistic read in place of a page others may put meanwhile:
+    // version before reading, waits while page is being changed,
+    // page is unchanged if is_changed(version) is false after reading
+    uint64_t get_version()const;
+    bool is_changed(uint64_t version)const;
+    // copy of page no put changed while it was copied
+    void copy_to(Byte *data)const;
+
+    // get
+    explicit operator bool()const {return cache != nullptr;}
+    BlockNum get_block_num()const {return block_num;}
+    const Byte *data()const {return ptr;}
+    BytesView view()const {return BytesView(ptr, BLOCK_SIZE);}
+    // only if pinned for write
+    Byte *mutable_data() {
+        assert(is_write);
+        return ptr;
+    }
+
+private:
+    friend class BlockCache;
+    PageRef(BlockCache *cache, BlockNum block_num, Byte *ptr, bool is_write)
+        :cache(cache), block_num(block_num), ptr(ptr), is_write(is_write){}
+
+private:
+    BlockCache *cache = nullptr;
+    BlockNum block_num = -1;
+    Byte *ptr = nullptr;
+    bool is_write = false;
+};
+
+// hits of get() and read pin() take no lock:
+//     frame is found by hint table of arena and checked by its tag,
+//     get() copies it and checks tag version didn't move,
+//     pin() counts a pin in tag, evictor bumps version before checking pins.
+// lock free hits only set reference bit of frame (CLOCK),
+// bits are replayed as accesses of replace policy before eviction.
+// misses, puts and write pins go by lock.
 class BlockCache {
 public:
-    struct CacheValue {
-        BlockNum key;
-        Bytes data;
-        CacheValue()=delete;
-        CacheValue(BlockNum key, Bytes data):key(key), data(data){}
-    };
-    using ValueList = std::list<CacheValue>;
+    // blocks of one aligned run share a shard of ShardedBlockCache,
+    // read ahead never passes the end of run
+    static constexpr size_t RUN_BLOCK_COUNT = 16;
+    // lock is held while writing a flush batch, keep it short
+    static constexpr size_t FLUSH_BATCH_COUNT = 16;
 
-    explicit BlockCache(size_t max_block_count):max_block_count(max_block_count){}
+    // policy: name of ReplacePolicy, "lru" or "2q".
+    // own arena of 2 * max_block_count frames, room to grow and for pinned pages
+    explicit BlockCache(size_t max_block_count, const std::string &policy = "lru");
+    // use frames [first_frame, first_frame + frame_count) of shared arena
+    BlockCache(std::shared_ptr<FrameArena> arena, size_t first_frame, size_t frame_count,
+               size_t max_block_count, const std::string &policy);
     BlockCache(const BlockCache &)=delete;
     BlockCache(BlockCache &&)=delete;
     BlockCache &operator=(const BlockCache &)=delete;
     BlockCache &operator=(BlockCache &&)=delete;
 
     // get and put
-    Bytes get(BlockNum block_num);
-    void put(BlockNum block_num, const Bytes &data);
+    Bytes get(BlockNum block_num, PageClass page_class = DATA_PAGE);
+    void put(BlockNum block_num, BytesView data, PageClass page_class = DATA_PAGE);
+    // pin page, read it first if missed
+    PageRef pin(BlockNum block_num, bool is_write = false, PageClass page_class = DATA_PAGE);
+    // raise class of cached block, e.g. once a node is known to be inner
+    void upgrade(BlockNum block_num, PageClass page_class);
+    // read missing blocks in one async batch
+    void prefetch(const std::vector<BlockNum> &block_num_lst, PageClass page_class = DATA_PAGE);
+    // copy block to data if cached, recency and stats untouched.
+    // waits while block is pinned for write
+    bool peek(BlockNum block_num, Byte *data);
+    // drop block without write back, e.g. block freed and file cut before it.
+    // return false if block is pinned
+    bool discard(BlockNum block_num);
 
-    // sync all cache
+    // sync all dirty blocks
     void sync();
     // sync file
-    // sync block
+    // sync block if dirty
     void sync(BlockNum block_num);
 
-    // for test
-    ValueList _value_list()const {
-        return value_list;
+    // write back at most FLUSH_BATCH_COUNT dirty blocks:
+    //     dirty blocks among the coldest 1/8 cache, so eviction finds clean victims,
+    //     and coldest dirty blocks until dirty count under low watermark if above high.
+    // return count of blocks written
+    size_t flush_cold();
+    // wake flusher when dirty count is above high watermark
+    void set_flusher(CacheFlusher *flusher) {
+        this->flusher = flusher;
     }
 
+    // change max block count at runtime, at most frame count of arena.
+    // growing is free, shrinking evicts gradually by trim() and later misses
+    void resize(size_t max_block_count);
+    // evict at most FLUSH_BATCH_COUNT blocks over max block count,
+    // return count of blocks evicted
+    size_t trim();
+
+    // get
+    size_t get_dirty_count() {
+        std::lock_guard<std::mutex> lg(mutex);
+        return dirty_count;
+    }
+    size_t get_block_count() {
+        std::lock_guard<std::mutex> lg(mutex);
+        return frame_map.size();
+    }
+    size_t get_max_block_count() {
+        std::lock_guard<std::mutex> lg(mutex);
+        return max_block_count;
+    }
+    size_t get_frame_count()const {
+        return frame_count;
+    }
+    CacheStats get_stats(PageClass page_class)const;
+
+    // cached blocks and class, hottest first: inner, leaf, data, by recency in class
+    std::vector<std::pair<BlockNum, PageClass>> resident_list();
+    // for test, cached blocks hottest first
+    std::vector<BlockNum> _key_list();
+
 private:
-    // block io
-    Bytes read_block(const std::string &path, size_t block_num);
+    // blocks read ahead by one miss at most
+    static constexpr size_t READ_AHEAD_COUNT = 8;
+    // quota of cache protected for index classes
+    static constexpr size_t INDEX_LEAF_QUOTA_PERCENT = 50;
+    static constexpr size_t INDEX_INNER_QUOTA_PERCENT = 25;
 
-    // pop
-    void pop();
+    // stat counters striped by thread, hits of many threads don't share a line
+    static constexpr size_t STAT_STRIPE_COUNT = 16;
+
+    struct Frame {
+        // BLOCK_SIZE bytes in arena
+        Byte *data;
+        bool is_dirty;
+        PageClass page_class;
+        // read pins are counted by tag.
+        // pages pinned for write are not flushed, they may be half written
+        size_t write_pin_count = 0;
+        // loaded by a miss and not hit by lock since,
+        // the miss is counted again under the class it is upgraded to
+        bool is_new = false;
+    };
+
+    struct alignas(64) StatStripe {
+        std::atomic<size_t> hit_count[PAGE_CLASS_COUNT] = {};
+        std::atomic<size_t> miss_count[PAGE_CLASS_COUNT] = {};
+    };
+
+    size_t high_dirty_count()const {return max_block_count / 2;}
+    size_t low_dirty_count()const {return max_block_count / 4;}
+
+    // === lock free hit ===
+    // frame index of cached block with at least page class, -1 if not found
+    int64_t find_frame(BlockNum key, PageClass page_class, uint64_t &version)const;
+    // copy cached block without lock, false => go by lock
+    bool try_get(BlockNum key, PageClass page_class, Byte *data);
+    // pin cached block for read without lock, nullptr => go by lock
+    Byte *try_pin(BlockNum key, PageClass page_class);
+    FrameTag &get_tag(const Byte *data)const {
+        return arena->get_tag(arena->get_index(data));
+    }
+    FrameTag &get_tag(const Frame &frame)const {
+        return get_tag(frame.data);
+    }
+    // frame is changed between begin and end, lock free readers retry
+    void begin_change(const Frame &frame) {
+        get_tag(frame).version.fetch_add(1);
+    }
+    void end_change(const Frame &frame) {
+        get_tag(frame).version.fetch_add(1);
+    }
+    // replay reference bits of lock free hits as accesses, coldest first,
+    // until the coldest block of class is unreferenced
+    void apply_reference(PageClass page_class);
+    StatStripe &get_stat_stripe();
+
+    // frame of block, read it first if missed
+    Frame &load(BlockNum key, PageClass page_class);
+    // free frame, evict if full.
+    // evict one more while over max block count, so shrinking goes on with misses.
+    // return nullptr if all frames are pinned
+    Byte *take_frame();
+    void insert(BlockNum key, Byte *data, bool is_dirty, PageClass page_class);
+    // block is cached or dropped by others while prefetch reads it,
+    // prefetch drops what it read
+    void mark_stale(BlockNum key) {
+        auto it = prefetch_map.find(key);
+        if (it != prefetch_map.end()) {
+            it->second = true;
+        }
+    }
+    void set_class(BlockNum key, Frame &frame, PageClass page_class);
+    // lowest class to evict from
+    std::vector<PageClass> evict_order()const;
+    std::vector<BlockNum> cold_keys(size_t count)const;
+    void mark_dirty(Frame &frame);
+    // lock free pinners check version after counting their pin,
+    // return false and leave frame unchanged if it is pinned
+    bool try_lock_frame(Frame &frame);
+    // detach frame from block and free it, policy is updated by caller
+    void remove_frame(std::unordered_map<BlockNum, Frame>::iterator it);
+    // pop unpinned victim, write back only if dirty.
+    // frame memory is given back to os if cache is over max.
+    // return false if all pages are pinned
+    bool pop();
+    friend class PageRef;
+    void unpin(BlockNum key, const Byte *data, bool is_write);
 
 private:
     // max cache block
     size_t max_block_count;
     // full mutex
-    std::mutex mutex;
-    // block cache data list
-    ValueList value_list;
-    std::unordered_map<BlockNum, ValueList::iterator> key_map;
+    mutable std::mutex mutex;
+    // block aligned frames, cache is the only buffer of block in direct io
+    std::shared_ptr<FrameArena> arena;
+    size_t first_frame;
+    size_t frame_count;
+    // frames never used are taken by next_frame first
+    size_t next_frame = 0;
+    std::vector<Byte*> free_frame_lst;
+    std::unordered_map<BlockNum, Frame> frame_map;
+    // <block num being read by prefetch, is stale>
+    std::unordered_map<BlockNum, bool> prefetch_map;
+    size_t dirty_count = 0;
+    // one replace policy per class
+    std::unique_ptr<ReplacePolicy> policy_lst[PAGE_CLASS_COUNT];
+    size_t class_count[PAGE_CLASS_COUNT] = {};
+    StatStripe stat_lst[STAT_STRIPE_COUNT];
+    CacheFlusher *flusher = nullptr;
     // io
     IO &io = IO::get();
 };
 
+// background writer of block caches,
+// trickles cold dirty blocks to disk every FLUSH_INTERVAL,
+// or at once when a cache passes its high watermark
+class CacheFlusher {
+public:
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(100);
+
+    explicit CacheFlusher(std::vector<BlockCache*> cache_lst);
+    CacheFlusher(const CacheFlusher &)=delete;
+    CacheFlusher(CacheFlusher &&)=delete;
+    CacheFlusher &operator=(const CacheFlusher &)=delete;
+    CacheFlusher &operator=(CacheFlusher &&)=delete;
+    ~CacheFlusher();
+
+    void notify();
+    // run task by flusher thread every interval
+    void set_periodic_task(std::chrono::milliseconds interval, std::function<void()> task);
+
+private:
+    void run();
+
+private:
+    std::vector<BlockCache*> cache_lst;
+    std::function<void()> periodic_task;
+    std::chrono::milliseconds task_interval{0};
+    std::chrono::steady_clock::time_point task_time;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool is_notified = false;
+    bool is_stop = false;
+    std::thread worker;
+};
+
+// progress of buffer pool warm up
+struct WarmProgress {
+    size_t done_count = 0;
+    size_t total_count = 0;
+    bool is_done = false;
+};
+
+// block cache split into independent shards by block run,
+// each shard has its own lock and replace policy
+class ShardedBlockCache {
+public:
+    // a shard holds MIN_SHARD_BLOCK_COUNT blocks at least,
+    // so shard count is lowered for a small cache
+    static constexpr size_t MIN_SHARD_BLOCK_COUNT = 16;
+
+    // frames for reserve_block_count blocks are reserved, so cache can grow to it
+    ShardedBlockCache(size_t max_block_count, size_t shard_count,
+                      const std::string &policy = "lru", size_t reserve_block_count = 0);
+    ShardedBlockCache(const ShardedBlockCache &)=delete;
+    ShardedBlockCache(ShardedBlockCache &&)=delete;
+    ShardedBlockCache &operator=(const ShardedBlockCache &)=delete;
+    ShardedBlockCache &operator=(ShardedBlockCache &&)=delete;
+
+    // get and put
+    Bytes get(BlockNum block_num, PageClass page_class = DATA_PAGE) {
+        return get_shard(block_num).get(block_num, page_class);
+    }
+    void put(BlockNum block_num, BytesView data, PageClass page_class = DATA_PAGE) {
+        get_shard(block_num).put(block_num, data, page_class);
+    }
+    PageRef pin(BlockNum block_num, bool is_write = false, PageClass page_class = DATA_PAGE) {
+        return get_shard(block_num).pin(block_num, is_write, page_class);
+    }
+    void upgrade(BlockNum block_num, PageClass page_class) {
+        get_shard(block_num).upgrade(block_num, page_class);
+    }
+    void prefetch(const std::vector<BlockNum> &block_num_lst, PageClass page_class = DATA_PAGE);
+    bool peek(BlockNum block_num, Byte *data) {
+        return get_shard(block_num).peek(block_num, data);
+    }
+    bool discard(BlockNum block_num) {
+        return get_shard(block_num).discard(block_num);
+    }
+
+    // === warm up ===
+    // blocks read per batch while warming up
+    static constexpr size_t WARM_BATCH_COUNT = 1024;
+    // resident blocks of all shards, shard lists interleaved
+    std::vector<std::pair<BlockNum, PageClass>> resident_list()const;
+    // dump resident list to file:
+    //     |len (block_num class)...|
+    void dump_resident(const std::string &file_path)const;
+    // prefetch blocks dumped by dump_resident, hottest batch first,
+    // every batch sorted by block num, stop at time limit.
+    // return count of blocks read
+    size_t warm_up(const std::string &file_path, std::chrono::milliseconds time_limit);
+    WarmProgress get_warm_progress()const {
+        return {warm_done_count, warm_total_count, is_warm_done};
+    }
+    // dump resident list by flusher every interval
+    void set_dump_task(const std::string &file_path, std::chrono::milliseconds interval);
+
+    // sync all shards
+    void sync();
+    // change max block count at runtime, at most reserved block count.
+    // shards over new max are trimmed by flusher
+    void resize(size_t max_block_count);
+    // sync block
+    void sync(BlockNum block_num) {
+        get_shard(block_num).sync(block_num);
+    }
+
+    // get
+    size_t get_shard_count()const {
+        return shard_lst.size();
+    }
+    size_t get_max_block_count()const;
+    size_t get_block_count()const;
+    // summed over shards
+    CacheStats get_stats(PageClass page_class)const;
+    BlockCache &get_shard(BlockNum block_num) {
+        return *shard_lst[shard_index(block_num)];
+    }
+
+private:
+    size_t shard_index(BlockNum block_num)const;
+
+private:
+    // power of 2
+    std::vector<std::unique_ptr<BlockCache>> shard_lst;
+    size_t shard_bits = 0;
+    // stopped before shards destroyed
+    std::unique_ptr<CacheFlusher> flusher;
+    // warm up
+    std::atomic<size_t> warm_done_count{0};
+    std::atomic<size_t> warm_total_count{0};
+    std::atomic<bool> is_warm_done{false};
+};
+
+// private frames of one large scan, reused round robin.
+// blocks touched once by a scan are read into the ring,
+// cached blocks are copied out of cache without becoming hotter,
+// so a scan never evicts the working set of cache.
+// not thread safe, one ring per scan.
+class ScanRing {
+public:
+    // 64 blocks => 256KB
+    static constexpr size_t RING_BLOCK_COUNT = 64;
+
+    explicit ScanRing(ShardedBlockCache &cache, size_t block_count = RING_BLOCK_COUNT);
+    ScanRing(const ScanRing &)=delete;
+    ScanRing &operator=(const ScanRing &)=delete;
+
+    // load missing blocks into ring in one async batch,
+    // at most half ring, so blocks loaded by last batch stay
+    void prefetch(const std::vector<BlockNum> &block_num_lst);
+    // view of block in ring, load it if missing.
+    // valid until the slot is reused
+    BytesView read(BlockNum block_num);
+    // copy data into ring as block, e.g. private block of snapshot
+    BytesView put(BlockNum block_num, BytesView data);
+
+    // get
+    size_t get_slot_count()const {
+        return key_lst.size();
+    }
+    size_t get_read_count()const {
+        return read_count;
+    }
+
+private:
+    // reuse the oldest slot for block
+    size_t take_slot(BlockNum block_num);
+
+private:
+    ShardedBlockCache &cache;
+    IO &io = IO::get();
+    AlignedBytes frames;
+    // key_lst[slot] => block num in slot, -1 if empty
+    std::vector<BlockNum> key_lst;
+    std::unordered_map<BlockNum, size_t> slot_map;
+    size_t next_slot = 0;
+    // blocks read from file by ring
+    size_t read_count = 0;
+};
+
 class CacheMaster {
 public:
-    static BlockCache &get_block_cache() {
-        static BlockCache cache(100);
-        return cache;
+    // sized by cache_size and cache_max_size of config
+    static ShardedBlockCache &get_block_cache();
+    // load hot blocks dumped by last run, bounded by cache_warm_time of config
+    // progress is read by get_warm_progress of the cache
+    static void warm_up();
+    // resize buffer pool at runtime
+    static void set_cache_size(size_t byte_count) {
+        get_block_cache().resize(byte_count / BLOCK_SIZE);
     }
 };
 
@@ -0,0 +1,86 @@
+#include <fstream>
+
+#include "config.h"
+#include "io.h"
+#include "../cpp_util/lib/error.hpp"
+
+using namespace cpp_util;
+
+namespace sdb {
+
+Config &Config::get() {
+    static Config config = []{
+        Config c;
+        IO &io = IO::get();
+        if (io.has_file(io.config_path())) {
+            c.load(io.get_db_file_path(io.config_path()));
+        }
+        return c;
+    }();
+    return config;
+}
+
+void Config::load(const std::string &abs_path) {
+    std::ifstream in(abs_path);
+    assert_msg(in.is_open(), abs_path);
+    auto trim = [](const std::string &str) {
+        size_t beg = str.find_first_not_of(" \t");
+        if (beg == std::string::npos) return std::string();
+        size_t end = str.find_last_not_of(" \t\r");
+        return str.substr(beg, end - beg + 1);
+    };
+    std::string line;
+    while (std::getline(in, line)) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        size_t pos = line.find('=');
+        assert_msg(pos != std::string::npos, format("config: bad line [%s]", line));
+        set(trim(line.substr(0, pos)), trim(line.substr(pos + 1)));
+    }
+}
+
+size_t Config::parse_size(const std::string &value) {
+    size_t pos = 0;
+    size_t size = std::stoull(value, &pos);
+    std::string unit = value.substr(pos);
+    if (unit == "K" || unit == "k") {
+        size <<= 10;
+    } else if (unit == "M" || unit == "m") {
+        size <<= 20;
+    } else if (unit == "G" || unit == "g") {
+        size <<= 30;
+    } else {
+        assert_msg(unit.empty(), format("config: bad size [%s]", value));
+    }
+    return size;
+}
+
+// ========== private ==========
+void Config::set(const std::string &key, const std::string &value) {
+    if (key == "direct_io") {
+        direct_io = value == "1" || value == "true";
+    } else if (key == "file_extent_blocks") {
+        file_extent_blocks = std::stoul(value);
+    } else if (key == "cache_policy") {
+        cache_policy = value;
+    } else if (key == "cache_size") {
+        cache_size = parse_size(value);
+    } else if (key == "cache_max_size") {
+        cache_max_size = parse_size(value);
+    } else if (key == "cache_warm_interval") {
+        cache_warm_interval = std::stoul(value);
+    } else if (key == "cache_warm_time") {
+        cache_warm_time = std::stoul(value);
+    } else if (key == "vacuum_interval") {
+        vacuum_interval = std::stoul(value);
+    } else if (key == "vacuum_merge_count") {
+        vacuum_merge_count = std::stoul(value);
+    } else if (key == "bulk_load_fill") {
+        bulk_load_fill = std::stoul(value);
+    } else if (key == "sort_memory") {
+        sort_memory = parse_size(value);
+    }
+    // unknown options are ignored
+}
+
+} // namespace sdb
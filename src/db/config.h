@@ -0,0 +1,64 @@
+#ifndef DB_CONFIG_H
+#define DB_CONFIG_H
+
+#include <string>
+
+#include "util.h"
+
+namespace sdb {
+
+// database config, read from config.sdb in db dir
+//
+// file format, one option per line:
+//     # comment
+//     direct_io = 1
+//     file_extent_blocks = 2048
+//     cache_policy = 2q
+//     cache_size = 4G
+//
+// missing file or option => default value
+struct Config {
+    static Config &get();
+
+    // open block.sdb with O_DIRECT,
+    // blocks are only buffered by BlockCache, not by kernel page cache
+    bool direct_io = false;
+
+    // block.sdb grows by this many blocks at once, 8MB by default
+    size_t file_extent_blocks = 2048;
+
+    // block cache replace policy, "lru" or "2q"(scan resistant, opt-in)
+    std::string cache_policy = "lru";
+
+    // buffer pool size in bytes, K/M/G suffix allowed
+    size_t cache_size = size_t(64) * 1024 * 1024;
+    // frames reserved for growing buffer pool at runtime, 0 => physical memory
+    size_t cache_max_size = 0;
+    // seconds between dumps of hot block list, 0 => never
+    size_t cache_warm_interval = 60;
+    // max seconds spent loading hot blocks at start
+    size_t cache_warm_time = 30;
+
+    // seconds between vacuum rounds, 0 => never, opt-in
+    size_t vacuum_interval = 0;
+    // max record blocks and nodes freed per table in one round
+    size_t vacuum_merge_count = 64;
+
+    // percent of record block and index node filled by bulk load,
+    // room left for later inserts
+    size_t bulk_load_fill = 90;
+    // bytes of tuples sorted in memory by bulk load before a run is written to file
+    size_t sort_memory = size_t(64) * 1024 * 1024;
+
+    void load(const std::string &abs_path);
+
+    // "512", "64K", "16M", "4G" => bytes
+    static size_t parse_size(const std::string &value);
+
+private:
+    void set(const std::string &key, const std::string &value);
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_CONFIG_H */
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "db.h"
 
 #include "io.h"
@@ -5,19 +7,31 @@
 #include "table.h"
 #include "cache.h"
 #include "block_alloc.h"
+#include "snapshot.h"
+#include "config.h"
+#include "../cpp_util/lib/log.hpp"
 
 namespace sdb {
 
-DB::DB(const std::string &db_name):db_name(db_name), t_log_ptr(std::make_shared<Tlog>(db_name)) {
-    // init db io
+DB::DB(const std::string &db_name):db_name(db_name) {
+    // init db io, log is opened under its dir
     IO::get(db_name);
-    add_table_list();
-    add_col_list();
-    // add_index();
+    t_log_ptr = std::make_shared<Tlog>();
+    // load hot blocks of last run before serving
+    CacheMaster::warm_up();
+    for (auto &&tp : {table_list_property(), col_list_property(), index_property()}) {
+        set_table(tp.table_name, std::make_shared<Table>(tp));
+    }
     // add_reference();
-    for (auto &&tn : table_name_lst(TransInfo())) {
-        TableProperty tp = get_tp(TransInfo(), tn);
-        table_map[tn] = std::make_shared<Table>(tp);
+    TransInfo t_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    for (auto &&tn : table_name_lst(t_info)) {
+        TableProperty tp = get_tp(t_info, tn);
+        set_table(tn, std::make_shared<Table>(tp));
+    }
+    // merge under-full records left by deletes in background
+    size_t vacuum_interval = Config::get().vacuum_interval;
+    if (vacuum_interval > 0) {
+        vacuum_ptr = std::make_unique<Vacuum>(std::chrono::seconds(vacuum_interval), [this]{vacuum();});
     }
 }
 
@@ -27,6 +41,7 @@ void DB::create_db(const std::string &db_name) {
     io.create_dir(db_name);
     io.create_file(db_name + "/block.sdb");
     io.create_file(db_name + "/log.sdb");
+    create_catalog();
 }
 
 void DB::drop_db(const std::string &db_name){
@@ -36,25 +51,175 @@ void DB::drop_db(const std::string &db_name){
     io.delete_file(db_name + "/log.sdb");
 }
 
+void DB::create_catalog() {
+    for (auto &&tp : {table_list_property(), col_list_property(), index_property()}) {
+        BpTree::build(tp);
+    }
+}
+
+void DB::shrink() {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    // used blocks would all fit before limit,
+    // as many holes are before it as used blocks are after it
+    BlockNum limit = BlockNum(block_alloc.get_used_count());
+    for (auto &&[table_name, ptr] : get_table_lst()) {
+        // catalog readers take no table lock, old blocks of meta tables can't be known unused
+        if (table_name.front() == '.') continue;
+        boost::upgrade_lock<boost::upgrade_mutex> ul(get_mutex(table_name));
+        // dropped or bulk loaded since list was taken
+        if (get_table(table_name) != ptr) continue;
+        // writers hold write mutex till commit, table being written stays as it is
+        std::unique_lock<std::shared_mutex> wl(ptr->get_write_mutex(), std::try_to_lock);
+        if (!wl.owns_lock()) continue;
+        std::vector<BlockNum> old_lst = ptr->relocate(limit);
+        // a reader of table may write next, it waits on write mutex while holding table lock,
+        // so write mutex is let go before waiting for readers
+        wl.unlock();
+        if (old_lst.empty()) continue;
+        // readers still on old blocks are gone once lock is unique
+        boost::upgrade_to_unique_lock<boost::upgrade_mutex> uul(ul);
+        block_alloc.free_blocks(old_lst);
+    }
+    // old blocks are free once new places are on disk
+    checkpoint();
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    size_t block_count = block_alloc.truncate([&cache](BlockNum num){return cache.discard(num);});
+    cpp_util::log(cpp_util::format("block.sdb shrinks to %s blocks", block_count));
+}
+
+void DB::checkpoint() {
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    BlockAlloc::get().sync([&cache]{cache.sync();});
+}
+
+void DB::bulk_load(const std::string &table_name, TupleSource next, bool is_sorted) {
+    // readers and writers of table wait till new table is published
+    boost::unique_lock<boost::upgrade_mutex> ul(get_mutex(table_name));
+    TablePtr old_ptr = get_table(table_name);
+    if (old_ptr == nullptr) {
+        throw TableNotFound(table_name);
+    }
+    TransInfo t_info{get_new_tid(), TransInfo::READ, std::make_shared<Snapshot>(), t_log_ptr};
+    if (!old_ptr->is_empty(t_info)) {
+        throw TableError(cpp_util::format("table [%s] isn't empty, bulk load needs an empty table", table_name));
+    }
+
+    TablePtr ptr;
+    try {
+        TableProperty tp = Table::bulk_load(t_info, old_ptr->tp, next, is_sorted);
+        // indexes are built again from loaded rows, in new table nobody sees yet
+        std::vector<IndexProperty> index_lst = tp.index_lst;
+        tp.index_lst.clear();
+        ptr = std::make_shared<Table>(tp);
+        auto il_ptr = get_table(".index");
+        for (auto &&old_ip : index_lst) {
+            IndexProperty ip = ptr->build_index(t_info, old_ip.index_name, old_ip.col_name_lst, old_ip.include_col_name_lst);
+            ptr->add_index(ip);
+            for (auto &&il_tuple : index_list_rows(table_name, ip)) {
+                il_ptr->update(t_info, il_tuple);
+            }
+        }
+        // table list, both roots in one update
+        get_table(".table_list")->update(t_info, table_list_row(table_name, tp.record_root, tp.keys_idx_root));
+    } catch (...) {
+        // new table never reached catalog, its blocks are used by nobody
+        t_info.s_ptr->rollback();
+        if (ptr != nullptr) {
+            ptr->drop();
+        }
+        throw;
+    }
+    t_info.s_ptr->commit();
+
+    // catalog points to new blocks, old ones are used by nobody
+    set_table(table_name, ptr);
+    old_ptr->drop();
+}
+
 // ========== private =======
-void DB::add_table_list() {
+void DB::vacuum() {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    size_t merge_count = Config::get().vacuum_merge_count;
+    for (auto &&[table_name, ptr] : get_table_lst()) {
+        // catalog readers take no table lock, nothing tells when they left unlinked blocks
+        if (table_name.front() == '.') continue;
+        boost::upgrade_mutex &mutex = get_mutex(table_name);
+        std::vector<BlockNum> &retired_lst = retired_map[table_name];
+        // readers of last round may still hold unlinked blocks,
+        // none is left once table can be locked
+        if (!retired_lst.empty() && mutex.try_lock()) {
+            for (BlockNum num : retired_lst) {
+                block_alloc.free_block(num);
+            }
+            retired_lst.clear();
+            mutex.unlock();
+        }
+        // readers go on while ddl and writers are excluded,
+        // busy table is left to next round
+        if (!retired_lst.empty() || !mutex.try_lock_upgrade()) continue;
+        // dropped or bulk loaded since list was taken
+        if (get_table(table_name) != ptr) {
+            mutex.unlock_upgrade();
+            continue;
+        }
+        // writers hold write mutex till commit, no uncommitted write is left once it is taken
+        std::unique_lock<std::shared_mutex> wl(ptr->get_write_mutex(), std::try_to_lock);
+        if (wl.owns_lock()) {
+            retired_lst = ptr->vacuum(merge_count);
+        }
+        mutex.unlock_upgrade();
+    }
+    checkpoint();
+}
+
+std::vector<std::pair<std::string, DB::TablePtr>> DB::get_table_lst() {
+    std::lock_guard<std::mutex> lg(map_mutex);
+    std::vector<std::pair<std::string, TablePtr>> lst;
+    for (auto &&[table_name, ptr] : table_map) {
+        if (ptr != nullptr) {
+            lst.push_back({table_name, ptr});
+        }
+    }
+    return lst;
+}
+
+DB::TablePtr DB::get_table(const std::string &table_name) {
+    std::lock_guard<std::mutex> lg(map_mutex);
+    return table_map[table_name];
+}
+
+void DB::set_table(const std::string &table_name, TablePtr ptr) {
+    if (ptr != nullptr && table_name.front() != '.') {
+        Table *table = ptr.get();
+        ptr->set_root_hook([this, table](TransInfo t_info, const std::string &index_name, BlockNum root_pos) {
+            set_root(t_info, *table, index_name, root_pos);
+        });
+    }
+    std::lock_guard<std::mutex> lg(map_mutex);
+    table_map[table_name] = std::move(ptr);
+}
+
+boost::upgrade_mutex &DB::get_mutex(const std::string &table_name) {
+    std::lock_guard<std::mutex> lg(map_mutex);
+    return mutex_map[table_name];
+}
+
+TableProperty DB::table_list_property() {
     // .table_list table attributes:
     //
     // 0. table_name  : Varchar(64)
     // 1. record_root : BigInt
-    // 1. keys_index_root  : BigInt
+    // 2. keys_index_root  : BigInt
     // 
 
     using namespace db_type;
     ColProperty table_name_col("table_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), 0, true);
-    ColProperty rr_cp("record_root", sdb::en_bytes(static_cast<char>(INT)), 1);
-    ColProperty ki_cp("keys_idx_root", sdb::en_bytes(static_cast<char>(INT)), 2);
-    TableProperty meta_tp(".table_list", 0, 1, {table_name_col, rr_cp});
-
-    table_map[".table_list"] = std::make_shared<Table>(meta_tp);
+    ColProperty rr_cp("record_root", sdb::en_bytes(static_cast<char>(BIGINT)), 1);
+    ColProperty ki_cp("keys_idx_root", sdb::en_bytes(static_cast<char>(BIGINT)), 2);
+    return TableProperty(".table_list", 0, 1, {table_name_col, rr_cp, ki_cp});
 }
 
-void DB::add_col_list() {
+TableProperty DB::col_list_property() {
     // .col_list table attributes:
     //
     // 0. table_name  : Varchar(64)
@@ -86,37 +251,48 @@ void DB::add_col_list() {
     cp_lst.push_back(is_not_null_cp);
 
     // get table property
-    TableProperty col_list_tp(".col_list", 2, 3, cp_lst);
-    table_map[".col_list"] = std::make_shared<Table>(col_list_tp);
+    return TableProperty(".col_list", 2, 3, cp_lst);
 }
 
-// void DB::add_index() {
-//     // .index table attributes:
-//     //
-//     // 0. table_name : Varchar(64)
-//     // 1. index_name : Varchar(64)
-//     // 2. col_name   : Varchar(64)
-//     // 3. index_root : Int
-//     // 
-//     using namespace db_type;
-//     // setting col property
-//     TableProperty::ColPropertyList cp_lst;
-//     ColProperty table_name_cp("table_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), true);
-//     cp_lst.push_back(table_name_cp);
-// 
-//     ColProperty index_name_cp("index_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), true);
-//     cp_lst.push_back(index_name_cp);
-// 
-//     ColProperty col_name_cp("col_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), true);
-//     cp_lst.push_back(col_name_cp);
-// 
-//     ColProperty index_root_cp("index_root", sdb::en_bytes(static_cast<char>(INT)));
-//     cp_lst.push_back(index_root_cp);
-// 
-//     // get table property
-//     TableProperty index_tp(db_name, ".index", 4, 5, cp_lst);
-//     db_map[".index"].second = std::make_shared<Table>(index_tp);
-// }
+TableProperty DB::index_property() {
+    // .index table attributes, one row per index col:
+    //
+    // 0. table_name    : Varchar(64)
+    // 1. index_name    : Varchar(64)
+    // 2. col_name      : Varchar(64)
+    // 3. order_num     : Char
+    // 4. is_include    : Char
+    // 5. record_root   : BigInt
+    // 6. keys_idx_root : BigInt
+    // 
+    using namespace db_type;
+    // setting col property
+    TableProperty::ColPropertyList cp_lst;
+    ColProperty table_name_cp("table_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), 0, true);
+    cp_lst.push_back(table_name_cp);
+
+    ColProperty index_name_cp("index_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), 1, true);
+    cp_lst.push_back(index_name_cp);
+
+    ColProperty col_name_cp("col_name", sdb::en_bytes(static_cast<char>(VARCHAR), Size(64)), 2, true);
+    cp_lst.push_back(col_name_cp);
+
+    ColProperty order_num_cp("order_num", sdb::en_bytes(static_cast<char>(CHAR)), 3);
+    cp_lst.push_back(order_num_cp);
+
+    ColProperty is_include_cp("is_include", sdb::en_bytes(static_cast<char>(CHAR)), 4);
+    cp_lst.push_back(is_include_cp);
+
+    ColProperty rr_cp("record_root", sdb::en_bytes(static_cast<char>(BIGINT)), 5);
+    cp_lst.push_back(rr_cp);
+
+    ColProperty ki_cp("keys_idx_root", sdb::en_bytes(static_cast<char>(BIGINT)), 6);
+    cp_lst.push_back(ki_cp);
+
+    // get table property, roots are the last two reserved catalog blocks
+    constexpr BlockNum root_end = BlockAlloc::CATALOG_BLOCK_COUNT;
+    return TableProperty(".index", root_end - 2, root_end - 1, cp_lst);
+}
 
 // void DB::add_reference() {
 //     // .reference table attributes:
@@ -139,9 +315,12 @@ void DB::add_col_list() {
 // 
 TableProperty DB::get_tp(TransInfo ti, const std::string &table_name) {
     // get record root and idx root;
-    auto tl_ptr = table_map[".table_list"];
+    auto tl_ptr = get_table(".table_list");
     Tuple keys = {std::make_shared<db_type::Varchar>(64, table_name)};
     auto tl_ts = tl_ptr->find(ti, keys);
+    if (tl_ts.data.empty()) {
+        throw TableNotFound(table_name);
+    }
     BlockNum record_root, keys_idx_root;
     Size offset = 0;
     sdb::de_bytes(record_root, tl_ts.data[0][1]->en_bytes(), offset);
@@ -150,8 +329,9 @@ TableProperty DB::get_tp(TransInfo ti, const std::string &table_name) {
 
     // get col list
     
-    auto cl_ptr = table_map[".col_list"];
-    auto cl_ts  = cl_ptr->find(ti, keys);
+    // keys of .col_list and .index begin with table name
+    auto cl_ptr = get_table(".col_list");
+    auto cl_ts  = cl_ptr->find_pre_key(ti, keys);
     TableProperty::ColPropertyList col_lst;
     for (auto &&tuple : cl_ts.data) {
         std::string col_name;
@@ -163,16 +343,48 @@ TableProperty DB::get_tp(TransInfo ti, const std::string &table_name) {
         bool is_key, is_not_null;
         sdb::de_bytes(is_key, tuple[4]->en_bytes(), (offset = 0));
         sdb::de_bytes(is_not_null, tuple[5]->en_bytes(), (offset = 0));
-        ColProperty cp(col_name, type_info, is_key, is_not_null);
+        ColProperty cp(col_name, type_info, order_num, is_key, is_not_null);
         col_lst.push_back(cp);
     }
-    return TableProperty(table_name, record_root, keys_idx_root, col_lst);
+    // rows are in col name order
+    std::sort(col_lst.begin(), col_lst.end(), [](auto &&a, auto &&b){return a.order_num < b.order_num;});
+    TableProperty tp(table_name, record_root, keys_idx_root, col_lst);
+
+    // index list, rows of an index share index name
+    auto il_ts = get_table(".index")->find_pre_key(ti, keys);
+    std::map<std::string, IndexProperty> ip_map;
+    // <index name, <<order num, is include>, col name>>
+    std::map<std::string, std::vector<std::pair<std::pair<int8_t, bool>, std::string>>> index_col_map;
+    for (auto &&tuple : il_ts.data) {
+        std::string index_name, col_name;
+        sdb::de_bytes(index_name, tuple[1]->en_bytes(), (offset = 0));
+        sdb::de_bytes(col_name, tuple[2]->en_bytes(), (offset = 0));
+        int8_t order_num;
+        sdb::de_bytes(order_num, tuple[3]->en_bytes(), (offset = 0));
+        bool is_include;
+        sdb::de_bytes(is_include, tuple[4]->en_bytes(), (offset = 0));
+        IndexProperty &ip = ip_map[index_name];
+        ip.index_name = index_name;
+        sdb::de_bytes(ip.record_root, tuple[5]->en_bytes(), (offset = 0));
+        sdb::de_bytes(ip.keys_idx_root, tuple[6]->en_bytes(), (offset = 0));
+        index_col_map[index_name].push_back({{order_num, is_include}, col_name});
+    }
+    for (auto &&[index_name, ip] : ip_map) {
+        auto &col_lst = index_col_map[index_name];
+        std::sort(col_lst.begin(), col_lst.end());
+        for (auto &&[order, col_name] : col_lst) {
+            (order.second ? ip.include_col_name_lst : ip.col_name_lst).push_back(col_name);
+        }
+        tp.index_lst.push_back(ip);
+    }
+    return tp;
 }
 
 std::vector<std::string> DB::table_name_lst(TransInfo t_info) {
-    auto tl_ptr = table_map[".table_list"];
+    auto tl_ptr = get_table(".table_list");
+    // names of meta tables begin with '.', they aren't in table list
     Tuple keys = {std::make_shared<db_type::Varchar>(3, ".z")};
-    auto ts = tl_ptr->find_less(t_info, keys, false);
+    auto ts = tl_ptr->find_greater(t_info, keys, false);
 
     std::vector<std::string> nl;
     for (auto && tuple : ts.data) {
@@ -186,13 +398,14 @@ std::vector<std::string> DB::table_name_lst(TransInfo t_info) {
 
 
 void DB::create_table(TransInfo t_info, const TableProperty &tp) {
+    set_ddl_trans(t_info.id, true);
     // insert table map
     auto &[lock_stat, ptr] = t_snapshot[t_info.id][tp.table_name];
     if (lock_stat == 0) {
         lock_stat = -2;
-        mutex_map[tp.table_name].lock();
+        get_mutex(tp.table_name).lock();
         lock_stat = 2;
-        ptr = table_map[tp.table_name];
+        ptr = get_table(tp.table_name);
     } else {
         throw TableExisted(tp.table_name);
     }
@@ -201,11 +414,15 @@ void DB::create_table(TransInfo t_info, const TableProperty &tp) {
         throw TableExisted(tp.table_name);
     }
 
+    // empty tree in new blocks, reached by nobody till catalog rows are committed
+    TupleSource next = []() -> std::optional<Tuple> {return std::nullopt;};
+    TableProperty new_tp = Table::bulk_load(t_info, tp, next, true);
+
     // table name
     auto table_name_ptr = std::make_shared<db_type::Varchar>(64, tp.table_name);
 
     // col list
-    auto cl_ptr = table_map[".col_list"];
+    auto cl_ptr = get_table(".col_list");
     int8_t order_num = 0;
     for (auto &&cl : tp.col_property_lst) {
         Tuple cl_tuple;
@@ -213,7 +430,7 @@ void DB::create_table(TransInfo t_info, const TableProperty &tp) {
         // col name
         cl_tuple.push_back(std::make_shared<db_type::Varchar>(64, cl.col_name));
         // type info
-        cl_tuple.push_back(std::make_shared<db_type::Varchar>(64, cl.type_info));
+        cl_tuple.push_back(std::make_shared<db_type::Varchar>(64, std::string(cl.type_info.begin(), cl.type_info.end())));
         // order num
         cl_tuple.push_back(std::make_shared<db_type::Char>(order_num));
         order_num++;
@@ -225,26 +442,23 @@ void DB::create_table(TransInfo t_info, const TableProperty &tp) {
     }
 
     // table list
-    Tuple tl_tuple;
-    tl_tuple.push_back(table_name_ptr->clone());
-    tl_tuple.push_back(std::make_shared<db_type::BigInt>(tp.record_root));
-    tl_tuple.push_back(std::make_shared<db_type::BigInt>(tp.keys_idx_root));
-    auto &tl_ptr = table_map[".table_list"];
-    tl_ptr->insert(t_info, tl_tuple);
+    auto tl_ptr = get_table(".table_list");
+    tl_ptr->insert(t_info, table_list_row(tp.table_name, new_tp.record_root, new_tp.keys_idx_root));
 }
 
 void DB::drop_table(TransInfo t_info, const std::string &table_name) {
+    set_ddl_trans(t_info.id, true);
     auto &[lock_stat, ptr] = t_snapshot[t_info.id][table_name];
     if (lock_stat == 0) {
         lock_stat = -2;
-        mutex_map[table_name].lock();
+        get_mutex(table_name).lock();
         lock_stat = 2;
-        ptr = table_map[table_name];
+        ptr = get_table(table_name);
     } else if (lock_stat == 1) {
         lock_stat = -3;
-        mutex_map[table_name].lock_upgrade();
+        get_mutex(table_name).lock_upgrade();
         lock_stat = 2;
-        ptr = table_map[table_name];
+        ptr = get_table(table_name);
     }
 
     if (ptr == nullptr) {
@@ -252,12 +466,169 @@ void DB::drop_table(TransInfo t_info, const std::string &table_name) {
     }
 
     // col list
-    auto clt_ptr = table_map[".col_list"];
+    auto clt_ptr = get_table(".col_list");
     Tuple table_name_key = {std::make_shared<db_type::Varchar>(64, table_name)};
-    clt_ptr->remove(t_info, table_name_key);
+    clt_ptr->remove_pre_key(t_info, table_name_key);
+
+    // index list
+    get_table(".index")->remove_pre_key(t_info, table_name_key);
 
     // table list
-    table_map[".table_list"]->remove(t_info, table_name_key);
+    get_table(".table_list")->remove(t_info, table_name_key);
+    // reserved blocks not used by table
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    block_alloc.close_extent(ptr->tp.record_owner());
+    block_alloc.close_extent(ptr->tp.keys_index_owner());
+    for (auto &&ip : ptr->tp.index_lst) {
+        TableProperty index_tp = ptr->tp.get_index_property(ip);
+        block_alloc.close_extent(index_tp.record_owner());
+        block_alloc.close_extent(index_tp.keys_index_owner());
+    }
+}
+
+void DB::create_index(const std::string &table_name, const std::string &index_name,
+                      const std::vector<std::string> &col_name_lst, const std::vector<std::string> &include_col_name_lst) {
+    // writers are excluded, index sees every row
+    boost::unique_lock<boost::upgrade_mutex> ul(get_mutex(table_name));
+    TablePtr ptr = get_table(table_name);
+    if (ptr == nullptr) {
+        throw TableNotFound(table_name);
+    }
+    TransInfo t_info{get_new_tid(), TransInfo::READ, std::make_shared<Snapshot>(), t_log_ptr};
+    IndexProperty ip = ptr->build_index(t_info, index_name, col_name_lst, include_col_name_lst);
+
+    // index list
+    auto il_ptr = get_table(".index");
+    try {
+        for (auto &&il_tuple : index_list_rows(table_name, ip)) {
+            il_ptr->insert(t_info, il_tuple);
+        }
+    } catch (...) {
+        // index never reached catalog, its blocks are used by nobody
+        t_info.s_ptr->rollback();
+        BpTree(ptr->tp.get_index_property(ip)).drop();
+        throw;
+    }
+    t_info.s_ptr->commit();
+    // writes keep it in step once it is in catalog
+    ptr->add_index(ip);
+}
+
+Tuple DB::table_list_row(const std::string &table_name, BlockNum record_root, BlockNum keys_idx_root) {
+    Tuple tl_tuple;
+    tl_tuple.push_back(std::make_shared<db_type::Varchar>(64, table_name));
+    tl_tuple.push_back(std::make_shared<db_type::BigInt>(record_root));
+    tl_tuple.push_back(std::make_shared<db_type::BigInt>(keys_idx_root));
+    return tl_tuple;
+}
+
+std::vector<Tuple> DB::index_list_rows(const std::string &table_name, const IndexProperty &ip) {
+    std::vector<Tuple> rows;
+    auto push_rows = [&](const std::vector<std::string> &col_name_lst, bool is_include) {
+        int8_t order_num = 0;
+        for (auto &&col_name : col_name_lst) {
+            Tuple il_tuple;
+            il_tuple.push_back(std::make_shared<db_type::Varchar>(64, table_name));
+            il_tuple.push_back(std::make_shared<db_type::Varchar>(64, ip.index_name));
+            il_tuple.push_back(std::make_shared<db_type::Varchar>(64, col_name));
+            il_tuple.push_back(std::make_shared<db_type::Char>(order_num));
+            order_num++;
+            il_tuple.push_back(std::make_shared<db_type::Char>(is_include));
+            il_tuple.push_back(std::make_shared<db_type::BigInt>(ip.record_root));
+            il_tuple.push_back(std::make_shared<db_type::BigInt>(ip.keys_idx_root));
+            rows.push_back(il_tuple);
+        }
+    };
+    push_rows(ip.col_name_lst, false);
+    push_rows(ip.include_col_name_lst, true);
+    return rows;
+}
+
+// root goes to catalog in a transaction of its own, committed at once,
+// so root splits of tables don't hold catalog blocks till their writers end.
+// a rolled back write keeps its splits, nodes reach cache at once, and any old root
+// still finds every key, as for create_index and bulk_load.
+// a ddl transaction holds catalog blocks till it ends, its roots go under it
+void DB::set_root(TransInfo t_info, const Table &table, const std::string &index_name, BlockNum root_pos) {
+    bool is_ddl = is_ddl_trans(t_info.id);
+    TransInfo root_info = is_ddl ? t_info : TransInfo{get_new_tid(), TransInfo::READ, std::make_shared<Snapshot>(), t_log_ptr};
+    const std::string &table_name = table.tp.table_name;
+    if (index_name.empty()) {
+        get_table(".table_list")->update(root_info, table_list_row(table_name, table.tp.record_root, root_pos));
+    } else {
+        auto il_ptr = get_table(".index");
+        for (auto &&ip : table.tp.index_lst) {
+            if (ip.index_name != index_name) continue;
+            IndexProperty new_ip = ip;
+            new_ip.keys_idx_root = root_pos;
+            for (auto &&il_tuple : index_list_rows(table_name, new_ip)) {
+                il_ptr->update(root_info, il_tuple);
+            }
+        }
+    }
+    if (!is_ddl) {
+        root_info.s_ptr->commit();
+    }
+}
+
+void DB::set_ddl_trans(Tid t_id, bool is_ddl) {
+    std::lock_guard<std::mutex> lg(map_mutex);
+    if (is_ddl) {
+        ddl_tid_set.insert(t_id);
+    } else {
+        ddl_tid_set.erase(t_id);
+    }
+}
+
+bool DB::is_ddl_trans(Tid t_id) {
+    std::lock_guard<std::mutex> lg(map_mutex);
+    return ddl_tid_set.count(t_id) != 0;
+}
+
+void DB::drop_index(TransInfo t_info, const std::string &table_name, const std::string &index_name) {
+    set_ddl_trans(t_info.id, true);
+    auto &[lock_stat, ptr] = t_snapshot[t_info.id][table_name];
+    if (lock_stat == 0) {
+        lock_stat = -2;
+        get_mutex(table_name).lock();
+        lock_stat = 2;
+        ptr = get_table(table_name);
+    } else if (lock_stat == 1) {
+        lock_stat = -3;
+        get_mutex(table_name).lock_upgrade();
+        lock_stat = 2;
+        ptr = get_table(table_name);
+    }
+
+    if (ptr == nullptr) {
+        throw TableNotFound(table_name);
+    }
+
+    // index as seen by transaction, it may have dropped it already
+    auto f = [&index_name](auto &&ip)->bool{return ip.index_name == index_name;};
+    auto index_lst = get_tp(t_info, table_name).index_lst;
+    if (std::find_if(index_lst.begin(), index_lst.end(), f) == index_lst.end()) {
+        throw TableError(cpp_util::format("index [%s] of table [%s] not found", index_name, table_name));
+    }
+
+    // index list.
+    // index tree stays till commit, see end_trans, writes keep it in step meanwhile
+    Tuple index_key = {std::make_shared<db_type::Varchar>(64, table_name),
+                       std::make_shared<db_type::Varchar>(64, index_name)};
+    get_table(".index")->remove_pre_key(t_info, index_key);
+}
+
+void DB::free_dropped_index(Table &table, const TableProperty &tp) {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    auto old_lst = table.tp.index_lst;
+    for (auto &&ip : old_lst) {
+        auto f = [&ip](auto &&new_ip)->bool{return new_ip.index_name == ip.index_name;};
+        if (std::find_if(tp.index_lst.begin(), tp.index_lst.end(), f) != tp.index_lst.end()) continue;
+        TableProperty index_tp = table.tp.get_index_property(ip);
+        table.remove_index(ip.index_name);
+        block_alloc.close_extent(index_tp.record_owner());
+        block_alloc.close_extent(index_tp.keys_index_owner());
+    }
 }
 
 //  ===== TransInfo =====
@@ -270,18 +641,76 @@ Tid DB::get_new_tid() {
     return old_t_id;
 }
 
-TransInfo DB::begin(Tid t_id = -1) {
+TransInfo DB::begin(Tid t_id) {
     Tid info_t_id = t_id;
     if (t_id == -1) {
         info_t_id = get_new_tid();
     }
-    auto s_ptr = std::make_shared<Snapshot>(db_name);
+    auto s_ptr = std::make_shared<Snapshot>();
     TransInfo info{info_t_id, TransInfo::READ, s_ptr, t_log_ptr};
-    t_info_map[info.id];
+    t_info_map[info.id] = info;
     t_snapshot[info.id];
     return info;
 }
 
+void DB::commit(Tid t_id) {
+    t_info_map[t_id].s_ptr->commit();
+    end_trans(t_id, true);
+}
+
+void DB::rollback(Tid t_id) {
+    t_info_map[t_id].s_ptr->rollback();
+    end_trans(t_id, false);
+}
+
+DB::TablePtr DB::get_table_ptr(Tid t_id, const std::string &table_name) {
+    auto &[lock_stat, ptr] = t_snapshot[t_id][table_name];
+    if (lock_stat == 0) {
+        lock_stat = -2;
+        get_mutex(table_name).lock_shared();
+        lock_stat = 1;
+        ptr = get_table(table_name);
+    }
+
+    if (ptr == nullptr) {
+        throw TableNotFound(table_name);
+    }
+    return ptr;
+}
+
+void DB::end_trans(Tid t_id, bool is_commit) {
+    TransInfo t_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    for (auto &&[table_name, lock] : t_snapshot[t_id]) {
+        auto &[lock_stat, ptr] = lock;
+        boost::upgrade_mutex &mutex = get_mutex(table_name);
+        if (lock_stat == 1) {
+            mutex.unlock_shared();
+        } else if (lock_stat == 2) {
+            // ddl of transaction, nobody else holds table till unlock
+            Tuple keys = {std::make_shared<db_type::Varchar>(64, table_name)};
+            if (is_commit && get_table(".table_list")->find(t_info, keys).data.empty()) {
+                if (ptr != nullptr) {
+                    ptr->drop();
+                }
+                set_table(table_name, nullptr);
+            } else if (is_commit) {
+                TableProperty tp = get_tp(t_info, table_name);
+                if (ptr != nullptr) {
+                    free_dropped_index(*ptr, tp);
+                }
+                set_table(table_name, std::make_shared<Table>(tp));
+            } else if (ptr != nullptr) {
+                // rolled back ddl, table as catalog has it
+                set_table(table_name, std::make_shared<Table>(get_tp(t_info, table_name)));
+            }
+            mutex.unlock();
+        }
+    }
+    set_ddl_trans(t_id, false);
+    t_snapshot.erase(t_id);
+    t_info_map.erase(t_id);
+}
+
 //  ===== log =====
 void DB::recover() {
     std::ifstream in(db_name + "/log.sdb");
@@ -339,8 +768,8 @@ void DB::log_redo_rollback(Tid t_id) {
 void DB::log_redo_update(Tid t_id, const Bytes &bytes) {
     Size offset = 0;
     std::string table_name;
-    TablePtr ptr = get_table_ptr(t_id, table_name);
     sdb::de_bytes(table_name, bytes, offset);
+    TablePtr ptr = get_table_ptr(t_id, table_name);
     Tuple new_tuple;
     new_tuple.de_bytes(ptr->tp.get_type_info_lst(), bytes, offset);
     ptr->update(t_info_map[t_id], new_tuple);
@@ -349,8 +778,8 @@ void DB::log_redo_update(Tid t_id, const Bytes &bytes) {
 void DB::log_redo_insert(Tid t_id, const Bytes &bytes) {
     Size offset = 0;
     std::string table_name;
-    TablePtr ptr = get_table_ptr(t_id, table_name);
     sdb::de_bytes(table_name, bytes, offset);
+    TablePtr ptr = get_table_ptr(t_id, table_name);
     Tuple new_tuple;
     new_tuple.de_bytes(ptr->tp.get_type_info_lst(), bytes, offset);
     ptr->insert(t_info_map[t_id], new_tuple);
@@ -359,8 +788,8 @@ void DB::log_redo_insert(Tid t_id, const Bytes &bytes) {
 void DB::log_redo_remove(Tid t_id, const Bytes &bytes) {
     Size offset = 0;
     std::string table_name;
-    TablePtr ptr = get_table_ptr(t_id, table_name);
     sdb::de_bytes(table_name, bytes, offset);
+    TablePtr ptr = get_table_ptr(t_id, table_name);
     Tuple keys;
     keys.de_bytes(ptr->tp.get_type_info_lst(), bytes, offset);
     ptr->remove(t_info_map[t_id], keys);
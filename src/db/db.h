@@ -2,12 +2,16 @@
 #define DB_DB_H
 
 #include <string>
+#include <set>
 #include <unordered_set>
 #include <utility>
+#include <vector>
+#include <mutex>
 #include <boost/thread.hpp>
 
 #include "table.h"
 #include "tlog.h"
+#include "vacuum.h"
 #include "../sql/ast.h"
 
 namespace sdb {
@@ -24,39 +28,97 @@ public:
     // db op
     static void create_db(const std::string &db_name);
     static void drop_db(const std::string &db_name);
+    // empty catalog trees at reserved root blocks of block.sdb of a new db
+    static void create_catalog();
     void execute(AstNodePtr ptr);
+    // move blocks of tables from tail of block.sdb into free holes,
+    // then cut file after last used block.
+    // readers go on, writers of a table wait while it is moved.
+    // meta tables stay, their readers take no table lock to wait for
+    void shrink();
+    // write all dirty blocks, then blocks freed before are reused
+    void checkpoint();
+    // fill an empty table from tuples, sorted by primary key if is_sorted.
+    // records and indexes are built bottom up in new blocks,
+    // catalog rows are committed, then new table replaces old one and old blocks are freed.
+    // not part of a transaction: it commits by itself and can't be rolled back,
+    // table is locked unique meanwhile, so caller must hold no lock of it
+    void bulk_load(const std::string &table_name, TupleSource next, bool is_sorted);
     // log
     void recover();
 
+    // transaction begin/commit/rollback,
+    // tables created or dropped by a transaction show in table map once it commits
+    TransInfo begin(Tid t_id = -1);
+    void commit(Tid t_id);
+    void rollback(Tid t_id);
+
+    // tp
+    TableProperty get_tp(TransInfo ti, const std::string &table_name);
+
+    // table, locked unique by transaction till it ends.
+    // create_table makes an empty tree, roots of tp aren't used
+    void create_table(TransInfo ti, const TableProperty &tp);
+    void drop_table(TransInfo ti, const std::string &table_name);
+    // table for reads and writes of transaction, locked shared till it ends
+    TablePtr get_table_ptr(Tid t_id, const std::string &table_name);
+
+    // index, rows of .index are kept with the index trees.
+    // create_index isn't part of a transaction, as bulk_load:
+    // catalog rows are committed before writes use index
+    void create_index(const std::string &table_name, const std::string &index_name,
+                      const std::vector<std::string> &col_name_lst, const std::vector<std::string> &include_col_name_lst);
+    // catalog rows go under ti, index tree is freed once ti commits
+    void drop_index(TransInfo ti, const std::string &table_name, const std::string &index_name);
+
 private:
     // check integrity
     // template <typename T>
     // void check_referenced(const Table &table, T t);
     // void check_referencing(const Table &table, const SDB::Type::TupleData &tuple_data);
 
-    // add meta table to db_map
-    void add_table_list();
-    void add_col_list();
-    // void add_index();
+    // property of meta table, roots are reserved catalog blocks
+    static TableProperty table_list_property();
+    static TableProperty col_list_property();
+    static TableProperty index_property();
     // void add_reference();
     std::vector<std::string> table_name_lst(TransInfo ti);
 
-    // tp
-    TableProperty get_tp(TransInfo ti, const std::string &table_name);
-
-    // table
-    void create_table(TransInfo ti, const TableProperty &tp);
-    void drop_table(TransInfo ti, const std::string &table_name);
-    TablePtr get_table_ptr(Tid t_id, const std::string &db_name);
+    // one throttled round of background vacuum over all tables but meta tables,
+    // catalog readers take no table lock to wait for
+    void vacuum();
+
+    // table maps, taken under map_mutex.
+    // tables of now, ddl may change table_map once it returns
+    std::vector<std::pair<std::string, TablePtr>> get_table_lst();
+    TablePtr get_table(const std::string &table_name);
+    // roots of a table other than meta tables go to catalog once they move
+    void set_table(const std::string &table_name, TablePtr ptr);
+    // entries are never erased, mutex stays valid
+    boost::upgrade_mutex &get_mutex(const std::string &table_name);
+
+    // row of table in .table_list
+    Tuple table_list_row(const std::string &table_name, BlockNum record_root, BlockNum keys_idx_root);
+    // rows of ip in .index
+    std::vector<Tuple> index_list_rows(const std::string &table_name, const IndexProperty &ip);
+    // new root of primary index, or of index of index name, goes to catalog,
+    // committed at once unless t_info is a ddl transaction, see Table::set_root_hook
+    void set_root(TransInfo t_info, const Table &table, const std::string &index_name, BlockNum root_pos);
+    // transaction wrote catalog rows of a ddl, they are locked till it ends
+    void set_ddl_trans(Tid t_id, bool is_ddl);
+    bool is_ddl_trans(Tid t_id);
+    // free trees of indexes of table not in tp, once their drop is committed.
+    // nobody else holds table
+    void free_dropped_index(Table &table, const TableProperty &tp);
 
     // transaction check
     void trans_check(TransInfo t_info);
 
-    // transaction begin/commit/rollback
+    // transaction
     Tid get_new_tid();
-    TransInfo begin(Tid t_id);
-    void commit(Tid t_id);
-    void rollback(Tid t_id);
+    // release table locks of transaction,
+    // table map takes tables of catalog it changed once committed
+    void end_trans(Tid t_id, bool is_commit);
 
     // log
     // redo op
@@ -71,11 +133,14 @@ private:
 
 private:
     std::string db_name;
-    // TODO concurrent map
+    // guards mutex_map, table_map and ddl_tid_set, never held while waiting for a table lock
+    std::mutex map_mutex;
     // TODO deadlock maybe
     // <name, tablePtr>
     std::map<std::string, boost::upgrade_mutex> mutex_map;
     std::map<std::string, TablePtr> table_map;
+    // transactions that did ddl, see set_root
+    std::set<Tid> ddl_tid_set;
     // int8_t => 
     // -3 : apply upgrade_lock
     // -2 : apply hared_lock
@@ -93,6 +158,11 @@ private:
 
     // log
     TlogPtr t_log_ptr;
+
+    // <table name, blocks unlinked by last vacuum round>, vacuum thread only
+    std::map<std::string, std::vector<BlockNum>> retired_map;
+    // last member, stopped before tables go away
+    std::unique_ptr<Vacuum> vacuum_ptr;
 };
 
 } // namespace sdb
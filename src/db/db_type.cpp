@@ -4,7 +4,7 @@ namespace sdb::db_type {
 
 // ===== Char =====
 bool Char::less(SP<const Object> obj)const {
-    if (auto p = dfc<Char>(obj)) {
+    if (auto p = dfc<const Char>(obj)) {
         return data < p->data;
     } else {
         throw_mismatching(obj, "<");
@@ -12,7 +12,7 @@ bool Char::less(SP<const Object> obj)const {
 }
 
 bool Char::eq(SP<const Object> obj)const {
-    if (auto p = dfc<Char>(obj)) {
+    if (auto p = dfc<const Char>(obj)) {
         return data == p->data;
     } else {
         throw_mismatching(obj, "=");
@@ -20,7 +20,7 @@ bool Char::eq(SP<const Object> obj)const {
 }
 
 void Char::assign(SP<const Object> obj) {
-    if (auto p = dfc<Char>(obj)) {
+    if (auto p = dfc<const Char>(obj)) {
         data = p->data;
     } else {
         throw_mismatching(obj, "=");
@@ -39,7 +39,7 @@ Vector::Vector(TypeTag vtt, Size max_size, const std::vector<ObjPtr> &data):vtt(
 Vector::Vector(const TypeInfo &info) {
     // bytes: |type_tag, dependent_type_tag, type_size|
     assert(info.size() >= 2 + sizeof(Size));
-    max_size = static_cast<TypeTag>(info[1]);
+    vtt = static_cast<TypeTag>(info[1]);
     Size offset = 2;
     sdb::de_bytes(max_size, info, offset);
 }
@@ -61,27 +61,29 @@ std::shared_ptr<Object> Vector::clone()const {
 }
 
 Bytes Vector::en_bytes()const {
-    Bytes bytes;
+    // bytes: |size, data|
+    Bytes bytes = sdb::en_bytes(Size(data.size()));
     for (auto &&ptr : data) {
-        bytes_append(bytes, ptr->en_bytes());
+        Bytes ptr_bytes = ptr->en_bytes();
+        bytes.insert(bytes.end(), ptr_bytes.begin(), ptr_bytes.end());
     }
     return bytes;
 }
 
-void Vector::de_bytes(const Bytes &bytes, int &offset) {
+void Vector::de_bytes(BytesView bytes, int &offset) {
     Size size = 0;
     sdb::de_bytes(size, bytes, offset);
     assert(size >= 0 && size <= max_size);
     data.clear();
     for (Size i = 0; i < size ;i++) {
         ObjPtr ptr = get_default(TypeInfo(1, static_cast<char>(vtt)));
-        ptr->de_bytes(bytes, size);
+        ptr->de_bytes(bytes, offset);
         data.push_back(ptr);
     }
 }
 
 bool Vector::less(SP<const Object> obj)const {
-    if (auto p = dfc<Vector>(obj)) {
+    if (auto p = dfc<const Vector>(obj)) {
         Size len_1 = data.size();
         Size len_2 = p->data.size();
         for (Size i = 0; i < len_1 && i < len_2; i++) {
@@ -97,7 +99,7 @@ bool Vector::less(SP<const Object> obj)const {
 }
 
 bool Vector::eq(SP<const Object> obj)const {
-    if (auto p = dfc<Vector>(obj)) {
+    if (auto p = dfc<const Vector>(obj)) {
         if (get_size() != obj->get_size()) return false;
         for (size_t i = 0; i < data.size(); i++) {
             if (!data[i]->eq(p->data[i])) {
@@ -111,19 +113,42 @@ bool Vector::eq(SP<const Object> obj)const {
 }
 
 void Vector::assign(SP<const Object> obj) {
-    if (auto p = dfc<Vector>(obj)) {
-        if (max_size < p->get_size()) {
-            throw DBTypeOverflowError("vector");
-        }
-        for (size_t i = 0; i < p->data.size(); i++) {
-            data[i] = p->data[i]->clone();
+    if (auto p = dfc<const Vector>(obj)) {
+        check_size(p->data.size());
+        data.clear();
+        for (auto &&ptr : p->data) {
+            data.push_back(ptr->clone());
         }
     } else {
         throw DBTypeMismatchingError(get_type_name(), obj->get_type_name(), "==");
     }
 }
 
+Size Vector::get_type_size(TypeTag tt) {
+    switch (tt) {
+        case CHAR:
+            return 1;
+        case INT:
+        case UINT:
+            return 4;
+        case BIGINT:
+            return 8;
+        default:
+            throw DBTypeError(format("TypeError: %s can't be in vector", int(tt)));
+    }
+}
+
 // ===== Varchar =====
+static Size varchar_max_size(const TypeInfo &info) {
+    assert(info.size() >= 1 + sizeof(Size));
+    Size offset = 1;
+    Size max_size = 0;
+    sdb::de_bytes(max_size, info, offset);
+    return max_size;
+}
+
+Varchar::Varchar(const TypeInfo &info):Vector(CHAR, varchar_max_size(info)) {}
+
 Varchar::Varchar(int max_size, const std::string &str):Vector(CHAR, max_size){
     check_size(str.size());
     for (char ch : str) {
@@ -76,7 +76,7 @@ public:
     
     // bytes
     virtual Bytes en_bytes()const =0;
-    virtual void de_bytes(const Bytes &bytes, int &offset)=0;
+    virtual void de_bytes(BytesView bytes, int &offset)=0;
 
     // operator
     virtual bool less(SP<const Object> obj)const =0;
@@ -119,7 +119,7 @@ struct None : public Object {
 
     // bytes
     Bytes en_bytes()const override {return Bytes();}
-    void de_bytes(const Bytes &, int &)override{}
+    void de_bytes(BytesView, int &)override{}
 
     // operator
     bool less(SP<const Object>)const override{
@@ -137,6 +137,8 @@ struct None : public Object {
 
 // ===== Char =====
 class Char : public Object {
+public:
+    Char():data(0){}
     explicit Char(char ch):data(ch){}
 
     TypeTag get_type_tag()const override {return CHAR;}
@@ -154,7 +156,7 @@ class Char : public Object {
 
     // bytes
     Bytes en_bytes()const override {return sdb::en_bytes(data);}
-    void de_bytes(const Bytes &bytes, Size &offset)override{
+    void de_bytes(BytesView bytes, Size &offset)override{
         sdb::de_bytes(data, bytes, offset);
     }
 
@@ -197,7 +199,7 @@ public:
     Bytes en_bytes()const override {
         return sdb::en_bytes(data);
     }
-    void de_bytes(const Bytes &bytes, int &offset) override {
+    void de_bytes(BytesView bytes, int &offset) override {
         sdb::de_bytes(data, bytes, offset);
     }
 
@@ -218,7 +220,7 @@ public:
 // === Integer === 
 using Int = Integer<int32_t>;
 using UInt = Integer<uint32_t>;
-using BigInt = Integer<uint64_t>;
+using BigInt = Integer<int64_t>;
 
 // === Float ===
 // approximate float
@@ -250,7 +252,7 @@ public:
     
     // bytes
     Bytes en_bytes()const override;
-    void de_bytes(const Bytes &bytes, int &offset) override;
+    void de_bytes(BytesView bytes, int &offset) override;
 
     // operator
     bool less(SP<const Object> obj)const override;
@@ -283,7 +285,9 @@ public:
     Varchar()=delete;
     Varchar(int max_size):Vector(CHAR, max_size) {}
     Varchar(int max_size, const std::string &str);
-    Varchar(const TypeInfo &info):Vector(info){}
+    Varchar(int max_size, const std::vector<ObjPtr> &data):Vector(CHAR, max_size, data){}
+    // info: |VARCHAR, max_size|
+    Varchar(const TypeInfo &info);
 
     // type
     TypeTag get_type_tag()const override { return VARCHAR; }
@@ -303,6 +307,8 @@ public:
 static ObjPtr get_default(TypeInfo type_info) {
     TypeTag tag = static_cast<TypeTag>(type_info[0]);
     switch (tag) {
+        case CHAR:
+            return std::make_shared<Char>();
         case INT:
             return std::make_shared<Int>();
         case UINT: 
@@ -437,6 +443,10 @@ namespace sdb {
     inline Bytes en_bytes(db_type::ObjCntPtr ptr) {
         return ptr->en_bytes();
     }
+    template <>
+    inline Bytes en_bytes(db_type::ObjPtr ptr) {
+        return ptr->en_bytes();
+    }
 }
 
 
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <unistd.h>
+
+#include "external_sort.h"
+#include "io.h"
+#include "../cpp_util/lib/error.hpp"
+
+using namespace cpp_util;
+
+namespace sdb {
+
+// ========== public ==========
+ExternalSort::ExternalSort(size_t run_size):run_size(std::max(run_size, size_t(BLOCK_SIZE))) {
+    // count starts again in every process, pid keeps names of processes apart
+    static std::atomic<size_t> sort_count{0};
+    file_prefix = format("sort_%s_%s_", getpid(), sort_count++);
+}
+
+ExternalSort::~ExternalSort() {
+    IO &io = IO::get();
+    for (auto &&run : run_lst) {
+        if (io.has_file(run.path)) {
+            io.delete_file(run.path);
+        }
+    }
+}
+
+void ExternalSort::push(Bytes key, Bytes value) {
+    assert(!is_merging);
+    mem_size += 2 * sizeof(Size) + key.size() + value.size();
+    pair_lst.emplace_back(std::move(key), std::move(value));
+    if (mem_size >= run_size) {
+        spill();
+    }
+}
+
+std::optional<ExternalSort::Pair> ExternalSort::next() {
+    if (!is_merging) {
+        is_merging = true;
+        if (run_lst.empty()) {
+            std::sort(pair_lst.begin(), pair_lst.end(), less);
+        } else {
+            if (!pair_lst.empty()) {
+                spill();
+            }
+            for (size_t i = 0; i < run_lst.size(); i++) {
+                if (auto pair = read(run_lst[i])) {
+                    heap.emplace(std::move(*pair), i);
+                }
+            }
+        }
+    }
+
+    if (run_lst.empty()) {
+        if (pair_pos == pair_lst.size()) return std::nullopt;
+        return std::move(pair_lst[pair_pos++]);
+    }
+    if (heap.empty()) return std::nullopt;
+    // top of heap is const, moved out before pop
+    HeapItem item = std::move(const_cast<HeapItem&>(heap.top()));
+    heap.pop();
+    if (auto pair = read(run_lst[item.second])) {
+        heap.emplace(std::move(*pair), item.second);
+    }
+    return std::move(item.first);
+}
+
+// ========== private ==========
+bool ExternalSort::less(const Pair &l, const Pair &r) {
+    const Bytes &lk = l.first;
+    const Bytes &rk = r.first;
+    int res = std::memcmp(lk.data(), rk.data(), std::min(lk.size(), rk.size()));
+    return res != 0 ? res < 0 : lk.size() < rk.size();
+}
+
+void ExternalSort::spill() {
+    std::sort(pair_lst.begin(), pair_lst.end(), less);
+    Bytes bytes;
+    bytes.reserve(mem_size);
+    for (auto &&[key, value] : pair_lst) {
+        bytes_append(bytes, Size(key.size()));
+        bytes.insert(bytes.end(), key.begin(), key.end());
+        bytes_append(bytes, Size(value.size()));
+        bytes.insert(bytes.end(), value.begin(), value.end());
+    }
+
+    Run run;
+    run.path = file_prefix + std::to_string(run_lst.size()) + ".sdb";
+    run.file_size = bytes.size();
+    IO &io = IO::get();
+    // left by a crashed process of same pid
+    if (io.has_file(run.path)) {
+        io.delete_file(run.path);
+    }
+    io.create_file(run.path);
+    io.full_write_file(run.path, bytes);
+    run_lst.push_back(std::move(run));
+
+    pair_lst.clear();
+    pair_lst.shrink_to_fit();
+    mem_size = 0;
+}
+
+std::optional<ExternalSort::Pair> ExternalSort::read(Run &run) {
+    auto read_bytes = [this, &run](Bytes &bytes) {
+        if (!fill(run, sizeof(Size))) return false;
+        Size size = 0;
+        std::memcpy(&size, run.buffer.data() + run.buffer_pos, sizeof(Size));
+        run.buffer_pos += sizeof(Size);
+        assert_msg(size >= 0 && fill(run, size), format("sort run %s is broken", run.path));
+        bytes.assign(run.buffer.begin() + run.buffer_pos, run.buffer.begin() + run.buffer_pos + size);
+        run.buffer_pos += size;
+        return true;
+    };
+    Pair pair;
+    if (!read_bytes(pair.first)) return std::nullopt;
+    assert_msg(read_bytes(pair.second), format("sort run %s is broken", run.path));
+    return pair;
+}
+
+bool ExternalSort::fill(Run &run, size_t size) {
+    if (run.buffer.size() - run.buffer_pos >= size) return true;
+    // drop read bytes, then read blocks till size bytes are unread
+    run.buffer.erase(run.buffer.begin(), run.buffer.begin() + run.buffer_pos);
+    run.buffer_pos = 0;
+    IO &io = IO::get();
+    while (run.buffer.size() < size && run.read_size < run.file_size) {
+        Bytes block = io.read_block(run.path, run.read_size / BLOCK_SIZE);
+        size_t len = std::min(size_t(BLOCK_SIZE), run.file_size - run.read_size);
+        run.buffer.insert(run.buffer.end(), block.begin(), block.begin() + len);
+        run.read_size += len;
+    }
+    return run.buffer.size() >= size;
+}
+
+} // namespace sdb
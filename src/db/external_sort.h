@@ -0,0 +1,79 @@
+#ifndef DB_EXTERNAL_SORT_H
+#define DB_EXTERNAL_SORT_H
+
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util.h"
+
+namespace sdb {
+
+// sort of (key, value) byte pairs by memcmp of key, more than fit in memory:
+// pairs are kept in memory up to run_size bytes, then sorted and written to a run file,
+// runs are merged by a heap reading every run file block by block.
+// all pairs fit in memory => no file.
+// run file => |key len, key, value len, value| ...
+// run files are named by pid and sort count, a stale one of same name is replaced
+class ExternalSort {
+public:
+    using Pair = std::pair<Bytes, Bytes>;
+
+    explicit ExternalSort(size_t run_size);
+    ExternalSort(const ExternalSort &)=delete;
+    ExternalSort &operator=(const ExternalSort &)=delete;
+    // run files are deleted
+    ~ExternalSort();
+
+    void push(Bytes key, Bytes value);
+    // pairs in key order, nullopt at end.
+    // no push after first next
+    std::optional<Pair> next();
+
+    // get
+    size_t get_run_count()const {return run_lst.size();}
+
+private:
+    struct Run {
+        std::string path;
+        size_t file_size = 0;
+        // bytes of file read into buffer
+        size_t read_size = 0;
+        Bytes buffer;
+        size_t buffer_pos = 0;
+    };
+
+    static bool less(const Pair &l, const Pair &r);
+    // sort pairs in memory and write them to a new run file
+    void spill();
+    // next pair of run file, nullopt at end
+    std::optional<Pair> read(Run &run);
+    // make buffer hold size unread bytes, false if file has less
+    bool fill(Run &run, size_t size);
+
+private:
+    size_t run_size;
+    // bytes of pairs in memory
+    size_t mem_size = 0;
+    std::vector<Pair> pair_lst;
+    // next pair in memory once sorted
+    size_t pair_pos = 0;
+    std::vector<Run> run_lst;
+    bool is_merging = false;
+    // merge heap: head pair of every run with run index, least key on top
+    using HeapItem = std::pair<Pair, size_t>;
+    struct HeapGreater {
+        bool operator()(const HeapItem &l, const HeapItem &r)const {
+            return less(r.first, l.first);
+        }
+    };
+    std::priority_queue<HeapItem, std::vector<HeapItem>, HeapGreater> heap;
+    // run file name prefix, unique per sort
+    std::string file_prefix;
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_EXTERNAL_SORT_H */
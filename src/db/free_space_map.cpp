@@ -0,0 +1,158 @@
+#include <algorithm>
+
+#include "free_space_map.h"
+#include "../cpp_util/lib/error.hpp"
+
+using namespace cpp_util;
+
+namespace sdb {
+
+// ========== public ==========
+FreeSpaceMap::FreeSpaceMap(std::shared_ptr<MmapFile> file_ptr):file_ptr(std::move(file_ptr)) {
+    size_t page_count = this->file_ptr->get_file_size() / BLOCK_SIZE;
+    for (size_t i = 0; i < page_count; i++) {
+        const uint64_t *words = get_words(i);
+        size_t used_count = 0;
+        for (size_t w = 0; w < PAGE_WORD_COUNT; w++) {
+            used_count += __builtin_popcountll(words[w]);
+        }
+        free_count_lst.push_back(PAGE_BLOCK_COUNT - used_count);
+        free_word_lst.push_back(WordHint{});
+    }
+    while (first_free_page < free_count_lst.size() && free_count_lst[first_free_page] == 0) {
+        first_free_page++;
+    }
+}
+
+BlockNum FreeSpaceMap::alloc() {
+    std::lock_guard<std::mutex> lg(mutex);
+    return alloc_locked();
+}
+
+BlockNum FreeSpaceMap::alloc_run(size_t count) {
+    assert(count > 0 && count <= 64 && (count & (count - 1)) == 0);
+    if (count == 1) return alloc();
+    std::lock_guard<std::mutex> lg(mutex);
+    uint64_t mask = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+    size_t run_class = __builtin_ctzll(count);
+    for (size_t page_num = find_page(first_free_page, count); ; page_num = find_page(page_num + 1, count)) {
+        uint64_t *words = get_words(page_num);
+        uint32_t &hint = free_word_lst[page_num][run_class];
+        for (; hint < PAGE_WORD_COUNT; hint++) {
+            uint64_t word = words[hint];
+            if (word == ~uint64_t(0)) continue;
+            for (size_t shift = 0; shift < 64; shift += count) {
+                if ((word >> shift & mask) != 0) continue;
+                words[hint] |= mask << shift;
+                free_count_lst[page_num] -= count;
+                return BlockNum(page_num * PAGE_BLOCK_COUNT + hint * 64 + shift);
+            }
+        }
+    }
+}
+
+void FreeSpaceMap::free(BlockNum block_num) {
+    std::lock_guard<std::mutex> lg(mutex);
+    free_locked(block_num);
+}
+
+std::vector<BlockNum> FreeSpaceMap::alloc_batch(size_t count) {
+    std::vector<BlockNum> block_lst;
+    block_lst.reserve(count);
+    std::lock_guard<std::mutex> lg(mutex);
+    for (size_t i = 0; i < count; i++) {
+        block_lst.push_back(alloc_locked());
+    }
+    return block_lst;
+}
+
+void FreeSpaceMap::free_batch(const std::vector<BlockNum> &block_lst) {
+    std::lock_guard<std::mutex> lg(mutex);
+    for (BlockNum block_num : block_lst) {
+        free_locked(block_num);
+    }
+}
+
+bool FreeSpaceMap::is_used(BlockNum block_num) {
+    std::lock_guard<std::mutex> lg(mutex);
+    size_t page_num = block_num / PAGE_BLOCK_COUNT;
+    if (page_num >= free_count_lst.size()) return false;
+    size_t bit = block_num % PAGE_BLOCK_COUNT;
+    return (get_words(page_num)[bit / 64] >> (bit % 64) & 1) != 0;
+}
+
+void FreeSpaceMap::sync() {
+    file_ptr->sync();
+}
+
+size_t FreeSpaceMap::get_used_count() {
+    std::lock_guard<std::mutex> lg(mutex);
+    size_t used_count = 0;
+    for (uint32_t free_count : free_count_lst) {
+        used_count += PAGE_BLOCK_COUNT - free_count;
+    }
+    return used_count;
+}
+
+// ========== private ==========
+BlockNum FreeSpaceMap::get_end() {
+    for (size_t page_num = free_count_lst.size(); page_num-- > 0; ) {
+        if (free_count_lst[page_num] == PAGE_BLOCK_COUNT) continue;
+        const uint64_t *words = get_words(page_num);
+        for (size_t w = PAGE_WORD_COUNT; w-- > 0; ) {
+            if (words[w] == 0) continue;
+            size_t bit = 63 - __builtin_clzll(words[w]);
+            return BlockNum(page_num * PAGE_BLOCK_COUNT + w * 64 + bit + 1);
+        }
+    }
+    return 0;
+}
+
+BlockNum FreeSpaceMap::alloc_locked() {
+    size_t page_num = find_page(first_free_page, 1);
+    first_free_page = page_num;
+    uint64_t *words = get_words(page_num);
+    uint32_t &hint = free_word_lst[page_num][0];
+    for (; hint < PAGE_WORD_COUNT; hint++) {
+        uint64_t &word = words[hint];
+        if (~word == 0) continue;
+        size_t bit = __builtin_ctzll(~word);
+        word |= uint64_t(1) << bit;
+        free_count_lst[page_num]--;
+        return BlockNum(page_num * PAGE_BLOCK_COUNT + hint * 64 + bit);
+    }
+    assert_msg(false, "free space map: free count of page is wrong");
+    return -1;
+}
+
+void FreeSpaceMap::free_locked(BlockNum block_num) {
+    size_t page_num = block_num / PAGE_BLOCK_COUNT;
+    size_t bit = block_num % PAGE_BLOCK_COUNT;
+    assert_msg(page_num < free_count_lst.size(), format("free block %s never allocated", block_num));
+    uint64_t &word = get_words(page_num)[bit / 64];
+    uint64_t bit_mask = uint64_t(1) << (bit % 64);
+    assert_msg((word & bit_mask) != 0, format("free block %s twice", block_num));
+    word &= ~bit_mask;
+    free_count_lst[page_num]++;
+    for (uint32_t &hint : free_word_lst[page_num]) {
+        hint = std::min(hint, uint32_t(bit / 64));
+    }
+    first_free_page = std::min(first_free_page, page_num);
+}
+
+size_t FreeSpaceMap::find_page(size_t page_num, size_t count) {
+    size_t run_class = __builtin_ctzll(count);
+    while (page_num < free_count_lst.size()
+           && (free_count_lst[page_num] < count || free_word_lst[page_num][run_class] == PAGE_WORD_COUNT)) {
+        page_num++;
+    }
+    if (page_num == free_count_lst.size()) {
+        // mapping grows file by a zero page
+        get_words(page_num);
+        free_count_lst.push_back(PAGE_BLOCK_COUNT);
+        free_word_lst.push_back(WordHint{});
+    }
+    return page_num;
+}
+
+} // namespace sdb
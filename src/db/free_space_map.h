@@ -0,0 +1,90 @@
+#ifndef DB_FREE_SPACE_MAP_H
+#define DB_FREE_SPACE_MAP_H
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "util.h"
+#include "mmap_file.h"
+
+namespace sdb {
+
+// bitmap of used blocks, one bit per block, kept in a mapped file:
+//     page i of file => blocks [i * PAGE_BLOCK_COUNT, (i + 1) * PAGE_BLOCK_COUNT)
+// alloc and free only flip a bit of a mapped page,
+// the page is written back with the file, no log.
+// free block count of every page is kept in memory,
+// so first fit skips full pages without reading them.
+class FreeSpaceMap {
+public:
+    // 32768 blocks => 128MB per bitmap page
+    static constexpr size_t PAGE_BLOCK_COUNT = BLOCK_SIZE * 8;
+
+    explicit FreeSpaceMap(std::shared_ptr<MmapFile> file_ptr);
+    FreeSpaceMap(const FreeSpaceMap &)=delete;
+    FreeSpaceMap &operator=(const FreeSpaceMap &)=delete;
+
+    // lowest free block
+    BlockNum alloc();
+    // lowest free run of count blocks aligned to count,
+    // count is a power of 2 at most 64
+    BlockNum alloc_run(size_t count);
+    void free(BlockNum block_num);
+    // count lowest free blocks and free a list of blocks,
+    // one lock for the whole batch
+    std::vector<BlockNum> alloc_batch(size_t count);
+    void free_batch(const std::vector<BlockNum> &block_lst);
+    bool is_used(BlockNum block_num);
+
+    // checkpoint: write changed bitmap pages to disk
+    void sync();
+
+    // f(end) runs under lock, end => last used block + 1,
+    // no block at or past end is allocated while f runs
+    template <typename F>
+    void with_end(F f) {
+        std::lock_guard<std::mutex> lg(mutex);
+        f(get_end());
+    }
+
+    // get
+    size_t get_page_count() {
+        std::lock_guard<std::mutex> lg(mutex);
+        return free_count_lst.size();
+    }
+    size_t get_used_count();
+
+private:
+    static constexpr size_t PAGE_WORD_COUNT = BLOCK_SIZE / sizeof(uint64_t);
+    // runs of 1, 2, 4 .. 64 blocks
+    static constexpr size_t RUN_CLASS_COUNT = 7;
+    using WordHint = std::array<uint32_t, RUN_CLASS_COUNT>;
+
+    uint64_t *get_words(size_t page_num) {
+        return reinterpret_cast<uint64_t*>(file_ptr->map_block(page_num));
+    }
+    // caller holds mutex
+    BlockNum get_end();
+    BlockNum alloc_locked();
+    void free_locked(BlockNum block_num);
+    // first page from page_num that may have a free run of count blocks,
+    // new page appended if none
+    size_t find_page(size_t page_num, size_t count);
+
+private:
+    std::mutex mutex;
+    std::shared_ptr<MmapFile> file_ptr;
+    // free block count of every page
+    std::vector<uint32_t> free_count_lst;
+    // free_word_lst[page][k]: words of page before it have no free run of 2^k blocks,
+    // PAGE_WORD_COUNT => page has none
+    std::vector<WordHint> free_word_lst;
+    // pages before are full
+    size_t first_free_page = 0;
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_FREE_SPACE_MAP_H */
@@ -13,6 +13,7 @@
 
 #include "io.h"
 #include "util.h"
+#include "config.h"
 #include "../cpp_util/lib/error.hpp"
 #include "../cpp_util/lib/log.hpp"
 
@@ -32,6 +33,7 @@ void IO::create_dir(const std::string &dir_path) {
 }
 
 void IO::remove_dir_force(const std::string &dir_path) {
+    IO::get().close_mmap_file(get_db_dir_path() + "/" + dir_path);
     try {
         ef::remove_all(get_db_dir_path() + "/" + dir_path);
     } catch (ef::filesystem_error err) {
@@ -49,6 +51,7 @@ void IO::create_file(const std::string &file_path) {
 
 void IO::delete_file(const std::string &file_name) {
     assert_msg(has_file(file_name), file_name);
+    close_mmap_file(get_db_file_path(file_name));
     try {
         ef::remove(get_db_file_path(file_name));
     } catch (ef::filesystem_error err) {
@@ -69,6 +72,7 @@ Bytes IO::read_file(const std::string &file_path) {
 void IO::full_write_file(const std::string &file_path, const Bytes &data) {
     std::string abs_path = get_db_file_path(file_path);
     assert_msg(has_file(file_path), abs_path);
+    close_mmap_file(abs_path);
     std::ofstream out(abs_path, ios::binary);
     out.write(data.data(), data.size());
     out.close();
@@ -77,41 +81,37 @@ void IO::full_write_file(const std::string &file_path, const Bytes &data) {
 void IO::append_write_file(const std::string &file_path, const Bytes &data) {
     std::string abs_path = get_db_file_path(file_path);
     assert_msg(has_file(file_path), abs_path);
+    close_mmap_file(abs_path);
     std::ofstream out(abs_path, ios::binary | ios::app);
     out.write(data.data(), data.size());
     out.close();
 }
 
 Bytes IO::read_block(const std::string &file_path, size_t block_num) {
-    // mmap read
-    std::string abs_path = get_db_file_path(file_path);
-    int fd = open(abs_path.data(), O_RDWR);
-    assert_msg(fd >= 0, abs_path);
-    if (get_file_size(file_path) < (block_num+1)*BLOCK_SIZE) {
-        lseek(fd, BLOCK_SIZE*(block_num+1), SEEK_SET);
-        write(fd, "", 1);
-    }
-    char *buff = (char*)mmap(nullptr, BLOCK_SIZE, PROT_READ, MAP_SHARED, fd, BLOCK_SIZE*block_num);
     Bytes block(BLOCK_SIZE);
-    std::memcpy(block.data(), buff, BLOCK_SIZE);
-    munmap(buff, BLOCK_SIZE);
-    close(fd);
-
+    get_mmap_file(file_path)->read_block(block_num, block.data());
     return block;
 }
 
 void IO::write_block(const std::string &file_path, size_t block_num, const Bytes &data){
-    std::string abs_path = get_db_file_path(file_path);
-    int fd = open(abs_path.data(), O_RDWR);
-    assert_msg(fd >= 0, abs_path);
-    if (get_file_size(file_path) < (block_num+1)*BLOCK_SIZE) {
-        lseek(fd, BLOCK_SIZE*(1+block_num), SEEK_SET);
-        write(fd, "", 1);
-    }
-    char *buff = (char*)mmap(nullptr, BLOCK_SIZE, PROT_WRITE, MAP_SHARED, fd, BLOCK_SIZE*block_num);
-    std::memcpy(buff, data.data(), BLOCK_SIZE);
-    close(fd);
-    munmap(buff, BLOCK_SIZE);
+    assert(data.size() == BLOCK_SIZE);
+    get_mmap_file(file_path)->write_block(block_num, data.data());
+}
+
+void IO::read_blocks(const std::string &file_path, const std::vector<size_t> &block_num_lst, const std::vector<Byte*> &data_lst) {
+    get_mmap_file(file_path)->read_blocks(block_num_lst, data_lst);
+}
+
+void IO::write_blocks(const std::string &file_path, const std::vector<size_t> &block_num_lst, const std::vector<const Byte*> &data_lst) {
+    get_mmap_file(file_path)->write_blocks(block_num_lst, data_lst);
+}
+
+void IO::reserve_blocks(const std::string &file_path, size_t block_count) {
+    get_mmap_file(file_path)->ensure_size(block_count * BLOCK_SIZE);
+}
+
+void IO::truncate_blocks(const std::string &file_path, size_t block_count) {
+    get_mmap_file(file_path)->truncate(block_count * BLOCK_SIZE);
 }
 
 bool IO::has_file(const std::string &str) {
@@ -136,4 +136,33 @@ std::string IO::get_db_file_path(const std::string &path)const {
     return file_path;
 }
 
+// ========= private =========
+std::shared_ptr<MmapFile> IO::get_mmap_file(const std::string &file_path) {
+    std::string abs_path = get_db_file_path(file_path);
+    std::lock_guard<std::mutex> lg(file_mutex);
+    auto &ptr = file_map[abs_path];
+    if (ptr == nullptr) {
+        // only block.sdb is direct and preallocated
+        Config &config = Config::get();
+        bool is_block = ef::path(abs_path).filename() == block_path();
+        bool is_direct = is_block && config.direct_io;
+        size_t extent_block_count = is_block ? config.file_extent_blocks : 1;
+        ptr = std::make_shared<MmapFile>(abs_path, is_direct, extent_block_count);
+    }
+    return ptr;
+}
+
+void IO::close_mmap_file(const std::string &abs_path) {
+    // the file itself or files in dir, not files sharing a name prefix
+    std::string dir_path = abs_path + "/";
+    std::lock_guard<std::mutex> lg(file_mutex);
+    for (auto it = file_map.begin(); it != file_map.end();) {
+        if (it->first == abs_path || it->first.compare(0, dir_path.size(), dir_path) == 0) {
+            it = file_map.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
 } // namespace sdb
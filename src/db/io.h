@@ -2,7 +2,12 @@
 #define DB_IO_H
 
 #include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include "util.h"
+#include "mmap_file.h"
 
 namespace sdb {
 
@@ -29,6 +34,15 @@ public:
     // block
     Bytes read_block(const std::string &file_path, size_t block_num);
     void write_block(const std::string &file_path, size_t block_num, const Bytes &data);
+    // runs of adjacent block num are merged into one preadv/pwritev
+    void read_blocks(const std::string &file_path, const std::vector<size_t> &block_num_lst, const std::vector<Byte*> &data_lst);
+    void write_blocks(const std::string &file_path, const std::vector<size_t> &block_num_lst, const std::vector<const Byte*> &data_lst);
+    // make file hold at least block_count blocks, no syscall if it does
+    void reserve_blocks(const std::string &file_path, size_t block_count);
+    // cut file to block_count blocks if larger
+    void truncate_blocks(const std::string &file_path, size_t block_count);
+    // get opened block file, open it if first use
+    std::shared_ptr<MmapFile> get_mmap_file(const std::string &file_path);
 
     // get
     bool has_file(const std::string &str);
@@ -38,13 +52,22 @@ public:
     std::string get_db_file_path(const std::string &path)const;
     static std::string block_path() {return "block.sdb";}
     std::string log_path() const {return "log.sdb";}
-    std::string balloc_log_path()const{return "bloack_log.sdb";}
-    std::string balloc_backup_path()const{return "bloack_backup.sdb";}
+    // bitmap of used blocks of block.sdb
+    std::string fsm_path()const{return "fsm.sdb";}
+    std::string config_path()const{return "config.sdb";}
+    // hot block list of buffer pool, read at start
+    std::string warm_path()const{return "warm.sdb";}
 
 private:
     // private function
     std::string db_name;
     size_t get_file_size(const std::string &file_path);
+    // close opened block file of abs path, or all under it if a dir
+    void close_mmap_file(const std::string &abs_path);
+
+    // <abs_path, block file>
+    std::mutex file_mutex;
+    std::unordered_map<std::string, std::shared_ptr<MmapFile>> file_map;
 
 private:
     // private member
@@ -0,0 +1,260 @@
+#include <mutex>
+#include <algorithm>
+#include <climits>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mmap_file.h"
+#include "../cpp_util/lib/error.hpp"
+#include "../cpp_util/lib/log.hpp"
+
+using namespace cpp_util;
+
+namespace sdb {
+
+// skip done bytes of iovec list after a short preadv/pwritev
+static void consume_iov(std::vector<iovec> &iov_lst, size_t done) {
+    auto it = iov_lst.begin();
+    while (it != iov_lst.end() && done >= it->iov_len) {
+        done -= it->iov_len;
+        it++;
+    }
+    iov_lst.erase(iov_lst.begin(), it);
+    if (done > 0) {
+        it = iov_lst.begin();
+        it->iov_base = static_cast<Byte*>(it->iov_base) + done;
+        it->iov_len -= done;
+    }
+}
+
+// ========== public ==========
+MmapFile::MmapFile(const std::string &abs_path, bool is_direct, size_t extent_block_count)
+        :abs_path(abs_path), is_direct(is_direct), extent_block_count(std::max(extent_block_count, size_t(1))) {
+    fd = open(abs_path.data(), O_RDWR | (is_direct ? O_DIRECT : 0));
+    if (fd < 0 && is_direct && errno == EINVAL) {
+        // e.g. tmpfs
+        log(format("O_DIRECT isn't supported by %s, use buffered io", abs_path));
+        this->is_direct = false;
+        fd = open(abs_path.data(), O_RDWR);
+    }
+    assert_msg(fd >= 0, abs_path);
+    struct stat file_info;
+    assert_msg(fstat(fd, &file_info) == 0, abs_path);
+    file_size = (size_t)(file_info.st_size);
+}
+
+MmapFile::~MmapFile() {
+    for (Byte *ptr : segment_lst) {
+        if (ptr != nullptr) {
+            munmap(ptr, SEGMENT_SIZE);
+        }
+    }
+    close(fd);
+}
+
+void MmapFile::read_block(size_t block_num, Byte *data) {
+    // block out of file is read by pread as zero, never grow file on read
+    if (is_direct || (block_num + 1) * BLOCK_SIZE > file_size) {
+        read_blocks({block_num}, {data});
+        return;
+    }
+    Byte *ptr = get_block_ptr(block_num);
+    std::memcpy(data, ptr, BLOCK_SIZE);
+}
+
+void MmapFile::write_block(size_t block_num, const Byte *data) {
+    if (is_direct) {
+        write_blocks({block_num}, {data});
+        return;
+    }
+    Byte *ptr = get_block_ptr(block_num);
+    std::memcpy(ptr, data, BLOCK_SIZE);
+}
+
+void MmapFile::read_blocks(const std::vector<size_t> &block_num_lst, const std::vector<Byte*> &data_lst) {
+    auto op = [this](size_t first_num, std::vector<iovec> &iov_lst) {
+        size_t len = iov_lst.size() * BLOCK_SIZE;
+        size_t done = 0;
+        while (done < len) {
+            ssize_t res = preadv(fd, iov_lst.data(), iov_lst.size(), first_num * BLOCK_SIZE + done);
+            if (res < 0 && errno == EINTR) continue;
+            assert_msg(res >= 0, format("preadv %s failed", abs_path));
+            if (res == 0) {
+                // blocks out of file read as zero
+                for (auto &&iov : iov_lst) {
+                    std::memset(iov.iov_base, 0, iov.iov_len);
+                }
+                return;
+            }
+            done += res;
+            consume_iov(iov_lst, res);
+        }
+    };
+    std::vector<Byte*> ptr_lst = data_lst;
+    AlignedBytes bounce;
+    auto bounce_idx_lst = use_bounce(ptr_lst, bounce);
+    range_run(block_num_lst, ptr_lst, op);
+    for (size_t i = 0; i < bounce_idx_lst.size(); i++) {
+        std::memcpy(data_lst[bounce_idx_lst[i]], bounce.data() + i * BLOCK_SIZE, BLOCK_SIZE);
+    }
+}
+
+void MmapFile::write_blocks(const std::vector<size_t> &block_num_lst, const std::vector<const Byte*> &data_lst) {
+    if (block_num_lst.empty()) return;
+    size_t max_num = *std::max_element(block_num_lst.begin(), block_num_lst.end());
+    ensure_size((max_num + 1) * BLOCK_SIZE);
+
+    auto op = [this](size_t first_num, std::vector<iovec> &iov_lst) {
+        size_t len = iov_lst.size() * BLOCK_SIZE;
+        size_t done = 0;
+        while (done < len) {
+            ssize_t res = pwritev(fd, iov_lst.data(), iov_lst.size(), first_num * BLOCK_SIZE + done);
+            if (res < 0 && errno == EINTR) continue;
+            assert_msg(res > 0, format("pwritev %s failed", abs_path));
+            done += res;
+            consume_iov(iov_lst, res);
+        }
+    };
+    // buffers only read by pwritev
+    std::vector<Byte*> ptr_lst;
+    for (const Byte *ptr : data_lst) {
+        ptr_lst.push_back(const_cast<Byte*>(ptr));
+    }
+    AlignedBytes bounce;
+    auto bounce_idx_lst = use_bounce(ptr_lst, bounce);
+    for (size_t i = 0; i < bounce_idx_lst.size(); i++) {
+        std::memcpy(bounce.data() + i * BLOCK_SIZE, data_lst[bounce_idx_lst[i]], BLOCK_SIZE);
+    }
+    range_run(block_num_lst, ptr_lst, op);
+}
+
+void MmapFile::ensure_size(size_t size) {
+    if (size <= file_size) return;
+    std::lock_guard<std::shared_mutex> lg(mutex);
+    if (size > file_size) {
+        extend(size);
+    }
+}
+
+void MmapFile::truncate(size_t size) {
+    std::lock_guard<std::shared_mutex> lg(mutex);
+    if (size >= file_size) return;
+    assert_msg(ftruncate(fd, size) == 0, format("ftruncate %s failed", abs_path));
+    file_size = size;
+}
+
+Byte *MmapFile::map_block(size_t block_num) {
+    assert(!is_direct);
+    return get_block_ptr(block_num);
+}
+
+void MmapFile::sync() {
+    std::shared_lock<std::shared_mutex> sl(mutex);
+    for (Byte *ptr : segment_lst) {
+        if (ptr != nullptr) {
+            assert_msg(msync(ptr, SEGMENT_SIZE, MS_SYNC) == 0, format("msync %s failed", abs_path));
+        }
+    }
+    assert_msg(fdatasync(fd) == 0, format("fdatasync %s failed", abs_path));
+}
+
+// ========== private ==========
+Byte *MmapFile::get_block_ptr(size_t block_num) {
+    size_t seg_num = block_num / SEGMENT_BLOCK_COUNT;
+    size_t seg_offset = (block_num % SEGMENT_BLOCK_COUNT) * BLOCK_SIZE;
+    size_t block_end = (block_num + 1) * BLOCK_SIZE;
+    {
+        // fast path: segment mapped and block in file
+        std::shared_lock<std::shared_mutex> sl(mutex);
+        if (block_end <= file_size && seg_num < segment_lst.size() && segment_lst[seg_num] != nullptr) {
+            return segment_lst[seg_num] + seg_offset;
+        }
+    }
+
+    std::lock_guard<std::shared_mutex> lg(mutex);
+    if (block_end > file_size) {
+        extend(block_end);
+    }
+    if (seg_num >= segment_lst.size()) {
+        segment_lst.resize(seg_num + 1, nullptr);
+    }
+    if (segment_lst[seg_num] == nullptr) {
+        // segment may pass the end of file,
+        // only the pages inside file are touched
+        void *ptr = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, seg_num * SEGMENT_SIZE);
+        assert_msg(ptr != MAP_FAILED, format("mmap segment %s of %s failed", seg_num, abs_path));
+        segment_lst[seg_num] = static_cast<Byte*>(ptr);
+    }
+    return segment_lst[seg_num] + seg_offset;
+}
+
+template <typename F>
+void MmapFile::range_run(const std::vector<size_t> &block_num_lst, const std::vector<Byte*> &data_lst, F op) {
+    assert(block_num_lst.size() == data_lst.size());
+    // sort by block num
+    std::vector<size_t> idx_lst(block_num_lst.size());
+    for (size_t i = 0; i < idx_lst.size(); i++) {
+        idx_lst[i] = i;
+    }
+    auto cmp = [&block_num_lst](size_t l, size_t r){return block_num_lst[l] < block_num_lst[r];};
+    std::sort(idx_lst.begin(), idx_lst.end(), cmp);
+
+    std::vector<iovec> iov_lst;
+    size_t first_num = 0;
+    for (size_t i = 0; i < idx_lst.size(); i++) {
+        size_t num = block_num_lst[idx_lst[i]];
+        bool is_adjacent = !iov_lst.empty() && num == first_num + iov_lst.size();
+        if (!is_adjacent || iov_lst.size() == IOV_MAX) {
+            if (!iov_lst.empty()) {
+                op(first_num, iov_lst);
+                iov_lst.clear();
+            }
+            first_num = num;
+        }
+        iov_lst.push_back({data_lst[idx_lst[i]], BLOCK_SIZE});
+    }
+    if (!iov_lst.empty()) {
+        op(first_num, iov_lst);
+    }
+}
+
+std::vector<size_t> MmapFile::use_bounce(std::vector<Byte*> &ptr_lst, AlignedBytes &bounce)const {
+    std::vector<size_t> idx_lst;
+    if (!is_direct) return idx_lst;
+    for (size_t i = 0; i < ptr_lst.size(); i++) {
+        if (reinterpret_cast<uintptr_t>(ptr_lst[i]) % BLOCK_SIZE != 0) {
+            idx_lst.push_back(i);
+        }
+    }
+    bounce.resize(idx_lst.size() * BLOCK_SIZE);
+    for (size_t i = 0; i < idx_lst.size(); i++) {
+        ptr_lst[idx_lst[i]] = bounce.data() + i * BLOCK_SIZE;
+    }
+    return idx_lst;
+}
+
+void MmapFile::extend(size_t size) {
+    // file may be grown by pwrite, never shrink it
+    struct stat file_info;
+    assert_msg(fstat(fd, &file_info) == 0, abs_path);
+    size_t old_size = (size_t)file_info.st_size;
+    if (old_size >= size) {
+        file_size = old_size;
+        return;
+    }
+    // round up to whole extent
+    size_t extent_size = extent_block_count * BLOCK_SIZE;
+    size_t new_size = (size + extent_size - 1) / extent_size * extent_size;
+    if (fallocate(fd, 0, old_size, new_size - old_size) != 0) {
+        assert_msg(errno == EOPNOTSUPP || errno == ENOSYS, format("fallocate %s failed", abs_path));
+        assert_msg(ftruncate(fd, new_size) == 0, abs_path);
+    }
+    file_size = new_size;
+}
+
+} // namespace sdb
@@ -0,0 +1,86 @@
+#ifndef DB_MMAP_FILE_H
+#define DB_MMAP_FILE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <shared_mutex>
+#include <sys/uio.h>
+
+#include "util.h"
+
+namespace sdb {
+
+// block file keeps one long-lived descriptor,
+// and maps the file in large segments on demand.
+// a segment is mapped once and never remapped, even if file grows,
+// so block read/write only cost a memcpy after warm up.
+//
+// direct mode opens file with O_DIRECT and maps nothing,
+// blocks go by pread/pwrite from block aligned buffers.
+//
+// file grows by whole extents with fallocate,
+// so most appends land in blocks already allocated.
+class MmapFile {
+public:
+    // 64MB per segment => 16384 blocks
+    static constexpr size_t SEGMENT_SIZE = size_t(64) * 1024 * 1024;
+    static constexpr size_t SEGMENT_BLOCK_COUNT = SEGMENT_SIZE / BLOCK_SIZE;
+
+    explicit MmapFile(const std::string &abs_path, bool is_direct = false, size_t extent_block_count = 1);
+    MmapFile(const MmapFile &)=delete;
+    MmapFile(MmapFile &&)=delete;
+    MmapFile &operator=(const MmapFile &)=delete;
+    MmapFile &operator=(MmapFile &&)=delete;
+    ~MmapFile();
+
+    // block
+    void read_block(size_t block_num, Byte *data);
+    void write_block(size_t block_num, const Byte *data);
+    // runs of adjacent block num are merged into one preadv/pwritev
+    void read_blocks(const std::vector<size_t> &block_num_lst, const std::vector<Byte*> &data_lst);
+    void write_blocks(const std::vector<size_t> &block_num_lst, const std::vector<const Byte*> &data_lst);
+
+    // grow file to at least size bytes, for writers not going through mapping
+    void ensure_size(size_t size);
+    // cut file to size bytes if larger,
+    // nobody may touch blocks past size meanwhile, mapping is kept
+    void truncate(size_t size);
+    // mapped block, written in place, grow file if block out of file.
+    // not for direct mode
+    Byte *map_block(size_t block_num);
+    // write changed pages of file to disk
+    void sync();
+
+    // get
+    int get_fd()const {return fd;}
+    bool get_is_direct()const {return is_direct;}
+    size_t get_file_size()const {return file_size;}
+
+private:
+    // grow file if block out of file, and map segment of block.
+    // only for write and map_block, read never grows file
+    Byte *get_block_ptr(size_t block_num);
+    void extend(size_t size);
+    // op(first block num, iovec list) for every run of adjacent block num
+    template <typename F>
+    void range_run(const std::vector<size_t> &block_num_lst, const std::vector<Byte*> &data_lst, F op);
+    // direct mode: point unaligned buffers of ptr_lst to bounce buffer,
+    // return index of replaced buffers
+    std::vector<size_t> use_bounce(std::vector<Byte*> &ptr_lst, AlignedBytes &bounce)const;
+
+private:
+    std::string abs_path;
+    int fd = -1;
+    bool is_direct;
+    size_t extent_block_count;
+    // file size kept in memory, no stat on block io
+    std::atomic<size_t> file_size;
+    // segment_lst[i] => mapped address of segment i, nullptr if unmapped
+    std::shared_mutex mutex;
+    std::vector<Byte*> segment_lst;
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_MMAP_FILE_H */
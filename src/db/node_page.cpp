@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <vector>
+
+#include "node_page.h"
+#include "../cpp_util/lib/error.hpp"
+
+using namespace cpp_util;
+
+namespace sdb {
+
+// ========== NodeView ==========
+BytesView NodeView::get_cell(Size cell)const {
+    cell = std::clamp(cell, HEADER_SIZE, BLOCK_SIZE - CELL_HEADER_SIZE);
+    Size len = std::clamp(read<Size>(cell), Size(0), BLOCK_SIZE - CELL_HEADER_SIZE - cell);
+    return BytesView(page.data() + cell + CELL_HEADER_SIZE, len);
+}
+
+Size NodeView::search(BytesView key)const {
+    // upper bound
+    Size beg = 0;
+    Size end = get_key_count();
+    while (beg < end) {
+        Size mid = beg + (end - beg) / 2;
+        if (compare(get_key(mid), key) <= 0) {
+            beg = mid + 1;
+        } else {
+            end = mid;
+        }
+    }
+    return beg;
+}
+
+Size NodeView::get_used_size()const {
+    Size size = HEADER_SIZE;
+    for (Size i = 0; i < get_key_count(); i++) {
+        size += SLOT_SIZE + CELL_HEADER_SIZE + Size(get_key(i).size());
+    }
+    if (has_high_key()) {
+        size += CELL_HEADER_SIZE + Size(get_high_key().size());
+    }
+    return size;
+}
+
+int NodeView::compare(BytesView l, BytesView r) {
+    int res = std::memcmp(l.data(), r.data(), std::min(l.size(), r.size()));
+    if (res != 0) return res < 0 ? -1 : 1;
+    if (l.size() == r.size()) return 0;
+    return l.size() < r.size() ? -1 : 1;
+}
+
+// ========== NodePage ==========
+NodePage::NodePage(bool is_leaf):page(BLOCK_SIZE, 0) {
+    page[NodeView::IS_LEAF_OFFSET] = is_leaf;
+    write(NodeView::RIGHT_POS_OFFSET, BlockNum(-1));
+    write(NodeView::KEY_COUNT_OFFSET, Size(0));
+    write(NodeView::CELL_BEGIN_OFFSET, Size(BLOCK_SIZE));
+    write(NodeView::HIGH_CELL_OFFSET, Size(0));
+    write(NodeView::POS_0_OFFSET, BlockNum(-1));
+}
+
+NodePage::NodePage(BytesView page):page(page.begin(), page.end()) {
+    assert(page.size() == BLOCK_SIZE);
+}
+
+void NodePage::set_pos(Size i, BlockNum pos) {
+    if (i == 0) {
+        write(NodeView::POS_0_OFFSET, pos);
+    } else {
+        write(NodeView::slot_offset(i - 1), pos);
+    }
+}
+
+bool NodePage::set_high_key(BytesView key) {
+    // old high cell is left as garbage until compact
+    Size need = NodeView::CELL_HEADER_SIZE + Size(key.size());
+    if (get_free_size() < need) {
+        write(NodeView::HIGH_CELL_OFFSET, Size(0));
+        compact();
+        if (get_free_size() < need) return false;
+    }
+    write(NodeView::HIGH_CELL_OFFSET, add_cell(key));
+    return true;
+}
+
+bool NodePage::insert(Size i, BytesView key, BlockNum pos) {
+    assert_msg(Size(key.size()) <= NodeView::MAX_KEY_SIZE, format("index key of %s bytes is too long", key.size()));
+    Size need = NodeView::SLOT_SIZE + NodeView::CELL_HEADER_SIZE + Size(key.size());
+    if (get_free_size() < need) {
+        compact();
+        if (get_free_size() < need) return false;
+    }
+    NodeView v = view();
+    Size key_count = v.get_key_count();
+    assert(i >= 0 && i <= key_count);
+
+    Size cell = add_cell(key);
+    // slot
+    Byte *slot = page.data() + NodeView::slot_offset(i);
+    std::memmove(slot + NodeView::SLOT_SIZE, slot, (key_count - i) * NodeView::SLOT_SIZE);
+    write(NodeView::slot_offset(i), pos);
+    write(NodeView::slot_offset(i) + Size(sizeof(BlockNum)), cell);
+    write(NodeView::KEY_COUNT_OFFSET, key_count + 1);
+    return true;
+}
+
+void NodePage::erase(Size i) {
+    Size key_count = view().get_key_count();
+    assert(i >= 0 && i < key_count);
+    // cell is left as garbage until compact
+    Byte *slot = page.data() + NodeView::slot_offset(i);
+    std::memmove(slot, slot + NodeView::SLOT_SIZE, (key_count - i - 1) * NodeView::SLOT_SIZE);
+    write(NodeView::KEY_COUNT_OFFSET, key_count - 1);
+}
+
+Bytes NodePage::split(NodePage &right) {
+    NodeView v = view();
+    Size key_count = v.get_key_count();
+    assert(key_count >= 3 && right.view().get_key_count() == 0);
+
+    // separator leaves about the same bytes on both sides
+    auto size = [&v](Size i) {
+        return NodeView::SLOT_SIZE + NodeView::CELL_HEADER_SIZE + Size(v.get_key(i).size());
+    };
+    Size used = 0;
+    for (Size i = 0; i < key_count; i++) {
+        used += size(i);
+    }
+    Size mid = 0;
+    for (Size half = 0; mid < key_count - 2 && (half + size(mid)) * 2 + size(mid + 1) <= used; mid++) {
+        half += size(mid);
+    }
+    mid = std::max(mid, Size(1));
+
+    Bytes sep(v.get_key(mid).begin(), v.get_key(mid).end());
+    right.set_pos(0, v.get_pos(mid + 1));
+    for (Size i = mid + 1; i < key_count; i++) {
+        bool is_ok = right.insert(i - mid - 1, v.get_key(i), v.get_pos(i + 1));
+        assert(is_ok);
+    }
+    if (v.has_high_key()) {
+        bool is_ok = right.set_high_key(v.get_high_key());
+        assert(is_ok);
+    }
+    write(NodeView::KEY_COUNT_OFFSET, mid);
+    bool is_ok = set_high_key(sep);
+    assert(is_ok);
+    return sep;
+}
+
+bool NodePage::merge(BytesView sep, NodeView right) {
+    NodePage page = *this;
+    // own high key is sep, dropped
+    page.write(NodeView::HIGH_CELL_OFFSET, Size(0));
+    Size key_count = page.view().get_key_count();
+    if (!page.insert(key_count, sep, right.get_pos(0))) return false;
+    for (Size i = 0; i < right.get_key_count(); i++) {
+        if (!page.insert(key_count + 1 + i, right.get_key(i), right.get_pos(i + 1))) return false;
+    }
+    if (right.has_high_key() && !page.set_high_key(right.get_high_key())) return false;
+    page.set_right_pos(right.get_right_pos());
+    *this = std::move(page);
+    return true;
+}
+
+Bytes NodePage::balance(BytesView sep, NodePage &right) {
+    // keys and pos of both nodes in order, sep between them
+    NodeView lv = view();
+    NodeView rv = right.view();
+    std::vector<Bytes> key_lst;
+    std::vector<BlockNum> pos_lst;
+    for (Size i = 0; i <= lv.get_key_count(); i++) {
+        pos_lst.push_back(lv.get_pos(i));
+        if (i < lv.get_key_count()) {
+            key_lst.emplace_back(lv.get_key(i).begin(), lv.get_key(i).end());
+        }
+    }
+    key_lst.emplace_back(sep.begin(), sep.end());
+    for (Size i = 0; i <= rv.get_key_count(); i++) {
+        pos_lst.push_back(rv.get_pos(i));
+        if (i < rv.get_key_count()) {
+            key_lst.emplace_back(rv.get_key(i).begin(), rv.get_key(i).end());
+        }
+    }
+    Size key_count = Size(key_lst.size());
+    assert(key_count >= 3);
+
+    // separator leaves about the same bytes on both sides, as split
+    auto size = [&key_lst](Size i) {
+        return NodeView::SLOT_SIZE + NodeView::CELL_HEADER_SIZE + Size(key_lst[i].size());
+    };
+    Size used = 0;
+    for (Size i = 0; i < key_count; i++) {
+        used += size(i);
+    }
+    Size mid = 0;
+    for (Size half = 0; mid < key_count - 2 && (half + size(mid)) * 2 + size(mid + 1) <= used; mid++) {
+        half += size(mid);
+    }
+    mid = std::max(mid, Size(1));
+
+    NodePage left_page(lv.is_leaf());
+    left_page.set_right_pos(lv.get_right_pos());
+    left_page.set_pos(0, pos_lst[0]);
+    for (Size i = 0; i < mid; i++) {
+        bool is_ok = left_page.insert(i, key_lst[i], pos_lst[i + 1]);
+        assert(is_ok);
+    }
+    bool is_ok = left_page.set_high_key(key_lst[mid]);
+    assert(is_ok);
+
+    NodePage right_page(rv.is_leaf());
+    right_page.set_right_pos(rv.get_right_pos());
+    right_page.set_pos(0, pos_lst[mid + 1]);
+    for (Size i = mid + 1; i < key_count; i++) {
+        is_ok = right_page.insert(i - mid - 1, key_lst[i], pos_lst[i + 1]);
+        assert(is_ok);
+    }
+    if (rv.has_high_key()) {
+        is_ok = right_page.set_high_key(rv.get_high_key());
+        assert(is_ok);
+    }
+    *this = std::move(left_page);
+    right = std::move(right_page);
+    return std::move(key_lst[mid]);
+}
+
+// ========== private ==========
+Size NodePage::add_cell(BytesView key) {
+    Size cell = view().get_cell_begin() - NodeView::CELL_HEADER_SIZE - Size(key.size());
+    write(cell, Size(key.size()));
+    std::memcpy(page.data() + cell + NodeView::CELL_HEADER_SIZE, key.data(), key.size());
+    write(NodeView::CELL_BEGIN_OFFSET, cell);
+    return cell;
+}
+
+void NodePage::compact() {
+    NodeView v = view();
+    Size key_count = v.get_key_count();
+    Bytes cells(BLOCK_SIZE);
+    Size cell_begin = BLOCK_SIZE;
+    auto move_cell = [&cells, &cell_begin](BytesView key) {
+        cell_begin -= NodeView::CELL_HEADER_SIZE + Size(key.size());
+        Size len = key.size();
+        std::memcpy(cells.data() + cell_begin, &len, sizeof(len));
+        std::memcpy(cells.data() + cell_begin + NodeView::CELL_HEADER_SIZE, key.data(), key.size());
+        return cell_begin;
+    };
+    for (Size i = 0; i < key_count; i++) {
+        write(NodeView::slot_offset(i) + Size(sizeof(BlockNum)), move_cell(v.get_key(i)));
+    }
+    if (v.has_high_key()) {
+        write(NodeView::HIGH_CELL_OFFSET, move_cell(v.get_high_key()));
+    }
+    std::memcpy(page.data() + cell_begin, cells.data() + cell_begin, BLOCK_SIZE - cell_begin);
+    write(NodeView::CELL_BEGIN_OFFSET, cell_begin);
+}
+
+} // namespace sdb
@@ -0,0 +1,146 @@
+#ifndef DB_NODE_PAGE_H
+#define DB_NODE_PAGE_H
+
+#include <algorithm>
+#include <cstring>
+
+#include "util.h"
+
+namespace sdb {
+
+// slotted page of a b+tree node:
+//     |is_leaf right_pos key_count cell_begin high_cell pos_0|slot_0 .. slot_n-1| free |cells|
+//     slot_i => |pos_i+1 cell offset of key_i|
+//     cell   => |len key bytes|
+// key_i separates pos_i and pos_i+1, pos_i+1 covers keys >= key_i.
+// high key is the first key of right node, keys >= it moved right by a split,
+// rightmost node of a level has none (high_cell 0).
+// slots are kept in key order, cells are packed from page end in any order.
+// keys are compared by memcmp, so callers encode them order preserving.
+//
+// optimistic readers may view a page while it is changed,
+// fields are clamped so reads stay in page, readers check page version after.
+class NodeView {
+public:
+    static constexpr Size HEADER_SIZE = sizeof(char) + sizeof(BlockNum) + 3 * sizeof(Size) + sizeof(BlockNum);
+    static constexpr Size SLOT_SIZE = sizeof(BlockNum) + sizeof(Size);
+    static constexpr Size CELL_HEADER_SIZE = sizeof(Size);
+    // a node holds 3 keys at least and a half node always takes one more
+    static constexpr Size MAX_KEY_SIZE = BLOCK_SIZE / 8;
+    static constexpr Size MAX_KEY_COUNT = (BLOCK_SIZE - HEADER_SIZE) / (SLOT_SIZE + CELL_HEADER_SIZE);
+
+    explicit NodeView(BytesView page):page(page){}
+
+    bool is_leaf()const {return page.data()[IS_LEAF_OFFSET] != 0;}
+    BlockNum get_right_pos()const {return read<BlockNum>(RIGHT_POS_OFFSET);}
+    Size get_key_count()const {
+        return std::clamp(read<Size>(KEY_COUNT_OFFSET), Size(0), MAX_KEY_COUNT);
+    }
+    // i in [0, key_count]
+    BlockNum get_pos(Size i)const {
+        return i == 0 ? read<BlockNum>(POS_0_OFFSET) : read<BlockNum>(slot_offset(i - 1));
+    }
+    // i in [0, key_count)
+    BytesView get_key(Size i)const {
+        return get_cell(read<Size>(slot_offset(i) + sizeof(BlockNum)));
+    }
+    bool has_high_key()const {return read<Size>(HIGH_CELL_OFFSET) != 0;}
+    BytesView get_high_key()const {return get_cell(read<Size>(HIGH_CELL_OFFSET));}
+    // key moved to right node by a split
+    bool is_beyond(BytesView key)const {
+        return has_high_key() && compare(key, get_high_key()) >= 0;
+    }
+    // bytes of header, slots and live cells, page size once compacted
+    Size get_used_size()const;
+    // count of keys <= key, pos of that index covers key.
+    // binary search on page, no copy
+    Size search(BytesView key)const;
+    // -1, 0, 1 as memcmp, shorter key is less if it is a prefix
+    static int compare(BytesView l, BytesView r);
+
+private:
+    friend class NodePage;
+
+    static constexpr Size IS_LEAF_OFFSET = 0;
+    static constexpr Size RIGHT_POS_OFFSET = IS_LEAF_OFFSET + sizeof(char);
+    static constexpr Size KEY_COUNT_OFFSET = RIGHT_POS_OFFSET + sizeof(BlockNum);
+    static constexpr Size CELL_BEGIN_OFFSET = KEY_COUNT_OFFSET + sizeof(Size);
+    static constexpr Size HIGH_CELL_OFFSET = CELL_BEGIN_OFFSET + sizeof(Size);
+    static constexpr Size POS_0_OFFSET = HIGH_CELL_OFFSET + sizeof(Size);
+
+    static Size slot_offset(Size i) {return HEADER_SIZE + i * SLOT_SIZE;}
+    Size get_cell_begin()const {return read<Size>(CELL_BEGIN_OFFSET);}
+    BytesView get_cell(Size cell)const;
+
+    // unaligned fields
+    template <typename T>
+    T read(Size offset)const {
+        T t;
+        std::memcpy(&t, page.data() + offset, sizeof(T));
+        return t;
+    }
+
+private:
+    BytesView page;
+};
+
+// node page owned for change, keys and slots are changed in place
+class NodePage {
+public:
+    // empty node
+    explicit NodePage(bool is_leaf);
+    // copy of node page
+    explicit NodePage(BytesView page);
+    NodePage(const NodePage &)=default;
+    NodePage &operator=(const NodePage &)=default;
+
+    NodeView view()const {return NodeView(page);}
+    BytesView bytes()const {return page;}
+
+    void set_right_pos(BlockNum pos) {write(NodeView::RIGHT_POS_OFFSET, pos);}
+    void set_pos(Size i, BlockNum pos);
+    // return false if page has no room
+    bool set_high_key(BytesView key);
+    // insert key_i and pos_i+1, later slots move by one memmove.
+    // return false if page has no room, page is unchanged then
+    bool insert(Size i, BytesView key, BlockNum pos);
+    // remove key_i and pos_i+1
+    void erase(Size i);
+    // move upper half by bytes to empty right page, return separator key,
+    // it is removed from both and goes up to parent:
+    //     left => keys [0, mid), right => pos_mid+1 and keys (mid, n)
+    // separator becomes high key of left, right takes old high key of left
+    Bytes split(NodePage &right);
+    // append separator with pos_0 of right node and keys of right node,
+    // take over its high key and right link.
+    // return false if page has no room, page is unchanged then
+    bool merge(BytesView sep, NodeView right);
+    // move keys between this and right node, separated by sep,
+    // until both hold about the same bytes. return new separator,
+    // it becomes high key of this, right keeps its high key and right link
+    Bytes balance(BytesView sep, NodePage &right);
+
+    // bytes between slots and cells
+    Size get_free_size()const {
+        NodeView v = view();
+        return v.get_cell_begin() - NodeView::slot_offset(v.get_key_count());
+    }
+
+private:
+    // new cell before cell begin, caller checked room
+    Size add_cell(BytesView key);
+    // pack live cells at page end again, cells of erased keys are dropped
+    void compact();
+
+    template <typename T>
+    void write(Size offset, T t) {
+        std::memcpy(page.data() + offset, &t, sizeof(T));
+    }
+
+private:
+    Bytes page;
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_NODE_PAGE_H */
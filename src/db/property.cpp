@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "property.h"
+#include "../cpp_util/lib/error.hpp"
 
 namespace sdb {
 
@@ -6,7 +9,7 @@ using namespace sdb::db_type;
 
 // === ColProperty === 
 Bytes ColProperty::en_bytes()const {
-    return sdb::en_bytes(col_name, col_type, type_size, default_value->en_bytes(), is_not_null);
+    return sdb::en_bytes(col_name, type_info, order_num, is_key, is_not_null);
 }
 
 ColProperty ColProperty::de_bytes(const Bytes &bytes, Size &offset){
@@ -14,24 +17,22 @@ ColProperty ColProperty::de_bytes(const Bytes &bytes, Size &offset){
     std::string col_name;
     sdb::de_bytes(col_name, bytes, offset);
     // type
-    TypeTag type;
-    sdb::de_bytes(type, bytes, offset);
-    // type_size
-    size_t type_size;
-    sdb::de_bytes(type_size, bytes, offset);
-    // default value
-    ObjPtr dv = get_default(type, type_size);
-    dv->de_bytes(bytes, offset);
+    TypeInfo type_info;
+    sdb::de_bytes(type_info, bytes, offset);
+    int8_t order_num = 0;
+    sdb::de_bytes(order_num, bytes, offset);
+    bool is_key = false;
+    sdb::de_bytes(is_key, bytes, offset);
     // is not null
-    char is_not_null = false;
+    bool is_not_null = false;
     sdb::de_bytes(is_not_null, bytes, offset);
-    return ColProperty(col_name, type, type_size, dv, is_not_null);
+    return ColProperty(col_name, type_info, order_num, is_key, is_not_null);
 }
 
 // === TableProperty === 
 Size TableProperty::get_col_property_pos(const std::string &col_name)const{
     auto f = [col_name](auto &&cp)->bool{return cp.col_name == col_name;};
-    std::find_if(col_property_lst.begin(), col_property_lst.end(), f);
+    return std::find_if(col_property_lst.begin(), col_property_lst.end(), f) - col_property_lst.begin();
 }
 
 std::vector<std::string> TableProperty::get_col_name_lst()const{
@@ -44,11 +45,57 @@ std::vector<std::string> TableProperty::get_col_name_lst()const{
 
 TableProperty::ColPropertyList TableProperty::get_keys_property()const {
     ColPropertyList cps;
-    for (auto &&x : keys) {
-        auto pos = get_col_property_pos(x);
-        cps.push_back(col_property_lst[pos]);
+    for (auto &&cp : col_property_lst) {
+        if (cp.is_key) {
+            cps.push_back(cp);
+        }
     }
     return cps;
 }
 
+ColProperty TableProperty::get_col_property(const std::string &col_name)const {
+    Size pos = get_col_property_pos(col_name);
+    assert_msg(pos < Size(col_property_lst.size()), cpp_util::format("col [%s] not in table [%s]", col_name, table_name));
+    return col_property_lst[pos];
+}
+
+std::vector<TypeInfo> TableProperty::get_type_info_lst()const {
+    std::vector<TypeInfo> info_lst;
+    for (auto &&cp : col_property_lst) {
+        info_lst.push_back(cp.type_info);
+    }
+    return info_lst;
+}
+
+std::vector<Size> TableProperty::get_keys_pos()const {
+    std::vector<Size> pos_lst;
+    for (Size i = 0; i < Size(col_property_lst.size()); i++) {
+        if (col_property_lst[i].is_key) {
+            pos_lst.push_back(i);
+        }
+    }
+    return pos_lst;
+}
+
+TableProperty TableProperty::get_index_property(const IndexProperty &ip)const {
+    std::vector<std::string> col_name_lst = ip.col_name_lst;
+    for (auto &&cp : col_property_lst) {
+        if (cp.is_key) {
+            col_name_lst.push_back(cp.col_name);
+        }
+    }
+    Size key_count = Size(col_name_lst.size());
+    col_name_lst.insert(col_name_lst.end(), ip.include_col_name_lst.begin(), ip.include_col_name_lst.end());
+    ColPropertyList cp_lst;
+    int8_t order_num = 0;
+    for (auto &&col_name : col_name_lst) {
+        auto f = [&col_name](auto &&cp)->bool{return cp.col_name == col_name;};
+        auto it = std::find_if(col_property_lst.begin(), col_property_lst.end(), f);
+        assert_msg(it != col_property_lst.end(), cpp_util::format("col [%s] not in table [%s]", col_name, table_name));
+        cp_lst.emplace_back(col_name, it->type_info, order_num, order_num < key_count, it->is_not_null);
+        order_num++;
+    }
+    return TableProperty(table_name + "." + ip.index_name, ip.record_root, ip.keys_idx_root, cp_lst);
+}
+
 } // SDB::Function namespace about
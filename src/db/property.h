@@ -24,6 +24,18 @@ struct ColProperty {
     static ColProperty de_bytes(const Bytes &bytes, Size &offset);
 };
 
+// secondary index of a table, a b+tree of its own:
+// index columns then primary key columns, all of them are keys,
+// so rows with equal index columns are kept apart by primary key.
+// include columns follow as data, for queries answered by index alone
+struct IndexProperty {
+    std::string index_name;
+    std::vector<std::string> col_name_lst;
+    std::vector<std::string> include_col_name_lst;
+    BlockNum record_root;
+    BlockNum keys_idx_root;
+};
+
 // table property
 struct TableProperty {
     // type alias
@@ -39,6 +51,8 @@ struct TableProperty {
     std::unordered_map<std::string, std::string> referencing_map;
     // <table_name, col_name>
     std::unordered_map<std::string, std::string> referenced_map;
+    // secondary indexes
+    std::vector<IndexProperty> index_lst;
 
     // TableProperty(){}
     TableProperty(const std::string &table_name,
@@ -51,12 +65,14 @@ struct TableProperty {
     Size get_col_property_pos(const std::string &col_name)const;
     std::vector<std::string> get_col_name_lst()const;
     ColPropertyList get_keys_property()const;
-    // TODO
     ColProperty get_col_property(const std::string &col_name)const;
-    // TODO
     std::vector<db_type::TypeInfo> get_type_info_lst()const;
-    // TODO
     std::vector<Size> get_keys_pos()const;
+    // property of index tree, table name => <table name>.<index name>
+    TableProperty get_index_property(const IndexProperty &ip)const;
+    // owners of block extents
+    std::string record_owner()const {return table_name;}
+    std::string keys_index_owner()const {return table_name + ".keys_index";}
 };
 
 } // namespace sdb
@@ -8,24 +8,21 @@
 namespace sdb {
 
 Record::Record(TransInfo t_info, TableProperty table_property, BlockNum bn):t_info(t_info), tp(table_property), block_num(bn) {
-    Bytes bytes = t_info.s_ptr->read_block(bn);
-    // read next record num
-    Size offset = 0;
-    sdb::de_bytes(next_record_num, bytes, offset);
-    // read tuples
-    std::vector<db_type::TypeInfo> info_lst;
-    for (auto &&cp : tp.col_property_lst) {
-        info_lst.push_back(cp.type_info);
-    }
-    Size len = 0;
-    sdb::de_bytes(len, bytes, offset);
-    for (Size i = 0; i < len; i++) {
-        Vid v_id = 0;
-        Tuple tuple;
-        sdb::de_bytes(v_id, bytes, offset);
-        tuple.de_bytes(info_lst, bytes, offset);
-        record_lst.push_back({v_id, tuple});
-    }
+    // deserialize from a copy of pinned page,
+    // a put may overwrite the frame in place while it is read
+    PageRef page = t_info.s_ptr->read_page(bn);
+    Byte data[BLOCK_SIZE];
+    page.copy_to(data);
+    load(BytesView(data, BLOCK_SIZE));
+}
+
+Record::Record(TransInfo t_info, TableProperty table_property, BlockNum bn, ScanRing &ring)
+        :t_info(t_info), tp(table_property), block_num(bn) {
+    load(t_info.s_ptr->read_scan_page(bn, ring));
+}
+
+Record Record::new_record(TransInfo t_info, TableProperty table_property, BlockNum bn) {
+    return Record(t_info, std::move(table_property), bn, nullptr);
 }
 
 bool Record::is_less()const {
@@ -36,20 +33,6 @@ bool Record::is_full() const {
     return get_bytes_size() > BLOCK_SIZE;
 }
 
-Record Record::split() {
-    // need log
-    BlockNum new_bn = BlockAlloc::get().new_block();
-    Record record(t_info, tp, new_bn);
-    // set next record num
-    record.next_record_num = next_record_num;
-    next_record_num = new_bn;
-
-    // move tuples
-    size_t len = record_lst.size() / 2;
-    record.record_lst.splice(record.record_lst.begin(), record_lst, std::next(record_lst.begin(), len), record_lst.end());
-    return record;
-}
-
 void Record::merge(Record &&record) {
     for (auto && pair : record.record_lst) {
         record_lst.push_back(std::move(pair));
@@ -57,7 +40,104 @@ void Record::merge(Record &&record) {
     next_record_num = record.next_record_num;
 }
 
+void Record::borrow(Record &right) {
+    Size size = get_bytes_size();
+    Size right_size = right.get_bytes_size();
+    while (!right.record_lst.empty()) {
+        Size tuple_size = tuple_bytes_size(right.record_lst.front().second);
+        if (size + tuple_size > right_size - tuple_size) break;
+        record_lst.splice(record_lst.end(), right.record_lst, right.record_lst.begin());
+        size += tuple_size;
+        right_size -= tuple_size;
+    }
+}
+
+std::vector<BlockNum> Record::insert(const Tuple &key, const Tuple &data) {
+    return put(key, data, false);
+}
+
+void Record::remove(const Tuple &key) {
+    auto it = lower_bound(key);
+    if (it == record_lst.end() || !it->second.select(tp.get_keys_pos()).eq(key)) return;
+    record_lst.erase(it);
+    sync();
+}
+
+void Record::remove(TuplePred pred) {
+    size_t size = record_lst.size();
+    record_lst.remove_if([&pred](auto &&pair){return pred(pair.second);});
+    if (record_lst.size() != size) {
+        sync();
+    }
+}
+
+std::vector<BlockNum> Record::update(const Tuple &key, const Tuple &data) {
+    return put(key, data, true);
+}
+
+Tuples Record::update(TuplePred pred, TupleOp op) {
+    Tuples left_ts(tp.col_property_lst.size());
+    bool is_changed = false;
+    auto keys_pos = tp.get_keys_pos();
+    Size size = get_bytes_size();
+    for (auto &&pair : record_lst) {
+        if (pred(pair.second)) {
+            Tuple tuple = op(pair.second);
+            // tuples are kept in key order
+            if (!tuple.select(keys_pos).eq(pair.second.select(keys_pos))) {
+                throw std::runtime_error(cpp_util::format("update changed key of table [%s]", tp.table_name));
+            }
+            Size new_size = size - tuple_bytes_size(pair.second) + tuple_bytes_size(tuple);
+            if (new_size > BLOCK_SIZE) {
+                left_ts.push_back(std::move(tuple));
+                continue;
+            }
+            size = new_size;
+            pair = {t_info.id, std::move(tuple)};
+            is_changed = true;
+        }
+    }
+    if (is_changed) {
+        sync();
+    }
+    return left_ts;
+}
+
+Tuples Record::find_key(const Tuple &key)const {
+    return select(&key, true, &key, true);
+}
+
+Tuples Record::find_less(const Tuple &key, bool is_close)const {
+    return select(nullptr, false, &key, is_close);
+}
+
+Tuples Record::find_greater(const Tuple &key, bool is_close)const {
+    return select(&key, is_close, nullptr, false);
+}
+
+Tuples Record::find_range(const Tuple &beg, const Tuple &end, bool is_beg_close, bool is_end_close)const {
+    return select(&beg, is_beg_close, &end, is_end_close);
+}
+
+Tuples Record::find(TuplePred pred)const {
+    Tuples ts(tp.col_property_lst.size());
+    for (auto &&[v_id, tuple] : record_lst) {
+        if (pred(tuple)) {
+            ts.push_back(tuple);
+        }
+    }
+    return ts;
+}
+
+Tuples Record::get_all_tuple()const {
+    return select(nullptr, false, nullptr, false);
+}
+
 void Record::sync() const {
+    t_info.s_ptr->write_block(block_num, en_bytes());
+}
+
+Bytes Record::en_bytes()const {
     // next record num
     Bytes bytes = sdb::en_bytes(next_record_num);
     // record list
@@ -65,18 +145,153 @@ void Record::sync() const {
     bytes.insert(bytes.end(), tuples_bytes.begin(), tuples_bytes.end());
     assert(bytes.size() <= BLOCK_SIZE);
     bytes.resize(BLOCK_SIZE);
-    t_info.s_ptr->write_block(block_num, bytes);
+    return bytes;
 }
 
 Size Record::get_bytes_size()const {
-    Size size = sizeof(next_record_num);
-    //  record list size
-    size += sizeof(Size);
+    Size size = HEADER_SIZE;
     for (auto &&[v_id, tuple] : record_lst) {
-        size += sizeof(v_id);
-        size += tuple.data_bytes_size();
+        size += tuple_bytes_size(tuple);
     }
     return size;
 }
 
+void Record::load(BytesView bytes) {
+    // read next record num
+    Size offset = 0;
+    sdb::de_bytes(next_record_num, bytes, offset);
+    // read tuples
+    std::vector<db_type::TypeInfo> info_lst;
+    for (auto &&cp : tp.col_property_lst) {
+        info_lst.push_back(cp.type_info);
+    }
+    Size len = 0;
+    sdb::de_bytes(len, bytes, offset);
+    for (Size i = 0; i < len; i++) {
+        Vid v_id = 0;
+        Tuple tuple;
+        sdb::de_bytes(v_id, bytes, offset);
+        tuple.de_bytes(info_lst, bytes, offset);
+        record_lst.push_back({v_id, tuple});
+    }
+}
+
+std::list<std::pair<Vid, Tuple>>::iterator Record::lower_bound(const Tuple &key) {
+    auto keys_pos = tp.get_keys_pos();
+    auto it = record_lst.begin();
+    while (it != record_lst.end() && it->second.select(keys_pos).less(key)) {
+        it++;
+    }
+    return it;
+}
+
+Tuples Record::select(const Tuple *beg, bool is_beg_close, const Tuple *end, bool is_end_close)const {
+    Tuples ts(tp.col_property_lst.size());
+    auto keys_pos = tp.get_keys_pos();
+    for (auto &&[v_id, tuple] : record_lst) {
+        Tuple key = tuple.select(keys_pos);
+        if (beg != nullptr && (key.less(*beg) || (!is_beg_close && key.eq(*beg)))) continue;
+        if (end != nullptr && (end->less(key) || (!is_end_close && key.eq(*end)))) break;
+        ts.push_back(tuple);
+    }
+    return ts;
+}
+
+std::vector<BlockNum> Record::put(const Tuple &key, const Tuple &data, bool is_update) {
+    if (HEADER_SIZE + tuple_bytes_size(data) > BLOCK_SIZE) {
+        throw std::runtime_error(cpp_util::format("tuple of %s bytes doesn't fit in a block", tuple_bytes_size(data)));
+    }
+    auto it = lower_bound(key);
+    bool is_found = it != record_lst.end() && it->second.select(tp.get_keys_pos()).eq(key);
+    if (is_found != is_update) {
+        throw std::runtime_error(cpp_util::format(is_update ? "key not found in table [%s]" : "key existed in table [%s]",
+                                                  tp.table_name));
+    }
+    if (is_found) {
+        *it = {t_info.id, data};
+    } else {
+        it = record_lst.insert(it, {t_info.id, data});
+    }
+    if (get_bytes_size() <= BLOCK_SIZE) {
+        sync();
+        return {};
+    }
+    return split(size_t(std::distance(record_lst.begin(), it)));
+}
+
+std::vector<size_t> Record::split_pos_lst(size_t pos)const {
+    std::vector<Size> size_lst;
+    Size total = 0;
+    for (auto &&[v_id, tuple] : record_lst) {
+        size_lst.push_back(tuple_bytes_size(tuple));
+        total += size_lst.back();
+    }
+    size_t mid = 1;
+    Size mid_size = total;
+    Size left_size = 0;
+    for (size_t i = 1; i < size_lst.size(); i++) {
+        left_size += size_lst[i - 1];
+        Size size = std::max(left_size, total - left_size);
+        if (size < mid_size) {
+            mid = i;
+            mid_size = size;
+        }
+    }
+    if (HEADER_SIZE + mid_size <= BLOCK_SIZE) return {mid};
+    // tuples before and after pos fit, they were in block before tuple at pos came
+    std::vector<size_t> pos_lst;
+    if (pos > 0) {
+        pos_lst.push_back(pos);
+    }
+    if (pos + 1 < size_lst.size()) {
+        pos_lst.push_back(pos + 1);
+    }
+    return pos_lst;
+}
+
+std::vector<BlockNum> Record::split(size_t pos) {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    // parts from right to left, positions before a cut stay
+    std::vector<size_t> pos_lst = split_pos_lst(pos);
+    std::vector<Record> right_lst;
+    for (auto it = pos_lst.rbegin(); it != pos_lst.rend(); it++) {
+        // next to this record if extent isn't used up
+        Record right = new_record(t_info, tp, block_alloc.new_block(tp.record_owner()));
+        right.record_lst.splice(right.record_lst.begin(), record_lst, std::next(record_lst.begin(), *it), record_lst.end());
+        right_lst.insert(right_lst.begin(), std::move(right));
+    }
+
+    // committed tuples, right records go to cache before anything links to them
+    TransInfo c_info{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    Record committed(c_info, tp, block_num);
+    BlockNum next = committed.next_record_num;
+    for (auto it = right_lst.rbegin(); it != right_lst.rend(); it++) {
+        Record c_right = new_record(c_info, tp, it->block_num);
+        auto c_it = committed.lower_bound(it->record_lst.front().second.select(tp.get_keys_pos()));
+        c_right.record_lst.splice(c_right.record_lst.begin(), committed.record_lst, c_it, committed.record_lst.end());
+        c_right.next_record_num = next;
+        cache.put(c_right.block_num, c_right.en_bytes());
+        next = c_right.block_num;
+    }
+    committed.next_record_num = next;
+    cache.put(block_num, committed.en_bytes());
+
+    // tuples of this transaction
+    std::vector<BlockNum> pos_of_right;
+    next = next_record_num;
+    for (auto it = right_lst.rbegin(); it != right_lst.rend(); it++) {
+        it->next_record_num = next;
+        next = it->block_num;
+    }
+    next_record_num = next;
+    for (auto &&right : right_lst) {
+        t_info.s_ptr->lock_block(right.block_num);
+        right.sync();
+        pos_of_right.push_back(right.block_num);
+    }
+    sync();
+    return pos_of_right;
+}
+
 } // namespace sdb
@@ -17,47 +17,84 @@ namespace sdb {
 
 class Record {
 public:
+    // next record num and tuple count
+    static constexpr Size HEADER_SIZE = sizeof(BlockNum) + sizeof(Size);
+
     Record()= delete;
     Record(TransInfo info, TableProperty, BlockNum);
+    // read block through ring of a large scan
+    Record(TransInfo info, TableProperty, BlockNum, ScanRing &ring);
+    // empty record of a new block, nothing read
+    static Record new_record(TransInfo info, TableProperty, BlockNum);
 
     bool is_less()const;
     bool is_full()const;
 
-    Record split();
     void merge(Record &&record);
+    // move first tuples of right record here,
+    // till both hold about the same bytes
+    void borrow(Record &right);
     
     // === sql ===
-    // return new block num if split
-    std::optional<BlockNum> insert(const Tuple &key, const Tuple &data);
+    // tuples are kept in key order.
+    // return new right block nums of a split in key order, see split
+    std::vector<BlockNum> insert(const Tuple &key, const Tuple &data);
     // remove
     void remove(const Tuple &key);
-    // TODO
+    // remove tuples matching pred
     void remove(TuplePred pred);
     // update
-    // return right pos if split
-    std::optional<BlockNum> update(const Tuple &key, const std::string &col_name, db_type::ObjCntPtr new_val);
-    // TODO
-    // return return rightmost pos if multi-split
-    std::optional<BlockNum> update(TuplePred pred, TupleOp op);
+    // return new right block nums of a split, as insert
+    std::vector<BlockNum> update(const Tuple &key, const Tuple &data);
+    // op on tuples matching pred, throw if op changes key columns.
+    // no split: return new tuples that don't fit in block any more, they are left as they were,
+    // caller updates them by key then.
+    Tuples update(TuplePred pred, TupleOp op);
 
     //  find
-    Tuples find_key(const Tuple &tuple);
+    Tuples find_key(const Tuple &key)const;
     Tuples find_less(const Tuple &key, bool is_close)const;
     Tuples find_greater(const Tuple &key, bool is_close)const;
     Tuples find_range(const Tuple &beg, const Tuple &end, bool is_beg_close, bool is_end_close)const;
-    // TODO
-    Tuples find(TuplePred pred);
+    Tuples find(TuplePred pred)const;
 
     // get
     Tuples get_all_tuple()const;
     BlockNum get_block_num()const {return block_num;}
-    BlockNum get_next_record_num()const {return block_num;}
+    BlockNum get_next_record_num()const {return next_record_num;}
+    // bytes taken in block
+    Size get_bytes_size()const;
+    // set
+    void set_next_record_num(BlockNum num) {next_record_num = num;}
+
+    // bytes taken by a tuple in record block
+    static Size tuple_bytes_size(const Tuple &tuple) {
+        return sizeof(Vid) + tuple.data_bytes_size();
+    }
 
     // sync
     void sync() const;
+    // block bytes
+    Bytes en_bytes()const;
 
 private: // function
-    Size get_bytes_size()const;
+    Record(TransInfo info, TableProperty tp, BlockNum bn, std::nullptr_t)
+        :t_info(info), tp(std::move(tp)), block_num(bn){}
+    void load(BytesView bytes);
+    // first tuple with key not less than key
+    std::list<std::pair<Vid, Tuple>>::iterator lower_bound(const Tuple &key);
+    // tuples with keys_pos of key between beg and end, either may be missing
+    Tuples select(const Tuple *beg, bool is_beg_close, const Tuple *end, bool is_end_close)const;
+    // put tuple, split if it doesn't fit, sync
+    std::vector<BlockNum> put(const Tuple &key, const Tuple &data, bool is_update);
+    // pos of first tuple of every part but the first, every part fits in a block:
+    // two parts of about the same bytes if they fit, else tuple at pos gets a part of its own
+    std::vector<size_t> split_pos_lst(size_t pos)const;
+    // move tuples past split_pos_lst(pos) to new right records, return their block nums.
+    // committed tuples are split by the same keys and written to cache at once, as nodes are,
+    // so a rollback keeps the split and readers routed to a new record find them.
+    // tuples of this transaction go through snapshot, new records are locked by it
+    std::vector<BlockNum> split(size_t pos);
 
 private: // member
     TransInfo t_info;
@@ -0,0 +1,174 @@
+#include <algorithm>
+
+#include "replace_policy.h"
+#include "../cpp_util/lib/error.hpp"
+
+using namespace cpp_util;
+
+namespace sdb {
+
+std::unique_ptr<ReplacePolicy> ReplacePolicy::make(const std::string &name, size_t max_block_count) {
+    if (name == "lru") {
+        return std::make_unique<LruPolicy>();
+    }
+    assert_msg(name == "2q", format("unknown cache policy: %s", name));
+    return std::make_unique<TwoQPolicy>(max_block_count);
+}
+
+// ========== LruPolicy ==========
+void LruPolicy::insert(BlockNum key) {
+    key_lst.push_front(key);
+    key_map[key] = key_lst.begin();
+}
+
+void LruPolicy::access(BlockNum key) {
+    auto it = key_map.find(key);
+    assert(it != key_map.end());
+    key_lst.splice(key_lst.begin(), key_lst, it->second);
+}
+
+BlockNum LruPolicy::victim() {
+    assert(!key_lst.empty());
+    BlockNum key = key_lst.back();
+    key_map.erase(key);
+    key_lst.pop_back();
+    return key;
+}
+
+void LruPolicy::requeue(BlockNum key) {
+    insert(key);
+}
+
+void LruPolicy::erase(BlockNum key) {
+    auto it = key_map.find(key);
+    if (it == key_map.end()) return;
+    key_lst.erase(it->second);
+    key_map.erase(it);
+}
+
+std::vector<BlockNum> LruPolicy::key_list()const {
+    return std::vector<BlockNum>(key_lst.begin(), key_lst.end());
+}
+
+std::vector<BlockNum> LruPolicy::cold_keys(size_t count)const {
+    std::vector<BlockNum> cold_lst;
+    for (auto it = key_lst.rbegin(); it != key_lst.rend() && cold_lst.size() < count; ++it) {
+        cold_lst.push_back(*it);
+    }
+    return cold_lst;
+}
+
+// ========== TwoQPolicy ==========
+TwoQPolicy::TwoQPolicy(size_t max_block_count) {
+    resize(max_block_count);
+}
+
+void TwoQPolicy::insert(BlockNum key) {
+    auto it = key_map.find(key);
+    if (it != key_map.end() && it->second.queue == A1_OUT) {
+        // evicted not long ago, hot
+        remove(key);
+        push(AM, key);
+        return;
+    }
+    assert(it == key_map.end());
+    push(A1_IN, key);
+}
+
+void TwoQPolicy::access(BlockNum key) {
+    auto it = key_map.find(key);
+    assert(it != key_map.end() && it->second.queue != A1_OUT);
+    // hits in a1_in are correlated references, keep fifo order
+    if (it->second.queue == AM) {
+        am.splice(am.begin(), am, it->second.it);
+    }
+}
+
+BlockNum TwoQPolicy::victim() {
+    assert(!a1_in.empty() || !am.empty());
+    BlockNum key;
+    if (a1_in.size() > max_in_count || am.empty()) {
+        key = a1_in.back();
+        remove(key);
+        push(A1_OUT, key);
+        if (a1_out.size() > max_out_count) {
+            remove(a1_out.back());
+        }
+    } else {
+        key = am.back();
+        remove(key);
+    }
+    return key;
+}
+
+void TwoQPolicy::requeue(BlockNum key) {
+    auto it = key_map.find(key);
+    if (it != key_map.end()) {
+        // came from a1_in, victim() left it in a1_out
+        assert(it->second.queue == A1_OUT);
+        remove(key);
+        push(A1_IN, key);
+        return;
+    }
+    push(AM, key);
+}
+
+void TwoQPolicy::erase(BlockNum key) {
+    auto it = key_map.find(key);
+    if (it == key_map.end() || it->second.queue == A1_OUT) return;
+    remove(key);
+}
+
+std::vector<BlockNum> TwoQPolicy::key_list()const {
+    std::vector<BlockNum> key_lst(am.begin(), am.end());
+    key_lst.insert(key_lst.end(), a1_in.begin(), a1_in.end());
+    return key_lst;
+}
+
+std::vector<BlockNum> TwoQPolicy::cold_keys(size_t count)const {
+    // same order as victim(): a1_in above its quota, am, rest of a1_in
+    std::vector<BlockNum> cold_lst;
+    auto in_it = a1_in.rbegin();
+    for (size_t in_count = a1_in.size(); in_count > max_in_count && cold_lst.size() < count; in_count--) {
+        cold_lst.push_back(*in_it++);
+    }
+    for (auto it = am.rbegin(); it != am.rend() && cold_lst.size() < count; ++it) {
+        cold_lst.push_back(*it);
+    }
+    for (; in_it != a1_in.rend() && cold_lst.size() < count; ++in_it) {
+        cold_lst.push_back(*in_it);
+    }
+    return cold_lst;
+}
+
+void TwoQPolicy::resize(size_t max_block_count) {
+    max_in_count = std::max(max_block_count / 4, size_t(1));
+    max_out_count = std::max(max_block_count / 2, size_t(1));
+    while (a1_out.size() > max_out_count) {
+        remove(a1_out.back());
+    }
+}
+
+// ========== private ==========
+std::list<BlockNum> &TwoQPolicy::get_list(Queue queue) {
+    switch (queue) {
+        case A1_IN: return a1_in;
+        case AM: return am;
+        default: return a1_out;
+    }
+}
+
+void TwoQPolicy::push(Queue queue, BlockNum key) {
+    auto &&lst = get_list(queue);
+    lst.push_front(key);
+    key_map[key] = Entry{queue, lst.begin()};
+}
+
+void TwoQPolicy::remove(BlockNum key) {
+    auto it = key_map.find(key);
+    assert(it != key_map.end());
+    get_list(it->second.queue).erase(it->second.it);
+    key_map.erase(it);
+}
+
+} // namespace sdb
@@ -0,0 +1,98 @@
+#ifndef DB_REPLACE_POLICY_H
+#define DB_REPLACE_POLICY_H
+
+#include <memory>
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "util.h"
+
+namespace sdb {
+
+// decide which cached block to evict,
+// only keeps block num, data is owned by BlockCache.
+// not thread safe, called under cache lock.
+class ReplacePolicy {
+public:
+    // name: "lru" or "2q"
+    static std::unique_ptr<ReplacePolicy> make(const std::string &name, size_t max_block_count);
+
+    virtual ~ReplacePolicy(){}
+
+    // block becomes resident
+    virtual void insert(BlockNum key) =0;
+    // resident block hit
+    virtual void access(BlockNum key) =0;
+    // remove block chosen to evict and return it, cache must not be empty
+    virtual BlockNum victim() =0;
+    // victim can't be evicted (pinned), put it back into the queue it came from
+    virtual void requeue(BlockNum key) =0;
+    // resident block removed without eviction
+    virtual void erase(BlockNum key) =0;
+    // resident blocks, hottest first
+    virtual std::vector<BlockNum> key_list()const =0;
+    // at most count resident blocks nearest to eviction, next victim first
+    virtual std::vector<BlockNum> cold_keys(size_t count)const =0;
+    // cache resized
+    virtual void resize(size_t) {}
+};
+
+class LruPolicy : public ReplacePolicy {
+public:
+    void insert(BlockNum key) override;
+    void access(BlockNum key) override;
+    BlockNum victim() override;
+    void requeue(BlockNum key) override;
+    void erase(BlockNum key) override;
+    std::vector<BlockNum> key_list()const override;
+    std::vector<BlockNum> cold_keys(size_t count)const override;
+
+private:
+    std::list<BlockNum> key_lst;
+    std::unordered_map<BlockNum, std::list<BlockNum>::iterator> key_map;
+};
+
+// 2Q (Johnson & Shasha):
+//     new blocks enter fifo a1_in, and are evicted from it first,
+//     evicted blocks leave their num in ghost fifo a1_out,
+//     a block inserted again while in a1_out is hot, goes to lru am.
+// blocks touched once by a scan never enter am, so scans don't flush hot blocks.
+class TwoQPolicy : public ReplacePolicy {
+public:
+    explicit TwoQPolicy(size_t max_block_count);
+
+    void insert(BlockNum key) override;
+    void access(BlockNum key) override;
+    BlockNum victim() override;
+    void requeue(BlockNum key) override;
+    void erase(BlockNum key) override;
+    std::vector<BlockNum> key_list()const override;
+    std::vector<BlockNum> cold_keys(size_t count)const override;
+    void resize(size_t max_block_count) override;
+
+private:
+    enum Queue : char { A1_IN, AM, A1_OUT };
+    struct Entry {
+        Queue queue;
+        std::list<BlockNum>::iterator it;
+    };
+
+    std::list<BlockNum> &get_list(Queue queue);
+    void push(Queue queue, BlockNum key);
+    void remove(BlockNum key);
+
+private:
+    // a1_in holds 1/4 cache, a1_out remembers 1/2 cache
+    size_t max_in_count;
+    size_t max_out_count;
+    std::list<BlockNum> a1_in;
+    std::list<BlockNum> am;
+    std::list<BlockNum> a1_out;
+    std::unordered_map<BlockNum, Entry> key_map;
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_REPLACE_POLICY_H */
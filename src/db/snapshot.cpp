@@ -1,78 +1,134 @@
+#include <algorithm>
+
 #include "snapshot.h"
 
 namespace sdb {
 
 // static init
-static std::map<BlockNum, std::mutex> block_lock_map;
+std::mutex Snapshot::lock_map_mutex;
+std::map<BlockNum, std::mutex> Snapshot::block_lock_map;
 
 // ========== public function =========
 Bytes Snapshot::read_block(BlockNum block_num) {
+    PageRef page = read_page(block_num);
+    Bytes bytes(BLOCK_SIZE);
+    page.copy_to(bytes.data());
+    return bytes;
+}
+
+PageRef Snapshot::read_page(BlockNum block_num) {
     auto it = block_map.find(block_num);
     if (it != block_map.end()) {
-        return block_cache.get(it->second);
+        return block_cache.pin(it->second);
     }
-    Bytes bytes = block_cache.get(block_num);
+    PageRef page = block_cache.pin(block_num);
     if (level == TransInfo::READ) {
-        return bytes;
+        return page;
     }
     BlockNum new_block_num = block_alloc.new_temp_block();
-    block_cache.put(new_block_num, bytes);
+    block_cache.put(new_block_num, page.view());
     block_map[block_num] = new_block_num;
-    return bytes;
+    return page;
 }
 
-void Snapshot::write_block(BlockNum block_num, const Bytes &bytes) {
-    if (level == TransInfo::READ) {
-        block_lock_map[block_num].lock();
+BytesView Snapshot::read_scan_page(BlockNum block_num, ScanRing &ring) {
+    if (level == TransInfo::READ && block_map.find(block_num) == block_map.end()) {
+        return ring.read(block_num);
+    }
+    // private copy of snapshot is kept in cache
+    PageRef page = read_page(block_num);
+    while (true) {
+        uint64_t version = page.get_version();
+        BytesView view = ring.put(block_num, page.view());
+        if (!page.is_changed(version)) return view;
     }
+}
+
+void Snapshot::write_block(BlockNum block_num, const Bytes &bytes) {
+    lock_block(block_num);
     auto it = block_map.find(block_num);
     BlockNum num;
     if (it == block_map.end()) {
         num = block_alloc.new_temp_block();
         block_map[block_num] = num;
     } else {
-        num = it->first;
+        num = it->second;
     }
     block_cache.put(num, bytes);
 }
 
+void Snapshot::lock_block(BlockNum block_num) {
+    if (level != TransInfo::READ || lock_set.count(block_num) != 0) return;
+    std::mutex *mutex;
+    {
+        std::lock_guard<std::mutex> lg(lock_map_mutex);
+        mutex = &block_lock_map[block_num];
+    }
+    mutex->lock();
+    lock_set.insert(block_num);
+}
+
+void Snapshot::lock_shared(const std::shared_ptr<std::shared_mutex> &mutex_ptr) {
+    if (std::find(shared_lst.begin(), shared_lst.end(), mutex_ptr) != shared_lst.end()) return;
+    mutex_ptr->lock_shared();
+    shared_lst.push_back(mutex_ptr);
+}
+
 void Snapshot::rollback(){
     for (auto &&[old_num, new_num] : block_map) {
-        if (level == TransInfo::READ) {
-            block_lock_map[old_num].unlock();
-        }
-        block_alloc.free_block(new_num);
+        block_cache.discard(new_num);
+        block_alloc.free_temp_block(new_num);
     }
+    block_map.clear();
+    unlock_all();
 }
 
 bool Snapshot::commit() {
     if (level == TransInfo::READ) {
         for (auto &&[old_num, new_num] : block_map) {
-            Bytes new_bytes = block_cache.get(new_num);
-            block_cache.put(old_num, new_bytes);
-            block_lock_map[old_num].unlock();
+            block_cache.put(old_num, block_cache.pin(new_num).view());
         }
     } else if (level == TransInfo::R_READ) {
         // check version
         for (auto &&[old_num, new_num] : block_map) {
-            Bytes old_bytes = block_cache.get(old_num);
-            Bytes new_bytes = block_cache.get(new_num);
+            PageRef old_page = block_cache.pin(old_num);
+            PageRef new_page = block_cache.pin(new_num);
             Size offset = 0;
             Vid old_v_id, new_v_id;
-            sdb::de_bytes(old_v_id, old_bytes, offset);
-            sdb::de_bytes(new_v_id, old_bytes, (offset = 0));
+            sdb::de_bytes(old_v_id, old_page.view(), offset);
+            sdb::de_bytes(new_v_id, new_page.view(), (offset = 0));
             if (new_v_id - old_v_id != 1) {
                 return false;
             }
         }
         // sync
         for (auto &&[old_num, new_num] : block_map) {
-            Bytes new_bytes = block_cache.get(new_num);
-            block_cache.put(old_num, new_bytes);
+            block_cache.put(old_num, block_cache.pin(new_num).view());
         }
     }
+    // private copies are done
+    for (auto &&[old_num, new_num] : block_map) {
+        block_cache.discard(new_num);
+        block_alloc.free_temp_block(new_num);
+    }
+    block_map.clear();
+    unlock_all();
     return true;
 }
 
+// ========== private function =========
+void Snapshot::unlock_all() {
+    {
+        std::lock_guard<std::mutex> lg(lock_map_mutex);
+        for (BlockNum num : lock_set) {
+            block_lock_map[num].unlock();
+        }
+        lock_set.clear();
+    }
+    for (auto &&mutex_ptr : shared_lst) {
+        mutex_ptr->unlock_shared();
+    }
+    shared_lst.clear();
+}
 
 } // namespace sdb
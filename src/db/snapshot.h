@@ -2,6 +2,11 @@
 #define DB_SNAPSHOT_H 
 
 #include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <vector>
 
 #include "util.h"
 #include "cache.h"
@@ -16,7 +21,17 @@ class Snapshot {
 public:
     Snapshot(){}
     Bytes read_block(BlockNum block_num);
+    // pinned page of block in this snapshot, no copy
+    PageRef read_page(BlockNum block_num);
+    // block of large scan read through ring, main cache stays untouched
+    BytesView read_scan_page(BlockNum block_num, ScanRing &ring);
     void write_block(BlockNum block_num, const Bytes &bytes);
+    // read committed: writer locks block before reading it, held till commit or rollback,
+    // so a read-change-write of one block by two transactions can't lose either
+    void lock_block(BlockNum block_num);
+    // mutex held shared till commit or rollback, once per snapshot,
+    // e.g. write mutex of a table, see Table::get_write_mutex
+    void lock_shared(const std::shared_ptr<std::shared_mutex> &mutex_ptr);
     void rollback();
     bool commit();
 
@@ -26,7 +41,7 @@ public:
     }
 
 private:
-    BlockCache &block_cache = CacheMaster::get_block_cache();
+    ShardedBlockCache &block_cache = CacheMaster::get_block_cache();
     BlockAlloc &block_alloc = BlockAlloc::get();
     IO &io = IO::get();
 
@@ -36,9 +51,17 @@ private:
     
     std::map<BlockNum, BlockNum> block_map;
 
+    // blocks locked by this snapshot
+    std::set<BlockNum> lock_set;
+    // mutexes held shared by this snapshot
+    std::vector<std::shared_ptr<std::shared_mutex>> shared_lst;
+
     // block lock()
     // TODO concurrent map
+    static std::mutex lock_map_mutex;
     static std::map<BlockNum, std::mutex> block_lock_map;
+
+    void unlock_all();
 };
 
 } // namespace sdb
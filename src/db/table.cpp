@@ -5,6 +5,7 @@
 #include <map>
 #include <utility>
 #include <functional>
+#include <algorithm>
 
 #include "table.h"
 
@@ -13,51 +14,282 @@
 #include "io.h"
 #include "cache.h"
 #include "block_alloc.h"
+#include "snapshot.h"
+#include "config.h"
+#include "external_sort.h"
 
 namespace sdb {
 
 // ========== public function ========
-void Table::record_range(TransInfo t_info, RecordOp op) {
+Table::Table(const TableProperty &tp):tp(tp), keys_index(std::make_shared<BpTree>(tp)) {
+    for (auto &&ip : tp.index_lst) {
+        Index index = make_index(ip);
+        index.tree = std::make_shared<BpTree>(index.tp);
+        index_map.emplace(ip.index_name, std::move(index));
+    }
+}
+
+IndexProperty Table::build_index(TransInfo t_info, const std::string &index_name, const std::vector<std::string> &col_name_lst,
+                                 const std::vector<std::string> &include_col_name_lst) {
+    if (index_map.count(index_name) != 0) {
+        throw TableError(cpp_util::format("index [%s] of table [%s] existed", index_name, tp.table_name));
+    }
+    if (col_name_lst.empty()) {
+        throw TableError(cpp_util::format("index [%s] has no col", index_name));
+    }
+    auto table_col_lst = tp.get_col_name_lst();
+    auto is_in = [](auto &&lst, const std::string &col_name) {
+        return std::find(lst.begin(), lst.end(), col_name) != lst.end();
+    };
+    // each col once, catalog keeps a row per col
+    auto is_twice = [](auto &&lst, auto it) {
+        return std::find(std::next(it), lst.end(), *it) != lst.end();
+    };
+    for (auto it = col_name_lst.begin(); it != col_name_lst.end(); ++it) {
+        if (!is_in(table_col_lst, *it)) {
+            throw TableError(cpp_util::format("col [%s] not in table [%s]", *it, tp.table_name));
+        }
+        if (is_twice(col_name_lst, it)) {
+            throw TableError(cpp_util::format("col [%s] is twice in index [%s]", *it, index_name));
+        }
+    }
+    // index and primary key cols are in index tuple already
+    for (auto it = include_col_name_lst.begin(); it != include_col_name_lst.end(); ++it) {
+        const std::string &col_name = *it;
+        if (!is_in(table_col_lst, col_name)) {
+            throw TableError(cpp_util::format("col [%s] not in table [%s]", col_name, tp.table_name));
+        }
+        if (is_twice(include_col_name_lst, it)) {
+            throw TableError(cpp_util::format("col [%s] is twice in index [%s]", col_name, index_name));
+        }
+        if (is_in(col_name_lst, col_name) || tp.col_property_lst[tp.get_col_property_pos(col_name)].is_key) {
+            throw TableError(cpp_util::format("include col [%s] is index or key col", col_name));
+        }
+    }
+
+    IndexProperty ip{index_name, col_name_lst, include_col_name_lst, -1, -1};
+    Index index = make_index(ip);
+    Config &config = Config::get();
+    ExternalSort sort(config.sort_memory);
+    RecordOp f = [&sort, &index](RecordPtr ptr){
+        for (auto &&tuple : ptr->get_all_tuple().data) {
+            sort_push(sort, index.tp, tuple.select(index.pos_lst));
+        }
+    };
+    record_range(t_info, f);
+    index.tp = BpTree::bulk_load(t_info, index.tp, sort_source(sort, index.tp), Size(config.bulk_load_fill));
+    ip.record_root = index.tp.record_root;
+    ip.keys_idx_root = index.tp.keys_idx_root;
+    return ip;
+}
+
+void Table::add_index(const IndexProperty &ip) {
+    Index index = make_index(ip);
+    index.tree = std::make_shared<BpTree>(index.tp);
+    hook_index(ip.index_name, index);
+    index_map.emplace(ip.index_name, std::move(index));
+    tp.index_lst.push_back(ip);
+}
+
+void Table::set_root_hook(RootHook hook) {
+    root_hook = std::move(hook);
+    keys_index->set_root_hook([this](TransInfo t_info, BlockNum root_pos) {
+        root_hook(t_info, "", root_pos);
+    });
+    for (auto &&[index_name, index] : index_map) {
+        hook_index(index_name, index);
+    }
+}
+
+void Table::remove_index(const std::string &index_name) {
+    auto it = index_map.find(index_name);
+    if (it == index_map.end()) {
+        throw TableError(cpp_util::format("index [%s] of table [%s] not found", index_name, tp.table_name));
+    }
+    it->second.tree->drop();
+    index_map.erase(it);
+    auto f = [&index_name](auto &&ip)->bool{return ip.index_name == index_name;};
+    tp.index_lst.erase(std::remove_if(tp.index_lst.begin(), tp.index_lst.end(), f), tp.index_lst.end());
+}
+
+bool Table::is_has_leading_index(const std::string &col_name)const {
+    for (auto &&ip : tp.index_lst) {
+        if (ip.col_name_lst.front() == col_name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Tuples Table::find_by_index(TransInfo t_info, const std::string &index_name, const Tuple &values) {
+    const Index &index = get_index(index_name);
+    std::vector<Size> pk_pos = index_pk_pos(index);
+    Tuples ts(tp.col_property_lst.size());
+    for (auto &&index_tuple : index.tree->find_pre_key(t_info, values).data) {
+        ts.append(keys_index->find_key(t_info, index_tuple.select(pk_pos)));
+    }
+    return ts;
+}
+
+Tuples Table::find_by_index(TransInfo t_info, const std::string &index_name, const Tuple &values,
+                            const std::vector<std::string> &col_name_lst) {
+    const Index &index = get_index(index_name);
+    Tuples ts(col_name_lst.size());
+    if (!is_covering(index_name, col_name_lst)) {
+        std::vector<Size> pos_lst;
+        for (auto &&col_name : col_name_lst) {
+            pos_lst.push_back(tp.get_col_property_pos(col_name));
+        }
+        for (auto &&tuple : find_by_index(t_info, index_name, values).data) {
+            ts.push_back(tuple.select(pos_lst));
+        }
+        return ts;
+    }
+
+    // cols picked from index tuples
+    std::vector<Size> pos_lst;
+    for (auto &&col_name : col_name_lst) {
+        pos_lst.push_back(index.tp.get_col_property_pos(col_name));
+    }
+    for (auto &&index_tuple : index.tree->find_pre_key(t_info, values).data) {
+        ts.push_back(index_tuple.select(pos_lst));
+    }
+    return ts;
+}
+
+bool Table::is_covering(const std::string &index_name, const std::vector<std::string> &col_name_lst)const {
+    auto index_col_lst = get_index(index_name).tp.get_col_name_lst();
+    for (auto &&col_name : col_name_lst) {
+        if (std::find(index_col_lst.begin(), index_col_lst.end(), col_name) == index_col_lst.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Table::record_range(TransInfo t_info, RecordOp op, bool is_write) {
+    // record chain is only known block by block,
+    // so read ahead the record blocks listed by index leaves in batch,
+    // leaves are read as the scan gets to them
+    std::vector<BlockNum> pos_lst;
+    BlockNum leaf_pos = keys_index->first_leaf_pos();
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    // once scan turns large, the rest goes through a private ring, not to flush the cache
+    std::unique_ptr<ScanRing> ring_ptr;
+    size_t visit_count = 0;
     BlockNum pos = tp.record_root;
     while (pos != -1) {
-        auto ptr = std::make_shared<Record>(t_info, tp, pos);
+        if (visit_count % SCAN_PREFETCH_COUNT == 0) {
+            while (leaf_pos != -1 && pos_lst.size() < visit_count + SCAN_PREFETCH_COUNT) {
+                leaf_pos = keys_index->leaf_record_pos(leaf_pos, pos_lst);
+            }
+            if (!is_write && !ring_ptr && pos_lst.size() * 100 > cache.get_max_block_count() * LARGE_SCAN_PERCENT) {
+                ring_ptr = std::make_unique<ScanRing>(cache);
+            }
+            if (visit_count < pos_lst.size()) {
+                auto beg = pos_lst.begin() + visit_count;
+                auto end = pos_lst.begin() + std::min(pos_lst.size(), visit_count + SCAN_PREFETCH_COUNT);
+                std::vector<BlockNum> prefetch_lst(beg, end);
+                if (ring_ptr) {
+                    ring_ptr->prefetch(prefetch_lst);
+                } else {
+                    cache.prefetch(prefetch_lst);
+                }
+            }
+        }
+        if (is_write) {
+            // read after lock, record can't change or split till transaction ends
+            t_info.s_ptr->lock_block(pos);
+        }
+        auto ptr = ring_ptr ? std::make_shared<Record>(t_info, tp, pos, *ring_ptr)
+                            : std::make_shared<Record>(t_info, tp, pos);
         op(ptr);
         pos = ptr->get_next_record_num();
+        visit_count++;
     }
 }
 
 void Table::insert(TransInfo t_info, const Tuple &tuple) {
+    t_info.s_ptr->lock_shared(write_mutex_ptr);
     Tuple keys = tuple.select(tp.get_keys_pos());
     keys_index->insert(t_info, keys, tuple);
+    index_insert(t_info, tuple);
 }
 
 void Table::remove(TransInfo t_info, const Tuple &keys) {
-    keys_index->remove(t_info, keys);
+    t_info.s_ptr->lock_shared(write_mutex_ptr);
+    // old row gives index keys, read under record lock
+    Tuples old_ts = keys_index->remove(t_info, keys);
+    for (auto &&tuple : old_ts.data) {
+        index_remove(t_info, tuple);
+    }
+}
+
+void Table::remove_pre_key(TransInfo t_info, const Tuple &keys) {
+    for (auto &&tuple : find_pre_key(t_info, keys).data) {
+        remove(t_info, tuple.select(tp.get_keys_pos()));
+    }
 }
 
 void Table::remove(TransInfo t_info, TuplePred pred) {
-    RecordOp f = [pred, t_info](RecordPtr ptr){
-        ptr->remove(pred);
+    t_info.s_ptr->lock_shared(write_mutex_ptr);
+    // old rows give index keys, taken as pred matches them
+    Tuples old_ts(tp.col_property_lst.size());
+    TuplePred f_pred = [pred, &old_ts](const Tuple &tuple) {
+        if (!pred(tuple)) return false;
+        old_ts.push_back(tuple);
+        return true;
     };
-    record_range(t_info, f);
+    RecordOp f = [f_pred](RecordPtr ptr){
+        ptr->remove(f_pred);
+    };
+    record_range(t_info, f, true);
+    for (auto &&tuple : old_ts.data) {
+        index_remove(t_info, tuple);
+    }
 }
 
 void Table::update(TransInfo t_info, const Tuple &new_tuple) {
+    t_info.s_ptr->lock_shared(write_mutex_ptr);
     Tuple keys = new_tuple.select(tp.get_keys_pos());
-    keys_index->update(t_info, keys, new_tuple);
+    Tuples old_ts = keys_index->update(t_info, keys, new_tuple);
+    for (auto &&tuple : old_ts.data) {
+        index_update(t_info, tuple, new_tuple);
+    }
 }
 
 void Table::update(TransInfo t_info, TuplePred pred, TupleOp op) {
-    RecordOp f = [pred, op](RecordPtr ptr){
-        ptr->update(pred, op);
+    t_info.s_ptr->lock_shared(write_mutex_ptr);
+    // <old row, new row> for index, op runs once per row
+    std::vector<std::pair<Tuple, Tuple>> changed_lst;
+    TupleOp f_op = [op, &changed_lst](const Tuple &tuple) {
+        Tuple new_tuple = op(tuple);
+        changed_lst.push_back({tuple, new_tuple});
+        return new_tuple;
     };
-    record_range(t_info, f);
+    // rows grown past their block are put by key after scan, record splits then
+    Tuples left_ts(tp.col_property_lst.size());
+    RecordOp f = [pred, f_op, &left_ts](RecordPtr ptr){
+        left_ts.append(ptr->update(pred, f_op));
+    };
+    record_range(t_info, f, true);
+    auto keys_pos = tp.get_keys_pos();
+    for (auto &&tuple : left_ts.data) {
+        keys_index->update(t_info, tuple.select(keys_pos), tuple);
+    }
+    for (auto &&[old_tuple, new_tuple] : changed_lst) {
+        index_update(t_info, old_tuple, new_tuple);
+    }
 }
 
 Tuples Table::find(TransInfo t_info, const Tuple &keys) {
     return keys_index->find_key(t_info, keys);
 }
 
+Tuples Table::find_pre_key(TransInfo t_info, const Tuple &keys) {
+    return keys_index->find_pre_key(t_info, keys);
+}
+
 Tuples Table::find_less(TransInfo t_info, const Tuple &keys, bool is_close) {
     return keys_index->find_less(t_info,  keys, is_close);
 }
@@ -77,7 +309,148 @@ Tuples Table::find(TransInfo t_info, TuplePred pred) {
         ts.append(ptr->find(pred));
     };
     record_range(t_info, f);
+    return ts;
+}
+
+TableProperty Table::bulk_load(TransInfo t_info, const TableProperty &tp, TupleSource next, bool is_sorted) {
+    Config &config = Config::get();
+    Size fill_percent = Size(config.bulk_load_fill);
+    if (is_sorted) {
+        return BpTree::bulk_load(t_info, tp, next, fill_percent);
+    }
+
+    ExternalSort sort(config.sort_memory);
+    while (std::optional<Tuple> tuple = next()) {
+        sort_push(sort, tp, *tuple);
+    }
+    return BpTree::bulk_load(t_info, tp, sort_source(sort, tp), fill_percent);
+}
+
+bool Table::is_empty(TransInfo t_info) {
+    bool is_empty = true;
+    RecordOp f = [&is_empty](RecordPtr ptr){
+        is_empty = is_empty && ptr->record_lst.empty();
+    };
+    record_range(t_info, f);
+    return is_empty;
+}
+
+void Table::drop() {
+    keys_index->drop();
+    for (auto &&[index_name, index] : index_map) {
+        index.tree->drop();
+    }
+}
+
+std::vector<BlockNum> Table::vacuum(size_t max_merge_count) {
+    std::vector<BlockNum> lst = keys_index->vacuum(max_merge_count);
+    for (auto &&[index_name, index] : index_map) {
+        auto index_lst = index.tree->vacuum(max_merge_count);
+        lst.insert(lst.end(), index_lst.begin(), index_lst.end());
+    }
+    return lst;
+}
+
+std::vector<BlockNum> Table::relocate(BlockNum limit) {
+    std::vector<BlockNum> lst = keys_index->relocate(limit);
+    for (auto &&[index_name, index] : index_map) {
+        auto index_lst = index.tree->relocate(limit);
+        lst.insert(lst.end(), index_lst.begin(), index_lst.end());
+    }
+    return lst;
 }
 
 // ========== private function ========
+Table::Index Table::make_index(const IndexProperty &ip)const {
+    Index index{tp.get_index_property(ip), {}, {}, nullptr};
+    for (auto &&cp : index.tp.col_property_lst) {
+        index.pos_lst.push_back(tp.get_col_property_pos(cp.col_name));
+    }
+    index.keys_pos = index.tp.get_keys_pos();
+    return index;
+}
+
+void Table::hook_index(const std::string &index_name, Index &index) {
+    if (!root_hook) return;
+    index.tree->set_root_hook([this, index_name](TransInfo t_info, BlockNum root_pos) {
+        root_hook(t_info, index_name, root_pos);
+    });
+}
+
+const Table::Index &Table::get_index(const std::string &index_name)const {
+    auto it = index_map.find(index_name);
+    if (it == index_map.end()) {
+        throw TableError(cpp_util::format("index [%s] of table [%s] not found", index_name, tp.table_name));
+    }
+    return it->second;
+}
+
+// primary key columns follow index columns in index tuple
+std::vector<Size> Table::index_pk_pos(const Index &index)const {
+    std::vector<Size> pk_pos;
+    Size key_count = Size(index.keys_pos.size());
+    for (Size pos = key_count - Size(tp.get_keys_pos().size()); pos < key_count; pos++) {
+        pk_pos.push_back(pos);
+    }
+    return pk_pos;
+}
+
+// index tuple => index columns, primary key, then include columns.
+// key of index tree is index columns and primary key, data is index tuple
+void Table::index_insert(TransInfo t_info, const Tuple &tuple) {
+    for (auto &&[index_name, index] : index_map) {
+        Tuple index_tuple = tuple.select(index.pos_lst);
+        index.tree->insert(t_info, index_tuple.select(index.keys_pos), index_tuple);
+    }
+}
+
+void Table::index_remove(TransInfo t_info, const Tuple &tuple) {
+    for (auto &&[index_name, index] : index_map) {
+        index.tree->remove(t_info, tuple.select(index.pos_lst).select(index.keys_pos));
+    }
+}
+
+void Table::index_update(TransInfo t_info, const Tuple &old_tuple, const Tuple &new_tuple) {
+    for (auto &&[index_name, index] : index_map) {
+        Tuple old_index_tuple = old_tuple.select(index.pos_lst);
+        Tuple new_index_tuple = new_tuple.select(index.pos_lst);
+        // untouched index and include columns => same index tuple
+        if (old_index_tuple.en_bytes() == new_index_tuple.en_bytes()) continue;
+        Tuple old_keys = old_index_tuple.select(index.keys_pos);
+        Tuple new_keys = new_index_tuple.select(index.keys_pos);
+        if (BpTree::en_key(old_keys) == BpTree::en_key(new_keys)) {
+            // only include columns changed, entry stays in place
+            index.tree->update(t_info, new_keys, new_index_tuple);
+        } else {
+            index.tree->remove(t_info, old_keys);
+            index.tree->insert(t_info, new_keys, new_index_tuple);
+        }
+    }
+}
+
+// <order preserving key, column bytes>
+void Table::sort_push(ExternalSort &sort, const TableProperty &tp, const Tuple &tuple) {
+    Bytes key = BpTree::en_key(tuple.select(tp.get_keys_pos()));
+    Bytes value;
+    tuple.range([&value](db_type::ObjCntPtr ptr) {
+        Bytes bytes = ptr->en_bytes();
+        value.insert(value.end(), bytes.begin(), bytes.end());
+    });
+    sort.push(std::move(key), std::move(value));
+}
+
+TupleSource Table::sort_source(ExternalSort &sort, const TableProperty &tp) {
+    std::vector<db_type::TypeInfo> info_lst;
+    for (auto &&cp : tp.col_property_lst) {
+        info_lst.push_back(cp.type_info);
+    }
+    return [&sort, info_lst]() -> std::optional<Tuple> {
+        auto pair = sort.next();
+        if (!pair) return std::nullopt;
+        Tuple tuple;
+        Size offset = 0;
+        tuple.de_bytes(info_lst, pair->second, offset);
+        return tuple;
+    };
+}
 } // namespace sdb
@@ -8,6 +8,7 @@
 #include "record.h"
 #include "util.h"
 #include "bpTree.h"
+#include "external_sort.h"
 
 namespace sdb {
 
@@ -28,21 +29,54 @@ struct TableExisted : public TableError {
 class Table {
 public:
     Table()= delete;
-    Table(const TableProperty &tp):tp(tp), keys_index(std::make_shared<BpTree>(tp)){}
+    Table(const TableProperty &tp);
 
     // index
-    // void create_index(TransInfo ti, const std::string &index_name, const std::list<std::string> &col_name_list);
-    // void remove_index(TransInfo ti, const std::string &index_name);
-
+    // build index from rows seen by t_info, bottom up in new blocks,
+    // include cols are kept in index tuples beside index cols.
+    // nothing uses it till add_index, caller puts it in catalog and commits first.
+    // throw TableError if a col is missing or given twice.
+    // return index property with roots
+    IndexProperty build_index(TransInfo t_info, const std::string &index_name, const std::vector<std::string> &col_name_lst,
+                              const std::vector<std::string> &include_col_name_lst);
+    // writes keep index in step from now on
+    void add_index(const IndexProperty &ip);
+    // f(t_info, index name, new root) once root of primary index, or of index of index name,
+    // moves up by a split in a write of t_info. index name is empty for primary index.
+    // set before writers use table, see BpTree::set_root_hook
+    using RootHook = std::function<void(TransInfo, const std::string &, BlockNum)>;
+    void set_root_hook(RootHook hook);
+    // free all blocks of index, nobody may use table meanwhile
+    void remove_index(const std::string &index_name);
+    // some index has col as its leading col.
+    // index lookups match leading cols, an index with col later can't serve col alone
+    bool is_has_leading_index(const std::string &col_name)const;
+    // rows whose leading index columns equal values,
+    // primary keys are found in index, then rows in primary index
+    Tuples find_by_index(TransInfo t_info, const std::string &index_name, const Tuple &values);
+    // cols of rows found by index, in order of col_name_lst.
+    // index covers cols => index-only scan, no record block of table is read
+    Tuples find_by_index(TransInfo t_info, const std::string &index_name, const Tuple &values,
+                         const std::vector<std::string> &col_name_lst);
+    // every col of col_name_lst is index, primary key or include col of index
+    bool is_covering(const std::string &index_name, const std::vector<std::string> &col_name_lst)const;
+
+    // insert/update/remove keep every index in step, under the same t_info,
+    // and hold write mutex shared till t_info ends
     // insert a tuple
     void insert(TransInfo t_info, const Tuple &tuple);
 
     using RecordPtr = std::shared_ptr<Record>;
     using RecordOp = std::function<void(RecordPtr)>;
-    void record_range(TransInfo t_info, RecordOp op);
+    // op on every record along record chain.
+    // is_write: each record is locked by t_info before it is read, and no ScanRing is used,
+    // so op may change and sync it
+    void record_range(TransInfo t_info, RecordOp op, bool is_write = false);
 
     // remove by key
     void remove(TransInfo ti, const Tuple &keys);
+    // remove rows whose leading key columns equal keys
+    void remove_pre_key(TransInfo ti, const Tuple &keys);
     // remove while predicate
     void remove(TransInfo ti, TuplePred pred);
 
@@ -55,12 +89,32 @@ public:
 
     // find use primary index
     Tuples find(TransInfo ti, const Tuple &keys);
+    // rows whose leading key columns equal keys
+    Tuples find_pre_key(TransInfo ti, const Tuple &keys);
     Tuples find_less(TransInfo ti, const Tuple &keys, bool is_close);
     Tuples find_greater(TransInfo ti, const Tuple &keys, bool is_close);
     Tuples find_range(TransInfo ti, const Tuple &beg, const Tuple &end, bool is_beg_close, bool is_end_close);
     // find use record
     Tuples find(TransInfo ti, TuplePred pred);
 
+    // build a new tree of tp from tuples, sorted by key in external runs unless is_sorted.
+    // return tp with new roots, see BpTree::bulk_load
+    static TableProperty bulk_load(TransInfo t_info, const TableProperty &tp, TupleSource next, bool is_sorted);
+    // no tuple in any record
+    bool is_empty(TransInfo t_info);
+    // free all blocks of table, nobody may use it meanwhile
+    void drop();
+
+    // writers hold it shared till their transaction ends, see Snapshot::lock_shared,
+    // readers don't take it
+    std::shared_mutex &get_write_mutex() {return *write_mutex_ptr;}
+    // merge under-full records, return unlinked blocks, see BpTree::vacuum.
+    // caller holds write mutex alone
+    std::vector<BlockNum> vacuum(size_t max_merge_count);
+    // move blocks at or past limit before it, see BpTree::relocate.
+    // caller holds write mutex alone
+    std::vector<BlockNum> relocate(BlockNum limit);
+
     // bool is_referenced()const;
     // bool is_referencing()const;
     // bool is_referencing(const std::string &table_name)const;
@@ -71,12 +125,43 @@ public:
     std::vector<std::string> get_col_name_lst()const{return tp.get_col_name_lst();}
 
 private:
-    bool is_has_index(const std::string &col_name)const;
+    // index tree of IndexProperty
+    struct Index {
+        TableProperty tp;
+        // pos of index tuple columns in row
+        std::vector<Size> pos_lst;
+        // pos of index tree key columns in index tuple, include columns follow them
+        std::vector<Size> keys_pos;
+        std::shared_ptr<BpTree> tree;
+    };
+    Index make_index(const IndexProperty &ip)const;
+    // new roots of index tree go to root_hook
+    void hook_index(const std::string &index_name, Index &index);
+    const Index &get_index(const std::string &index_name)const;
+    // pos of primary key columns in index tuple
+    std::vector<Size> index_pk_pos(const Index &index)const;
+    void index_insert(TransInfo t_info, const Tuple &tuple);
+    void index_remove(TransInfo t_info, const Tuple &tuple);
+    void index_update(TransInfo t_info, const Tuple &old_tuple, const Tuple &new_tuple);
+
+    // external sort of tuples by key of tp, for bottom up build
+    static void sort_push(ExternalSort &sort, const TableProperty &tp, const Tuple &tuple);
+    static TupleSource sort_source(ExternalSort &sort, const TableProperty &tp);
+
+    // record blocks read ahead per batch while range records
+    static constexpr size_t SCAN_PREFETCH_COUNT = 32;
+    // scan of more record blocks than this percent of cache uses a ScanRing
+    static constexpr size_t LARGE_SCAN_PERCENT = 25;
 
 public:
     TableProperty tp;
 private:
     const std::shared_ptr<BpTree> keys_index;
+    // <index name, index>
+    std::map<std::string, Index> index_map;
+    RootHook root_hook;
+    // held by snapshots of writers, so it outlives table
+    std::shared_ptr<std::shared_mutex> write_mutex_ptr = std::make_shared<std::shared_mutex>();
 };
 
 } // namespace sdb
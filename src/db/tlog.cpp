@@ -15,8 +15,6 @@ namespace sdb {
 //     remove content     : <table_name, keys>
 
 void Tlog::begin(Tid t_id) {
-    assert(db_mt.find(db_name) != db_mt.end());
-
     // log type
     Bytes bytes = sdb::en_bytes(char(BEGIN));
     // log content
@@ -57,7 +55,6 @@ void Tlog::insert(Tid t_id, const std::string &table_name, const Tuple &tuple) {
 }
 
 void Tlog::remove(Tid t_id, const std::string &table_name, const Tuple &keys) {
-    assert(db_mt.find(db_name) != db_mt.end());
     // log type
     Bytes bytes = sdb::en_bytes(char(REMOVE));
     // log content
@@ -90,9 +87,9 @@ Tlog::get_log_info(std::ifstream &in) {
     Tid t_id;
     sdb::de_bytes(t_id, data, offset);
     // log type
-    LogType log_type;
+    char log_type;
     sdb::de_bytes(log_type, data, offset);
-    return {t_id, log_type, data};
+    return {t_id, LogType(log_type), data};
 }
 
 } // namespace sdb
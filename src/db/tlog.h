@@ -26,10 +26,8 @@ public:
     };
 
 public:
-    static Tlog &get() {
-        static Tlog t_log;
-        return t_log;
-    }
+    // log file of db io was opened for
+    Tlog():BaseLog(IO::get().log_path()){}
 
     void begin(Tid t_id);
     void commit(Tid t_id);
@@ -41,7 +39,6 @@ public:
     std::tuple<Tid, LogType, Bytes> get_log_info(std::ifstream &in);
 
 private:
-    Tlog():BaseLog(IO::get().log_path()){}
     void write_info(const Bytes &bytes);
 
 private:
@@ -8,19 +8,26 @@ using db_type::ObjPtr;
 using db_type::ObjCntPtr;
 
 // ========== tuple =========
+Tuple::Tuple(std::initializer_list<db_type::ObjPtr> data) {
+    for (auto &&ptr : data) {
+        push_back(ptr);
+    }
+}
+
 Tuple &Tuple::operator=(const Tuple &tuple) {
+    if (this == &tuple) return *this;
     // deepin copy
+    data.clear();
     for (auto &ptr : tuple.data) {
         data.push_back(ptr->clone());
     }
+    return *this;
 }
 
 Tuple &Tuple::operator=(Tuple &&tuple) {
-    // simple copy
-    data = tuple.data;
-    for (ObjPtr &ptr : tuple.data) {
-        ptr = nullptr;
-    }
+    data = std::move(tuple.data);
+    tuple.data.clear();
+    return *this;
 }
 
 Size Tuple::type_size()const {
@@ -31,6 +38,14 @@ Size Tuple::type_size()const {
     return sum;
 }
 
+Size Tuple::data_bytes_size()const {
+    Size sum = 0;
+    for (auto &&ptr : data) {
+        sum += Size(ptr->en_bytes().size());
+    }
+    return sum;
+}
+
 bool Tuple::eq(const Tuple &tuple)const{
     if (data.size() != tuple.data.size()) return false;
 
@@ -41,6 +56,14 @@ bool Tuple::eq(const Tuple &tuple)const{
     return true;
 }
 
+bool Tuple::pre_eq(const Tuple &tuple)const {
+    if (data.size() < tuple.data.size()) return false;
+    for (size_t i = 0; i < tuple.data.size(); i++) {
+        if (!data[i]->eq(tuple.data[i])) return false;
+    }
+    return true;
+}
+
 bool Tuple::less(const Tuple &tuple)const {
     if (data.size() != tuple.data.size()) return false;
     // deepin compare
@@ -48,17 +71,22 @@ bool Tuple::less(const Tuple &tuple)const {
         if (data[i]->eq(tuple.data[i])) {
             continue;
         }
-        return data[i]->eq(tuple.data[i]);
+        return data[i]->less(tuple.data[i]);
     }
     return false;
 }
 
 // bytes
 Bytes Tuple::en_bytes()const {
-    return sdb::en_bytes(data);
+    Bytes bytes;
+    for (auto &&ptr : data) {
+        Bytes ptr_bytes = ptr->en_bytes();
+        bytes.insert(bytes.end(), ptr_bytes.begin(), ptr_bytes.end());
+    }
+    return bytes;
 }
 
-void Tuple::de_bytes(const std::vector<db_type::TypeInfo> &infos, const Bytes &bytes, Size offset) {
+void Tuple::de_bytes(const std::vector<db_type::TypeInfo> &infos, BytesView bytes, Size &offset) {
     for (auto &&info : infos) {
         ObjPtr ptr = db_type::get_default(info);
         ptr->de_bytes(bytes, offset);
@@ -133,8 +161,8 @@ Bytes Tuples::en_bytes()const {
     return sdb::en_bytes(data);
 }
 
-void Tuples::de_bytes(const std::vector<db_type::TypeInfo> &infos, const Bytes &bytes, int &offset) {
-    assert(tag_sizes.size() == col_num);
+void Tuples::de_bytes(const std::vector<db_type::TypeInfo> &infos, BytesView bytes, int &offset) {
+    assert(Size(infos.size()) == col_num);
     data.clear();
     int len;
     sdb::de_bytes(len, bytes, offset);
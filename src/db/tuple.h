@@ -1,6 +1,9 @@
 #ifndef DB_TUPLE_H
 #define DB_TUPLE_H
 
+#include <optional>
+#include <functional>
+
 #include "util.h"
 #include "db_type.h"
 
@@ -9,8 +12,7 @@ namespace sdb {
 class Tuple {
 public:
     Tuple(){}
-    // TODO
-    Tuple(std::initializer_list<db_type::ObjPtr> date);
+    Tuple(std::initializer_list<db_type::ObjPtr> data);
     Tuple(const Tuple &tuple) {*this = tuple;}
     Tuple(Tuple &&tuple) {*this = std::move(tuple);}
     Tuple &operator=(const Tuple &);
@@ -28,17 +30,19 @@ public:
     }
 
     Size type_size()const;
+    // size of en_bytes()
     Size data_bytes_size()const;
     Size len()const { return data.size(); }
 
     // compare
     bool eq(const Tuple &tuple)const;
+    // leading columns equal tuple
     bool pre_eq(const Tuple &tuple)const;
     bool less(const Tuple &tuple)const;
 
-    // bytes
+    // bytes: columns one by one, no count, read back by type info of columns
     Bytes en_bytes()const;
-    void de_bytes(const std::vector<db_type::TypeInfo> &infos, const Bytes &bytes, Size offset);
+    void de_bytes(const std::vector<db_type::TypeInfo> &infos, BytesView bytes, Size &offset);
 
     // push back
     void push_back(db_type::ObjCntPtr ptr){
@@ -76,7 +80,7 @@ public:
 
     // append
     void append(const Tuples &tuples) {
-        assert(tuple.len() == col_num);
+        assert(tuples.col_num == col_num);
         data.insert(data.end(), tuples.data.begin(), tuples.data.end());
     }
 
@@ -88,7 +92,7 @@ public:
 
     // bytes
     Bytes en_bytes()const;
-    void de_bytes(const std::vector<db_type::TypeInfo> &infos, const Bytes &bytes, int &offset) ;
+    void de_bytes(const std::vector<db_type::TypeInfo> &infos, BytesView bytes, int &offset) ;
 
     // debug
     void print()const;
@@ -107,6 +111,8 @@ inline Bytes en_bytes(Tuple tuple) {
 // type alias
 using TuplePred = std::function<bool(Tuple)>;
 using TupleOp = std::function<Tuple(Tuple)>;
+// next tuple of a stream, nullopt at end
+using TupleSource = std::function<std::optional<Tuple>()>;
 
 } // namespace sdb
 
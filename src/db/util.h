@@ -14,6 +14,8 @@
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
+#include <cstdlib>
+#include <new>
 #include <boost/spirit/home/support/container.hpp>
 
 #include "../cpp_util/lib/error.hpp"
@@ -35,6 +37,52 @@ using BlockOffset = Size;
 using Byte = char;
 using Bytes = std::vector<Byte>;
 
+// block aligned buffer, needed by O_DIRECT io
+template <typename T>
+struct BlockAlignedAllocator {
+    using value_type = T;
+
+    BlockAlignedAllocator()=default;
+    template <typename U>
+    BlockAlignedAllocator(const BlockAlignedAllocator<U> &){}
+
+    T *allocate(size_t n) {
+        size_t size = (n * sizeof(T) + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        void *ptr = std::aligned_alloc(BLOCK_SIZE, size);
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T *ptr, size_t) {
+        std::free(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const BlockAlignedAllocator<U> &)const {return true;}
+    template <typename U>
+    bool operator!=(const BlockAlignedAllocator<U> &)const {return false;}
+};
+using AlignedBytes = std::vector<Byte, BlockAlignedAllocator<Byte>>;
+
+// read only view of bytes owned by others, e.g. a pinned cache page
+class BytesView {
+public:
+    BytesView(const Byte *ptr, size_t len):ptr(ptr), len(len){}
+    BytesView(const Bytes &bytes):ptr(bytes.data()), len(bytes.size()){}
+    BytesView(const AlignedBytes &bytes):ptr(bytes.data()), len(bytes.size()){}
+
+    const Byte *data()const {return ptr;}
+    size_t size()const {return len;}
+    const Byte *begin()const {return ptr;}
+    const Byte *end()const {return ptr + len;}
+
+private:
+    const Byte *ptr;
+    size_t len;
+};
+
 // transaction
 // Tid => transaction id
 using Tid = int64_t;
@@ -142,7 +190,7 @@ inline Bytes en_bytes(T &&t, Args... args) {
 }
 
 // === de_bytes ===
-inline void _bytes_length_check(Size size, const Bytes &bytes, Size offset){
+inline void _bytes_length_check(Size size, BytesView bytes, Size offset){
     assert(size <= bytes.size() - offset);
 }
 
@@ -157,7 +205,7 @@ inline void container_append(T &t, typename T::value_type tail) {
 }
 
 template <typename T>
-inline void de_bytes(T &t, const Bytes &bytes, Size &offset) {
+inline void de_bytes(T &t, BytesView bytes, Size &offset) {
     if constexpr (std::is_fundamental_v<T>) {
         _bytes_length_check(sizeof(T), bytes, offset);
         std::memcpy(&t, bytes.data() + offset, sizeof(T));
@@ -208,12 +256,10 @@ inline void bytes_append(Bytes &bytes, Args... args) {
     bytes.insert(bytes.end(), append_bytes.begin(), append_bytes.end());
 }
 
+// return old value
 template <typename T>
-inline T atomic_increment_integer(T &data) {
-    static_assert(Traits::AtomicTrait<T>::value);
-    T old_data = data;
-    while (!data.compare_exchange_weak(&old_data, old_data + 1));
-    return old_data;
+inline T atomic_increment_integer(std::atomic<T> &data) {
+    return data.fetch_add(1);
 }
 
 } // SDB namespace
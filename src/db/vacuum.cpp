@@ -0,0 +1,33 @@
+#include "vacuum.h"
+
+namespace sdb {
+
+// ========== public ==========
+Vacuum::Vacuum(std::chrono::milliseconds interval, std::function<void()> round)
+        :interval(interval), round(std::move(round)) {
+    worker = std::thread([this]{run();});
+}
+
+Vacuum::~Vacuum() {
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        is_stop = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+// ========== private ==========
+void Vacuum::run() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> ul(mutex);
+            cv.wait_for(ul, interval, [this]{return is_stop;});
+            if (is_stop) return;
+        }
+        round();
+        round_count++;
+    }
+}
+
+} // namespace sdb
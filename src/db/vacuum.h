@@ -0,0 +1,43 @@
+#ifndef DB_VACUUM_H
+#define DB_VACUUM_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+namespace sdb {
+
+// background thread running a vacuum round every interval,
+// round itself is throttled by its caller, e.g. DB::vacuum.
+// stopped and joined when destroyed
+class Vacuum {
+public:
+    Vacuum(std::chrono::milliseconds interval, std::function<void()> round);
+    Vacuum(const Vacuum &)=delete;
+    Vacuum(Vacuum &&)=delete;
+    Vacuum &operator=(const Vacuum &)=delete;
+    Vacuum &operator=(Vacuum &&)=delete;
+    ~Vacuum();
+
+    // get
+    size_t get_round_count()const {return round_count;}
+
+private:
+    void run();
+
+private:
+    std::chrono::milliseconds interval;
+    std::function<void()> round;
+    std::atomic<size_t> round_count{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool is_stop = false;
+    std::thread worker;
+};
+
+} // namespace sdb
+
+#endif /* ifndef DB_VACUUM_H */
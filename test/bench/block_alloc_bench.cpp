@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+
+#include "../../src/db/block_alloc.h"
+#include "../../src/db/free_space_map.h"
+#include "../../src/db/io.h"
+
+using namespace sdb;
+
+namespace {
+
+// every thread inserts like a bulk load splitting nodes:
+// op_count new blocks of its own table, 1 block freed per 4
+template <typename NewF, typename FreeF>
+double ops_per_sec(size_t thread_count, size_t op_count, NewF new_f, FreeF free_f) {
+    auto beg = std::chrono::steady_clock::now();
+    std::vector<std::thread> thread_lst;
+    for (size_t t = 0; t < thread_count; t++) {
+        thread_lst.emplace_back([t, op_count, &new_f, &free_f]{
+            std::string owner = "_bench_table_" + std::to_string(t);
+            for (size_t i = 0; i < op_count; i++) {
+                BlockNum num = new_f(owner);
+                if (i % 4 == 0) {
+                    free_f(num);
+                }
+            }
+        });
+    }
+    for (auto &&th : thread_lst) {
+        th.join();
+    }
+    std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+    return thread_count * op_count / sec.count();
+}
+
+} // namespace
+
+TEST(db_block_alloc_bench, parallel_insert) {
+    IO &io = IO::get();
+    std::string file_path = "_fsm_bench.sdb";
+    const size_t op_count = 100000;
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+
+    for (size_t thread_count : {1, 2, 4, 8}) {
+        if (io.has_file(file_path)) {
+            io.delete_file(file_path);
+        }
+        io.create_file(file_path);
+        // every block goes to the shared map under its lock
+        FreeSpaceMap fsm(io.get_mmap_file(file_path));
+        double shared_ops = ops_per_sec(thread_count, op_count,
+                                        [&fsm](const std::string &){return fsm.alloc();},
+                                        [&fsm](BlockNum num){fsm.free(num);});
+        io.delete_file(file_path);
+
+        BlockAlloc &block_alloc = BlockAlloc::get();
+        double cached_ops = ops_per_sec(thread_count, op_count,
+                                        [&block_alloc](const std::string &owner){return block_alloc.new_block(owner);},
+                                        [&block_alloc](BlockNum num){block_alloc.free_temp_block(num);});
+        for (size_t t = 0; t < thread_count; t++) {
+            block_alloc.close_extent("_bench_table_" + std::to_string(t));
+        }
+        std::cout << "threads " << thread_count
+                  << " blocks/s: shared map " << shared_ops
+                  << ", thread cache " << cached_ops << std::endl;
+    }
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "../../src/db/bpTree.h"
+#include "../../src/db/block_alloc.h"
+#include "../../src/db/io.h"
+#include "../../src/db/snapshot.h"
+
+using namespace sdb;
+
+namespace {
+
+TransInfo new_trans() {
+    return TransInfo{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+}
+
+Tuple int_tuple(int32_t i) {
+    Tuple tuple;
+    tuple.push_back(std::make_shared<db_type::Int>(i));
+    return tuple;
+}
+
+// table of one int key column: empty record root and empty root leaf
+TableProperty new_table(const std::string &table_name) {
+    ColProperty cp("id", sdb::en_bytes(static_cast<char>(db_type::INT)), 0, true);
+    TableProperty tp(table_name, -1, -1, {cp});
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    tp.record_root = block_alloc.new_block(tp.record_owner());
+    TransInfo t_info = new_trans();
+    Record::new_record(t_info, tp, tp.record_root).sync();
+    t_info.s_ptr->commit();
+
+    BpTree::BptNode root = BpTree::BptNode::new_node(tp, true);
+    root.page.set_pos(0, tp.record_root);
+    root.sync();
+    tp.keys_idx_root = root.file_pos;
+    return tp;
+}
+
+// every thread does op_count ops on keys of its own:
+//     key % thread_count == thread id
+template <typename F>
+double ops_per_sec(size_t thread_count, size_t op_count, F f) {
+    auto beg = std::chrono::steady_clock::now();
+    std::vector<std::thread> thread_lst;
+    for (size_t t = 0; t < thread_count; t++) {
+        thread_lst.emplace_back([t, thread_count, op_count, &f]{
+            std::vector<int32_t> key_lst;
+            for (size_t i = 0; i < op_count; i++) {
+                key_lst.push_back(int32_t(i * thread_count + t));
+            }
+            std::shuffle(key_lst.begin(), key_lst.end(), std::mt19937(t));
+            for (int32_t key : key_lst) {
+                f(key);
+            }
+        });
+    }
+    for (auto &&th : thread_lst) {
+        th.join();
+    }
+    std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+    return thread_count * op_count / sec.count();
+}
+
+} // namespace
+
+TEST(db_bptree_bench, parallel_insert_find) {
+    IO &io = IO::get();
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+    const size_t op_count = 20000;
+
+    for (size_t thread_count : {1, 2, 4, 8}) {
+        TableProperty tp = new_table("_bench_bptree_" + std::to_string(thread_count));
+        BpTree tree(tp);
+        double insert_ops = ops_per_sec(thread_count, op_count, [&tree](int32_t key){
+            TransInfo t_info = new_trans();
+            Tuple tuple = int_tuple(key);
+            tree.insert(t_info, tuple, tuple);
+            t_info.s_ptr->commit();
+        });
+        // readers take no latch, only writers of a node wait for each other
+        double find_ops = ops_per_sec(thread_count, op_count, [&tree](int32_t key){
+            tree.find_key(new_trans(), int_tuple(key));
+        });
+        BlockAlloc::get().close_extent(tp.record_owner());
+        BlockAlloc::get().close_extent(tp.keys_index_owner());
+        std::cout << "threads " << thread_count
+                  << " insert/s " << insert_ops
+                  << ", find/s " << find_ops << std::endl;
+    }
+}
+
+TEST(db_bptree_bench, bulk_load) {
+    IO &io = IO::get();
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+    const int32_t tuple_count = 200000;
+    auto seconds = [](auto f) {
+        auto beg = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+        return sec.count();
+    };
+
+    TableProperty tp = new_table("_bench_bptree_insert");
+    BpTree tree(tp);
+    double insert_sec = seconds([&tree, tuple_count]{
+        for (int32_t key = 0; key < tuple_count; key++) {
+            TransInfo t_info = new_trans();
+            Tuple tuple = int_tuple(key);
+            tree.insert(t_info, tuple, tuple);
+            t_info.s_ptr->commit();
+        }
+    });
+
+    // records and nodes written once, left to right
+    TableProperty load_tp(tp.table_name + "_load", -1, -1, tp.col_property_lst);
+    double load_sec = seconds([&load_tp, tuple_count]{
+        int32_t key = 0;
+        TupleSource next = [&key, tuple_count]() -> std::optional<Tuple> {
+            if (key == tuple_count) return std::nullopt;
+            return int_tuple(key++);
+        };
+        load_tp = BpTree::bulk_load(new_trans(), load_tp, next, 90);
+    });
+    BpTree load_tree(load_tp);
+    ASSERT_TRUE(load_tree.find_key(new_trans(), int_tuple(tuple_count / 2)).data.size() == 1);
+    BlockAlloc::get().close_extent(tp.record_owner());
+    BlockAlloc::get().close_extent(tp.keys_index_owner());
+    BlockAlloc::get().close_extent(load_tp.record_owner());
+    BlockAlloc::get().close_extent(load_tp.keys_index_owner());
+    std::cout << "tuples " << tuple_count
+              << " insert " << insert_sec << "s"
+              << ", bulk load " << load_sec << "s" << std::endl;
+}
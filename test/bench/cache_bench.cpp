@@ -0,0 +1,255 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include "../../src/db/cache.h"
+#include "../../src/db/io.h"
+#include "../../src/db/util.h"
+
+using namespace sdb;
+
+namespace {
+
+// every thread does op_count random get/put on hot blocks,
+// 1 put per 8 ops
+template <typename Cache>
+double ops_per_sec(Cache &cache, size_t thread_count, size_t block_count, size_t op_count) {
+    auto beg = std::chrono::steady_clock::now();
+    std::vector<std::thread> thread_lst;
+    for (size_t t = 0; t < thread_count; t++) {
+        thread_lst.emplace_back([&cache, t, block_count, op_count]{
+            std::mt19937 gen(t);
+            std::uniform_int_distribution<BlockNum> dist(0, block_count - 1);
+            Bytes block(BLOCK_SIZE, 'a' + t);
+            for (size_t i = 0; i < op_count; i++) {
+                BlockNum num = dist(gen);
+                if (i % 8 == 0) {
+                    cache.put(num, block);
+                } else {
+                    cache.get(num);
+                }
+            }
+        });
+    }
+    for (auto &&th : thread_lst) {
+        th.join();
+    }
+    std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+    return thread_count * op_count / sec.count();
+}
+
+} // namespace
+
+TEST(db_cache_bench, thread_scaling) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+
+    // all blocks fit in cache with room for uneven shards,
+    // measure lock cost only
+    const size_t block_count = 1024;
+    const size_t op_count = 50000;
+    Bytes block(BLOCK_SIZE, 'a');
+    for (size_t i = 0; i < block_count; i++) {
+        io.write_block(file_path, i, block);
+    }
+
+    for (size_t thread_count : {1, 2, 4, 8, 16, 32}) {
+        BlockCache single(block_count * 2);
+        ShardedBlockCache sharded(block_count * 2, 64);
+        double single_ops = ops_per_sec(single, thread_count, block_count, op_count);
+        double sharded_ops = ops_per_sec(sharded, thread_count, block_count, op_count);
+        std::cout << "threads " << thread_count
+                  << " ops/s: one lock " << single_ops
+                  << ", " << sharded.get_shard_count() << " shards " << sharded_ops << std::endl;
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_bench, get_vs_pin) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+
+    const size_t block_count = 256;
+    const size_t op_count = 1000000;
+    Bytes block(BLOCK_SIZE, 'a');
+    for (size_t i = 0; i < block_count; i++) {
+        io.write_block(file_path, i, block);
+    }
+    BlockCache cache(block_count);
+    // read first 8 bytes of block, as record and node headers do
+    size_t sum = 0;
+    auto beg = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < op_count; i++) {
+        Bytes bytes = cache.get(i % block_count);
+        sum += bytes[i % 8];
+    }
+    std::chrono::duration<double> get_sec = std::chrono::steady_clock::now() - beg;
+    beg = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < op_count; i++) {
+        PageRef page = cache.pin(i % block_count);
+        sum += page.data()[i % 8];
+    }
+    std::chrono::duration<double> pin_sec = std::chrono::steady_clock::now() - beg;
+    std::cout << "ops/s: get copy " << op_count / get_sec.count()
+              << ", pin " << op_count / pin_sec.count() << std::endl;
+    ASSERT_TRUE(sum == 2 * op_count * 'a');
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_bench, root_read) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    io.write_block(file_path, 0, Bytes(BLOCK_SIZE, 'a'));
+
+    // every thread reads root node header, hits take no lock
+    const size_t op_count = 200000;
+    for (size_t thread_count : {1, 2, 4, 8, 16}) {
+        ShardedBlockCache cache(1024, 16);
+        cache.get(0, INDEX_INNER_PAGE);
+        for (bool use_pin : {true, false}) {
+            std::atomic<size_t> sum{0};
+            auto beg = std::chrono::steady_clock::now();
+            std::vector<std::thread> thread_lst;
+            for (size_t t = 0; t < thread_count; t++) {
+                thread_lst.emplace_back([&cache, &sum, use_pin, op_count]{
+                    size_t local_sum = 0;
+                    for (size_t i = 0; i < op_count; i++) {
+                        if (use_pin) {
+                            PageRef page = cache.pin(0, false, INDEX_INNER_PAGE);
+                            local_sum += page.data()[i % 8];
+                        } else {
+                            local_sum += cache.get(0, INDEX_INNER_PAGE)[i % 8];
+                        }
+                    }
+                    sum += local_sum;
+                });
+            }
+            for (auto &&th : thread_lst) {
+                th.join();
+            }
+            std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+            std::cout << "threads " << thread_count << (use_pin ? " pin" : " get")
+                      << " ops/s " << thread_count * op_count / sec.count() << std::endl;
+            ASSERT_TRUE(sum == thread_count * op_count * 'a');
+        }
+        ASSERT_TRUE(cache.get_stats(INDEX_INNER_PAGE).hit_count == 2 * thread_count * op_count);
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_bench, index_priority) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+
+    // 1 root, 16 inner nodes, 256 leaves over 8192 data blocks
+    const BlockNum inner_beg = 1, leaf_beg = 1024, data_beg = 4096, data_count = 8192;
+    const size_t lookup_count = 20000;
+    io.get_mmap_file(file_path)->ensure_size((data_beg + data_count) * BLOCK_SIZE);
+
+    for (bool use_class : {false, true}) {
+        BlockCache cache(384, "2q");
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<BlockNum> dist(0, data_count - 1);
+        auto cls = [use_class](PageClass page_class){return use_class ? page_class : DATA_PAGE;};
+        for (size_t i = 0; i < lookup_count; i++) {
+            BlockNum data = dist(gen);
+            cache.get(0, cls(INDEX_INNER_PAGE));
+            cache.get(inner_beg + data / 512, cls(INDEX_INNER_PAGE));
+            cache.get(leaf_beg + data / 32, cls(INDEX_LEAF_PAGE));
+            cache.get(data_beg + data);
+        }
+        size_t miss_count = 0;
+        for (size_t i = 0; i < PAGE_CLASS_COUNT; i++) {
+            miss_count += cache.get_stats(PageClass(i)).miss_count;
+        }
+        std::cout << (use_class ? "priority classes" : "one class")
+                  << ": disk reads per lookup " << double(miss_count) / lookup_count << std::endl;
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_bench, scan_ring) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+
+    // point lookups on 768 hot blocks while one thread scans 8192 blocks
+    const BlockNum hot_count = 768, scan_beg = 1024, scan_count = 8192;
+    const size_t batch_count = 32;
+    io.get_mmap_file(file_path)->ensure_size((scan_beg + scan_count) * BLOCK_SIZE);
+
+    for (bool use_ring : {false, true}) {
+        ShardedBlockCache cache(1024, 4);
+        for (BlockNum num = 0; num < hot_count; num++) {
+            cache.get(num);
+        }
+        std::atomic<bool> is_scan_done{false};
+        std::thread scanner([&]{
+            ScanRing ring(cache);
+            for (BlockNum beg = scan_beg; beg < scan_beg + scan_count; beg += batch_count) {
+                std::vector<BlockNum> num_lst;
+                for (BlockNum num = beg; num < beg + BlockNum(batch_count); num++) {
+                    num_lst.push_back(num);
+                }
+                if (use_ring) {
+                    ring.prefetch(num_lst);
+                    for (BlockNum num : num_lst) {
+                        ring.read(num);
+                    }
+                } else {
+                    cache.prefetch(num_lst);
+                    for (BlockNum num : num_lst) {
+                        cache.get(num);
+                    }
+                }
+            }
+            is_scan_done = true;
+        });
+        std::mt19937 gen(0);
+        std::uniform_int_distribution<BlockNum> dist(0, hot_count - 1);
+        size_t lookup_count = 0;
+        auto beg = std::chrono::steady_clock::now();
+        while (!is_scan_done) {
+            cache.get(dist(gen));
+            lookup_count++;
+        }
+        std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+        scanner.join();
+
+        // hot blocks still cached after scan
+        size_t miss_count = cache.get_stats(DATA_PAGE).miss_count;
+        for (BlockNum num = 0; num < hot_count; num++) {
+            cache.get(num);
+        }
+        size_t hot_miss_count = cache.get_stats(DATA_PAGE).miss_count - miss_count;
+        std::cout << (use_ring ? "scan ring" : "shared cache")
+                  << ": lookups/s during scan " << lookup_count / sec.count()
+                  << ", hot blocks lost " << hot_miss_count << "/" << hot_count << std::endl;
+    }
+
+    io.delete_file(file_path);
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../../src/db/io.h"
+#include "../../src/db/util.h"
+
+using namespace sdb;
+
+namespace {
+
+// block io before persistent descriptor and segment mapping:
+// open, stat, mmap one block, memcpy, munmap and close per call
+Bytes per_call_read_block(const std::string &abs_path, size_t block_num) {
+    int fd = open(abs_path.data(), O_RDWR);
+    struct stat file_info;
+    fstat(fd, &file_info);
+    if ((size_t)file_info.st_size < (block_num+1)*BLOCK_SIZE) {
+        lseek(fd, BLOCK_SIZE*(block_num+1), SEEK_SET);
+        write(fd, "", 1);
+    }
+    char *buff = (char*)mmap(nullptr, BLOCK_SIZE, PROT_READ, MAP_SHARED, fd, BLOCK_SIZE*block_num);
+    Bytes block(BLOCK_SIZE);
+    std::memcpy(block.data(), buff, BLOCK_SIZE);
+    munmap(buff, BLOCK_SIZE);
+    close(fd);
+    return block;
+}
+
+void per_call_write_block(const std::string &abs_path, size_t block_num, const Bytes &data) {
+    int fd = open(abs_path.data(), O_RDWR);
+    struct stat file_info;
+    fstat(fd, &file_info);
+    if ((size_t)file_info.st_size < (block_num+1)*BLOCK_SIZE) {
+        lseek(fd, BLOCK_SIZE*(block_num+1), SEEK_SET);
+        write(fd, "", 1);
+    }
+    char *buff = (char*)mmap(nullptr, BLOCK_SIZE, PROT_WRITE, MAP_SHARED, fd, BLOCK_SIZE*block_num);
+    std::memcpy(buff, data.data(), BLOCK_SIZE);
+    munmap(buff, BLOCK_SIZE);
+    close(fd);
+}
+
+template <typename F>
+double blocks_per_sec(size_t count, F f) {
+    auto beg = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> sec = std::chrono::steady_clock::now() - beg;
+    return count / sec.count();
+}
+
+} // namespace
+
+TEST(db_io_bench, block_throughput) {
+    IO &io = IO::get();
+    if (io.has_file("_io_bench")) {
+        io.remove_dir_force("_io_bench");
+    }
+    io.create_dir("_io_bench");
+    std::string file_path = "_io_bench/block.sdb";
+    std::string abs_path = io.get_db_file_path(file_path);
+    io.create_file(file_path);
+
+    const size_t block_count = 4096;
+    const size_t op_count = 100000;
+    Bytes block(BLOCK_SIZE, 'a');
+    for (size_t i = 0; i < block_count; i++) {
+        io.write_block(file_path, i, block);
+    }
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<size_t> dist(0, block_count - 1);
+    std::vector<size_t> nums;
+    for (size_t i = 0; i < op_count; i++) {
+        nums.push_back(dist(gen));
+    }
+
+    double old_read = blocks_per_sec(op_count, [&]{
+        for (size_t num : nums) per_call_read_block(abs_path, num);
+    });
+    double new_read = blocks_per_sec(op_count, [&]{
+        for (size_t num : nums) io.read_block(file_path, num);
+    });
+    double old_write = blocks_per_sec(op_count, [&]{
+        for (size_t num : nums) per_call_write_block(abs_path, num, block);
+    });
+    double new_write = blocks_per_sec(op_count, [&]{
+        for (size_t num : nums) io.write_block(file_path, num, block);
+    });
+
+    std::cout << "read  blocks/s: per call " << old_read << ", mmap file " << new_read << std::endl;
+    std::cout << "write blocks/s: per call " << old_write << ", mmap file " << new_write << std::endl;
+    ASSERT_TRUE(io.read_block(file_path, 0) == block);
+
+    io.remove_dir_force("_io_bench");
+}
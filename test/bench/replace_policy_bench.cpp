@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <unordered_set>
+
+#include "../../src/db/replace_policy.h"
+#include "../../src/db/util.h"
+
+using namespace sdb;
+
+namespace {
+
+// oltp point reads on a skewed hot set,
+// with a report scanning the whole table every scan_period accesses
+std::vector<BlockNum> mixed_trace(size_t access_count) {
+    const BlockNum hot_count = 80;
+    const BlockNum table_count = 5000;
+    const size_t scan_period = 20000;
+    std::mt19937 gen(0);
+    // about 1 / (rank + 1)
+    std::vector<double> weight_lst;
+    for (BlockNum i = 0; i < hot_count; i++) {
+        weight_lst.push_back(1.0 / (i + 1));
+    }
+    std::discrete_distribution<BlockNum> hot_dist(weight_lst.begin(), weight_lst.end());
+    std::uniform_int_distribution<BlockNum> cold_dist(hot_count, table_count - 1);
+    std::uniform_int_distribution<int> pct(0, 99);
+
+    std::vector<BlockNum> trace;
+    while (trace.size() < access_count) {
+        if (trace.size() % scan_period == 0 && !trace.empty()) {
+            for (BlockNum num = hot_count; num < table_count; num++) {
+                trace.push_back(num);
+            }
+        }
+        trace.push_back(pct(gen) < 95 ? hot_dist(gen) : cold_dist(gen));
+    }
+    return trace;
+}
+
+// trace file: one block num per line
+std::vector<BlockNum> load_trace(const std::string &path) {
+    std::ifstream in(path);
+    std::vector<BlockNum> trace;
+    BlockNum num;
+    while (in >> num) {
+        trace.push_back(num);
+    }
+    return trace;
+}
+
+double hit_ratio(const std::string &name, size_t max_block_count, const std::vector<BlockNum> &trace) {
+    auto policy = ReplacePolicy::make(name, max_block_count);
+    std::unordered_set<BlockNum> resident;
+    size_t hit_count = 0;
+    for (BlockNum num : trace) {
+        if (resident.count(num) != 0) {
+            policy->access(num);
+            hit_count++;
+            continue;
+        }
+        if (resident.size() >= max_block_count) {
+            resident.erase(policy->victim());
+        }
+        policy->insert(num);
+        resident.insert(num);
+    }
+    return double(hit_count) / trace.size();
+}
+
+} // namespace
+
+// SDB_CACHE_TRACE=<file> replays a recorded trace instead of the synthetic one
+TEST(db_replace_policy_bench, trace_replay) {
+    const char *trace_path = std::getenv("SDB_CACHE_TRACE");
+    std::vector<BlockNum> trace = trace_path != nullptr ? load_trace(trace_path) : mixed_trace(200000);
+    for (size_t max_block_count : {100, 1000}) {
+        for (std::string name : {"lru", "2q"}) {
+            std::cout << "cache " << max_block_count << " blocks, " << name
+                      << " hit ratio: " << hit_ratio(name, max_block_count, trace) << std::endl;
+        }
+    }
+}
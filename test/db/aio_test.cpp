@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "../../src/db/aio.h"
+#include "../../src/db/io.h"
+#include "../../src/db/util.h"
+
+using namespace sdb;
+
+namespace {
+
+// empty block file in a new dir
+std::string new_file(const std::string &dir) {
+    IO &io = IO::get();
+    if (io.has_file(dir)) {
+        io.remove_dir_force(dir);
+    }
+    io.create_dir(dir);
+    std::string file_path = dir + "/block.sdb";
+    io.create_file(file_path);
+    return file_path;
+}
+
+} // namespace
+
+TEST(db_aio_test, batch) {
+    IO &io = IO::get();
+    std::string file_path = new_file("_aio_test");
+    auto file_ptr = io.get_mmap_file(file_path);
+
+    // write batch
+    const size_t block_count = 64;
+    std::vector<Bytes> block_lst;
+    for (size_t i = 0; i < block_count; i++) {
+        block_lst.push_back(Bytes(BLOCK_SIZE, 'a' + i % 26));
+    }
+    AioBatch write_batch;
+    for (size_t i = 0; i < block_count; i++) {
+        write_batch.write(i, block_lst[i].data());
+    }
+    AsyncIO::get().execute(file_ptr, write_batch);
+    ASSERT_TRUE(!write_batch.has_error());
+
+    // read batch, and check with mapped read
+    std::vector<Bytes> read_lst(block_count, Bytes(BLOCK_SIZE));
+    AioBatch read_batch;
+    for (size_t i = 0; i < block_count; i++) {
+        read_batch.read(block_count - 1 - i, read_lst[i].data());
+    }
+    AsyncIO::get().submit(file_ptr, read_batch);
+    read_batch.wait();
+    ASSERT_TRUE(!read_batch.has_error());
+    for (size_t i = 0; i < block_count; i++) {
+        ASSERT_TRUE(read_lst[i] == block_lst[block_count - 1 - i]);
+        ASSERT_TRUE(io.read_block(file_path, i) == block_lst[i]);
+    }
+    ASSERT_TRUE(AsyncIO::get().get_in_flight() == 0);
+
+    io.remove_dir_force("_aio_test");
+}
+
+#ifdef SDB_IO_URING
+TEST(db_aio_test, uring_deep_batch) {
+    IO &io = IO::get();
+    std::string file_path = new_file("_aio_deep_test");
+    auto file_ptr = io.get_mmap_file(file_path);
+
+    // more requests than queue depth 256 of io_uring engine in one batch,
+    // sqes prepared before a wait for room must be submitted first
+    const size_t block_count = 1000;
+    std::vector<Bytes> block_lst;
+    for (size_t i = 0; i < block_count; i++) {
+        block_lst.push_back(Bytes(BLOCK_SIZE, 'a' + i % 26));
+    }
+    AioBatch write_batch;
+    for (size_t i = 0; i < block_count; i++) {
+        write_batch.write(i, block_lst[i].data());
+    }
+    AsyncIO::get().execute(file_ptr, write_batch);
+    ASSERT_TRUE(!write_batch.has_error());
+
+    std::vector<Bytes> read_lst(block_count, Bytes(BLOCK_SIZE));
+    AioBatch read_batch;
+    for (size_t i = 0; i < block_count; i++) {
+        read_batch.read(i, read_lst[i].data());
+    }
+    AsyncIO::get().execute(file_ptr, read_batch);
+    ASSERT_TRUE(!read_batch.has_error());
+    ASSERT_TRUE(read_lst == block_lst);
+    ASSERT_TRUE(AsyncIO::get().get_in_flight() == 0);
+
+    io.remove_dir_force("_aio_deep_test");
+}
+#endif
@@ -1,30 +1,138 @@
 #include <gtest/gtest.h>
+#include <set>
+#include <thread>
 
 #include "../../src/db/block_alloc.h"
 #include "../../src/db/io.h"
 
 using namespace sdb;
 
-TEST(db_block_alloc_test, block_alloc) {
+TEST(db_block_alloc_test, extent) {
     IO &io = IO::get();
-    if (io.has_file("_block_alloc_test")) {
-        io.remove_dir_force("_block_alloc_test");
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
     }
-    io.create_dir("_block_alloc_test");
-    io.create_file("_block_alloc_test/alloc.sdb");
-    std::vector<size_t> v{0};
-    io.full_write_file("_block_alloc_test/alloc.sdb", en_bytes(v));
     BlockAlloc &block_alloc = BlockAlloc::get();
-    // todo : delete it
-    block_alloc._get_map()["_block_alloc_test"];
-    int bn = block_alloc.new_block("_block_alloc_test");
-    ASSERT_TRUE(bn == 0);
-    bn = block_alloc.new_block("_block_alloc_test");
-    ASSERT_TRUE(bn == 1);
-    bn = block_alloc.new_block("_block_alloc_test");
-    ASSERT_TRUE(bn == 2);
-    block_alloc.free_block("_block_alloc_test", 1);
-    bn = block_alloc.new_block("_block_alloc_test");
-    ASSERT_TRUE(bn == 1);
+    const BlockNum extent_count = BlockAlloc::EXTENT_BLOCK_COUNT;
+    BlockNum a0 = block_alloc.new_block("_extent_a");
+    BlockNum b0 = block_alloc.new_block("_extent_b");
+    // owners don't share extents, extents are aligned
+    ASSERT_TRUE(a0 % extent_count == 0);
+    ASSERT_TRUE(b0 % extent_count == 0);
+    ASSERT_TRUE(b0 != a0);
+    // blocks of owner are adjacent
+    for (BlockNum i = 1; i < extent_count; i++) {
+        ASSERT_TRUE(block_alloc.new_block("_extent_a") == a0 + i);
+    }
+    BlockNum a1 = block_alloc.new_block("_extent_a");
+    ASSERT_TRUE(a1 % extent_count == 0);
+    ASSERT_TRUE(a1 > b0);
+
+    // unused blocks of extent are freed
+    block_alloc.close_extent("_extent_b");
+    ASSERT_TRUE(block_alloc.new_block("_extent_b") > a1);
+}
+
+TEST(db_block_alloc_test, thread_cache) {
+    IO &io = IO::get();
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    const BlockNum extent_count = BlockAlloc::EXTENT_BLOCK_COUNT;
+
+    // freed temp block is reused by the same thread first
+    BlockNum num = block_alloc.new_temp_block();
+    block_alloc.free_temp_block(num);
+    ASSERT_TRUE(block_alloc.new_temp_block() == num);
+    block_alloc.free_temp_block(num);
+
+    // every thread fills its own extent of owner
+    const size_t thread_count = 4;
+    std::vector<std::vector<BlockNum>> num_lst_lst(thread_count);
+    std::vector<std::thread> thread_lst;
+    for (size_t t = 0; t < thread_count; t++) {
+        thread_lst.emplace_back([&block_alloc, &num_lst_lst, t]{
+            for (BlockNum i = 0; i < BlockAlloc::EXTENT_BLOCK_COUNT / 2; i++) {
+                num_lst_lst[t].push_back(block_alloc.new_block("_thread_cache"));
+            }
+        });
+    }
+    for (auto &&th : thread_lst) {
+        th.join();
+    }
+    std::set<BlockNum> num_set;
+    for (auto &&num_lst : num_lst_lst) {
+        ASSERT_TRUE(num_lst[0] % extent_count == 0);
+        for (size_t i = 1; i < num_lst.size(); i++) {
+            ASSERT_TRUE(num_lst[i] == num_lst[0] + BlockNum(i));
+        }
+        num_set.insert(num_lst.begin(), num_lst.end());
+    }
+    ASSERT_TRUE(num_set.size() == thread_count * extent_count / 2);
+
+    // extents of ended threads are closed
+    BlockNum next = block_alloc.new_block("_thread_cache");
+    ASSERT_TRUE(next % extent_count == 0);
+    ASSERT_TRUE(num_set.count(next) == 0);
+    block_alloc.close_extent("_thread_cache");
 }
 
+TEST(db_block_alloc_test, truncate) {
+    IO &io = IO::get();
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    auto discard = [](BlockNum){return true;};
+
+    // file grows by extent
+    BlockNum num = block_alloc.new_block("_truncate");
+    size_t block_count = io.get_mmap_file(io.block_path())->get_file_size() / BLOCK_SIZE;
+    ASSERT_TRUE(block_count > size_t(num));
+    // cut after last used block
+    block_alloc.close_extent("_truncate");
+    ASSERT_TRUE(block_alloc.truncate(discard) == size_t(num) + 1);
+    ASSERT_TRUE(io.get_mmap_file(io.block_path())->get_file_size() == (size_t(num) + 1) * BLOCK_SIZE);
+
+    // block before limit comes from a hole
+    BlockNum hole = block_alloc.new_block_before(num);
+    ASSERT_TRUE(hole != -1 && hole < num);
+    ASSERT_TRUE(block_alloc.new_block_before(0) == -1);
+    // catalog roots are never handed out
+    ASSERT_TRUE(block_alloc.new_block_before(BlockAlloc::CATALOG_BLOCK_COUNT) == -1);
+    block_alloc.free_blocks({num, hole});
+    block_alloc.sync([]{});
+    ASSERT_TRUE(block_alloc.truncate(discard) <= size_t(num));
+
+    // blocks that can't be dropped from cache stay
+    BlockNum tail = block_alloc.new_block("_truncate");
+    block_alloc.close_extent("_truncate");
+    block_alloc.free_blocks({tail});
+    block_alloc.sync([]{});
+    auto keep = [tail](BlockNum n){return n != tail;};
+    ASSERT_TRUE(block_alloc.truncate(keep) == size_t(tail) + 1);
+}
+
+TEST(db_block_alloc_test, pending_free) {
+    IO &io = IO::get();
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    BlockNum num = block_alloc.new_block("_pending_free");
+    block_alloc.close_extent("_pending_free");
+    size_t used_count = block_alloc.get_used_count();
+    // freed block stays used until checkpoint
+    block_alloc.free_block(num);
+    ASSERT_TRUE(block_alloc.get_used_count() == used_count);
+
+    // cache is written before frees are applied
+    bool is_flushed = false;
+    block_alloc.sync([&]{
+        is_flushed = true;
+        ASSERT_TRUE(block_alloc.get_used_count() == used_count);
+    });
+    ASSERT_TRUE(is_flushed);
+    ASSERT_TRUE(block_alloc.get_used_count() == used_count - 1);
+}
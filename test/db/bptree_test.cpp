@@ -0,0 +1,382 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <set>
+#include <thread>
+
+#include "../../src/db/bpTree.h"
+#include "test_util.h"
+
+using namespace sdb;
+using namespace sdb::test;
+
+namespace {
+
+// long keys => few entries per node, so a few records make a tree of some leaves.
+// key => 8 digits of num, then padding to KEY_SIZE chars
+constexpr int KEY_SIZE = 128;
+
+Tuple new_key(int32_t num) {
+    std::string str = std::to_string(num);
+    str = std::string(8 - str.size(), '0') + str + std::string(KEY_SIZE - 8, 'k');
+    Tuple tuple;
+    tuple.push_back(std::make_shared<db_type::Varchar>(KEY_SIZE, str));
+    return tuple;
+}
+
+// key and varchar of size chars
+Tuple new_tuple(int32_t num, int size) {
+    Tuple tuple = new_key(num);
+    tuple.push_back(std::make_shared<db_type::Varchar>(3000, std::string(size, 'a')));
+    return tuple;
+}
+
+// keys 0 .. count - 1, bulk loaded to fill_percent
+TableProperty load_table(const std::string &table_name, int32_t count, int size, Size fill_percent) {
+    create_block_file();
+    ColProperty id_cp("id", sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(KEY_SIZE)), 0, true);
+    ColProperty data_cp("data", sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(3000)), 1);
+    TableProperty tp(table_name, -1, -1, {id_cp, data_cp});
+    int32_t key = 0;
+    TupleSource next = [&key, count, size]() -> std::optional<Tuple> {
+        if (key == count) return std::nullopt;
+        return new_tuple(key++, size);
+    };
+    return BpTree::bulk_load(new_trans(), tp, next, fill_percent);
+}
+
+// keys read along record chain
+std::vector<int32_t> chain_keys(const TableProperty &tp) {
+    std::vector<int32_t> lst;
+    for (auto &&[pos, tuple] : chain_tuples(tp)) {
+        lst.push_back(std::stoi(tuple[0]->to_string().substr(0, 8)));
+    }
+    return lst;
+}
+
+// leaves left to right, from root of catalog
+std::vector<BpTree::BptNode> leaf_lst(const TableProperty &tp) {
+    BlockNum pos = tp.keys_idx_root;
+    while (!BpTree::BptNode::get(tp, pos).page.view().is_leaf()) {
+        pos = BpTree::BptNode::get(tp, pos).page.view().get_pos(0);
+    }
+    std::vector<BpTree::BptNode> lst;
+    for (; pos != -1; pos = lst.back().page.view().get_right_pos()) {
+        lst.push_back(BpTree::BptNode::get(tp, pos));
+    }
+    return lst;
+}
+
+} // namespace
+
+TEST(db_bptree_test, vacuum) {
+    // one tuple per record, one leaf
+    TableProperty tp = load_table("_bptree_vacuum", 24, 2000, 100);
+    BpTree tree(tp);
+    std::vector<BlockNum> old_chain = record_chain(tp);
+    ASSERT_TRUE(old_chain.size() == 24);
+
+    TransInfo t_info = new_trans();
+    std::vector<int32_t> key_lst;
+    for (int32_t key = 0; key < 24; key++) {
+        if (key % 4 == 0) {
+            key_lst.push_back(key);
+        } else {
+            tree.remove(t_info, new_key(key));
+        }
+    }
+    t_info.s_ptr->commit();
+
+    std::vector<BlockNum> retired_lst = tree.vacuum(1000);
+    std::vector<BlockNum> chain = record_chain(tp);
+    // empty records are merged into left ones
+    ASSERT_TRUE(chain.size() == key_lst.size());
+    ASSERT_TRUE(chain_keys(tp) == key_lst);
+
+    // leaves route to chain records only, in chain order
+    std::vector<BlockNum> pos_lst = tree.record_pos_lst();
+    pos_lst.erase(std::unique(pos_lst.begin(), pos_lst.end()), pos_lst.end());
+    ASSERT_TRUE(pos_lst == chain);
+
+    // retired blocks are unlinked records of old chain
+    ASSERT_TRUE(retired_lst.size() == old_chain.size() - chain.size());
+    std::set<BlockNum> chain_set(chain.begin(), chain.end());
+    std::set<BlockNum> old_set(old_chain.begin(), old_chain.end());
+    for (BlockNum pos : retired_lst) {
+        ASSERT_TRUE(chain_set.count(pos) == 0);
+        ASSERT_TRUE(old_set.count(pos) == 1);
+    }
+    for (int32_t key = 0; key < 24; key++) {
+        ASSERT_TRUE(tree.find_key(new_trans(), new_key(key)).data.size() == (key % 4 == 0 ? 1 : 0));
+    }
+    close_table(tp);
+}
+
+TEST(db_bptree_test, read_while_vacuum) {
+    // one tuple per record, every other one removed
+    TableProperty tp = load_table("_bptree_read_while_vacuum", 200, 2000, 100);
+    BpTree tree(tp);
+    TransInfo t_info = new_trans();
+    for (int32_t key = 1; key < 200; key += 2) {
+        tree.remove(t_info, new_key(key));
+    }
+    t_info.s_ptr->commit();
+
+    // readers go on while records are relinked and leaves synced after them
+    std::atomic<bool> is_done{false};
+    std::atomic<size_t> error_count{0};
+    std::vector<std::thread> reader_lst;
+    for (int i = 0; i < 2; i++) {
+        reader_lst.emplace_back([&] {
+            while (!is_done) {
+                if (tree.find_range(new_trans(), new_key(50), new_key(149), true, true).data.size() != 50) {
+                    error_count++;
+                }
+                if (tree.find_less(new_trans(), new_key(100), false).data.size() != 50) {
+                    error_count++;
+                }
+            }
+        });
+    }
+    std::vector<BlockNum> retired_lst = tree.vacuum(1000);
+    is_done = true;
+    for (auto &&reader : reader_lst) {
+        reader.join();
+    }
+    ASSERT_TRUE(error_count == 0);
+    ASSERT_TRUE(!retired_lst.empty());
+    ASSERT_TRUE(record_chain(tp).size() == 100);
+    close_table(tp);
+}
+
+TEST(db_bptree_test, bulk_load_error) {
+    create_block_file();
+    ColProperty id_cp("id", sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(KEY_SIZE)), 0, true);
+    ColProperty data_cp("data", sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(3000)), 1);
+    TableProperty tp("_bptree_bulk_load_error", -1, -1, {id_cp, data_cp});
+    auto checkpoint = [] {
+        BlockAlloc::get().sync([]{CacheMaster::get_block_cache().sync();});
+    };
+    checkpoint();
+    size_t used_count = BlockAlloc::get().get_used_count();
+
+    // last key comes twice, after some records and nodes are written
+    int32_t key = 0;
+    TupleSource next = [&key]() -> std::optional<Tuple> {
+        if (key == 1001) return std::nullopt;
+        return new_tuple(std::min(key++, 999), 100);
+    };
+    ASSERT_THROW(BpTree::bulk_load(new_trans(), tp, next, 100), std::runtime_error);
+    // blocks of partial tree are free again
+    close_table(tp);
+    checkpoint();
+    ASSERT_TRUE(BlockAlloc::get().get_used_count() == used_count);
+}
+
+TEST(db_bptree_test, merge_node) {
+    // one tuple per record, about 13 records per leaf
+    TableProperty tp = load_table("_bptree_merge_node", 60, 1000, 50);
+    BpTree tree(tp);
+    ASSERT_TRUE(!BpTree::BptNode::get(tp, tp.keys_idx_root).page.view().is_leaf());
+    std::vector<BpTree::BptNode> old_leaf_lst = leaf_lst(tp);
+    ASSERT_TRUE(old_leaf_lst.size() > 2);
+
+    TransInfo t_info = new_trans();
+    std::vector<int32_t> key_lst;
+    for (int32_t key = 0; key < 60; key++) {
+        if (key % 10 == 0) {
+            key_lst.push_back(key);
+        } else {
+            tree.remove(t_info, new_key(key));
+        }
+    }
+    t_info.s_ptr->commit();
+
+    std::vector<BlockNum> retired_lst = tree.vacuum(1000);
+    // leaves are merged into first one, root of one child gives way to it
+    std::vector<BpTree::BptNode> new_leaf_lst = leaf_lst(tp);
+    ASSERT_TRUE(new_leaf_lst.size() == 1);
+    ASSERT_TRUE(new_leaf_lst[0].file_pos == tp.keys_idx_root);
+    std::set<BlockNum> retired_set(retired_lst.begin(), retired_lst.end());
+    for (auto &&leaf : old_leaf_lst) {
+        ASSERT_TRUE(retired_set.count(leaf.file_pos) == 1);
+    }
+
+    ASSERT_TRUE(chain_keys(tp) == key_lst);
+    std::vector<BlockNum> pos_lst = tree.record_pos_lst();
+    pos_lst.erase(std::unique(pos_lst.begin(), pos_lst.end()), pos_lst.end());
+    ASSERT_TRUE(pos_lst == record_chain(tp));
+    for (int32_t key = 0; key < 60; key++) {
+        ASSERT_TRUE(tree.find_key(new_trans(), new_key(key)).data.size() == (key % 10 == 0 ? 1 : 0));
+    }
+
+    // tree still splits after collapse
+    t_info = new_trans();
+    for (int32_t key = 1; key < 140; key++) {
+        if (key >= 60 || key % 2 == 1) {
+            tree.insert(t_info, new_key(key), new_tuple(key, 1000));
+            key_lst.push_back(key);
+        }
+    }
+    t_info.s_ptr->commit();
+    std::sort(key_lst.begin(), key_lst.end());
+    ASSERT_TRUE(leaf_lst(tp).size() > 1);
+    ASSERT_TRUE(chain_keys(tp) == key_lst);
+    ASSERT_TRUE(tree.find_range(new_trans(), new_key(0), new_key(139), true, true).data.size() == key_lst.size());
+    close_table(tp);
+}
+
+TEST(db_bptree_test, refill_node) {
+    // one tuple per record, full leaves
+    TableProperty tp = load_table("_bptree_refill_node", 70, 2000, 100);
+    BpTree tree(tp);
+    std::vector<BpTree::BptNode> old_leaf_lst = leaf_lst(tp);
+    ASSERT_TRUE(old_leaf_lst.size() == 3);
+    NodeView first_view = old_leaf_lst[0].page.view();
+    int32_t first_count = first_view.get_key_count() + 1;
+
+    // first leaf under a quarter, too much with second one to merge
+    TransInfo t_info = new_trans();
+    for (int32_t key = 0; key < first_count; key++) {
+        if (key % 20 != 0) {
+            tree.remove(t_info, new_key(key));
+        }
+    }
+    t_info.s_ptr->commit();
+
+    std::vector<BlockNum> retired_lst = tree.vacuum(1000);
+    std::vector<BpTree::BptNode> new_leaf_lst = leaf_lst(tp);
+    ASSERT_TRUE(new_leaf_lst.size() == 3);
+    // first leaf changed in place, second one copied to a new block
+    ASSERT_TRUE(new_leaf_lst[0].file_pos == old_leaf_lst[0].file_pos);
+    ASSERT_TRUE(new_leaf_lst[1].file_pos != old_leaf_lst[1].file_pos);
+    ASSERT_TRUE(std::count(retired_lst.begin(), retired_lst.end(), old_leaf_lst[1].file_pos) == 1);
+    Size left_size = new_leaf_lst[0].page.view().get_used_size();
+    Size right_size = new_leaf_lst[1].page.view().get_used_size();
+    ASSERT_TRUE(left_size >= BLOCK_SIZE / 4);
+    ASSERT_TRUE(right_size >= BLOCK_SIZE / 4);
+
+    std::vector<BlockNum> pos_lst = tree.record_pos_lst();
+    pos_lst.erase(std::unique(pos_lst.begin(), pos_lst.end()), pos_lst.end());
+    ASSERT_TRUE(pos_lst == record_chain(tp));
+    for (int32_t key = 0; key < 70; key++) {
+        bool is_left = key >= first_count || key % 20 == 0;
+        ASSERT_TRUE(tree.find_key(new_trans(), new_key(key)).data.size() == (is_left ? 1 : 0));
+    }
+    close_table(tp);
+}
+
+TEST(db_bptree_test, relocate_after_root_split) {
+    BlockAlloc &block_alloc = BlockAlloc::get();
+    // free blocks before all blocks of table
+    BlockNum hole = block_alloc.new_block("_bptree_relocate_hole");
+    // root of catalog is the only leaf
+    TableProperty tp = load_table("_bptree_relocate", 10, 1000, 100);
+    BpTree tree(tp);
+    ASSERT_TRUE(BpTree::BptNode::get(tp, tp.keys_idx_root).page.view().is_leaf());
+    block_alloc.close_extent("_bptree_relocate_hole");
+    block_alloc.free_blocks({hole});
+    block_alloc.sync([]{});
+
+    // root splits, root of catalog is first leaf now
+    TransInfo t_info = new_trans();
+    for (int32_t key = 10; key < 140; key++) {
+        tree.insert(t_info, new_key(key), new_tuple(key, 1000));
+    }
+    t_info.s_ptr->commit();
+    ASSERT_TRUE(leaf_lst(tp).size() > 1);
+
+    std::vector<BlockNum> old_lst = tree.relocate(tp.keys_idx_root);
+    ASSERT_TRUE(!old_lst.empty());
+    ASSERT_TRUE(std::count(old_lst.begin(), old_lst.end(), tp.keys_idx_root) == 0);
+    block_alloc.free_blocks(old_lst);
+    block_alloc.sync([]{});
+
+    // tree opened from catalog root finds every key
+    BpTree reopened(tp);
+    std::vector<BpTree::BptNode> new_leaf_lst = leaf_lst(tp);
+    ASSERT_TRUE(new_leaf_lst[0].file_pos == tp.keys_idx_root);
+    ASSERT_TRUE(new_leaf_lst.size() > 1);
+    for (int32_t key = 0; key < 140; key++) {
+        ASSERT_TRUE(reopened.find_key(new_trans(), new_key(key)).data.size() == 1);
+    }
+    std::vector<int32_t> key_lst(140);
+    std::iota(key_lst.begin(), key_lst.end(), 0);
+    ASSERT_TRUE(chain_keys(tp) == key_lst);
+    close_table(tp);
+}
+
+TEST(db_bptree_test, root_hook) {
+    // root of catalog is the only leaf
+    TableProperty tp = load_table("_bptree_root_hook", 10, 1000, 100);
+    BpTree tree(tp);
+    std::vector<std::pair<Tid, BlockNum>> root_lst;
+    tree.set_root_hook([&root_lst](TransInfo t_info, BlockNum pos) {
+        root_lst.push_back({t_info.id, pos});
+    });
+
+    // root splits once, new root goes to hook with t_info of write
+    TransInfo t_info{7, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    for (int32_t key = 10; key < 140; key++) {
+        tree.insert(t_info, new_key(key), new_tuple(key, 1000));
+    }
+    t_info.s_ptr->commit();
+    ASSERT_TRUE(root_lst.size() == 1);
+    ASSERT_TRUE(root_lst[0].first == 7);
+
+    // tree opened from new root finds every key
+    TableProperty root_tp = tp;
+    root_tp.keys_idx_root = root_lst[0].second;
+    ASSERT_TRUE(!BpTree::BptNode::get(root_tp, root_tp.keys_idx_root).page.view().is_leaf());
+    BpTree reopened(root_tp);
+    for (int32_t key = 0; key < 140; key++) {
+        ASSERT_TRUE(reopened.find_key(new_trans(), new_key(key)).data.size() == 1);
+    }
+    close_table(tp);
+}
+
+TEST(db_bptree_test, split_big_tuple) {
+    // one tuple of 3000 chars in the only record
+    TableProperty tp = load_table("_bptree_split_big", 1, 3000, 100);
+    BpTree tree(tp);
+    TransInfo t_info{7, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    // big tuple after it: a part each
+    tree.insert(t_info, new_key(2), new_tuple(2, 3000));
+    // record of 10 and 12, then a big tuple between them: a record of its own
+    tree.insert(t_info, new_key(10), new_tuple(10, 1800));
+    tree.insert(t_info, new_key(12), new_tuple(12, 1800));
+    tree.insert(t_info, new_key(11), new_tuple(11, 3000));
+    t_info.s_ptr->commit();
+
+    ASSERT_TRUE(chain_keys(tp) == (std::vector<int32_t>{0, 2, 10, 11, 12}));
+    for (int32_t key : {0, 2, 10, 11, 12}) {
+        ASSERT_TRUE(tree.find_key(new_trans(), new_key(key)).data.size() == 1);
+    }
+    close_table(tp);
+}
+
+TEST(db_bptree_test, split_rollback) {
+    // keys 0 .. 2 fill the only record
+    TableProperty tp = load_table("_bptree_split_rollback", 3, 1000, 100);
+    BpTree tree(tp);
+    TransInfo t_info{7, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    tree.insert(t_info, new_key(5), new_tuple(5, 1000));
+
+    // others see committed tuples only, once each, through split records
+    ASSERT_TRUE(chain_keys(tp) == (std::vector<int32_t>{0, 1, 2}));
+    ASSERT_TRUE(tree.find_key(new_trans(), new_key(5)).data.empty());
+    for (int32_t key = 0; key < 3; key++) {
+        ASSERT_TRUE(tree.find_key(new_trans(), new_key(key)).data.size() == 1);
+    }
+
+    // split stays after rollback, rows written later are in chain
+    t_info.s_ptr->rollback();
+    ASSERT_TRUE(chain_keys(tp) == (std::vector<int32_t>{0, 1, 2}));
+    t_info = TransInfo{8, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+    tree.insert(t_info, new_key(5), new_tuple(5, 1000));
+    t_info.s_ptr->commit();
+    ASSERT_TRUE(chain_keys(tp) == (std::vector<int32_t>{0, 1, 2, 5}));
+    ASSERT_TRUE(tree.find_range(new_trans(), new_key(0), new_key(5), true, true).data.size() == 4);
+    close_table(tp);
+}
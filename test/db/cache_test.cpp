@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <thread>
+#include <algorithm>
+#include <cstring>
 
 #include "../../src/db/cache.h"
 #include "../../src/db/io.h"
@@ -8,7 +11,7 @@ using namespace sdb;
 
 TEST(db_cache_test, BlockCache) {
     IO &io = IO::get();
-    std::string file_path = "_cache_test.tmp";
+    std::string file_path = io.block_path();
     if (io.has_file(file_path)) {
         io.delete_file(file_path);
     }
@@ -19,21 +22,15 @@ TEST(db_cache_test, BlockCache) {
     Bytes b3(BLOCK_SIZE, 'd');
     if (true) {
         BlockCache cache(3);
-        cache.put(file_path, 0, b0);
-        cache.put(file_path, 1, b1);
-        cache.put(file_path, 2, b2);
-        cache.put(file_path, 0, b0);
-        cache.put(file_path, 3, b3);
-        BlockCache::ValueList lst = cache._value_list();
-        // put
-        auto it = lst.begin();
-        ASSERT_TRUE(*it->ptr == b3);
-        it = std::next(it);
-        ASSERT_TRUE(*it->ptr == b0);
-        it = std::next(it);
-        ASSERT_TRUE(*it->ptr == b2);
-        // get and sync
-        Bytes read_block = cache.get(file_path, 1);
+        cache.put(0, b0);
+        cache.put(1, b1);
+        cache.put(2, b2);
+        cache.put(0, b0);
+        cache.put(3, b3);
+        // put, hottest first
+        ASSERT_TRUE(cache._key_list() == std::vector<BlockNum>({3, 0, 2}));
+        // evicted block is written back
+        Bytes read_block = cache.get(1);
         ASSERT_TRUE(read_block == b1);
 
         // sync all cache
@@ -41,22 +38,627 @@ TEST(db_cache_test, BlockCache) {
     }
     // check get sync
     BlockCache cache(3);
-    cache.get(file_path, 0);
-    cache.get(file_path, 1);
-    cache.get(file_path, 2);
-    cache.get(file_path, 0);
-    cache.get(file_path, 3);
-    BlockCache::ValueList lst = cache._value_list();
-    // put
-    auto it = lst.begin();
-    ASSERT_TRUE(*it->ptr == b3);
-    it = std::next(it);
-    ASSERT_TRUE(*it->ptr == b0);
-    it = std::next(it);
-    ASSERT_TRUE(*it->ptr == b2);
-
-    io.delete_file(file_path);
-
-    // === todo
-    // + multithreading check
+    ASSERT_TRUE(cache.get(0) == b0);
+    ASSERT_TRUE(cache.get(1) == b1);
+    ASSERT_TRUE(cache.get(2) == b2);
+    ASSERT_TRUE(cache.get(0) == b0);
+    ASSERT_TRUE(cache.get(3) == b3);
+    ASSERT_TRUE(cache._key_list() == std::vector<BlockNum>({3, 0, 2}));
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, read_ahead_and_sync) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    std::vector<size_t> num_lst;
+    std::vector<Bytes> block_lst;
+    std::vector<const Byte*> ptr_lst;
+    for (size_t i = 0; i < 16; i++) {
+        num_lst.push_back(i);
+        block_lst.push_back(Bytes(BLOCK_SIZE, 'a' + i));
+    }
+    for (auto &&block : block_lst) {
+        ptr_lst.push_back(block.data());
+    }
+    io.write_blocks(file_path, num_lst, ptr_lst);
+
+    {
+        BlockCache cache(64);
+        // miss of block 0 also reads block 1 - 8
+        ASSERT_TRUE(cache.get(0) == block_lst[0]);
+        ASSERT_TRUE(cache._key_list().size() == 9);
+        ASSERT_TRUE(cache._key_list().front() == 0);
+        ASSERT_TRUE(cache.get(8) == block_lst[8]);
+        ASSERT_TRUE(cache._key_list().size() == 9);
+
+        // sync all cache
+        Bytes b(BLOCK_SIZE, 'z');
+        cache.put(3, b);
+        cache.put(4, b);
+        cache.sync();
+        ASSERT_TRUE(io.read_block(file_path, 3) == b);
+        ASSERT_TRUE(io.read_block(file_path, 4) == b);
+        ASSERT_TRUE(io.read_block(file_path, 5) == block_lst[5]);
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, prefetch_race) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    for (size_t i = 0; i < 64; i++) {
+        io.write_block(file_path, i, Bytes(BLOCK_SIZE, 'a'));
+    }
+
+    {
+        // block 0 is put, written back by eviction and read again,
+        // while another thread prefetches it over and over.
+        // prefetch must never bring back bytes older than the put
+        BlockCache cache(8);
+        std::atomic<bool> is_done{false};
+        std::thread prefetcher([&cache, &is_done]{
+            while (!is_done) {
+                cache.prefetch({0});
+            }
+        });
+        bool is_fresh = true;
+        for (size_t round = 0; round < 1000 && is_fresh; round++) {
+            // block 0 is out of cache, let prefetcher start reading it
+            std::this_thread::yield();
+            Bytes block(BLOCK_SIZE, 'a' + round % 26);
+            cache.put(0, block);
+            for (BlockNum num = 16; num < 32; num++) {
+                cache.get(num);
+            }
+            std::this_thread::yield();
+            is_fresh = cache.get(0) == block;
+            for (BlockNum num = 32; num < 48; num++) {
+                cache.get(num);
+            }
+        }
+        is_done = true;
+        prefetcher.join();
+        ASSERT_TRUE(is_fresh);
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, ShardedBlockCache) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+
+    {
+        // too many shards for 64 blocks
+        ShardedBlockCache cache(64, 7);
+        ASSERT_TRUE(cache.get_shard_count() == 4);
+        // blocks of one run share a shard
+        ASSERT_TRUE(&cache.get_shard(0) == &cache.get_shard(BlockCache::RUN_BLOCK_COUNT - 1));
+    }
+
+    // threads put and get own blocks
+    const size_t thread_count = 8;
+    const size_t block_count = 32;
+    {
+        ShardedBlockCache cache(128, thread_count);
+        std::vector<std::thread> thread_lst;
+        for (size_t t = 0; t < thread_count; t++) {
+            thread_lst.emplace_back([&cache, t]{
+                for (size_t i = 0; i < block_count; i++) {
+                    BlockNum num = t * block_count + i;
+                    cache.put(num, Bytes(BLOCK_SIZE, 'a' + t));
+                    ASSERT_TRUE(cache.get(num) == Bytes(BLOCK_SIZE, 'a' + t));
+                }
+            });
+        }
+        for (auto &&th : thread_lst) {
+            th.join();
+        }
+        cache.sync();
+    }
+    for (size_t t = 0; t < thread_count; t++) {
+        for (size_t i = 0; i < block_count; i++) {
+            ASSERT_TRUE(io.read_block(file_path, t * block_count + i) == Bytes(BLOCK_SIZE, 'a' + t));
+        }
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, dirty) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    Bytes a(BLOCK_SIZE, 'a');
+    Bytes b(BLOCK_SIZE, 'b');
+    for (size_t i = 0; i < 32; i++) {
+        io.write_block(file_path, i, a);
+    }
+
+    {
+        BlockCache cache(8);
+        // clean block is dropped without write back
+        cache.get(0);
+        io.write_block(file_path, 0, b);
+        for (BlockNum num = 16; num < 24; num++) {
+            cache.get(num);
+        }
+        ASSERT_TRUE(io.read_block(file_path, 0) == b);
+
+        // 5 dirty > high watermark 4, flush to low watermark 2
+        for (BlockNum num = 16; num < 21; num++) {
+            cache.put(num, b);
+        }
+        ASSERT_TRUE(cache.get_dirty_count() == 5);
+        ASSERT_TRUE(cache.flush_cold() == 3);
+        ASSERT_TRUE(cache.get_dirty_count() == 2);
+        // coldest are written
+        ASSERT_TRUE(io.read_block(file_path, 16) == b);
+        ASSERT_TRUE(io.read_block(file_path, 20) == a);
+        // under high watermark, only coldest 1/8 cache is flushed
+        ASSERT_TRUE(cache.flush_cold() == 0);
+        cache.sync();
+        ASSERT_TRUE(cache.get_dirty_count() == 0);
+        ASSERT_TRUE(io.read_block(file_path, 20) == b);
+    }
+
+    {
+        // background flusher cleans cold blocks.
+        // it may run between puts, so dirty count ends anywhere under high watermark 8,
+        // but the coldest 1/8 cache is written back either way
+        Bytes c(BLOCK_SIZE, 'c');
+        ShardedBlockCache cache(16, 1);
+        for (BlockNum num = 0; num < 16; num++) {
+            cache.put(num, c);
+        }
+        BlockCache &shard = cache.get_shard(0);
+        auto is_flushed = [&io, &file_path, &shard, &c]{
+            std::vector<BlockNum> key_lst = shard._key_list();
+            return shard.get_dirty_count() <= 8
+                && io.read_block(file_path, key_lst[key_lst.size() - 1]) == c
+                && io.read_block(file_path, key_lst[key_lst.size() - 2]) == c;
+        };
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!is_flushed() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(CacheFlusher::FLUSH_INTERVAL);
+        }
+        ASSERT_TRUE(is_flushed());
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, pin) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    Bytes a(BLOCK_SIZE, 'a');
+    Bytes b(BLOCK_SIZE, 'b');
+    for (size_t i = 0; i < 64; i++) {
+        io.write_block(file_path, i, a);
+    }
+
+    {
+        BlockCache cache(4);
+        PageRef page = cache.pin(0);
+        ASSERT_TRUE(Bytes(page.view().begin(), page.view().end()) == a);
+        {
+            // write in place
+            PageRef w_page = cache.pin(1, true);
+            std::memset(w_page.mutable_data(), 'b', BLOCK_SIZE);
+        }
+        ASSERT_TRUE(cache.get_dirty_count() == 1);
+        ASSERT_TRUE(cache.get(1) == b);
+
+        // pinned page survives eviction
+        const Byte *ptr = page.data();
+        for (BlockNum num = 16; num < 48; num += 4) {
+            cache.get(num);
+        }
+        ASSERT_TRUE(page.data() == ptr);
+        ASSERT_TRUE(page.get_block_num() == 0);
+        auto key_lst = cache._key_list();
+        ASSERT_TRUE(std::find(key_lst.begin(), key_lst.end(), 0) != key_lst.end());
+        // evicted dirty page is written back
+        ASSERT_TRUE(io.read_block(file_path, 1) == b);
+
+        // all pinned, cache grows over max
+        std::vector<PageRef> page_lst;
+        for (BlockNum num = 48; num < 52; num++) {
+            page_lst.push_back(cache.pin(num));
+        }
+        ASSERT_TRUE(cache._key_list().size() == 5);
+        page_lst.clear();
+        page.release();
+        ASSERT_TRUE(!page);
+    }
+    {
+        // 2q: pinned cold page skipped by eviction stays cold
+        BlockCache cache(8, "2q");
+        PageRef page = cache.pin(0);
+        for (BlockNum num = 16; num < 48; num++) {
+            cache.get(num);
+        }
+        page.release();
+        for (BlockNum num = 48; num < 64; num++) {
+            cache.get(num);
+        }
+        auto key_lst = cache._key_list();
+        ASSERT_TRUE(std::find(key_lst.begin(), key_lst.end(), 0) == key_lst.end());
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, resize) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    Bytes a(BLOCK_SIZE, 'a');
+
+    {
+        ShardedBlockCache cache(64, 1, "lru", 256);
+        ASSERT_TRUE(cache.get_max_block_count() == 64);
+        for (BlockNum num = 0; num < 256; num++) {
+            cache.put(num, a);
+        }
+        ASSERT_TRUE(cache.get_block_count() == 64);
+
+        // grow
+        cache.resize(128);
+        for (BlockNum num = 0; num < 256; num++) {
+            cache.put(num, a);
+        }
+        ASSERT_TRUE(cache.get_block_count() == 128);
+
+        // shrink, flusher trims in background
+        cache.resize(32);
+        std::this_thread::sleep_for(CacheFlusher::FLUSH_INTERVAL * 3);
+        ASSERT_TRUE(cache.get_block_count() == 32);
+        ASSERT_TRUE(io.read_block(file_path, 200) == a);
+
+        // never over reserved frames
+        cache.resize(1024);
+        ASSERT_TRUE(cache.get_max_block_count() < 1024);
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, page_class) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    Bytes a(BLOCK_SIZE, 'a');
+    for (size_t i = 0; i < 256; i++) {
+        io.write_block(file_path, i, a);
+    }
+
+    {
+        // inner quota 4 blocks, leaf quota 8
+        BlockCache cache(16);
+        cache.get(0, INDEX_INNER_PAGE);
+        cache.get(16, INDEX_LEAF_PAGE);
+        cache.get(32);
+        cache.upgrade(32, INDEX_INNER_PAGE);
+        // data scan doesn't evict index pages
+        for (BlockNum num = 64; num < 256; num++) {
+            cache.get(num);
+        }
+        auto key_lst = cache._key_list();
+        ASSERT_TRUE(key_lst[0] == 32);
+        ASSERT_TRUE(key_lst[1] == 0);
+        ASSERT_TRUE(key_lst[2] == 16);
+        // miss of 32 moved to inner class by upgrade
+        ASSERT_TRUE(cache.get_stats(INDEX_INNER_PAGE).miss_count == 2);
+        cache.get(0, INDEX_INNER_PAGE);
+        ASSERT_TRUE(cache.get_stats(INDEX_INNER_PAGE).hit_count == 1);
+        // reading index page as data keeps class
+        cache.get(0);
+        ASSERT_TRUE(cache._key_list()[0] == 0);
+
+        // index pages over quota are evicted first
+        for (BlockNum num = 64; num < 80; num++) {
+            cache.get(num, INDEX_INNER_PAGE);
+        }
+        key_lst = cache._key_list();
+        ASSERT_TRUE(key_lst.size() == 16);
+        ASSERT_TRUE(std::find(key_lst.begin(), key_lst.end(), 16) != key_lst.end());
+    }
+    {
+        // stats go by class of frame: node read as leaf, then upgraded
+        BlockCache cache(16);
+        cache.pin(0, false, INDEX_LEAF_PAGE);
+        cache.upgrade(0, INDEX_INNER_PAGE);
+        cache.pin(0, false, INDEX_LEAF_PAGE);
+        cache.get(0, INDEX_LEAF_PAGE);
+        ASSERT_TRUE(cache.get_stats(INDEX_INNER_PAGE).miss_count == 1);
+        ASSERT_TRUE(cache.get_stats(INDEX_INNER_PAGE).hit_count == 2);
+        ASSERT_TRUE(cache.get_stats(INDEX_LEAF_PAGE).miss_count == 0);
+        ASSERT_TRUE(cache.get_stats(INDEX_LEAF_PAGE).hit_count == 0);
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, warm_up) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    std::string warm_path = "_warm_test.sdb";
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    for (size_t i = 0; i < 128; i++) {
+        io.write_block(file_path, i, Bytes(BLOCK_SIZE, 'a' + i % 26));
+    }
+
+    {
+        ShardedBlockCache cache(64, 2);
+        cache.get(100, INDEX_INNER_PAGE);
+        cache.get(3);
+        cache.get(70);
+        cache.dump_resident(warm_path);
+    }
+    {
+        // restarted cache reads dumped blocks only
+        ShardedBlockCache cache(64, 2);
+        ASSERT_TRUE(cache.warm_up(warm_path, std::chrono::seconds(10)) > 0);
+        auto progress = cache.get_warm_progress();
+        ASSERT_TRUE(progress.is_done);
+        ASSERT_TRUE(progress.done_count == progress.total_count);
+        auto resident_lst = cache.resident_list();
+        ASSERT_TRUE(resident_lst.size() == progress.total_count);
+        auto it = std::find(resident_lst.begin(), resident_lst.end(), std::make_pair(BlockNum(100), INDEX_INNER_PAGE));
+        ASSERT_TRUE(it != resident_lst.end());
+        ASSERT_TRUE(cache.get_stats(DATA_PAGE).miss_count == 0);
+        ASSERT_TRUE(cache.get(70) == Bytes(BLOCK_SIZE, 'a' + 70 % 26));
+        ASSERT_TRUE(cache.get_stats(DATA_PAGE).hit_count == 1);
+        ASSERT_TRUE(cache.get_stats(DATA_PAGE).miss_count == 0);
+    }
+    {
+        // no time for any batch
+        ShardedBlockCache cache(64, 2);
+        ASSERT_TRUE(cache.warm_up(warm_path, std::chrono::milliseconds(0)) == 0);
+        ASSERT_TRUE(cache.get_block_count() == 0);
+    }
+    {
+        // broken dump is ignored
+        io.full_write_file(warm_path, Bytes(7, 'x'));
+        ShardedBlockCache cache(64, 2);
+        ASSERT_TRUE(cache.warm_up(warm_path, std::chrono::seconds(10)) == 0);
+    }
+
+    io.delete_file(warm_path);
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, scan_ring) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    for (size_t i = 0; i < 64; i++) {
+        io.write_block(file_path, i, Bytes(BLOCK_SIZE, 'a' + i % 26));
+    }
+
+    ShardedBlockCache cache(32, 1);
+    // dirty cached block is newer than file
+    cache.put(1, Bytes(BLOCK_SIZE, 'z'));
+    size_t block_count = cache.get_block_count();
+
+    ScanRing ring(cache, 8);
+    std::vector<BlockNum> num_lst{0, 1, 2, 3, 4, 5};
+    ring.prefetch(num_lst);
+    // only half ring per batch, cached block copied
+    ASSERT_TRUE(ring.get_read_count() == 3);
+    BytesView view = ring.read(1);
+    ASSERT_TRUE(Bytes(view.begin(), view.end()) == Bytes(BLOCK_SIZE, 'z'));
+    for (BlockNum num = 0; num < 64; num++) {
+        view = ring.read(num);
+        Bytes expect(BLOCK_SIZE, num == 1 ? 'z' : 'a' + num % 26);
+        ASSERT_TRUE(Bytes(view.begin(), view.end()) == expect);
+    }
+    // scan didn't enter cache
+    ASSERT_TRUE(cache.get_block_count() == block_count);
+    ASSERT_TRUE(cache.get_stats(DATA_PAGE).hit_count == 0);
+
+    view = ring.put(100, Bytes(BLOCK_SIZE, 'x'));
+    ASSERT_TRUE(Bytes(view.begin(), view.end()) == Bytes(BLOCK_SIZE, 'x'));
+
+    // block being written in place is copied after unpin, never torn
+    {
+        PageRef page = cache.pin(40, true);
+        std::memset(page.mutable_data(), 'y', BLOCK_SIZE / 2);
+        std::thread writer([&page]{
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            std::memset(page.mutable_data() + BLOCK_SIZE / 2, 'y', BLOCK_SIZE / 2);
+            page.release();
+        });
+        Bytes data(BLOCK_SIZE);
+        ASSERT_TRUE(cache.peek(40, data.data()));
+        writer.join();
+        ASSERT_TRUE(data == Bytes(BLOCK_SIZE, 'y'));
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, lock_free_hit) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    for (size_t i = 0; i < 256; i++) {
+        io.write_block(file_path, i, Bytes(BLOCK_SIZE, 'a'));
+    }
+
+    {
+        // last block of a run, no read ahead
+        auto num = [](BlockNum i){return i * BlockCache::RUN_BLOCK_COUNT + BlockCache::RUN_BLOCK_COUNT - 1;};
+        auto has = [](const std::vector<BlockNum> &key_lst, BlockNum key) {
+            return std::find(key_lst.begin(), key_lst.end(), key) != key_lst.end();
+        };
+        BlockCache cache(4);
+        for (BlockNum i = 0; i < 4; i++) {
+            cache.get(num(i));
+        }
+        // hits only set reference bit, blocks survive as if accessed
+        ASSERT_TRUE(cache.get(num(0)) == Bytes(BLOCK_SIZE, 'a'));
+        PageRef page = cache.pin(num(1));
+        cache.get(num(4));
+        auto key_lst = cache._key_list();
+        ASSERT_TRUE(has(key_lst, num(0)) && has(key_lst, num(1)) && !has(key_lst, num(2)));
+        ASSERT_TRUE(cache.get_stats(DATA_PAGE).hit_count == 2);
+        // lock free pin keeps page until released
+        for (BlockNum i = 5; i < 8; i++) {
+            cache.get(num(i));
+        }
+        ASSERT_TRUE(has(cache._key_list(), num(1)));
+        page.release();
+        for (BlockNum i = 8; i < 11; i++) {
+            cache.get(num(i));
+        }
+        ASSERT_TRUE(!has(cache._key_list(), num(1)));
+    }
+
+    // readers never see half written page
+    {
+        ShardedBlockCache cache(64, 1);
+        cache.get(0);
+        std::atomic<bool> is_stop{false};
+        std::vector<std::thread> thread_lst;
+        for (size_t t = 0; t < 4; t++) {
+            thread_lst.emplace_back([&cache, &is_stop]{
+                while (!is_stop) {
+                    Bytes bytes = cache.get(0);
+                    ASSERT_TRUE(std::count(bytes.begin(), bytes.end(), bytes[0]) == BLOCK_SIZE);
+                }
+            });
+        }
+        for (size_t i = 0; i < 2000; i++) {
+            cache.put(0, Bytes(BLOCK_SIZE, 'a' + i % 26));
+            // evict and load block 0 again now and then
+            cache.get(16 + i % 48);
+        }
+        is_stop = true;
+        for (auto &&th : thread_lst) {
+            th.join();
+        }
+    }
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, discard) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    Bytes a(BLOCK_SIZE, 'a');
+    Bytes b(BLOCK_SIZE, 'b');
+    io.write_block(file_path, 0, a);
+
+    BlockCache cache(8);
+    cache.put(0, b);
+    ASSERT_TRUE(cache.get_dirty_count() == 1);
+    // pinned block stays
+    {
+        PageRef page = cache.pin(0);
+        ASSERT_TRUE(!cache.discard(0));
+    }
+    // dirty block is dropped without write back
+    ASSERT_TRUE(cache.discard(0));
+    ASSERT_TRUE(cache.discard(0));
+    ASSERT_TRUE(cache.get_dirty_count() == 0);
+    ASSERT_TRUE(cache.get_block_count() == 0);
+    cache.sync();
+    ASSERT_TRUE(io.read_block(file_path, 0) == a);
+    ASSERT_TRUE(cache.get(0) == a);
+
+    io.delete_file(file_path);
+}
+
+TEST(db_cache_test, page_version) {
+    IO &io = IO::get();
+    std::string file_path = io.block_path();
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    Bytes a(BLOCK_SIZE, 'a');
+    Bytes b(BLOCK_SIZE, 'b');
+    io.write_block(file_path, 0, a);
+
+    {
+        BlockCache cache(4);
+        PageRef page = cache.pin(0);
+        uint64_t version = page.get_version();
+        ASSERT_FALSE(page.is_changed(version));
+        // readers of page see a put by version
+        cache.put(0, b);
+        ASSERT_TRUE(page.is_changed(version));
+        version = page.get_version();
+        ASSERT_TRUE(page.data()[0] == 'b');
+        ASSERT_FALSE(page.is_changed(version));
+        cache.get(0);
+        ASSERT_FALSE(page.is_changed(version));
+    }
+
+    // copy of pinned page is never half written by a put in place
+    {
+        BlockCache cache(4);
+        PageRef page = cache.pin(0);
+        std::atomic<bool> is_stop{false};
+        std::thread writer([&cache, &is_stop]{
+            for (size_t i = 0; !is_stop; i++) {
+                cache.put(0, Bytes(BLOCK_SIZE, 'a' + i % 26));
+            }
+        });
+        size_t torn_count = 0;
+        Byte data[BLOCK_SIZE];
+        for (size_t i = 0; i < 2000; i++) {
+            page.copy_to(data);
+            if (std::count(data, data + BLOCK_SIZE, data[0]) != BLOCK_SIZE) {
+                torn_count++;
+            }
+        }
+        is_stop = true;
+        writer.join();
+        ASSERT_TRUE(torn_count == 0);
+    }
+
+    io.delete_file(file_path);
 }
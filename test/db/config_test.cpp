@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include "../../src/db/config.h"
+#include "../../src/db/io.h"
+
+using namespace sdb;
+
+TEST(db_config_test, load) {
+    IO &io = IO::get();
+    std::string file_path = "_config_test.sdb";
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+    std::string text = "# comment\n"
+                       "direct_io = 1\n"
+                       "file_extent_blocks = 64\n"
+                       "cache_policy = 2q\n"
+                       "cache_size = 16M\n"
+                       "cache_warm_interval = 0\n"
+                       "vacuum_interval = 10\n"
+                       "vacuum_merge_count = 8\n"
+                       "bulk_load_fill = 70\n"
+                       "sort_memory = 1M\n"
+                       "\n"
+                       "unknown_option = 10 # ignored\n";
+    io.full_write_file(file_path, Bytes(text.begin(), text.end()));
+
+    Config config;
+    ASSERT_TRUE(!config.direct_io);
+    ASSERT_TRUE(config.cache_policy == "lru");
+    ASSERT_TRUE(config.vacuum_interval == 0);
+    config.load(io.get_db_file_path(file_path));
+    ASSERT_TRUE(config.direct_io);
+    ASSERT_TRUE(config.file_extent_blocks == 64);
+    ASSERT_TRUE(config.cache_policy == "2q");
+    ASSERT_TRUE(config.cache_size == 16 * 1024 * 1024);
+    ASSERT_TRUE(config.cache_warm_interval == 0);
+    ASSERT_TRUE(config.cache_warm_time == 30);
+    ASSERT_TRUE(config.vacuum_interval == 10);
+    ASSERT_TRUE(config.vacuum_merge_count == 8);
+    ASSERT_TRUE(config.bulk_load_fill == 70);
+    ASSERT_TRUE(config.sort_memory == 1024 * 1024);
+    ASSERT_TRUE(Config::parse_size("512") == 512);
+    ASSERT_TRUE(Config::parse_size("4G") == size_t(4) << 30);
+
+    io.delete_file(file_path);
+}
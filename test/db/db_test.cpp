@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "../../src/db/db.h"
+#include "test_util.h"
+
+using namespace sdb;
+using namespace sdb::test;
+
+namespace {
+
+db_type::ObjPtr new_str(const std::string &str) {
+    return std::make_shared<db_type::Varchar>(32, str);
+}
+
+// |id, name, age|, id is key
+TableProperty new_tp(const std::string &table_name) {
+    Bytes str_info = sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(32));
+    ColProperty id_cp("id", sdb::en_bytes(static_cast<char>(db_type::INT)), 0, true);
+    ColProperty name_cp("name", str_info, 1);
+    ColProperty age_cp("age", sdb::en_bytes(static_cast<char>(db_type::INT)), 2);
+    return TableProperty(table_name, -1, -1, {id_cp, name_cp, age_cp});
+}
+
+Tuple new_row(int32_t id, const std::string &name, int32_t age) {
+    Tuple tuple;
+    tuple.push_back(std::make_shared<db_type::Int>(id));
+    tuple.push_back(new_str(name));
+    tuple.push_back(std::make_shared<db_type::Int>(age));
+    return tuple;
+}
+
+int32_t get_int(const Tuple &tuple, size_t pos) {
+    return db_type::dfc<const db_type::Int>(tuple[pos])->data;
+}
+
+// new db over a new catalog
+void create_db() {
+    create_block_file();
+    DB::create_catalog();
+}
+
+// table of tp with rows of id in [0, count), name n<id % 5>
+void create_table(DB &db, const TableProperty &tp, int32_t count) {
+    TransInfo t_info = db.begin();
+    db.create_table(t_info, tp);
+    db.commit(t_info.id);
+
+    t_info = db.begin();
+    auto ptr = db.get_table_ptr(t_info.id, tp.table_name);
+    for (int32_t id = 0; id < count; id++) {
+        ptr->insert(t_info, new_row(id, "n" + std::to_string(id % 5), id));
+    }
+    db.commit(t_info.id);
+}
+
+// ids of rows found by name in index
+std::vector<int32_t> find_ids(DB &db, const std::string &table_name, const std::string &name) {
+    TransInfo t_info = db.begin();
+    auto ptr = db.get_table_ptr(t_info.id, table_name);
+    std::vector<int32_t> lst;
+    for (auto &&tuple : ptr->find_by_index(t_info, "by_name", {new_str(name)}).data) {
+        lst.push_back(get_int(tuple, 0));
+    }
+    db.commit(t_info.id);
+    std::sort(lst.begin(), lst.end());
+    return lst;
+}
+
+} // namespace
+
+TEST(db_db_test, get_tp) {
+    create_db();
+    DB db("");
+    TableProperty tp = new_tp("_db_get_tp");
+    create_table(db, tp, 10);
+
+    TableProperty tp2 = db.get_tp(new_trans(), tp.table_name);
+    ASSERT_TRUE(tp2.get_col_name_lst() == tp.get_col_name_lst());
+    for (auto &&cp : tp.col_property_lst) {
+        ColProperty cp2 = tp2.get_col_property(cp.col_name);
+        ASSERT_TRUE(cp2.type_info == cp.type_info);
+        ASSERT_TRUE(cp2.order_num == cp.order_num);
+        ASSERT_TRUE(cp2.is_key == cp.is_key);
+    }
+    ASSERT_TRUE(tp2.record_root != -1 && tp2.keys_idx_root != -1);
+    ASSERT_TRUE(tp2.index_lst.empty());
+    ASSERT_THROW(db.get_tp(new_trans(), "_db_no_table"), TableNotFound);
+
+    TransInfo t_info = db.begin();
+    ASSERT_TRUE(db.get_table_ptr(t_info.id, tp.table_name)->find(t_info, {std::make_shared<db_type::Int>(3)}).data.size() == 1);
+    db.commit(t_info.id);
+}
+
+TEST(db_db_test, create_index) {
+    create_db();
+    DB db("");
+    TableProperty tp = new_tp("_db_create_index");
+    create_table(db, tp, 20);
+    db.create_index(tp.table_name, "by_name", {"name"}, {"age"});
+
+    // catalog rows of index
+    std::vector<IndexProperty> index_lst = db.get_tp(new_trans(), tp.table_name).index_lst;
+    ASSERT_TRUE(index_lst.size() == 1);
+    ASSERT_TRUE(index_lst[0].index_name == "by_name");
+    ASSERT_TRUE(index_lst[0].col_name_lst == std::vector<std::string>{"name"});
+    ASSERT_TRUE(index_lst[0].include_col_name_lst == std::vector<std::string>{"age"});
+    ASSERT_THROW(db.create_index(tp.table_name, "by_name", {"age"}, {}), TableError);
+    // col twice fails before catalog, table isn't held after it
+    ASSERT_THROW(db.create_index(tp.table_name, "by_age", {"age", "age"}, {}), TableError);
+    ASSERT_THROW(db.create_index(tp.table_name, "by_age", {"age"}, {"name", "name"}), TableError);
+    db.create_index(tp.table_name, "by_age", {"age"}, {"name"});
+    ASSERT_TRUE(db.get_tp(new_trans(), tp.table_name).index_lst.size() == 2);
+
+    // rows before index and writes after it
+    ASSERT_TRUE(find_ids(db, tp.table_name, "n2") == (std::vector<int32_t>{2, 7, 12, 17}));
+    TransInfo t_info = db.begin();
+    db.get_table_ptr(t_info.id, tp.table_name)->insert(t_info, new_row(20, "n2", 20));
+    db.commit(t_info.id);
+    ASSERT_TRUE(find_ids(db, tp.table_name, "n2") == (std::vector<int32_t>{2, 7, 12, 17, 20}));
+}
+
+TEST(db_db_test, restart) {
+    create_db();
+    TableProperty tp = new_tp("_db_restart");
+    {
+        DB db("");
+        create_table(db, tp, 20);
+        db.create_index(tp.table_name, "by_name", {"name"}, {});
+        TransInfo t_info = db.begin();
+        db.create_table(t_info, new_tp("_db_restart_dropped"));
+        db.rollback(t_info.id);
+        db.checkpoint();
+    }
+
+    // tables and indexes come back from catalog
+    DB db("");
+    TransInfo t_info = db.begin();
+    ASSERT_THROW(db.get_table_ptr(t_info.id, "_db_restart_dropped"), TableNotFound);
+    auto ptr = db.get_table_ptr(t_info.id, tp.table_name);
+    ASSERT_TRUE(ptr->find(t_info, [](const Tuple &){return true;}).data.size() == 20);
+    db.commit(t_info.id);
+    ASSERT_TRUE(find_ids(db, tp.table_name, "n3") == (std::vector<int32_t>{3, 8, 13, 18}));
+
+    // drop is kept in catalog once committed
+    t_info = db.begin();
+    db.drop_table(t_info, tp.table_name);
+    db.commit(t_info.id);
+    DB db2("");
+    t_info = db2.begin();
+    ASSERT_THROW(db2.get_table_ptr(t_info.id, tp.table_name), TableNotFound);
+    db2.commit(t_info.id);
+}
+
+TEST(db_db_test, root_split) {
+    create_db();
+    // long keys => few keys per node, roots of both trees split after some rows
+    Bytes str_info = sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(200));
+    ColProperty id_cp("id", str_info, 0, true);
+    ColProperty name_cp("name", str_info, 1);
+    TableProperty tp("_db_root_split", -1, -1, {id_cp, name_cp});
+    auto new_str = [](const std::string &pre, int32_t num) {
+        std::string str = std::to_string(num);
+        str = pre + std::string(8 - str.size(), '0') + str + std::string(180, 'a');
+        return std::make_shared<db_type::Varchar>(200, str);
+    };
+    TableProperty old_tp = tp;
+    {
+        DB db("");
+        TransInfo t_info = db.begin();
+        db.create_table(t_info, tp);
+        db.commit(t_info.id);
+        db.create_index(tp.table_name, "by_name", {"name"}, {});
+        old_tp = db.get_tp(new_trans(), tp.table_name);
+
+        t_info = db.begin();
+        auto ptr = db.get_table_ptr(t_info.id, tp.table_name);
+        for (int32_t num = 0; num < 150; num++) {
+            ptr->insert(t_info, {new_str("i", num), new_str("n", num)});
+        }
+        db.commit(t_info.id);
+        db.checkpoint();
+    }
+
+    // new roots of both trees are in catalog
+    DB db("");
+    TableProperty new_tp = db.get_tp(new_trans(), tp.table_name);
+    ASSERT_TRUE(new_tp.keys_idx_root != old_tp.keys_idx_root);
+    ASSERT_TRUE(new_tp.index_lst[0].keys_idx_root != old_tp.index_lst[0].keys_idx_root);
+    TableProperty index_tp = new_tp.get_index_property(new_tp.index_lst[0]);
+    ASSERT_TRUE(!BpTree::BptNode::get(new_tp, new_tp.keys_idx_root).page.view().is_leaf());
+    ASSERT_TRUE(!BpTree::BptNode::get(index_tp, index_tp.keys_idx_root).page.view().is_leaf());
+
+    TransInfo t_info = db.begin();
+    auto ptr = db.get_table_ptr(t_info.id, tp.table_name);
+    ASSERT_TRUE(ptr->find(t_info, [](const Tuple &){return true;}).data.size() == 150);
+    for (int32_t num : {0, 75, 149}) {
+        ASSERT_TRUE(ptr->find_by_index(t_info, "by_name", {new_str("n", num)}).data.size() == 1);
+    }
+    db.commit(t_info.id);
+}
+
+TEST(db_db_test, drop_index) {
+    create_db();
+    TableProperty tp = new_tp("_db_drop_index");
+    {
+        DB db("");
+        create_table(db, tp, 20);
+        db.create_index(tp.table_name, "by_name", {"name"}, {});
+
+        // rolled back drop keeps index, writes after it keep it in step
+        TransInfo t_info = db.begin();
+        db.drop_index(t_info, tp.table_name, "by_name");
+        ASSERT_TRUE(db.get_tp(t_info, tp.table_name).index_lst.empty());
+        ASSERT_THROW(db.drop_index(t_info, tp.table_name, "by_name"), TableError);
+        db.rollback(t_info.id);
+        ASSERT_TRUE(db.get_tp(new_trans(), tp.table_name).index_lst.size() == 1);
+        t_info = db.begin();
+        db.get_table_ptr(t_info.id, tp.table_name)->insert(t_info, new_row(20, "n4", 20));
+        db.commit(t_info.id);
+        ASSERT_TRUE(find_ids(db, tp.table_name, "n4") == (std::vector<int32_t>{4, 9, 14, 19, 20}));
+        db.checkpoint();
+    }
+
+    // index is in step after restart, then dropped once committed
+    DB db("");
+    ASSERT_TRUE(find_ids(db, tp.table_name, "n4") == (std::vector<int32_t>{4, 9, 14, 19, 20}));
+    TransInfo t_info = db.begin();
+    db.drop_index(t_info, tp.table_name, "by_name");
+    db.commit(t_info.id);
+    ASSERT_TRUE(db.get_tp(new_trans(), tp.table_name).index_lst.empty());
+    t_info = db.begin();
+    auto ptr = db.get_table_ptr(t_info.id, tp.table_name);
+    ASSERT_THROW(ptr->find_by_index(t_info, "by_name", {new_str("n4")}), TableError);
+    ptr->insert(t_info, new_row(21, "n4", 21));
+    ASSERT_TRUE(ptr->find(t_info, [](const Tuple &){return true;}).data.size() == 22);
+    db.commit(t_info.id);
+}
+
+TEST(db_db_test, root_split_own_trans) {
+    create_db();
+    Bytes str_info = sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(200));
+    // long keys => few keys per node, roots split after some rows
+    ColProperty id_cp("id", str_info, 0, true);
+    ColProperty name_cp("name", str_info, 1);
+    auto new_str = [](int32_t num) {
+        std::string str = std::to_string(num);
+        str = std::string(8 - str.size(), '0') + str + std::string(180, 'a');
+        return std::make_shared<db_type::Varchar>(200, str);
+    };
+    auto new_key = [&new_str](int32_t num) {return Tuple{new_str(num)};};
+    TableProperty a_tp("_db_root_split_a", -1, -1, {id_cp, name_cp});
+    TableProperty b_tp("_db_root_split_b", -1, -1, {id_cp, name_cp});
+    DB db("");
+    for (auto &&tp : {a_tp, b_tp}) {
+        TransInfo t_info = db.begin();
+        db.create_table(t_info, tp);
+        db.commit(t_info.id);
+    }
+    BlockNum a_root = db.get_tp(new_trans(), a_tp.table_name).keys_idx_root;
+    BlockNum b_root = db.get_tp(new_trans(), b_tp.table_name).keys_idx_root;
+
+    // root of a is in catalog at once, writer of a still open
+    TransInfo a_info = db.begin();
+    auto a_ptr = db.get_table_ptr(a_info.id, a_tp.table_name);
+    for (int32_t num = 0; num < 150; num++) {
+        a_ptr->insert(a_info, {new_str(num), new_str(num)});
+    }
+    ASSERT_TRUE(db.get_tp(new_trans(), a_tp.table_name).keys_idx_root != a_root);
+
+    // root split of b doesn't wait for writer of a
+    std::atomic<bool> is_done{false};
+    std::thread b_writer([&] {
+        TransInfo b_info = db.begin();
+        auto b_ptr = db.get_table_ptr(b_info.id, b_tp.table_name);
+        for (int32_t num = 0; num < 150; num++) {
+            b_ptr->insert(b_info, {new_str(num), new_str(num)});
+        }
+        db.commit(b_info.id);
+        is_done = true;
+    });
+    for (int i = 0; i < 6000 && !is_done; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    bool is_early = is_done;
+    // rolled back write keeps new root, it still finds every key
+    db.rollback(a_info.id);
+    b_writer.join();
+    ASSERT_TRUE(is_early);
+    ASSERT_TRUE(db.get_tp(new_trans(), b_tp.table_name).keys_idx_root != b_root);
+    TransInfo t_info = db.begin();
+    ASSERT_TRUE(db.get_table_ptr(t_info.id, a_tp.table_name)->find(t_info, [](const Tuple &){return true;}).data.empty());
+    ASSERT_TRUE(db.get_table_ptr(t_info.id, b_tp.table_name)->find(t_info, new_key(75)).data.size() == 1);
+    db.commit(t_info.id);
+}
+
+TEST(db_db_test, bulk_load) {
+    create_db();
+    DB db("");
+    TableProperty tp = new_tp("_db_bulk_load");
+    create_table(db, tp, 0);
+    db.create_index(tp.table_name, "by_name", {"name"}, {});
+    auto new_source = [](std::vector<int32_t> id_lst) -> TupleSource {
+        return [id_lst, pos = size_t(0)]() mutable -> std::optional<Tuple> {
+            if (pos == id_lst.size()) return std::nullopt;
+            int32_t id = id_lst[pos++];
+            return new_row(id, "n" + std::to_string(id % 5), id);
+        };
+    };
+
+    // bad input leaves table as it was, nothing is held
+    ASSERT_THROW(db.bulk_load(tp.table_name, new_source({0, 1, 1}), true), std::runtime_error);
+    TransInfo t_info = db.begin();
+    ASSERT_TRUE(db.get_table_ptr(t_info.id, tp.table_name)->is_empty(t_info));
+    db.commit(t_info.id);
+
+    db.bulk_load(tp.table_name, new_source({3, 0, 2, 1, 7}), false);
+    ASSERT_TRUE(find_ids(db, tp.table_name, "n2") == (std::vector<int32_t>{2, 7}));
+    ASSERT_THROW(db.bulk_load(tp.table_name, new_source({8}), true), TableError);
+}
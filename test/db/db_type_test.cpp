@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <climits>
 
 #include "../../src/db/db_type.h"
 
@@ -79,12 +80,22 @@ TEST(db_db_type_test, integer) {
 }
 
 TEST(db_db_type_test, varchar) {
-    Varchar var("asdf", 100);
+    Varchar var(100, "asdf");
     ASSERT_TRUE(var.get_type_tag() == VARCHAR);
     ASSERT_TRUE(var.get_type_name() == "varchar");
-    ASSERT_TRUE(var.get_type_size() == 4);
+    ASSERT_TRUE(var.get_type_size() == 100);
+    ASSERT_TRUE(var.get_size() == 4);
 
-    auto var2_ptr = std::make_shared<Varchar>("asdf", 10);
+    auto var2_ptr = std::make_shared<Varchar>(10, "asdf");
     ASSERT_TRUE(var.eq(var2_ptr));
     ASSERT_TRUE(!var.less(var2_ptr));
+
+    // bytes
+    sdb::Bytes bytes = var.en_bytes();
+    Varchar var3(sdb::en_bytes(static_cast<char>(VARCHAR), sdb::Size(100)));
+    int offset = 0;
+    var3.de_bytes(bytes, offset);
+    ASSERT_TRUE(offset == int(bytes.size()));
+    ASSERT_TRUE(var3.to_string() == "asdf");
+    ASSERT_TRUE(var3.get_type_size() == 100);
 }
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <unistd.h>
+
+#include "../../src/db/external_sort.h"
+#include "../../src/db/io.h"
+
+using namespace sdb;
+
+static Bytes int_key(uint32_t num) {
+    // big endian, memcmp order == num order
+    Bytes key(4);
+    for (int i = 0; i < 4; i++) {
+        key[i] = Byte(num >> (24 - 8 * i));
+    }
+    return key;
+}
+
+TEST(db_external_sort_test, in_memory) {
+    ExternalSort sort(size_t(1) << 20);
+    for (uint32_t num : {5, 1, 4, 2, 3}) {
+        sort.push(int_key(num), Bytes(num, 'a'));
+    }
+    ASSERT_TRUE(sort.get_run_count() == 0);
+    for (uint32_t num = 1; num <= 5; num++) {
+        auto pair = sort.next();
+        ASSERT_TRUE(pair);
+        ASSERT_TRUE(pair->first == int_key(num));
+        ASSERT_TRUE(pair->second == Bytes(num, 'a'));
+    }
+    ASSERT_TRUE(!sort.next());
+
+    // shorter key first if it is a prefix
+    ExternalSort prefix_sort(0);
+    prefix_sort.push({'a', 'b'}, {});
+    prefix_sort.push({'a'}, {});
+    ASSERT_TRUE(prefix_sort.next()->first == Bytes{'a'});
+    ASSERT_TRUE(prefix_sort.next()->first == Bytes({'a', 'b'}));
+    ASSERT_TRUE(!prefix_sort.next());
+}
+
+TEST(db_external_sort_test, merge_runs) {
+    const uint32_t count = 20000;
+    std::vector<uint32_t> num_lst(count);
+    for (uint32_t i = 0; i < count; i++) {
+        num_lst[i] = i;
+    }
+    std::shuffle(num_lst.begin(), num_lst.end(), std::mt19937(42));
+
+    {
+        // one block per run => many runs, pairs cross block boundaries
+        ExternalSort sort(BLOCK_SIZE);
+        for (uint32_t num : num_lst) {
+            sort.push(int_key(num), Bytes(num % 7, Byte(num)));
+        }
+        ASSERT_TRUE(sort.get_run_count() > 10);
+        for (uint32_t num = 0; num < count; num++) {
+            auto pair = sort.next();
+            ASSERT_TRUE(pair);
+            ASSERT_TRUE(pair->first == int_key(num));
+            ASSERT_TRUE(pair->second == Bytes(num % 7, Byte(num)));
+        }
+        ASSERT_TRUE(!sort.next());
+    }
+
+    // empty sort
+    ExternalSort sort(BLOCK_SIZE);
+    ASSERT_TRUE(!sort.next());
+}
+
+TEST(db_external_sort_test, stale_run) {
+    // run files left by a crashed process of same pid
+    IO &io = IO::get();
+    std::vector<std::string> path_lst;
+    for (size_t i = 0; i < 100; i++) {
+        std::string path = "sort_" + std::to_string(getpid()) + "_" + std::to_string(i) + "_0.sdb";
+        if (!io.has_file(path)) {
+            io.create_file(path);
+            io.full_write_file(path, Bytes(10, 'x'));
+            path_lst.push_back(path);
+        }
+    }
+    {
+        ExternalSort sort(BLOCK_SIZE);
+        for (uint32_t num = 2000; num > 0; num--) {
+            sort.push(int_key(num), {});
+        }
+        ASSERT_TRUE(sort.get_run_count() > 1);
+        for (uint32_t num = 1; num <= 2000; num++) {
+            ASSERT_TRUE(sort.next()->first == int_key(num));
+        }
+        ASSERT_TRUE(!sort.next());
+    }
+    for (auto &&path : path_lst) {
+        if (io.has_file(path)) {
+            io.delete_file(path);
+        }
+    }
+}
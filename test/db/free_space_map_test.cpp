@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "../../src/db/free_space_map.h"
+#include "../../src/db/io.h"
+
+using namespace sdb;
+
+TEST(db_free_space_map_test, alloc_and_free) {
+    IO &io = IO::get();
+    std::string file_path = "_fsm_test.sdb";
+    if (io.has_file(file_path)) {
+        io.delete_file(file_path);
+    }
+    io.create_file(file_path);
+
+    {
+        FreeSpaceMap fsm(io.get_mmap_file(file_path));
+        // first fit
+        ASSERT_TRUE(fsm.alloc() == 0);
+        ASSERT_TRUE(fsm.alloc() == 1);
+        ASSERT_TRUE(fsm.alloc() == 2);
+        fsm.free(1);
+        ASSERT_TRUE(!fsm.is_used(1));
+        ASSERT_TRUE(fsm.alloc() == 1);
+        // aligned run skips the used head
+        ASSERT_TRUE(fsm.alloc_run(16) == 16);
+        ASSERT_TRUE(fsm.alloc_run(64) == 64);
+        ASSERT_TRUE(fsm.alloc() == 3);
+        ASSERT_TRUE(fsm.is_used(20));
+        ASSERT_TRUE(!fsm.is_used(40));
+
+        // full page is skipped, run goes to next page
+        for (BlockNum num = 4; num < BlockNum(FreeSpaceMap::PAGE_BLOCK_COUNT); num++) {
+            if (!fsm.is_used(num)) {
+                ASSERT_TRUE(fsm.alloc() == num);
+            }
+        }
+        ASSERT_TRUE(fsm.alloc() == BlockNum(FreeSpaceMap::PAGE_BLOCK_COUNT));
+        ASSERT_TRUE(fsm.get_page_count() == 2);
+        fsm.free(7);
+        ASSERT_TRUE(fsm.alloc_run(2) == BlockNum(FreeSpaceMap::PAGE_BLOCK_COUNT) + 2);
+        fsm.sync();
+    }
+    {
+        // bitmap survives reopen, summary rebuilt
+        FreeSpaceMap fsm(io.get_mmap_file(file_path));
+        ASSERT_TRUE(fsm.get_page_count() == 2);
+        ASSERT_TRUE(fsm.is_used(0));
+        ASSERT_TRUE(!fsm.is_used(7));
+        ASSERT_TRUE(fsm.alloc() == 7);
+        ASSERT_TRUE(fsm.alloc() == BlockNum(FreeSpaceMap::PAGE_BLOCK_COUNT) + 1);
+
+        // end follows last used block
+        BlockNum last = BlockNum(FreeSpaceMap::PAGE_BLOCK_COUNT) + 3;
+        size_t used_count = fsm.get_used_count();
+        BlockNum end = 0;
+        fsm.with_end([&end](BlockNum e){end = e;});
+        ASSERT_TRUE(end == last + 1);
+        fsm.free(last);
+        fsm.free(last - 1);
+        ASSERT_TRUE(fsm.get_used_count() == used_count - 2);
+        fsm.with_end([&end](BlockNum e){end = e;});
+        ASSERT_TRUE(end == last - 1);
+    }
+
+    io.delete_file(file_path);
+}
@@ -46,3 +46,155 @@ TEST(db_io_test, io) {
     ASSERT_TRUE(!io.has_file("_test"));
 }
 
+TEST(db_io_test, block_segment) {
+    IO &io = IO::get();
+    if (io.has_file("_test_seg")) {
+        io.remove_dir_force("_test_seg");
+    }
+    io.create_dir("_test_seg");
+    std::string file_path = "_test_seg/block.sdb";
+    io.create_file(file_path);
+
+    // blocks in first segment, and after growing into next segment
+    size_t far_num = MmapFile::SEGMENT_BLOCK_COUNT + 1;
+    Bytes b0(BLOCK_SIZE, 'a');
+    Bytes b1(BLOCK_SIZE, 'b');
+    io.write_block(file_path, 0, b0);
+    io.write_block(file_path, far_num, b1);
+    ASSERT_TRUE(io.read_block(file_path, 0) == b0);
+    ASSERT_TRUE(io.read_block(file_path, far_num) == b1);
+    ASSERT_TRUE(io.read_block(file_path, 1) == Bytes(BLOCK_SIZE, '\0'));
+
+    io.remove_dir_force("_test_seg");
+    ASSERT_TRUE(!io.has_file("_test_seg"));
+}
+
+TEST(db_io_test, blocks) {
+    IO &io = IO::get();
+    if (io.has_file("_test_blocks")) {
+        io.remove_dir_force("_test_blocks");
+    }
+    io.create_dir("_test_blocks");
+    std::string file_path = "_test_blocks/block.sdb";
+    io.create_file(file_path);
+
+    // two runs: 3 4 5 and 9, given out of order
+    std::vector<size_t> num_lst = {5, 9, 3, 4};
+    std::vector<Bytes> block_lst;
+    std::vector<const Byte*> w_ptr_lst;
+    for (size_t num : num_lst) {
+        block_lst.push_back(Bytes(BLOCK_SIZE, 'a' + num));
+    }
+    for (auto &&block : block_lst) {
+        w_ptr_lst.push_back(block.data());
+    }
+    io.write_blocks(file_path, num_lst, w_ptr_lst);
+    for (size_t i = 0; i < num_lst.size(); i++) {
+        ASSERT_TRUE(io.read_block(file_path, num_lst[i]) == block_lst[i]);
+    }
+
+    // read with a hole and a block out of file
+    std::vector<size_t> r_num_lst = {3, 4, 5, 6, 42};
+    std::vector<Bytes> r_block_lst(r_num_lst.size(), Bytes(BLOCK_SIZE, 'x'));
+    std::vector<Byte*> r_ptr_lst;
+    for (auto &&block : r_block_lst) {
+        r_ptr_lst.push_back(block.data());
+    }
+    io.read_blocks(file_path, r_num_lst, r_ptr_lst);
+    ASSERT_TRUE(r_block_lst[0] == Bytes(BLOCK_SIZE, 'a' + 3));
+    ASSERT_TRUE(r_block_lst[2] == Bytes(BLOCK_SIZE, 'a' + 5));
+    ASSERT_TRUE(r_block_lst[3] == Bytes(BLOCK_SIZE, '\0'));
+    ASSERT_TRUE(r_block_lst[4] == Bytes(BLOCK_SIZE, '\0'));
+
+    io.remove_dir_force("_test_blocks");
+}
+
+TEST(db_io_test, direct_io) {
+    IO &io = IO::get();
+    if (io.has_file("_test_direct")) {
+        io.remove_dir_force("_test_direct");
+    }
+    io.create_dir("_test_direct");
+    std::string file_path = "_test_direct/block.sdb";
+    io.create_file(file_path);
+
+    {
+        // fall back to buffered io if file system refuses O_DIRECT
+        MmapFile file(io.get_db_file_path(file_path), true);
+        // unaligned buffer goes through bounce buffer
+        Bytes block(BLOCK_SIZE, 'a');
+        file.write_block(2, block.data());
+        AlignedBytes read_block(BLOCK_SIZE);
+        file.read_blocks({2}, {read_block.data()});
+        ASSERT_TRUE(Bytes(read_block.begin(), read_block.end()) == block);
+        Bytes unaligned_block(BLOCK_SIZE);
+        file.read_block(2, unaligned_block.data());
+        ASSERT_TRUE(unaligned_block == block);
+        ASSERT_TRUE(file.get_file_size() == 3 * BLOCK_SIZE);
+    }
+
+    io.remove_dir_force("_test_direct");
+}
+
+TEST(db_io_test, extent) {
+    IO &io = IO::get();
+    if (io.has_file("_test_extent")) {
+        io.remove_dir_force("_test_extent");
+    }
+    io.create_dir("_test_extent");
+    std::string file_path = "_test_extent/block.sdb";
+    io.create_file(file_path);
+
+    {
+        // file grows by 16 blocks at once
+        MmapFile file(io.get_db_file_path(file_path), false, 16);
+        Bytes block(BLOCK_SIZE, 'a');
+        file.write_block(0, block.data());
+        ASSERT_TRUE(file.get_file_size() == 16 * BLOCK_SIZE);
+        file.write_block(15, block.data());
+        ASSERT_TRUE(file.get_file_size() == 16 * BLOCK_SIZE);
+        file.write_block(16, block.data());
+        ASSERT_TRUE(file.get_file_size() == 32 * BLOCK_SIZE);
+        // preallocated blocks read as zero
+        Bytes read_block(BLOCK_SIZE);
+        file.read_block(20, read_block.data());
+        ASSERT_TRUE(read_block == Bytes(BLOCK_SIZE, '\0'));
+        file.read_block(16, read_block.data());
+        ASSERT_TRUE(read_block == block);
+        // blocks out of file read as zero, and read never grows file
+        file.read_block(40, read_block.data());
+        ASSERT_TRUE(read_block == Bytes(BLOCK_SIZE, '\0'));
+        ASSERT_TRUE(file.get_file_size() == 32 * BLOCK_SIZE);
+        // never shrink
+        file.ensure_size(BLOCK_SIZE);
+        ASSERT_TRUE(file.get_file_size() == 32 * BLOCK_SIZE);
+    }
+
+    io.remove_dir_force("_test_extent");
+}
+
+TEST(db_io_test, close_file) {
+    IO &io = IO::get();
+    if (io.has_file("_test_close")) {
+        io.remove_dir_force("_test_close");
+    }
+    io.create_dir("_test_close");
+    io.create_dir("_test_close/x2");
+    for (auto &&file_path : {"_test_close/x", "_test_close/xy", "_test_close/x2/block.sdb"}) {
+        io.create_file(file_path);
+    }
+
+    auto xy_ptr = io.get_mmap_file("_test_close/xy");
+    auto x2_ptr = io.get_mmap_file("_test_close/x2/block.sdb");
+    io.get_mmap_file("_test_close/x");
+    // files sharing name prefix keep their mapping
+    io.delete_file("_test_close/x");
+    ASSERT_TRUE(io.get_mmap_file("_test_close/xy") == xy_ptr);
+    ASSERT_TRUE(io.get_mmap_file("_test_close/x2/block.sdb") == x2_ptr);
+    // files under a removed dir are closed
+    io.remove_dir_force("_test_close/x2");
+    ASSERT_TRUE(io.get_mmap_file("_test_close/xy") == xy_ptr);
+    ASSERT_TRUE(!io.has_file("_test_close/x2"));
+
+    io.remove_dir_force("_test_close");
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "../../src/db/node_page.h"
+
+using namespace sdb;
+
+namespace {
+
+Bytes key(const std::string &str) {
+    return Bytes(str.begin(), str.end());
+}
+
+std::string key_str(BytesView bytes) {
+    return std::string(bytes.begin(), bytes.end());
+}
+
+} // namespace
+
+TEST(db_node_page_test, search_and_insert) {
+    NodePage node(true);
+    ASSERT_TRUE(node.view().is_leaf());
+    ASSERT_TRUE(node.view().get_right_pos() == -1);
+    node.set_pos(0, 100);
+    // key "b" "d" "f" => pos 100 101 102 103
+    ASSERT_TRUE(node.insert(0, key("d"), 102));
+    ASSERT_TRUE(node.insert(0, key("b"), 101));
+    ASSERT_TRUE(node.insert(2, key("f"), 103));
+    NodeView view = node.view();
+    ASSERT_TRUE(view.get_key_count() == 3);
+    ASSERT_TRUE(key_str(view.get_key(1)) == "d");
+    ASSERT_TRUE(view.get_pos(2) == 102);
+
+    // count of keys <= key
+    ASSERT_TRUE(view.search(key("a")) == 0);
+    ASSERT_TRUE(view.search(key("b")) == 1);
+    ASSERT_TRUE(view.search(key("c")) == 1);
+    ASSERT_TRUE(view.search(key("d")) == 2);
+    ASSERT_TRUE(view.search(key("z")) == 3);
+    // prefix is less
+    ASSERT_TRUE(NodeView::compare(key("d"), key("da")) < 0);
+    ASSERT_TRUE(view.search(key("da")) == 2);
+
+    // erase key and pos on its right
+    node.erase(1);
+    view = node.view();
+    ASSERT_TRUE(view.get_key_count() == 2);
+    ASSERT_TRUE(key_str(view.get_key(1)) == "f");
+    ASSERT_TRUE(view.get_pos(1) == 101);
+    ASSERT_TRUE(view.get_pos(2) == 103);
+
+    // page bytes round trip
+    NodePage copy(node.bytes());
+    ASSERT_TRUE(copy.view().get_key_count() == 2);
+    ASSERT_TRUE(copy.view().search(key("c")) == 1);
+}
+
+TEST(db_node_page_test, full_and_split) {
+    NodePage node(false);
+    node.set_pos(0, 0);
+    // erased cells are reused after compact
+    for (int round = 0; round < 3; round++) {
+        Size count = 0;
+        while (true) {
+            char str[16];
+            snprintf(str, sizeof(str), "key%05d", count);
+            if (!node.insert(count, key(str), count + 1)) break;
+            count++;
+        }
+        ASSERT_TRUE(count > 100);
+        ASSERT_TRUE(node.view().get_key_count() == count);
+        if (round == 2) break;
+        for (Size i = count - 1; i >= 0; i -= 2) {
+            node.erase(i);
+        }
+        while (node.view().get_key_count() > 0) {
+            node.erase(0);
+        }
+    }
+
+    NodePage right(false);
+    Size count = node.view().get_key_count();
+    Bytes sep = node.split(right);
+    NodeView left_view = node.view();
+    NodeView right_view = right.view();
+    // separator goes up, left and right keep all other keys
+    ASSERT_TRUE(left_view.get_key_count() + right_view.get_key_count() + 1 == count);
+    Size left_count = left_view.get_key_count();
+    ASSERT_TRUE(std::abs(left_count - right_view.get_key_count()) <= 1);
+    ASSERT_TRUE(NodeView::compare(left_view.get_key(left_count - 1), sep) < 0);
+    ASSERT_TRUE(NodeView::compare(sep, right_view.get_key(0)) < 0);
+    ASSERT_TRUE(right_view.get_pos(0) == left_count + 1);
+    ASSERT_TRUE(right_view.get_pos(right_view.get_key_count()) == count);
+    // both halves have room again
+    ASSERT_TRUE(node.insert(left_view.search(key("key00000a")), key("key00000a"), -2));
+    ASSERT_TRUE(right.insert(right_view.search(key("zzz")), key("zzz"), -3));
+}
+
+TEST(db_node_page_test, high_key) {
+    NodePage node(true);
+    node.set_pos(0, 0);
+    ASSERT_FALSE(node.view().has_high_key());
+    ASSERT_FALSE(node.view().is_beyond(key("zzz")));
+    for (Size i = 0; i < 9; i++) {
+        ASSERT_TRUE(node.insert(i, key(std::string(1, char('b' + i))), i + 1));
+    }
+
+    // separator is high key of left, right has none as left had none
+    NodePage right(true);
+    Bytes sep = node.split(right);
+    ASSERT_TRUE(key_str(node.view().get_high_key()) == key_str(sep));
+    ASSERT_FALSE(right.view().has_high_key());
+    ASSERT_TRUE(node.view().is_beyond(sep));
+    ASSERT_TRUE(node.view().is_beyond(key("zzz")));
+    ASSERT_FALSE(node.view().is_beyond(key("b")));
+
+    // right passes its high key on
+    NodePage left(node.bytes());
+    NodePage mid(true);
+    Bytes left_sep = left.split(mid);
+    ASSERT_TRUE(key_str(left.view().get_high_key()) == key_str(left_sep));
+    ASSERT_TRUE(key_str(mid.view().get_high_key()) == key_str(sep));
+
+    // high key is kept by compact
+    while (mid.view().get_key_count() > 0) {
+        mid.erase(0);
+    }
+    for (Size i = 0; mid.insert(i, key("k" + std::to_string(1000 + i)), i); i++) {}
+    ASSERT_TRUE(key_str(mid.view().get_high_key()) == key_str(sep));
+}
+
+TEST(db_node_page_test, merge_and_balance) {
+    // left: b c | high d, right: e f | high g, right link 9
+    NodePage left(true);
+    left.set_pos(0, 1);
+    left.insert(0, key("b"), 2);
+    left.insert(1, key("c"), 3);
+    left.set_high_key(key("d"));
+    left.set_right_pos(8);
+    NodePage right(true);
+    right.set_pos(0, 4);
+    right.insert(0, key("e"), 5);
+    right.insert(1, key("f"), 6);
+    right.set_high_key(key("g"));
+    right.set_right_pos(9);
+    Size used = left.view().get_used_size() + right.view().get_used_size();
+
+    NodePage merged = left;
+    ASSERT_TRUE(merged.merge(key("d"), right.view()));
+    NodeView view = merged.view();
+    ASSERT_TRUE(view.get_key_count() == 5);
+    ASSERT_TRUE(key_str(view.get_key(2)) == "d");
+    for (Size i = 0; i <= 5; i++) {
+        ASSERT_TRUE(view.get_pos(i) == i + 1);
+    }
+    ASSERT_TRUE(key_str(view.get_high_key()) == "g");
+    ASSERT_TRUE(view.get_right_pos() == 9);
+    // left high key is dropped, one header less, one slot more
+    ASSERT_TRUE(view.get_used_size() == used - NodeView::HEADER_SIZE + NodeView::SLOT_SIZE);
+
+    // full page takes no more, page is unchanged
+    NodePage full(true);
+    full.set_pos(0, 0);
+    for (Size i = 0; full.insert(i, key("k" + std::to_string(1000 + i)), i + 1); i++) {}
+    NodePage copy = full;
+    ASSERT_FALSE(full.merge(key("x"), right.view()));
+    ASSERT_TRUE(key_str(full.bytes()) == key_str(copy.bytes()));
+
+    // keys of full left move right till both are about the same
+    NodePage less(true);
+    less.set_pos(0, -1);
+    less.set_high_key(key("z"));
+    Bytes sep = full.balance(key("y"), less);
+    Size left_count = full.view().get_key_count();
+    Size right_count = less.view().get_key_count();
+    ASSERT_TRUE(std::abs(left_count - right_count) <= 1);
+    ASSERT_TRUE(left_count + right_count + 1 == copy.view().get_key_count() + 1);
+    ASSERT_TRUE(key_str(full.view().get_high_key()) == key_str(sep));
+    ASSERT_TRUE(key_str(less.view().get_high_key()) == "z");
+    ASSERT_TRUE(key_str(less.view().get_key(right_count - 1)) == "y");
+    ASSERT_TRUE(less.view().get_pos(right_count) == -1);
+    ASSERT_TRUE(less.view().get_pos(0) == full.view().get_pos(left_count) + 1);
+}
+
+TEST(db_node_page_test, torn_page) {
+    // optimistic readers may see any bytes, reads stay in page
+    Bytes page(BLOCK_SIZE);
+    uint32_t seed = 1;
+    for (int round = 0; round < 100; round++) {
+        for (auto &&b : page) {
+            seed = seed * 1103515245 + 12345;
+            b = Byte(seed >> 16);
+        }
+        NodeView view(page);
+        Size i = view.search(key("key"));
+        ASSERT_TRUE(i >= 0 && i <= view.get_key_count());
+        view.get_pos(i);
+        view.is_beyond(key("key"));
+    }
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+
+#include "../../src/db/replace_policy.h"
+
+using namespace sdb;
+
+TEST(db_replace_policy_test, lru) {
+    LruPolicy policy;
+    policy.insert(0);
+    policy.insert(1);
+    policy.insert(2);
+    policy.access(0);
+    ASSERT_TRUE(policy.key_list() == std::vector<BlockNum>({0, 2, 1}));
+    ASSERT_TRUE(policy.victim() == 1);
+    policy.erase(2);
+    ASSERT_TRUE(policy.key_list() == std::vector<BlockNum>({0}));
+}
+
+TEST(db_replace_policy_test, two_q) {
+    // a1_in holds 2 blocks, a1_out remembers 4
+    TwoQPolicy policy(8);
+    policy.insert(0);
+    policy.insert(1);
+    policy.insert(2);
+    // first in first out
+    ASSERT_TRUE(policy.victim() == 0);
+    // evicted block inserted again is hot
+    policy.insert(0);
+    ASSERT_TRUE(policy.key_list() == std::vector<BlockNum>({0, 2, 1}));
+
+    // scan only goes through a1_in
+    for (BlockNum num = 100; num < 120; num++) {
+        policy.insert(num);
+        BlockNum key = policy.victim();
+        ASSERT_TRUE(key != 0);
+    }
+    ASSERT_TRUE(policy.key_list().front() == 0);
+}
+
+TEST(db_replace_policy_test, requeue) {
+    TwoQPolicy policy(8);
+    policy.insert(0);
+    policy.insert(1);
+    policy.insert(2);
+    policy.victim();
+    policy.insert(0);
+    ASSERT_TRUE(policy.key_list() == std::vector<BlockNum>({0, 2, 1}));
+
+    // pinned hot block goes back to am
+    BlockNum key = policy.victim();
+    ASSERT_TRUE(key == 0);
+    policy.requeue(key);
+    ASSERT_TRUE(policy.key_list() == std::vector<BlockNum>({0, 2, 1}));
+    // pinned cold block goes back to a1_in, not am
+    policy.insert(3);
+    key = policy.victim();
+    ASSERT_TRUE(key == 1);
+    policy.requeue(key);
+    ASSERT_TRUE(policy.key_list() == std::vector<BlockNum>({0, 1, 3, 2}));
+}
+
+TEST(db_replace_policy_test, cold_keys) {
+    // cold keys come in victim order
+    for (std::string name : {"lru", "2q"}) {
+        auto policy = ReplacePolicy::make(name, 8);
+        for (BlockNum num = 0; num < 8; num++) {
+            policy->insert(num);
+        }
+        policy->access(0);
+        std::vector<BlockNum> cold_lst = policy->cold_keys(8);
+        ASSERT_TRUE(cold_lst.size() == 8);
+        for (BlockNum num : cold_lst) {
+            ASSERT_TRUE(policy->victim() == num);
+        }
+    }
+}
@@ -0,0 +1,344 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "../../src/db/table.h"
+#include "../../src/db/cache.h"
+#include "test_util.h"
+
+using namespace sdb;
+using namespace sdb::test;
+
+namespace {
+
+db_type::ObjPtr new_str(const std::string &str) {
+    return std::make_shared<db_type::Varchar>(32, str);
+}
+
+// |id, name, age, note|, id is key
+Tuple new_row(int32_t id, const std::string &name, int32_t age, const std::string &note) {
+    Tuple tuple;
+    tuple.push_back(std::make_shared<db_type::Int>(id));
+    tuple.push_back(new_str(name));
+    tuple.push_back(std::make_shared<db_type::Int>(age));
+    tuple.push_back(new_str(note));
+    return tuple;
+}
+
+// empty table, roots made by bulk load
+TableProperty new_table(const std::string &table_name) {
+    create_block_file();
+    Bytes str_info = sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(32));
+    ColProperty id_cp("id", sdb::en_bytes(static_cast<char>(db_type::INT)), 0, true);
+    ColProperty name_cp("name", str_info, 1);
+    ColProperty age_cp("age", sdb::en_bytes(static_cast<char>(db_type::INT)), 2);
+    ColProperty note_cp("note", str_info, 3);
+    TableProperty tp(table_name, -1, -1, {id_cp, name_cp, age_cp, note_cp});
+    TupleSource next = []() -> std::optional<Tuple> {return std::nullopt;};
+    return Table::bulk_load(new_trans(), tp, next, true);
+}
+
+int32_t get_int(const Tuple &tuple, size_t pos) {
+    return db_type::dfc<const db_type::Int>(tuple[pos])->data;
+}
+
+// ids of rows found by name in index
+std::vector<int32_t> find_ids(Table &table, const std::string &index_name, const std::string &name) {
+    std::vector<int32_t> lst;
+    for (auto &&tuple : table.find_by_index(new_trans(), index_name, {new_str(name)}).data) {
+        lst.push_back(get_int(tuple, 0));
+    }
+    std::sort(lst.begin(), lst.end());
+    return lst;
+}
+
+void write(const std::function<void(TransInfo)> &f) {
+    TransInfo t_info = new_trans();
+    f(t_info);
+    t_info.s_ptr->commit();
+}
+
+// table and all its indexes
+void close_table(const Table &table) {
+    sdb::test::close_table(table.tp);
+    for (auto &&ip : table.tp.index_lst) {
+        sdb::test::close_table(table.tp.get_index_property(ip));
+    }
+}
+
+} // namespace
+
+TEST(db_table_test, index) {
+    Table table(new_table("_table_index"));
+    write([&table](TransInfo t_info) {
+        for (int32_t id = 0; id < 20; id++) {
+            table.insert(t_info, new_row(id, "n" + std::to_string(id % 5), id, "a"));
+        }
+    });
+    // built from rows there, then kept in step by writes
+    IndexProperty ip = table.build_index(new_trans(), "by_name", {"name"}, {});
+    table.add_index(ip);
+    ASSERT_TRUE(table.is_has_leading_index("name"));
+    ASSERT_TRUE(!table.is_has_leading_index("age"));
+    ASSERT_TRUE(find_ids(table, "by_name", "n1") == std::vector<int32_t>({1, 6, 11, 16}));
+    // whole key col is matched, not a prefix of it
+    ASSERT_TRUE(find_ids(table, "by_name", "n").empty());
+
+    // insert
+    write([&table](TransInfo t_info) {
+        table.insert(t_info, new_row(20, "n1", 20, "a"));
+    });
+    ASSERT_TRUE(find_ids(table, "by_name", "n1") == std::vector<int32_t>({1, 6, 11, 16, 20}));
+
+    // update of index col moves entry
+    write([&table](TransInfo t_info) {
+        table.update(t_info, new_row(1, "n2", 1, "a"));
+    });
+    ASSERT_TRUE(find_ids(table, "by_name", "n1") == std::vector<int32_t>({6, 11, 16, 20}));
+    ASSERT_TRUE(find_ids(table, "by_name", "n2") == std::vector<int32_t>({1, 2, 7, 12, 17}));
+
+    // update of other cols leaves index as it was
+    write([&table](TransInfo t_info) {
+        table.update(t_info, new_row(6, "n1", 60, "b"));
+    });
+    ASSERT_TRUE(find_ids(table, "by_name", "n1") == std::vector<int32_t>({6, 11, 16, 20}));
+
+    // remove
+    write([&table](TransInfo t_info) {
+        table.remove(t_info, {std::make_shared<db_type::Int>(11)});
+    });
+    ASSERT_TRUE(find_ids(table, "by_name", "n1") == std::vector<int32_t>({6, 16, 20}));
+
+    // rows found by index are whole rows of table
+    Tuples ts = table.find_by_index(new_trans(), "by_name", {new_str("n1")}, {"age", "note"});
+    ASSERT_TRUE(ts.data.size() == 3);
+    ASSERT_TRUE(get_int(ts.data[0], 0) == 60);
+    ASSERT_TRUE(ts.data[0][1]->to_string() == "b");
+    close_table(table);
+}
+
+TEST(db_table_test, write_mutex) {
+    Table table(new_table("_table_write_mutex"));
+    // held by writer till its transaction ends, vacuum can't take it meanwhile
+    TransInfo t_info = new_trans();
+    table.insert(t_info, new_row(0, "n0", 0, "a"));
+    table.update(t_info, new_row(0, "n0", 1, "a"));
+    ASSERT_TRUE(!std::unique_lock<std::shared_mutex>(table.get_write_mutex(), std::try_to_lock).owns_lock());
+    // readers don't take it, they see committed rows only
+    ASSERT_TRUE(table.find(new_trans(), {std::make_shared<db_type::Int>(0)}).data.empty());
+    t_info.s_ptr->commit();
+    ASSERT_TRUE(table.find(new_trans(), {std::make_shared<db_type::Int>(0)}).data.size() == 1);
+    ASSERT_TRUE(std::unique_lock<std::shared_mutex>(table.get_write_mutex(), std::try_to_lock).owns_lock());
+
+    t_info = new_trans();
+    table.remove(t_info, {std::make_shared<db_type::Int>(0)});
+    ASSERT_TRUE(!std::unique_lock<std::shared_mutex>(table.get_write_mutex(), std::try_to_lock).owns_lock());
+    t_info.s_ptr->rollback();
+    ASSERT_TRUE(std::unique_lock<std::shared_mutex>(table.get_write_mutex(), std::try_to_lock).owns_lock());
+    close_table(table);
+}
+
+TEST(db_table_test, concurrent_update) {
+    Table table(new_table("_table_concurrent_update"));
+    write([&table](TransInfo t_info) {
+        table.insert(t_info, new_row(0, "t0", 0, "a"));
+    });
+    table.add_index(table.build_index(new_trans(), "by_name", {"name"}, {}));
+
+    // old row is read under record lock, so each update moves the entry the last one made
+    std::vector<std::thread> thread_lst;
+    for (int32_t i = 0; i < 2; i++) {
+        thread_lst.emplace_back([&table, i] {
+            for (int32_t age = 0; age < 50; age++) {
+                write([&table, i, age](TransInfo t_info) {
+                    table.update(t_info, new_row(0, "t" + std::to_string(i), age, "a"));
+                });
+            }
+        });
+    }
+    for (auto &&t : thread_lst) {
+        t.join();
+    }
+    std::string name = table.find(new_trans(), {std::make_shared<db_type::Int>(0)}).data[0][1]->to_string();
+    std::string other_name = name == "t0" ? "t1" : "t0";
+    ASSERT_TRUE(find_ids(table, "by_name", name) == std::vector<int32_t>({0}));
+    ASSERT_TRUE(find_ids(table, "by_name", other_name).empty());
+    close_table(table);
+}
+
+TEST(db_table_test, index_only_scan) {
+    Table table(new_table("_table_index_only"));
+    write([&table](TransInfo t_info) {
+        for (int32_t id = 0; id < 200; id++) {
+            table.insert(t_info, new_row(id, "n" + std::to_string(id % 5), id, "a"));
+        }
+    });
+    table.add_index(table.build_index(new_trans(), "by_name", {"name"}, {"age"}));
+    ASSERT_TRUE(table.is_covering("by_name", {"id", "age"}));
+    ASSERT_TRUE(!table.is_covering("by_name", {"id", "note"}));
+
+    // record blocks of table leave cache, reading any of them is a miss
+    ShardedBlockCache &cache = CacheMaster::get_block_cache();
+    cache.sync();
+    std::vector<BlockNum> record_lst = record_chain(table.tp);
+    ASSERT_TRUE(record_lst.size() > 1);
+    for (BlockNum pos : record_lst) {
+        ASSERT_TRUE(cache.discard(pos));
+    }
+
+    size_t miss_count = cache.get_stats(DATA_PAGE).miss_count;
+    Tuples ts = table.find_by_index(new_trans(), "by_name", {new_str("n1")}, {"id", "age"});
+    ASSERT_TRUE(ts.data.size() == 40);
+    for (auto &&tuple : ts.data) {
+        ASSERT_TRUE(get_int(tuple, 0) % 5 == 1);
+        ASSERT_TRUE(get_int(tuple, 1) == get_int(tuple, 0));
+    }
+    // index-only: no record block of table is read
+    ASSERT_TRUE(cache.get_stats(DATA_PAGE).miss_count == miss_count);
+    Byte data[BLOCK_SIZE];
+    for (BlockNum pos : record_lst) {
+        ASSERT_TRUE(!cache.peek(pos, data));
+    }
+
+    // not covered => rows are read from table
+    ts = table.find_by_index(new_trans(), "by_name", {new_str("n1")}, {"id", "note"});
+    ASSERT_TRUE(ts.data.size() == 40);
+    ASSERT_TRUE(cache.get_stats(DATA_PAGE).miss_count > miss_count);
+    close_table(table);
+}
+
+TEST(db_table_test, include_update) {
+    Table table(new_table("_table_include_update"));
+    write([&table](TransInfo t_info) {
+        for (int32_t id = 0; id < 20; id++) {
+            table.insert(t_info, new_row(id, "n" + std::to_string(id % 5), id, "a"));
+        }
+    });
+    IndexProperty ip = table.build_index(new_trans(), "by_name", {"name"}, {"age"});
+    table.add_index(ip);
+    TableProperty index_tp = table.tp.get_index_property(ip);
+    auto old_lst = chain_tuples(index_tp);
+
+    // only include col of index changes
+    write([&table](TransInfo t_info) {
+        table.update(t_info, new_row(6, "n1", 60, "a"));
+    });
+    // entry keeps its place in index, only include col differs
+    auto new_lst = chain_tuples(index_tp);
+    ASSERT_TRUE(new_lst.size() == old_lst.size());
+    size_t changed_count = 0;
+    for (size_t i = 0; i < new_lst.size(); i++) {
+        ASSERT_TRUE(new_lst[i].first == old_lst[i].first);
+        // |name, id, age|
+        ASSERT_TRUE(new_lst[i].second.select({0, 1}).eq(old_lst[i].second.select({0, 1})));
+        if (get_int(new_lst[i].second, 1) == 6) {
+            ASSERT_TRUE(get_int(new_lst[i].second, 2) == 60);
+            changed_count++;
+        } else {
+            ASSERT_TRUE(new_lst[i].second.eq(old_lst[i].second));
+        }
+    }
+    ASSERT_TRUE(changed_count == 1);
+    Tuples ts = table.find_by_index(new_trans(), "by_name", {new_str("n1")}, {"id", "age"});
+    ASSERT_TRUE(ts.data.size() == 4);
+    ASSERT_TRUE(get_int(ts.data[0], 0) == 1);
+    ASSERT_TRUE(get_int(ts.data[1], 1) == 60);
+    close_table(table);
+}
+
+TEST(db_table_test, pred_write) {
+    Table table(new_table("_table_pred_write"));
+    write([&table](TransInfo t_info) {
+        for (int32_t id = 0; id < 20; id++) {
+            table.insert(t_info, new_row(id, "n" + std::to_string(id % 5), id, "a"));
+        }
+    });
+    table.add_index(table.build_index(new_trans(), "by_name", {"name"}, {}));
+
+    // rows matched in the scan move their index entries
+    write([&table](TransInfo t_info) {
+        table.update(t_info, [](const Tuple &tuple) {return get_int(tuple, 2) < 10;},
+                     [](const Tuple &tuple) {
+                         return new_row(get_int(tuple, 0), "m", get_int(tuple, 2), "a");
+                     });
+    });
+    ASSERT_TRUE(find_ids(table, "by_name", "n1") == std::vector<int32_t>({11, 16}));
+    ASSERT_TRUE(find_ids(table, "by_name", "m").size() == 10);
+
+    // op runs once per row, index gets the rows a stateful op wrote
+    int32_t count = 0;
+    write([&table, &count](TransInfo t_info) {
+        table.update(t_info, [](const Tuple &tuple) {return get_int(tuple, 0) == 10 || get_int(tuple, 0) == 11;},
+                     [&count](const Tuple &tuple) {
+                         return new_row(get_int(tuple, 0), "c" + std::to_string(count++), get_int(tuple, 2), "a");
+                     });
+    });
+    ASSERT_TRUE(count == 2);
+    ASSERT_TRUE(find_ids(table, "by_name", "c0").size() == 1 && find_ids(table, "by_name", "c1").size() == 1);
+
+    // key columns can't be changed by op, record stays in key order
+    TransInfo t_info = new_trans();
+    ASSERT_THROW(table.update(t_info, [](const Tuple &tuple) {return get_int(tuple, 0) == 3;},
+                              [](const Tuple &) {return new_row(100, "m", 0, "a");}), std::runtime_error);
+    t_info.s_ptr->rollback();
+    ASSERT_TRUE(table.find(new_trans(), {std::make_shared<db_type::Int>(3)}).data.size() == 1);
+
+    write([&table](TransInfo t_info) {
+        table.remove(t_info, [](const Tuple &tuple) {return get_int(tuple, 0) % 2 == 0;});
+    });
+    ASSERT_TRUE(find_ids(table, "by_name", "m") == std::vector<int32_t>({1, 3, 5, 7, 9}));
+    ASSERT_TRUE(find_ids(table, "by_name", "n1").empty());
+    ASSERT_TRUE(find_ids(table, "by_name", "c0").size() + find_ids(table, "by_name", "c1").size() == 1);
+    ASSERT_TRUE(table.find(new_trans(), [](const Tuple &){return true;}).data.size() == 10);
+
+    // records of a predicate write are locked as they are read,
+    // an insert into them waits, and neither write is lost
+    TransInfo w_info = new_trans();
+    table.update(w_info, [](const Tuple &) {return true;},
+                 [](const Tuple &tuple) {return new_row(get_int(tuple, 0), "w", get_int(tuple, 2), "a");});
+    std::atomic<bool> is_inserted{false};
+    std::thread inserter([&table, &is_inserted] {
+        write([&table](TransInfo t_info) {
+            table.insert(t_info, new_row(100, "i", 100, "a"));
+        });
+        is_inserted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    bool is_early = is_inserted;
+    w_info.s_ptr->commit();
+    inserter.join();
+    ASSERT_TRUE(!is_early);
+    ASSERT_TRUE(find_ids(table, "by_name", "w").size() == 10);
+    ASSERT_TRUE(find_ids(table, "by_name", "i") == std::vector<int32_t>({100}));
+    close_table(table);
+}
+
+TEST(db_table_test, pred_update_grow) {
+    Table table(new_table("_table_pred_update_grow"));
+    write([&table](TransInfo t_info) {
+        for (int32_t id = 0; id < 300; id++) {
+            table.insert(t_info, new_row(id, "n" + std::to_string(id % 5), id, "a"));
+        }
+    });
+    table.add_index(table.build_index(new_trans(), "by_name", {"name"}, {}));
+
+    // rows grow past their records, records split, op runs once per row
+    std::string note(32, 'b');
+    int32_t count = 0;
+    write([&table, &note, &count](TransInfo t_info) {
+        table.update(t_info, [](const Tuple &) {return true;},
+                     [&note, &count](const Tuple &tuple) {
+                         count++;
+                         return new_row(get_int(tuple, 0), "g" + std::to_string(get_int(tuple, 0) % 5), get_int(tuple, 2), note);
+                     });
+    });
+    ASSERT_TRUE(count == 300);
+    TuplePred is_grown = [&note](const Tuple &tuple) {return tuple[3]->eq(new_str(note));};
+    Tuples ts = table.find(new_trans(), is_grown);
+    ASSERT_TRUE(ts.data.size() == 300);
+    ASSERT_TRUE(table.find(new_trans(), {std::make_shared<db_type::Int>(299)}).data.size() == 1);
+    ASSERT_TRUE(find_ids(table, "by_name", "g3").size() == 60);
+    ASSERT_TRUE(find_ids(table, "by_name", "n3").empty());
+    close_table(table);
+}
@@ -0,0 +1,58 @@
+#ifndef TEST_DB_TEST_UTIL_H
+#define TEST_DB_TEST_UTIL_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "../../src/db/record.h"
+#include "../../src/db/block_alloc.h"
+#include "../../src/db/io.h"
+#include "../../src/db/snapshot.h"
+
+// helpers shared by tests of trees and tables
+namespace sdb::test {
+
+// transaction of its own snapshot, not logged
+inline TransInfo new_trans() {
+    return TransInfo{-1, TransInfo::READ, std::make_shared<Snapshot>(), nullptr};
+}
+
+// block file tables are made in
+inline void create_block_file() {
+    IO &io = IO::get();
+    if (!io.has_file(io.block_path())) {
+        io.create_file(io.block_path());
+    }
+}
+
+// record chain from record root
+inline std::vector<BlockNum> record_chain(const TableProperty &tp) {
+    std::vector<BlockNum> lst;
+    for (BlockNum pos = tp.record_root; pos != -1; ) {
+        lst.push_back(pos);
+        pos = Record(new_trans(), tp, pos).get_next_record_num();
+    }
+    return lst;
+}
+
+// <record block, tuple> along record chain
+inline std::vector<std::pair<BlockNum, Tuple>> chain_tuples(const TableProperty &tp) {
+    std::vector<std::pair<BlockNum, Tuple>> lst;
+    for (BlockNum pos : record_chain(tp)) {
+        for (auto &&tuple : Record(new_trans(), tp, pos).get_all_tuple().data) {
+            lst.push_back({pos, tuple});
+        }
+    }
+    return lst;
+}
+
+// give back unused blocks of extents of tp
+inline void close_table(const TableProperty &tp) {
+    BlockAlloc::get().close_extent(tp.record_owner());
+    BlockAlloc::get().close_extent(tp.keys_index_owner());
+}
+
+} // namespace sdb::test
+
+#endif //TEST_DB_TEST_UTIL_H
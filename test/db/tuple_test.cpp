@@ -1,47 +1,44 @@
 #include <gtest/gtest.h>
 
-#include "../../src/db/io.h"
 #include "../../src/db/tuple.h"
 
 using namespace sdb;
 
 TEST(db_tuple_test, tuples) {
-    IO &io = IO::get();
-    // create first
-    if (io.has_file("_tuple_test")) {
-        io.remove_dir_force("_tuple_test");
-    }
-    io.create_dir("_tuple_test");
-    io.create_file("_tuple_test/block.sdb");
     Tuples tuples(2);
     db_type::ObjPtr x_ptr = std::make_shared<db_type::Int>(10);
-    db_type::ObjPtr v_ptr = std::make_shared<db_type::Varchar>("asdf", 10);
-    Tuples::Tuple tuple = {x_ptr, v_ptr};
-
-    // tuple_clone
-    Tuples::Tuple tuple_backup = Tuples::tuple_clone(tuple);
-    tuples.data.push_back(Tuples::tuple_clone(tuple));
-    ASSERT_TRUE(Tuples::tuple_eq(tuple, tuple_backup));
-    db_type::ObjPtr x2_ptr = std::make_shared<db_type::Int>(20);
-    x_ptr->assign(x2_ptr);
-    ASSERT_TRUE(!Tuples::tuple_eq(tuple, tuple_backup));
+    db_type::ObjPtr v_ptr = std::make_shared<db_type::Varchar>(10, "asdf");
+    Tuple tuple = {x_ptr, v_ptr};
+
+    // tuple clone
+    Tuple tuple_backup = tuple;
+    tuples.push_back(tuple);
+    ASSERT_TRUE(tuple.eq(tuple_backup));
+    tuple[0]->assign(std::make_shared<db_type::Int>(20));
+    ASSERT_TRUE(!tuple.eq(tuple_backup));
+    ASSERT_TRUE(tuple_backup.less(tuple));
+    ASSERT_TRUE(tuple.pre_eq(Tuple{std::make_shared<db_type::Int>(20)}));
 
     // check tuple size
-    ASSERT_TRUE(Tuples::tuple_type_size(tuple) == Tuples::tuple_type_size(tuple_backup));
+    ASSERT_TRUE(tuple.type_size() == tuple_backup.type_size());
+    ASSERT_TRUE(tuple.data_bytes_size() == Size(tuple.en_bytes().size()));
 
     // check bytes
-    tuples.data.push_back(tuple);
+    tuples.push_back(tuple);
     Tuples tuples_backup = tuples;
     Bytes bytes = tuples.en_bytes();
     int offset = 0;
-    tuples.de_bytes({{x_ptr->get_type_tag(), x_ptr->get_type_tag()}, {v_ptr->get_type_tag(), v_ptr->get_type_tag()}}, bytes, offset);
+    std::vector<db_type::TypeInfo> info_lst = {sdb::en_bytes(static_cast<char>(db_type::INT)),
+                                               sdb::en_bytes(static_cast<char>(db_type::VARCHAR), Size(10))};
+    tuples.de_bytes(info_lst, bytes, offset);
+    ASSERT_TRUE(offset == Size(bytes.size()));
+    ASSERT_TRUE(tuples.data.size() == 2);
     for (size_t i = 0; i < tuples.data.size(); i++) {
-        ASSERT_TRUE(Tuples::tuple_eq(tuples.data[i], tuples_backup.data[i]));
+        ASSERT_TRUE(tuples.data[i].eq(tuples_backup.data[i]));
     }
     // check copy constructor
     tuples.data[0][0]->assign(std::make_shared<db_type::Int>(30));
-    ASSERT_TRUE(!Tuples::tuple_eq(tuples.data[0], tuples_backup.data[0]));
+    ASSERT_TRUE(!tuples.data[0].eq(tuples_backup.data[0]));
 
     // TODO map/filter/range check
 }
-
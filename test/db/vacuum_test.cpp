@@ -0,0 +1,30 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+#include "../../src/db/vacuum.h"
+
+using namespace sdb;
+
+TEST(db_vacuum_test, round) {
+    std::atomic<size_t> count{0};
+    {
+        Vacuum vacuum(std::chrono::milliseconds(10), [&count]{count++;});
+        while (vacuum.get_round_count() < 3) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+    // no round after vacuum is destroyed
+    size_t stop_count = count;
+    ASSERT_TRUE(stop_count >= 3);
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    ASSERT_TRUE(count == stop_count);
+
+    // long interval => destroyed without waiting for it
+    auto beg = std::chrono::steady_clock::now();
+    {
+        Vacuum vacuum(std::chrono::seconds(60), [&count]{count++;});
+    }
+    ASSERT_TRUE(std::chrono::steady_clock::now() - beg < std::chrono::seconds(1));
+    ASSERT_TRUE(count == stop_count);
+}